@@ -0,0 +1,330 @@
+#include "AnimationSystem.h"
+#include "JobSystem.h"
+
+#include <cmath>
+
+using namespace DirectX;
+
+// Moves the last element into index i and drops the last one
+template<typename T> static void SwapRemove(std::vector<T>& values, size_t i)
+{
+	values[i] = values.back();
+	values.pop_back();
+}
+
+AnimationSystem::AnimationSystem()
+{
+}
+
+AnimationTrackHandle AnimationSystem::AddTrack(Transform* target, int channel,
+	const AnimationKey* trackKeys, int keyCount, int interpolation, int loop)
+{
+	if (!target || channel < ANIMATION_CHANNEL_POSITION || channel > ANIMATION_CHANNEL_SCALE)
+		return AnimationTrackHandle();
+	return AddTrack(target, 0, channel, trackKeys, keyCount, interpolation, loop);
+}
+
+AnimationTrackHandle AnimationSystem::AddTrack(Material* target,
+	const AnimationKey* trackKeys, int keyCount, int interpolation, int loop)
+{
+	if (!target)
+		return AnimationTrackHandle();
+	return AddTrack(0, target, ANIMATION_CHANNEL_COLOR_TINT, trackKeys, keyCount, interpolation, loop);
+}
+
+AnimationTrackHandle AnimationSystem::AddTween(Transform* target, int channel, XMFLOAT4 from, XMFLOAT4 to,
+	float duration, int interpolation, int loop)
+{
+	// Flat tangents, so a Hermite tween eases in and out
+	AnimationKey tweenKeys[2] = {};
+	tweenKeys[0].value = from;
+	tweenKeys[1].time = duration;
+	tweenKeys[1].value = to;
+	return AddTrack(target, channel, tweenKeys, 2, interpolation, loop);
+}
+
+AnimationTrackHandle AnimationSystem::AddTween(Material* target, XMFLOAT4 from, XMFLOAT4 to,
+	float duration, int interpolation, int loop)
+{
+	AnimationKey tweenKeys[2] = {};
+	tweenKeys[0].value = from;
+	tweenKeys[1].time = duration;
+	tweenKeys[1].value = to;
+	return AddTrack(target, tweenKeys, 2, interpolation, loop);
+}
+
+AnimationTrackHandle AnimationSystem::AddTrack(Transform* transform, Material* material, int channel,
+	const AnimationKey* trackKeys, int keyCount, int interpolation, int loop)
+{
+	if (!trackKeys || keyCount < 1 ||
+		interpolation < ANIMATION_INTERPOLATION_STEP || interpolation > ANIMATION_INTERPOLATION_HERMITE ||
+		loop < ANIMATION_LOOP_NONE || loop > ANIMATION_LOOP_PING_PONG)
+		return AnimationTrackHandle();
+	for (int i = 1; i < keyCount; i++)
+	{
+		if (trackKeys[i].time < trackKeys[i - 1].time)
+			return AnimationTrackHandle();
+	}
+
+	// Reuses a removed track's slot when there is one
+	unsigned int slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		if (trackOfSlot.size() > HANDLE_INDEX_MASK)
+			return AnimationTrackHandle();
+
+		slot = (unsigned int)trackOfSlot.size();
+		trackOfSlot.push_back(0);
+		slotGenerations.push_back(1);
+	}
+	trackOfSlot[slot] = (unsigned int)channels.size();
+
+	transforms.push_back(transform);
+	materials.push_back(material);
+	channels.push_back(channel);
+	interpolations.push_back(interpolation);
+	loops.push_back(loop);
+	firstKeys.push_back((int)keys.size());
+	keyCounts.push_back(keyCount);
+	cursors.push_back(0);
+	times.push_back(0);
+	playing.push_back(1);
+	slotOfTrack.push_back(slot);
+	keys.insert(keys.end(), trackKeys, trackKeys + keyCount);
+
+	return AnimationTrackHandle::Make(slot, slotGenerations[slot]);
+}
+
+int AnimationSystem::GetTrack(AnimationTrackHandle handle)
+{
+	unsigned int slot = handle.GetIndex();
+	if (handle.IsNull() || slot >= trackOfSlot.size() || slotGenerations[slot] != handle.GetGeneration())
+		return -1;
+	return (int)trackOfSlot[slot];
+}
+
+void AnimationSystem::Remove(AnimationTrackHandle handle)
+{
+	int track = GetTrack(handle);
+	if (track < 0)
+		return;
+
+	// The track's keys are taken out, so every later track's keys move down
+	int first = firstKeys[track];
+	int count = keyCounts[track];
+	keys.erase(keys.begin() + first, keys.begin() + first + count);
+	for (size_t i = 0; i < firstKeys.size(); i++)
+	{
+		if (firstKeys[i] > first)
+			firstKeys[i] -= count;
+	}
+
+	// The last track fills the hole, keeping the arrays packed
+	unsigned int moved = slotOfTrack.back();
+	SwapRemove(transforms, track);
+	SwapRemove(materials, track);
+	SwapRemove(channels, track);
+	SwapRemove(interpolations, track);
+	SwapRemove(loops, track);
+	SwapRemove(firstKeys, track);
+	SwapRemove(keyCounts, track);
+	SwapRemove(cursors, track);
+	SwapRemove(times, track);
+	SwapRemove(playing, track);
+	SwapRemove(slotOfTrack, track);
+	trackOfSlot[moved] = track;
+
+	unsigned int slot = handle.GetIndex();
+	slotGenerations[slot] = NextHandleGeneration(slotGenerations[slot]);
+	freeSlots.push_back(slot);
+}
+
+bool AnimationSystem::IsPlaying(AnimationTrackHandle handle)
+{
+	int track = GetTrack(handle);
+	return track >= 0 && playing[track] != 0;
+}
+
+void AnimationSystem::SetPlaying(AnimationTrackHandle handle, bool isPlaying)
+{
+	int track = GetTrack(handle);
+	if (track >= 0)
+		playing[track] = isPlaying ? 1 : 0;
+}
+
+void AnimationSystem::SetTime(AnimationTrackHandle handle, float time)
+{
+	int track = GetTrack(handle);
+	if (track >= 0)
+		times[track] = time;
+}
+
+int AnimationSystem::GetTrackCount() { return (int)channels.size(); }
+
+void AnimationSystem::Update(float deltaTime)
+{
+	size_t count = channels.size();
+	if (count == 0)
+		return;
+
+	// Padded so the last batch of four can be loaded whole
+	size_t paddedCount = (count + 3) & ~(size_t)3;
+	segmentT.resize(paddedCount);
+	segmentLength.resize(paddedCount);
+	segmentInterpolations.resize(paddedCount);
+	evaluated.resize(paddedCount);
+	for (int c = 0; c < 4; c++)
+	{
+		start[c].resize(paddedCount);
+		end[c].resize(paddedCount);
+		startTangent[c].resize(paddedCount);
+		endTangent[c].resize(paddedCount);
+		values[c].resize(paddedCount);
+	}
+
+	JobSystem::GetInstance().ParallelFor(count, ANIMATION_JOB_SIZE, [this, deltaTime](size_t first, size_t last)
+	{
+		EvaluateTracks(first, last, deltaTime);
+	});
+
+	// Setting the values touches the targets (and a target can have several
+	// tracks), so it's done here, in track order
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!evaluated[i])
+			continue;
+
+		XMFLOAT4 value(values[0][i], values[1][i], values[2][i], values[3][i]);
+		switch (channels[i])
+		{
+		case ANIMATION_CHANNEL_POSITION: transforms[i]->SetPosition(value.x, value.y, value.z); break;
+		case ANIMATION_CHANNEL_ROTATION: transforms[i]->SetRotation(value); break;
+		case ANIMATION_CHANNEL_SCALE: transforms[i]->SetScale(value.x, value.y, value.z); break;
+		case ANIMATION_CHANNEL_COLOR_TINT: materials[i]->SetColorTint(value); break;
+		}
+	}
+}
+
+void AnimationSystem::EvaluateTracks(size_t first, size_t last, float deltaTime)
+{
+	for (size_t i = first; i < last; i++)
+	{
+		evaluated[i] = playing[i];
+		if (!playing[i])
+			continue;
+
+		// Advances the track's time, wrapping or stopping at the end
+		const AnimationKey* trackKeys = &keys[firstKeys[i]];
+		int keyCount = keyCounts[i];
+		float duration = trackKeys[keyCount - 1].time - trackKeys[0].time;
+		float time = times[i] + deltaTime;
+		float keyTime = time;
+		if (duration <= 0 || (loops[i] == ANIMATION_LOOP_NONE && time >= duration))
+		{
+			// Run out (sets the last value once more, then stops)
+			time = duration > 0 ? duration : 0;
+			keyTime = time;
+			playing[i] = 0;
+		}
+		else if (loops[i] == ANIMATION_LOOP_REPEAT)
+		{
+			time = fmodf(time, duration);
+			if (time < 0)
+				time += duration;
+			keyTime = time;
+		}
+		else if (loops[i] == ANIMATION_LOOP_PING_PONG)
+		{
+			time = fmodf(time, duration * 2);
+			if (time < 0)
+				time += duration * 2;
+			keyTime = time <= duration ? time : duration * 2 - time;
+		}
+		times[i] = time;
+		keyTime += trackKeys[0].time;
+
+		// Usually still the same segment as last frame, or the next one
+		int cursor = cursors[i];
+		if (cursor > keyCount - 2 || trackKeys[cursor].time > keyTime)
+			cursor = 0;
+		while (cursor < keyCount - 2 && trackKeys[cursor + 1].time <= keyTime)
+			cursor++;
+		cursors[i] = cursor;
+
+		const AnimationKey& a = trackKeys[cursor];
+		const AnimationKey& b = trackKeys[keyCount > 1 ? cursor + 1 : cursor];
+		float length = b.time - a.time;
+		float t = length > 0 ? (keyTime - a.time) / length : 1.0f;
+		segmentT[i] = t < 0 ? 0 : (t > 1 ? 1 : t);
+		segmentLength[i] = length;
+		segmentInterpolations[i] = interpolations[i];
+
+		// Quaternions q and -q are the same rotation; the end is flipped to
+		// whichever is nearer, so blending takes the short way round
+		float sign = 1;
+		if (channels[i] == ANIMATION_CHANNEL_ROTATION &&
+			a.value.x * b.value.x + a.value.y * b.value.y + a.value.z * b.value.z + a.value.w * b.value.w < 0)
+			sign = -1;
+
+		// Tangents are per second, so they're scaled to the segment's length
+		const float* aValue = &a.value.x;
+		const float* bValue = &b.value.x;
+		const float* aTangent = &a.outTangent.x;
+		const float* bTangent = &b.inTangent.x;
+		for (int c = 0; c < 4; c++)
+		{
+			start[c][i] = aValue[c];
+			end[c][i] = bValue[c] * sign;
+			startTangent[c][i] = aTangent[c] * length;
+			endTangent[c][i] = bTangent[c] * length * sign;
+		}
+	}
+
+	// value = w0 * start + w1 * end + w2 * startTangent + w3 * endTangent, with
+	// the weights picked per lane. Lanes past the last track, or of tracks that
+	// weren't evaluated, are computed too and just never used.
+	size_t paddedLast = (last + 3) & ~(size_t)3;
+	XMVECTOR one = XMVectorSplatOne();
+	XMVECTOR two = XMVectorReplicate(2.0f);
+	XMVECTOR three = XMVectorReplicate(3.0f);
+	XMVECTOR stepMode = XMVectorReplicateInt(ANIMATION_INTERPOLATION_STEP);
+	XMVECTOR linearMode = XMVectorReplicateInt(ANIMATION_INTERPOLATION_LINEAR);
+	for (size_t i = first; i < paddedLast; i += 4)
+	{
+		XMVECTOR t = XMLoadFloat4((const XMFLOAT4*)&segmentT[i]);
+		XMVECTOR mode = XMLoadInt4((const uint32_t*)&segmentInterpolations[i]);
+		XMVECTOR t2 = t * t;
+		XMVECTOR t3 = t2 * t;
+
+		// Hermite basis
+		XMVECTOR w0 = two * t3 - three * t2 + one;
+		XMVECTOR w1 = three * t2 - two * t3;
+		XMVECTOR w2 = t3 - two * t2 + t;
+		XMVECTOR w3 = t3 - t2;
+
+		// Linear is the straight blend, and step jumps only at the end key
+		XMVECTOR isLinear = XMVectorEqualInt(mode, linearMode);
+		XMVECTOR isStep = XMVectorEqualInt(mode, stepMode);
+		XMVECTOR stepEnd = XMVectorSelect(XMVectorZero(), one, XMVectorGreaterOrEqual(t, one));
+		XMVECTOR zero = XMVectorZero();
+		w0 = XMVectorSelect(XMVectorSelect(w0, one - t, isLinear), one - stepEnd, isStep);
+		w1 = XMVectorSelect(XMVectorSelect(w1, t, isLinear), stepEnd, isStep);
+		w2 = XMVectorSelect(w2, zero, XMVectorOrInt(isLinear, isStep));
+		w3 = XMVectorSelect(w3, zero, XMVectorOrInt(isLinear, isStep));
+
+		for (int c = 0; c < 4; c++)
+		{
+			XMVECTOR value =
+				w0 * XMLoadFloat4((const XMFLOAT4*)&start[c][i]) +
+				w1 * XMLoadFloat4((const XMFLOAT4*)&end[c][i]) +
+				w2 * XMLoadFloat4((const XMFLOAT4*)&startTangent[c][i]) +
+				w3 * XMLoadFloat4((const XMFLOAT4*)&endTangent[c][i]);
+			XMStoreFloat4((XMFLOAT4*)&values[c][i], value);
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "Handle.h"
+#include "Material.h"
+#include "Transform.h"
+
+#include <DirectXMath.h>
+#include <vector>
+
+// What a track drives
+#define ANIMATION_CHANNEL_POSITION		0
+#define ANIMATION_CHANNEL_ROTATION		1	// Unit quaternion
+#define ANIMATION_CHANNEL_SCALE			2
+#define ANIMATION_CHANNEL_COLOR_TINT	3	// Of a material
+
+// How values between two keys are found
+#define ANIMATION_INTERPOLATION_STEP	0	// Holds each key's value until the next
+#define ANIMATION_INTERPOLATION_LINEAR	1
+#define ANIMATION_INTERPOLATION_HERMITE	2	// Cubic through the keys' tangents
+
+// What happens after the last key
+#define ANIMATION_LOOP_NONE			0	// Holds the last value and stops
+#define ANIMATION_LOOP_REPEAT		1
+#define ANIMATION_LOOP_PING_PONG	2
+
+// Tracks per job when the tracks are evaluated in parallel (a multiple of 4)
+#define ANIMATION_JOB_SIZE 256
+
+// One key of a track. Unused components (w of a position) are ignored.
+struct AnimationKey
+{
+	float time;						// Seconds from the start of the track
+	DirectX::XMFLOAT4 value;
+	DirectX::XMFLOAT4 inTangent;	// Change per second arriving at and leaving the key,
+	DirectX::XMFLOAT4 outTangent;	// only used by Hermite tracks
+};
+
+class AnimationSystem;
+typedef Handle<AnimationSystem> AnimationTrackHandle;
+
+// --------------------------------------------------------
+// Plays keyframe tracks on transforms and materials. Each
+// track is a curve over one channel of one target; a tween
+// is just a track with two keys.
+//
+// Tracks are kept as separate arrays per field (structure
+// of arrays), and Update evaluates them four at a time, one
+// track per XMVECTOR lane. Step, linear and Hermite keys
+// all come out of the same cubic with different weights,
+// so mixed tracks share one path with no per-track calls.
+// The evaluation is spread over the JobSystem; the values
+// are then set on the targets in track order.
+// --------------------------------------------------------
+class AnimationSystem
+{
+private:
+	// Track fields, one entry per live track, kept packed
+	std::vector<Transform*> transforms;		// Target of transform channels
+	std::vector<Material*> materials;		// Target of material channels
+	std::vector<int> channels;
+	std::vector<int> interpolations;
+	std::vector<int> loops;
+	std::vector<int> firstKeys;				// Into keys
+	std::vector<int> keyCounts;
+	std::vector<int> cursors;				// Key the last evaluation started from
+	std::vector<float> times;
+	std::vector<unsigned char> playing;
+	std::vector<unsigned int> slotOfTrack;	// Handle slot of each packed track
+
+	std::vector<AnimationKey> keys;			// Every track's keys, each track's in one run
+
+	// Per-frame results, padded to a multiple of four: each track's place in
+	// its current segment, the segment's ends and tangents, and the value
+	std::vector<float> segmentT, segmentLength;
+	std::vector<int> segmentInterpolations;
+	std::vector<unsigned char> evaluated;
+	std::vector<float> start[4], end[4], startTangent[4], endTangent[4];
+	std::vector<float> values[4];
+
+	// Handles: each slot points at its packed track
+	std::vector<unsigned int> trackOfSlot;
+	std::vector<unsigned int> slotGenerations;
+	std::vector<unsigned int> freeSlots;
+
+	AnimationTrackHandle AddTrack(Transform* transform, Material* material, int channel,
+		const AnimationKey* trackKeys, int keyCount, int interpolation, int loop);
+	int GetTrack(AnimationTrackHandle handle);
+
+	// Finds each track's segment and its ends, then the value four tracks at a time
+	void EvaluateTracks(size_t first, size_t last, float deltaTime);
+
+public:
+	AnimationSystem();
+
+	// Keys must be in time order. Returns a null handle for empty or unordered keys.
+	AnimationTrackHandle AddTrack(Transform* target, int channel,
+		const AnimationKey* trackKeys, int keyCount, int interpolation, int loop);
+	AnimationTrackHandle AddTrack(Material* target,
+		const AnimationKey* trackKeys, int keyCount, int interpolation, int loop);
+
+	// Two key tracks from one value to another
+	AnimationTrackHandle AddTween(Transform* target, int channel, DirectX::XMFLOAT4 from, DirectX::XMFLOAT4 to,
+		float duration, int interpolation, int loop);
+	AnimationTrackHandle AddTween(Material* target, DirectX::XMFLOAT4 from, DirectX::XMFLOAT4 to,
+		float duration, int interpolation, int loop);
+
+	// Stops a track for good (its target keeps the last value set)
+	void Remove(AnimationTrackHandle handle);
+
+	// Pausing keeps the track's time; tracks that ran out can be restarted with a time
+	bool IsPlaying(AnimationTrackHandle handle);
+	void SetPlaying(AnimationTrackHandle handle, bool isPlaying);
+	void SetTime(AnimationTrackHandle handle, float time);
+
+	// Advances every playing track and sets its target's channel.
+	// Targets must outlive their tracks.
+	void Update(float deltaTime);
+
+	int GetTrackCount();
+};
+
@@ -0,0 +1,560 @@
+#include "Benchmark.h"
+#include "MeshBVH.h"
+#include "MeshStreamer.h"
+#include "RayQuery.h"
+#include "SceneBVH.h"
+#include "Skinning.h"
+#include "JobSystem.h"
+#include "SpatialHashGrid.h"
+#include "TransformHierarchy.h"
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+
+#define BENCHMARK_RAY_COUNT 200000
+#define BENCHMARK_MAX_TRANSFORMS 100000	// Transform objects are big, so the runs stop here
+#define BENCHMARK_SKELETON_BONES 64
+#define BENCHMARK_SKINNED_POSES 1000
+#define BENCHMARK_SKINNED_VERTICES 200000
+#define BENCHMARK_SCENE_QUERIES 1000
+#define BENCHMARK_SPATIAL_FRAMES 10
+#define BENCHMARK_SCALING_ROOTS 20000
+#define BENCHMARK_SCALING_CHILDREN 4	// Per root, so 100k transforms in all
+#define BENCHMARK_SCALING_FRAMES 20
+
+// Milliseconds since "start"
+static double ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Benchmark::Run(const std::vector<std::shared_ptr<Mesh>>& meshes,
+	const std::vector<std::shared_ptr<Entity>>& entities)
+{
+	// Everything is measured on the full levels, so finish streaming first
+	while (MeshStreamer::GetInstance().GetPendingCount() > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	MeshBVHs(meshes);
+	RayQueries(entities);
+	Transforms();
+	SkinnedMeshes();
+	SceneQueries();
+	SpatialHashes();
+	JobScaling();
+}
+
+void Benchmark::MeshBVHs(const std::vector<std::shared_ptr<Mesh>>& meshes)
+{
+	printf("%-10s %10s %12s %12s %8s %10s %8s\n",
+		"mesh", "triangles", "serial ms", "parallel ms", "nodes", "Mrays/s", "hits");
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		Mesh* mesh = meshes[m].get();
+		if (!mesh->IsFullyResident() || mesh->GetIndices().empty())
+			continue;
+
+		MeshBVH bvh;
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		bvh.Build(mesh->GetVertices(), mesh->GetIndices(), false);
+		double serialMs = ElapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		bvh.Build(mesh->GetVertices(), mesh->GetIndices(), true);
+		double parallelMs = ElapsedMs(start);
+
+		// Rays from a sphere around the mesh towards random points inside its bounds
+		const BVHNode& root = bvh.GetNodes()[0];
+		XMVECTOR boundsMin = XMLoadFloat3(&root.boundsMin);
+		XMVECTOR boundsMax = XMLoadFloat3(&root.boundsMax);
+		XMVECTOR center = (boundsMin + boundsMax) * 0.5f;
+		float radius = XMVectorGetX(XMVector3Length(boundsMax - boundsMin));
+
+		std::vector<XMFLOAT3> origins(BENCHMARK_RAY_COUNT);
+		std::vector<XMFLOAT3> directions(BENCHMARK_RAY_COUNT);
+		for (int i = 0; i < BENCHMARK_RAY_COUNT; i++)
+		{
+			XMVECTOR onSphere = XMVector3Normalize(XMVectorSet(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f, 0));
+			XMVECTOR origin = center + onSphere * radius;
+			XMVECTOR target = XMVectorLerpV(boundsMin, boundsMax, XMVectorSet(unit(random), unit(random), unit(random), 0));
+			XMStoreFloat3(&origins[i], origin);
+			XMStoreFloat3(&directions[i], XMVector3Normalize(target - origin));
+		}
+
+		int hits = 0;
+		RayHit hit;
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < BENCHMARK_RAY_COUNT; i++)
+		{
+			if (bvh.Raycast(origins[i], directions[i], FLT_MAX, hit))
+				hits++;
+		}
+		double queryMs = ElapsedMs(start);
+
+		printf("%-10zu %10zu %12.2f %12.2f %8zu %10.2f %7.1f%%\n", m, mesh->GetIndices().size() / 3,
+			serialMs, parallelMs, bvh.GetNodes().size(), BENCHMARK_RAY_COUNT / (queryMs * 1000.0),
+			100.0 * hits / BENCHMARK_RAY_COUNT);
+	}
+}
+
+void Benchmark::RayQueries(const std::vector<std::shared_ptr<Entity>>& entities)
+{
+	RayQuery query(entities);
+	if (query.GetInstanceCount() == 0)
+		return;
+
+	XMFLOAT3 sceneMin, sceneMax;
+	query.GetBounds(sceneMin, sceneMax);
+	XMVECTOR boundsMin = XMLoadFloat3(&sceneMin);
+	XMVECTOR boundsMax = XMLoadFloat3(&sceneMax);
+	XMVECTOR center = (boundsMin + boundsMax) * 0.5f;
+	float radius = XMVectorGetX(XMVector3Length(boundsMax - boundsMin));
+
+	// Coherent rays: a pinhole camera looking at the scene, in 2x2 pixel quads
+	// so each packet holds neighbouring pixels
+	const int size = 512;
+	std::vector<Ray> coherent(size * size);
+	XMVECTOR eye = center + XMVectorSet(0.3f, 0.4f, -1.0f, 0) * radius;
+	XMVECTOR forward = XMVector3Normalize(center - eye);
+	XMVECTOR right = XMVector3Normalize(XMVector3Cross(XMVectorSet(0, 1, 0, 0), forward));
+	XMVECTOR up = XMVector3Cross(forward, right);
+	for (int i = 0; i < size * size; i++)
+	{
+		int quad = i / 4;
+		int x = (quad % (size / 2)) * 2 + (i & 1);
+		int y = (quad / (size / 2)) * 2 + ((i >> 1) & 1);
+		XMVECTOR direction = forward + right * ((x + 0.5f) / size - 0.5f) - up * ((y + 0.5f) / size - 0.5f);
+		XMStoreFloat3(&coherent[i].origin, eye);
+		XMStoreFloat3(&coherent[i].direction, XMVector3Normalize(direction));
+		coherent[i].maxDistance = FLT_MAX;
+	}
+
+	// Random rays: from a sphere around the scene to random points inside it
+	std::vector<Ray> incoherent(BENCHMARK_RAY_COUNT);
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (int i = 0; i < BENCHMARK_RAY_COUNT; i++)
+	{
+		XMVECTOR onSphere = XMVector3Normalize(XMVectorSet(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f, 0));
+		XMVECTOR origin = center + onSphere * radius;
+		XMVECTOR target = XMVectorLerpV(boundsMin, boundsMax, XMVectorSet(unit(random), unit(random), unit(random), 0));
+		XMStoreFloat3(&incoherent[i].origin, origin);
+		XMStoreFloat3(&incoherent[i].direction, XMVector3Normalize(target - origin));
+		incoherent[i].maxDistance = FLT_MAX;
+	}
+
+	int threadCount = (int)std::thread::hardware_concurrency();
+	if (threadCount < 1)
+		threadCount = 1;
+
+	printf("%-10s %8s %12s %12s %12s %8s\n", "rays", "count", "single", "packets", "threaded", "hits");
+	const std::vector<Ray>* batches[2] = { &coherent, &incoherent };
+	const char* names[2] = { "coherent", "random" };
+	for (int b = 0; b < 2; b++)
+	{
+		const std::vector<Ray>& rays = *batches[b];
+		std::vector<RayQueryHit> hits(rays.size());
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < rays.size(); i++)
+			query.Cast(rays[i], hits[i]);
+		double singleMs = ElapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		query.Cast(rays.data(), rays.size(), hits.data());
+		double packetMs = ElapsedMs(start);
+
+		// Splits the batch on packet boundaries so threads never share one
+		start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> threads;
+		size_t perThread = ((rays.size() / threadCount) + 3) & ~(size_t)3;
+		for (size_t first = 0; first < rays.size(); first += perThread)
+		{
+			size_t count = rays.size() - first < perThread ? rays.size() - first : perThread;
+			threads.push_back(std::thread([&query, &rays, &hits, first, count]()
+				{ query.Cast(rays.data() + first, count, hits.data() + first); }));
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+		double threadedMs = ElapsedMs(start);
+
+		int hitCount = 0;
+		for (size_t i = 0; i < hits.size(); i++)
+			hitCount += hits[i].entity >= 0;
+
+		double count = (double)rays.size();
+		printf("%-10s %8zu %7.2f Mr/s %7.2f Mr/s %7.2f Mr/s %7.1f%%\n", names[b], rays.size(),
+			count / (singleMs * 1000.0), count / (packetMs * 1000.0), count / (threadedMs * 1000.0),
+			100.0 * hitCount / count);
+	}
+}
+
+void Benchmark::Transforms()
+{
+	printf("%-10s %14s %14s %14s\n", "transforms", "on demand", "tree serial", "tree threaded");
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	JobSystem& jobs = JobSystem::GetInstance();
+	for (int count = 1000; count <= BENCHMARK_MAX_TRANSFORMS; count *= 10)
+	{
+		// Declared last so it's gone before the transforms it points at
+		std::vector<Transform> transforms(count);
+		TransformHierarchy hierarchy;
+		for (int i = 0; i < count; i++)
+		{
+			transforms[i].SetPosition(unit(random) * 100, unit(random) * 100, unit(random) * 100);
+			transforms[i].SetRotation(unit(random) * XM_PI, unit(random) * XM_PI, unit(random) * XM_PI);
+			transforms[i].SetScale(1 + unit(random) * 0.5f, 1 + unit(random) * 0.5f, 1 + unit(random) * 0.5f);
+			hierarchy.Add(&transforms[i]);
+		}
+		hierarchy.Update();
+
+		// Everything moves each run, which is the worst case. First one
+		// object at a time, as anything outside a hierarchy is rebuilt...
+		for (int i = 0; i < count; i++)
+			transforms[i].MoveAbsolute(0, 1, 0);
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < count; i++)
+			transforms[i].UpdateMatrices();
+		double demandMs = ElapsedMs(start);
+
+		// ...then in the one pass the game's entities get, on one thread and on all
+		double treeMs[2];
+		for (int run = 0; run < 2; run++)
+		{
+			jobs.SetThreadLimit(run == 0 ? 1 : 0);
+			for (int i = 0; i < count; i++)
+				transforms[i].MoveAbsolute(0, 1, 0);
+			start = std::chrono::high_resolution_clock::now();
+			hierarchy.Update();
+			treeMs[run] = ElapsedMs(start);
+		}
+		jobs.SetThreadLimit(0);
+
+		printf("%-10d %9.2f ns/t %9.2f ns/t %9.2f ns/t\n", count,
+			demandMs * 1e6 / count, treeMs[0] * 1e6 / count, treeMs[1] * 1e6 / count);
+	}
+}
+
+void Benchmark::SkinnedMeshes()
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	// A branching skeleton, each bone a unit above its parent
+	Skeleton skeleton;
+	for (int bone = 0; bone < BENCHMARK_SKELETON_BONES; bone++)
+	{
+		skeleton.AddBone("bone" + std::to_string(bone), bone == 0 ? -1 : (bone - 1) / 2,
+			XMFLOAT3(0, 1, 0), XMFLOAT4(0, 0, 0, 1), XMFLOAT3(1, 1, 1));
+	}
+
+	// Two seconds sampled at 60Hz, each bone swinging on its own slow curve.
+	// Only the root moves and nothing scales, so there's plenty to drop.
+	std::vector<std::vector<BoneKey>> boneKeys(BENCHMARK_SKELETON_BONES);
+	for (int bone = 0; bone < BENCHMARK_SKELETON_BONES; bone++)
+	{
+		float phase = unit(random) * XM_PI;
+		float speed = 1 + unit(random) * 0.5f;
+		for (int frame = 0; frame <= 120; frame++)
+		{
+			BoneKey key;
+			key.time = frame / 60.0f;
+			key.position = bone == 0 ? XMFLOAT3(sinf(key.time * speed), 1, 0) : XMFLOAT3(0, 1, 0);
+			XMStoreFloat4(&key.rotation, XMQuaternionRotationRollPitchYaw(
+				sinf(key.time * speed + phase) * 0.5f, 0, cosf(key.time * speed + phase) * 0.25f));
+			key.scale = XMFLOAT3(1, 1, 1);
+			boneKeys[bone].push_back(key);
+		}
+	}
+
+	SkeletalClip clip;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	clip.Compress(boneKeys, 0.001f, 0.001f, 0.001f);
+	double compressMs = ElapsedMs(start);
+	printf("clip: %d bones, kept %d of %d keys, %zu bytes (from %zu), compressed in %.2f ms\n",
+		clip.GetBoneCount(), clip.GetKeyCount(), clip.GetSourceKeyCount(), clip.GetSizeInBytes(),
+		BENCHMARK_SKELETON_BONES * boneKeys[0].size() * sizeof(BoneKey), compressMs);
+
+	// Many characters, each at its own point in the clip
+	std::vector<SkinnedPose> poses(BENCHMARK_SKINNED_POSES);
+	std::vector<float> times(BENCHMARK_SKINNED_POSES);
+	for (float& time : times)
+		time = (unit(random) * 0.5f + 0.5f) * clip.GetDuration();
+	Skinning::EvaluatePoses(skeleton, clip, times.data(), poses.data(), poses.size(), false);
+
+	start = std::chrono::high_resolution_clock::now();
+	Skinning::EvaluatePoses(skeleton, clip, times.data(), poses.data(), poses.size(), false);
+	double poseSerialMs = ElapsedMs(start);
+	start = std::chrono::high_resolution_clock::now();
+	Skinning::EvaluatePoses(skeleton, clip, times.data(), poses.data(), poses.size(), true);
+	double poseThreadedMs = ElapsedMs(start);
+
+	// A mesh around the skeleton, each vertex weighted to four random bones
+	std::vector<SkinnedVertex> vertices(BENCHMARK_SKINNED_VERTICES);
+	std::vector<Vertex> skinned(BENCHMARK_SKINNED_VERTICES);
+	std::uniform_int_distribution<int> anyBone(0, BENCHMARK_SKELETON_BONES - 1);
+	for (SkinnedVertex& vertex : vertices)
+	{
+		vertex.Position = XMFLOAT3(unit(random), unit(random) * 4 + 4, unit(random));
+		vertex.Normal = XMFLOAT3(0, 1, 0);
+		vertex.Tangent = XMFLOAT4(1, 0, 0, 1);
+		vertex.UV = XMFLOAT2(0, 0);
+		float weights[SKINNED_VERTEX_INFLUENCES];
+		float total = 0;
+		for (int influence = 0; influence < SKINNED_VERTEX_INFLUENCES; influence++)
+		{
+			vertex.BoneIndices[influence] = (unsigned char)anyBone(random);
+			weights[influence] = unit(random) * 0.5f + 0.5f;
+			total += weights[influence];
+		}
+		vertex.BoneWeights = XMFLOAT4(weights[0] / total, weights[1] / total, weights[2] / total, weights[3] / total);
+	}
+
+	const XMFLOAT4X4* palette = poses[0].GetPalette().data();
+	start = std::chrono::high_resolution_clock::now();
+	Skinning::SkinVertices(vertices.data(), vertices.size(), palette, skinned.data(), false);
+	double skinSerialMs = ElapsedMs(start);
+	start = std::chrono::high_resolution_clock::now();
+	Skinning::SkinVertices(vertices.data(), vertices.size(), palette, skinned.data(), true);
+	double skinThreadedMs = ElapsedMs(start);
+
+	double bones = (double)BENCHMARK_SKINNED_POSES * BENCHMARK_SKELETON_BONES;
+	printf("%-10s %14s %14s\n", "skinning", "serial", "threaded");
+	printf("%-10s %9.0f b/ms %9.0f b/ms\n", "poses", bones / poseSerialMs, bones / poseThreadedMs);
+	printf("%-10s %9.0f v/ms %9.0f v/ms\n", "vertices",
+		BENCHMARK_SKINNED_VERTICES / skinSerialMs, BENCHMARK_SKINNED_VERTICES / skinThreadedMs);
+}
+
+void Benchmark::SceneQueries()
+{
+	printf("%-8s %10s %10s %10s %12s %12s %8s\n",
+		"boxes", "build ms", "insert ms", "move ms", "tree q/ms", "scan q/ms", "found");
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (int count = 1000; count <= 100000; count *= 10)
+	{
+		// Boxes a few units across, spread through a level that grows with the count
+		float extent = 50.0f * cbrtf(count / 1000.0f);
+		std::vector<SceneBVHItem> items(count);
+		for (int i = 0; i < count; i++)
+		{
+			XMFLOAT3 center(unit(random) * extent, unit(random) * extent * 0.25f, unit(random) * extent);
+			float size = 1.5f + unit(random);
+			items[i].boundsMin = XMFLOAT3(center.x - size, center.y - size, center.z - size);
+			items[i].boundsMax = XMFLOAT3(center.x + size, center.y + size, center.z + size);
+			items[i].userData = (unsigned int)i;
+		}
+
+		SceneBVH tree;
+		std::vector<int> proxies;
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		tree.Build(items, proxies);
+		double buildMs = ElapsedMs(start);
+
+		SceneBVH inserted;
+		start = std::chrono::high_resolution_clock::now();
+		for (const SceneBVHItem& item : items)
+			inserted.Insert(item.boundsMin, item.boundsMax, item.userData);
+		double insertMs = ElapsedMs(start);
+
+		// A tenth of them drift a little, as moving entities would in a frame;
+		// only the ones that leave their margin touch the tree
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < count; i += 10)
+		{
+			float dx = unit(random) * 0.2f;
+			float dz = unit(random) * 0.2f;
+			items[i].boundsMin.x += dx;
+			items[i].boundsMax.x += dx;
+			items[i].boundsMin.z += dz;
+			items[i].boundsMax.z += dz;
+			tree.Move(proxies[i], items[i].boundsMin, items[i].boundsMax);
+		}
+		double moveMs = ElapsedMs(start);
+
+		// Spheres the size of a light's range, from the tree and by brute force
+		std::vector<XMFLOAT3> centers(BENCHMARK_SCENE_QUERIES);
+		for (XMFLOAT3& center : centers)
+			center = XMFLOAT3(unit(random) * extent, unit(random) * extent * 0.25f, unit(random) * extent);
+		float radius = 10.0f;
+
+		std::vector<unsigned int> results;
+		size_t found = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (const XMFLOAT3& center : centers)
+		{
+			results.clear();
+			tree.QuerySphere(center, radius, results);
+			found += results.size();
+		}
+		double treeMs = ElapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (const XMFLOAT3& center : centers)
+		{
+			results.clear();
+			XMVECTOR sphereCenter = XMLoadFloat3(&center);
+			for (const SceneBVHItem& item : items)
+			{
+				XMVECTOR nearest = XMVectorClamp(sphereCenter, XMLoadFloat3(&item.boundsMin), XMLoadFloat3(&item.boundsMax));
+				if (XMVectorGetX(XMVector3LengthSq(nearest - sphereCenter)) <= radius * radius)
+					results.push_back(item.userData);
+			}
+		}
+		double scanMs = ElapsedMs(start);
+
+		printf("%-8d %10.2f %10.2f %10.3f %12.1f %12.1f %8.1f\n", count, buildMs, insertMs, moveMs,
+			BENCHMARK_SCENE_QUERIES / treeMs, BENCHMARK_SCENE_QUERIES / scanMs, (double)found / BENCHMARK_SCENE_QUERIES);
+	}
+}
+
+void Benchmark::SpatialHashes()
+{
+	printf("%-8s %10s %12s %10s %12s %12s %8s\n",
+		"points", "serial ms", "parallel ms", "bvh ms", "grid q/ms", "bvh q/ms", "found");
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (int count = 10000; count <= 1000000; count *= 10)
+	{
+		// Balls half a unit across, about one per eight cubic units, all moving
+		// fast enough that most leave a tree's margin within a few frames
+		float extent = cbrtf((float)count);
+		float radius = 0.25f;
+		std::vector<XMFLOAT3> positions(count);
+		std::vector<XMFLOAT3> velocities(count);
+		std::vector<SceneBVHItem> items(count);
+		for (int i = 0; i < count; i++)
+		{
+			positions[i] = XMFLOAT3(unit(random) * extent, unit(random) * extent, unit(random) * extent);
+			velocities[i] = XMFLOAT3(unit(random) * 10.0f, unit(random) * 10.0f, unit(random) * 10.0f);
+			items[i].boundsMin = XMFLOAT3(positions[i].x - radius, positions[i].y - radius, positions[i].z - radius);
+			items[i].boundsMax = XMFLOAT3(positions[i].x + radius, positions[i].y + radius, positions[i].z + radius);
+			items[i].userData = (unsigned int)i;
+		}
+
+		SpatialHashGrid grid(2.0f);
+		SceneBVH tree;
+		std::vector<int> proxies;
+		tree.Build(items, proxies);
+
+		// Each frame moves everything, then brings the grid (both ways) and the tree up to date
+		double serialMs = 0, parallelMs = 0, treeMs = 0;
+		for (int frame = 0; frame < BENCHMARK_SPATIAL_FRAMES; frame++)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				positions[i].x += velocities[i].x / 60.0f;
+				positions[i].y += velocities[i].y / 60.0f;
+				positions[i].z += velocities[i].z / 60.0f;
+			}
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			grid.Build(positions.data(), positions.size(), false);
+			serialMs += ElapsedMs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			grid.Build(positions.data(), positions.size(), true);
+			parallelMs += ElapsedMs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < count; i++)
+			{
+				const XMFLOAT3& position = positions[i];
+				tree.Move(proxies[i], XMFLOAT3(position.x - radius, position.y - radius, position.z - radius),
+					XMFLOAT3(position.x + radius, position.y + radius, position.z + radius));
+			}
+			treeMs += ElapsedMs(start);
+		}
+
+		// Everything within a couple of units of random balls, as collision or flocking would ask
+		std::vector<XMFLOAT3> centers(BENCHMARK_SCENE_QUERIES);
+		for (XMFLOAT3& center : centers)
+			center = positions[random() % count];
+
+		std::vector<unsigned int> results;
+		size_t found = 0;
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (const XMFLOAT3& center : centers)
+		{
+			results.clear();
+			grid.QueryRadius(center, 2.0f, results);
+			found += results.size();
+		}
+		double gridQueryMs = ElapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (const XMFLOAT3& center : centers)
+		{
+			results.clear();
+			tree.QuerySphere(center, 2.0f, results);
+		}
+		double treeQueryMs = ElapsedMs(start);
+
+		printf("%-8d %10.2f %12.2f %10.2f %12.1f %12.1f %8.1f\n", count,
+			serialMs / BENCHMARK_SPATIAL_FRAMES, parallelMs / BENCHMARK_SPATIAL_FRAMES, treeMs / BENCHMARK_SPATIAL_FRAMES,
+			BENCHMARK_SCENE_QUERIES / gridQueryMs, BENCHMARK_SCENE_QUERIES / treeQueryMs, (double)found / BENCHMARK_SCENE_QUERIES);
+	}
+}
+
+void Benchmark::JobScaling()
+{
+	printf("%-8s %10s %10s\n", "threads", "update ms", "speedup");
+
+	// Roots with a few children each, all in one hierarchy. The hierarchy is
+	// declared last so it's gone before the transforms it points at.
+	int transformCount = BENCHMARK_SCALING_ROOTS * (BENCHMARK_SCALING_CHILDREN + 1);
+	std::vector<Transform> transforms(transformCount);
+	TransformHierarchy hierarchy;
+	for (int r = 0; r < BENCHMARK_SCALING_ROOTS; r++)
+	{
+		Transform* root = &transforms[r * (BENCHMARK_SCALING_CHILDREN + 1)];
+		root->SetPosition((float)r, 0, 0);
+		for (int c = 1; c <= BENCHMARK_SCALING_CHILDREN; c++)
+		{
+			Transform* child = root + c;
+			child->SetPosition(0, (float)c, 0);
+			child->SetRotation(0, c * 0.5f, 0);
+			child->SetParent(root);
+			hierarchy.Add(child);
+		}
+		hierarchy.Add(root);
+	}
+	hierarchy.Update();
+
+	// Thread counts are capped through the JobSystem, so every run splits the
+	// work into the same pieces and only the number of threads taking them changes
+	JobSystem& jobs = JobSystem::GetInstance();
+	double serialMs = 0;
+	for (int threads = 1; threads <= jobs.GetThreadCount(); threads++)
+	{
+		jobs.SetThreadLimit(threads);
+
+		double totalMs = 0;
+		for (int frame = 0; frame < BENCHMARK_SCALING_FRAMES; frame++)
+		{
+			for (int r = 0; r < BENCHMARK_SCALING_ROOTS; r++)
+				transforms[r * (BENCHMARK_SCALING_CHILDREN + 1)].SetPosition((float)r, (float)frame, 0);
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			hierarchy.Update();
+			totalMs += ElapsedMs(start);
+		}
+
+		double frameMs = totalMs / BENCHMARK_SCALING_FRAMES;
+		if (threads == 1)
+			serialMs = frameMs;
+		printf("%-8d %10.3f %9.2fx\n", threads, frameMs, serialMs / frameMs);
+	}
+	jobs.SetThreadLimit(0);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "Entity.h"
+#include "Mesh.h"
+
+#include <memory>
+#include <vector>
+
+// --------------------------------------------------------
+// Timings for the CPU side systems, printed to the console.
+// Only compiled into the game when RUN_BENCHMARKS is
+// defined, since it stalls startup until it's done.
+// --------------------------------------------------------
+class Benchmark
+{
+public:
+	// Runs every benchmark against the loaded meshes and entities
+	static void Run(const std::vector<std::shared_ptr<Mesh>>& meshes,
+		const std::vector<std::shared_ptr<Entity>>& entities);
+
+	// Times serial and parallel BVH builds, then random ray queries
+	static void MeshBVHs(const std::vector<std::shared_ptr<Mesh>>& meshes);
+
+	// Times coherent and random rays against the whole scene, one at a time,
+	// as packets, and as packets spread across threads
+	static void RayQueries(const std::vector<std::shared_ptr<Entity>>& entities);
+
+	// Times rebuilding every matrix of 1k to 100k transforms, one Transform
+	// at a time and through a TransformHierarchy, serial and threaded
+	static void Transforms();
+
+	// Compresses a clip for a synthetic skeleton, then times posing many
+	// copies of it and skinning a mesh, serial and threaded, in bones and
+	// vertices per millisecond
+	static void SkinnedMeshes();
+
+	// Builds a SceneBVH over 1k to 100k boxes in bulk and one at a time, then
+	// times small moves and sphere queries against testing every box
+	static void SceneQueries();
+
+	// Moves 10k to 1M balls every frame, timing the SpatialHashGrid's serial
+	// and parallel rebuilds against moving them in a SceneBVH, then radius
+	// queries against each
+	static void SpatialHashes();
+
+	// Times the same TransformHierarchy update (every root moved, so every
+	// world matrix rebuilt) on one thread, then spread over 2 to all of
+	// the JobSystem's threads, to show how it scales
+	static void JobScaling();
+};
@@ -94,21 +94,16 @@ void Camera::Update(float dt)
 
 		// Rotates around the x axis
 		float cursorMovementY = input.GetMouseYDelta() * mouseLookSpeed * dt;
-		transform.Rotate(cursorMovementY, 0, 0);
-
-		// Clamps the x axis rotation, so the camera doesn't flip over
-		if (transform.GetPitchYawRoll().x > XM_PIDIV2 - .01)
-		{
-			transform.SetRotation(XM_PIDIV2 - .01,
-				transform.GetPitchYawRoll().y,
-				transform.GetPitchYawRoll().z);
-		}
-		else if (transform.GetPitchYawRoll().x < -XM_PIDIV2 + .01)
-		{
-			transform.SetRotation(-XM_PIDIV2 + .01,
-				transform.GetPitchYawRoll().y,
-				transform.GetPitchYawRoll().z);
-		}
+
+		// Clamps the x axis rotation before applying it, so the camera doesn't
+		// flip over (past straight up, the orientation reads back as flipped)
+		float pitch = transform.GetPitchYawRoll().x;
+		float newPitch = pitch + cursorMovementY;
+		if (newPitch > XM_PIDIV2 - .01f)
+			newPitch = XM_PIDIV2 - .01f;
+		else if (newPitch < -XM_PIDIV2 + .01f)
+			newPitch = -XM_PIDIV2 + .01f;
+		transform.Rotate(newPitch - pitch, 0, 0);
 	}
 
 	// Updates the view matrix
@@ -120,12 +115,10 @@ void Camera::UpdateViewMatrix()
 	// I need the position, direction and "world up" vectors
 	XMFLOAT3 pos = transform.GetPosition();
 	XMFLOAT3 up(0, 1, 0);
-	XMFLOAT3 rot = transform.GetPitchYawRoll();
+	XMFLOAT3 dir = transform.GetForward();
 
 	// This is the "math" type
-	XMVECTOR forward = XMVector3Rotate(
-	XMVectorSet(0, 0, 1, 0), // The world "forward" is (0, 0, 1)
-	XMQuaternionRotationRollPitchYaw(rot.x, rot.y, rot.z));
+	XMVECTOR forward = XMLoadFloat3(&dir);
 
 	// Build the view matrix from our position, our local foward vector
 	// and the world's up axis
@@ -0,0 +1,53 @@
+#pragma once
+#include "Transform.h"
+#include "Resources.h"
+#include "Lights.h"
+
+#include <DirectXMath.h>
+
+// --------------------------------------------------------
+// Components the game keeps in its EntityStore, holding
+// everything the per-frame systems read so they never
+// have to go back through the Entity objects
+// --------------------------------------------------------
+
+// Where something is. The Transform itself stays put in its Entity, since
+// parent/child links point at it; its world matrices are copied in here
+// whenever its version changes, so readers walk the store instead.
+struct TransformComponent
+{
+	Transform* transform;
+	DirectX::XMFLOAT4X4 worldMatrix;
+	DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
+	unsigned int version;			// Of the transform the matrices came from
+};
+
+// Something drawn with a mesh, with a material per mesh slot
+struct RenderComponent
+{
+	MeshHandle mesh;
+	unsigned int firstMaterial;		// Into the game's list of material slots
+	unsigned int materialCount;		// At least one; slot 0 stands in for missing ones
+};
+
+// Box around a renderable, refit whenever its transform changes
+struct BoundsComponent
+{
+	DirectX::XMFLOAT3 localMin;		// Mesh space box
+	DirectX::XMFLOAT3 localMax;
+	DirectX::XMFLOAT3 boundsMin;	// World space box
+	DirectX::XMFLOAT3 boundsMax;
+	unsigned int transformVersion;	// Of the transform the world box came from
+	int sceneProxy;					// In the game's SceneBVH, or -1 until it has a box
+};
+
+// Never moves, so it's drawn through a static batch once they're built
+struct StaticComponent
+{
+};
+
+struct LightComponent
+{
+	Light light;
+};
+
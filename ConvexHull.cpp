@@ -0,0 +1,576 @@
+#include "ConvexHull.h"
+#include "MeshCache.h"
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Decomposition only splits a piece when its halves' hulls are at least
+// this much smaller (by volume) than its own hull
+#define HULL_SPLIT_MIN_SAVINGS 0.2f
+
+// One triangle of the hull while it's being built
+struct HullFace
+{
+	unsigned int v[3];
+	XMFLOAT3 normal;
+	float offset;
+	std::vector<unsigned int> outside;	// Points above this face
+	unsigned int farthest;				// The one of those farthest above it
+	float farthestDistance;
+	bool removed;
+};
+
+// A piece of a mesh being decomposed, with its best split worked out
+struct HullPiece
+{
+	std::vector<unsigned int> triangles;
+	ConvexHull hull;
+	float volume;
+	std::vector<unsigned int> splitTriangles[2];
+	ConvexHull splitHulls[2];
+	float savings;	// Fraction of the volume a split saves
+};
+
+static float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static XMFLOAT3 Subtract(const XMFLOAT3& a, const XMFLOAT3& b)
+{
+	return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b)
+{
+	return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static float Distance(const HullFace& face, const XMFLOAT3& p)
+{
+	return Dot(face.normal, p) - face.offset;
+}
+
+static HullFace MakeFace(const std::vector<XMFLOAT3>& points, unsigned int a, unsigned int b, unsigned int c)
+{
+	HullFace face;
+	face.v[0] = a;
+	face.v[1] = b;
+	face.v[2] = c;
+	XMFLOAT3 normal = Cross(Subtract(points[b], points[a]), Subtract(points[c], points[a]));
+	float length = sqrtf(Dot(normal, normal));
+	float scale = length > 0 ? 1.0f / length : 0;
+	face.normal = XMFLOAT3(normal.x * scale, normal.y * scale, normal.z * scale);
+	face.offset = Dot(face.normal, points[a]);
+	face.farthest = UINT_MAX;
+	face.farthestDistance = 0;
+	face.removed = false;
+	return face;
+}
+
+// Gives each point to the new face it's farthest above, if any
+static void AssignOutsidePoints(const std::vector<XMFLOAT3>& points, const std::vector<unsigned int>& candidates,
+	std::vector<HullFace>& faces, size_t firstFace, float epsilon)
+{
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		unsigned int p = candidates[i];
+		size_t best = SIZE_MAX;
+		float bestDistance = epsilon;
+		for (size_t f = firstFace; f < faces.size(); f++)
+		{
+			float distance = Distance(faces[f], points[p]);
+			if (distance > bestDistance)
+			{
+				bestDistance = distance;
+				best = f;
+			}
+		}
+		if (best == SIZE_MAX)
+			continue;
+
+		HullFace& face = faces[best];
+		face.outside.push_back(p);
+		if (bestDistance > face.farthestDistance)
+		{
+			face.farthestDistance = bestDistance;
+			face.farthest = p;
+		}
+	}
+}
+
+ConvexHull::ConvexHull()
+{
+}
+
+bool ConvexHull::Build(const std::vector<XMFLOAT3>& points, int maxVertices)
+{
+	vertices.clear();
+	indices.clear();
+	planes.clear();
+	if (points.size() < 3)
+		return false;
+	if (maxVertices < 4)
+		maxVertices = 4;
+
+	// Tolerance scaled to the size of the input
+	XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX), boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	unsigned int extremes[6] = {};
+	for (unsigned int i = 0; i < points.size(); i++)
+	{
+		const XMFLOAT3& p = points[i];
+		if (p.x < boundsMin.x) { boundsMin.x = p.x; extremes[0] = i; }
+		if (p.x > boundsMax.x) { boundsMax.x = p.x; extremes[1] = i; }
+		if (p.y < boundsMin.y) { boundsMin.y = p.y; extremes[2] = i; }
+		if (p.y > boundsMax.y) { boundsMax.y = p.y; extremes[3] = i; }
+		if (p.z < boundsMin.z) { boundsMin.z = p.z; extremes[4] = i; }
+		if (p.z > boundsMax.z) { boundsMax.z = p.z; extremes[5] = i; }
+	}
+	XMFLOAT3 diagonal = Subtract(boundsMax, boundsMin);
+	float size = sqrtf(Dot(diagonal, diagonal));
+	float epsilon = size * 1e-5f;
+
+	// Starts from a tetrahedron: the two extremes farthest apart...
+	unsigned int a = extremes[0], b = extremes[1];
+	float bestDistance = -1;
+	for (int i = 0; i < 6; i++)
+	{
+		for (int j = i + 1; j < 6; j++)
+		{
+			XMFLOAT3 d = Subtract(points[extremes[i]], points[extremes[j]]);
+			if (Dot(d, d) > bestDistance)
+			{
+				bestDistance = Dot(d, d);
+				a = extremes[i];
+				b = extremes[j];
+			}
+		}
+	}
+	if (sqrtf(bestDistance) <= epsilon)
+		return false;
+
+	// ...the point farthest from the line between them...
+	XMFLOAT3 ab = Subtract(points[b], points[a]);
+	unsigned int c = 0;
+	bestDistance = -1;
+	for (unsigned int i = 0; i < points.size(); i++)
+	{
+		XMFLOAT3 cross = Cross(Subtract(points[i], points[a]), ab);
+		if (Dot(cross, cross) > bestDistance)
+		{
+			bestDistance = Dot(cross, cross);
+			c = i;
+		}
+	}
+	if (sqrtf(bestDistance) / sqrtf(Dot(ab, ab)) <= epsilon)
+		return false;
+
+	// ...and the point farthest from their plane
+	HullFace base = MakeFace(points, a, b, c);
+	unsigned int d = 0;
+	bestDistance = -1;
+	for (unsigned int i = 0; i < points.size(); i++)
+	{
+		float distance = fabsf(Distance(base, points[i]));
+		if (distance > bestDistance)
+		{
+			bestDistance = distance;
+			d = i;
+		}
+	}
+	if (bestDistance <= epsilon)
+	{
+		// Flat, like a quad or a floor, so extrude it slightly and try again
+		float thickness = size * 0.01f > 0.001f ? size * 0.01f : 0.001f;
+		std::vector<XMFLOAT3> thick(points);
+		thick.reserve(points.size() * 2);
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			const XMFLOAT3& p = points[i];
+			thick.push_back(XMFLOAT3(p.x - base.normal.x * thickness,
+				p.y - base.normal.y * thickness, p.z - base.normal.z * thickness));
+		}
+		return Build(thick, maxVertices);
+	}
+
+	// Winds each face of the tetrahedron so the fourth point is behind it
+	std::vector<HullFace> faces;
+	unsigned int corners[4] = { a, b, c, d };
+	const int tetrahedron[4][4] = { { 0, 1, 2, 3 }, { 0, 3, 1, 2 }, { 0, 2, 3, 1 }, { 1, 3, 2, 0 } };
+	for (int f = 0; f < 4; f++)
+	{
+		HullFace face = MakeFace(points, corners[tetrahedron[f][0]], corners[tetrahedron[f][1]], corners[tetrahedron[f][2]]);
+		if (Distance(face, points[corners[tetrahedron[f][3]]]) > 0)
+			face = MakeFace(points, corners[tetrahedron[f][0]], corners[tetrahedron[f][2]], corners[tetrahedron[f][1]]);
+		faces.push_back(face);
+	}
+
+	std::vector<unsigned int> remaining;
+	remaining.reserve(points.size());
+	for (unsigned int i = 0; i < points.size(); i++)
+	{
+		if (i != a && i != b && i != c && i != d)
+			remaining.push_back(i);
+	}
+	AssignOutsidePoints(points, remaining, faces, 0, epsilon);
+
+	// Adds the farthest outside point of any face until none are left or the limit is hit
+	int vertexCount = 4;
+	std::vector<size_t> visible;
+	std::vector<unsigned int> horizon;
+	std::vector<unsigned int> orphans;
+	while (vertexCount < maxVertices)
+	{
+		size_t eyeFace = SIZE_MAX;
+		float eyeDistance = 0;
+		for (size_t f = 0; f < faces.size(); f++)
+		{
+			if (!faces[f].removed && !faces[f].outside.empty() && faces[f].farthestDistance > eyeDistance)
+			{
+				eyeDistance = faces[f].farthestDistance;
+				eyeFace = f;
+			}
+		}
+		if (eyeFace == SIZE_MAX)
+			break;
+		unsigned int eye = faces[eyeFace].farthest;
+
+		// Every face the new point can see gets replaced
+		visible.clear();
+		for (size_t f = 0; f < faces.size(); f++)
+		{
+			if (!faces[f].removed && Distance(faces[f], points[eye]) > epsilon)
+				visible.push_back(f);
+		}
+
+		// The horizon is every edge of a visible face whose twin isn't visible
+		horizon.clear();
+		for (size_t i = 0; i < visible.size(); i++)
+		{
+			const HullFace& face = faces[visible[i]];
+			for (int e = 0; e < 3; e++)
+			{
+				unsigned int from = face.v[e], to = face.v[(e + 1) % 3];
+				bool shared = false;
+				for (size_t j = 0; j < visible.size() && !shared; j++)
+				{
+					const HullFace& other = faces[visible[j]];
+					for (int k = 0; k < 3; k++)
+					{
+						if (other.v[k] == to && other.v[(k + 1) % 3] == from)
+						{
+							shared = true;
+							break;
+						}
+					}
+				}
+				if (!shared)
+				{
+					horizon.push_back(from);
+					horizon.push_back(to);
+				}
+			}
+		}
+
+		orphans.clear();
+		for (size_t i = 0; i < visible.size(); i++)
+		{
+			HullFace& face = faces[visible[i]];
+			for (size_t p = 0; p < face.outside.size(); p++)
+			{
+				if (face.outside[p] != eye)
+					orphans.push_back(face.outside[p]);
+			}
+			face.outside.clear();
+			face.removed = true;
+		}
+
+		// Fans new faces from the horizon to the new point
+		size_t firstNew = faces.size();
+		for (size_t e = 0; e < horizon.size(); e += 2)
+			faces.push_back(MakeFace(points, horizon[e], horizon[e + 1], eye));
+		AssignOutsidePoints(points, orphans, faces, firstNew, epsilon);
+		vertexCount++;
+	}
+
+	// Compacts the surviving faces and the vertices they use
+	std::vector<unsigned int> remap(points.size(), UINT_MAX);
+	for (size_t f = 0; f < faces.size(); f++)
+	{
+		if (faces[f].removed)
+			continue;
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = faces[f].v[k];
+			if (remap[v] == UINT_MAX)
+			{
+				remap[v] = (unsigned int)vertices.size();
+				vertices.push_back(points[v]);
+			}
+			indices.push_back(remap[v]);
+		}
+
+		// Coplanar triangles (two per side of a box, say) share one plane
+		const HullFace& face = faces[f];
+		bool duplicate = false;
+		for (size_t p = 0; p < planes.size() && !duplicate; p++)
+		{
+			XMFLOAT3 normal(planes[p].x, planes[p].y, planes[p].z);
+			duplicate = Dot(normal, face.normal) > 0.9999f && fabsf(planes[p].w - face.offset) <= epsilon;
+		}
+		if (!duplicate)
+			planes.push_back(XMFLOAT4(face.normal.x, face.normal.y, face.normal.z, face.offset));
+	}
+
+	// Pushes planes out past any point the vertex limit left outside
+	for (size_t p = 0; p < planes.size(); p++)
+	{
+		XMFLOAT3 normal(planes[p].x, planes[p].y, planes[p].z);
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			float offset = Dot(normal, points[i]);
+			if (offset > planes[p].w)
+				planes[p].w = offset;
+		}
+	}
+	return true;
+}
+
+// Works out the split of a piece that shrinks its hull volume the most
+static void FindBestSplit(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+	int maxVertices, HullPiece& piece)
+{
+	piece.savings = 0;
+	if (piece.volume <= 0)
+		return;
+
+	XMFLOAT3 centroidMin(FLT_MAX, FLT_MAX, FLT_MAX), centroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	std::vector<XMFLOAT3> centroids(piece.triangles.size());
+	for (size_t t = 0; t < piece.triangles.size(); t++)
+	{
+		unsigned int first = piece.triangles[t] * 3;
+		const XMFLOAT3& a = vertices[indices[first]].Position;
+		const XMFLOAT3& b = vertices[indices[first + 1]].Position;
+		const XMFLOAT3& c = vertices[indices[first + 2]].Position;
+		XMFLOAT3& centroid = centroids[t];
+		centroid = XMFLOAT3((a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f, (a.z + b.z + c.z) / 3.0f);
+		centroidMin = XMFLOAT3(fminf(centroidMin.x, centroid.x), fminf(centroidMin.y, centroid.y), fminf(centroidMin.z, centroid.z));
+		centroidMax = XMFLOAT3(fmaxf(centroidMax.x, centroid.x), fmaxf(centroidMax.y, centroid.y), fmaxf(centroidMax.z, centroid.z));
+	}
+
+	// Tries halving the piece across each axis
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float middle = axis == 0 ? (centroidMin.x + centroidMax.x) * 0.5f :
+			axis == 1 ? (centroidMin.y + centroidMax.y) * 0.5f : (centroidMin.z + centroidMax.z) * 0.5f;
+
+		std::vector<unsigned int> sides[2];
+		std::vector<XMFLOAT3> sidePoints[2];
+		for (size_t t = 0; t < piece.triangles.size(); t++)
+		{
+			float value = axis == 0 ? centroids[t].x : axis == 1 ? centroids[t].y : centroids[t].z;
+			int side = value < middle ? 0 : 1;
+			unsigned int first = piece.triangles[t] * 3;
+			sides[side].push_back(piece.triangles[t]);
+			sidePoints[side].push_back(vertices[indices[first]].Position);
+			sidePoints[side].push_back(vertices[indices[first + 1]].Position);
+			sidePoints[side].push_back(vertices[indices[first + 2]].Position);
+		}
+		if (sides[0].empty() || sides[1].empty())
+			continue;
+
+		ConvexHull hulls[2];
+		if (!hulls[0].Build(sidePoints[0], maxVertices) || !hulls[1].Build(sidePoints[1], maxVertices))
+			continue;
+
+		float savings = 1.0f - (hulls[0].GetVolume() + hulls[1].GetVolume()) / piece.volume;
+		if (savings > piece.savings)
+		{
+			piece.savings = savings;
+			for (int s = 0; s < 2; s++)
+			{
+				piece.splitTriangles[s].swap(sides[s]);
+				piece.splitHulls[s] = hulls[s];
+			}
+		}
+	}
+}
+
+void ConvexHull::Decompose(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+	int maxHulls, int maxVertices, std::vector<ConvexHull>& hulls)
+{
+	hulls.clear();
+	if (indices.size() < 3)
+		return;
+
+	// Starts with one piece holding the whole mesh
+	std::vector<HullPiece> pieces(1);
+	std::vector<XMFLOAT3> points(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+		points[i] = vertices[indices[i]].Position;
+	pieces[0].triangles.resize(indices.size() / 3);
+	for (unsigned int t = 0; t < pieces[0].triangles.size(); t++)
+		pieces[0].triangles[t] = t;
+	if (!pieces[0].hull.Build(points, maxVertices))
+		return;
+	pieces[0].volume = pieces[0].hull.GetVolume();
+	if (maxHulls > 1)
+		FindBestSplit(vertices, indices, maxVertices, pieces[0]);
+
+	// Repeatedly splits whichever piece gains the most, while the budget lasts
+	while ((int)pieces.size() < maxHulls)
+	{
+		size_t best = SIZE_MAX;
+		float bestSavings = HULL_SPLIT_MIN_SAVINGS;
+		for (size_t i = 0; i < pieces.size(); i++)
+		{
+			if (pieces[i].savings > bestSavings)
+			{
+				bestSavings = pieces[i].savings;
+				best = i;
+			}
+		}
+		if (best == SIZE_MAX)
+			break;
+
+		HullPiece halves[2];
+		for (int s = 0; s < 2; s++)
+		{
+			halves[s].triangles.swap(pieces[best].splitTriangles[s]);
+			halves[s].hull = pieces[best].splitHulls[s];
+			halves[s].volume = halves[s].hull.GetVolume();
+			FindBestSplit(vertices, indices, maxVertices, halves[s]);
+		}
+		pieces[best] = halves[0];
+		pieces.push_back(halves[1]);
+	}
+
+	for (size_t i = 0; i < pieces.size(); i++)
+		hulls.push_back(pieces[i].hull);
+}
+
+void ConvexHull::Write(const std::vector<ConvexHull>& hulls, MeshCacheWriter& writer)
+{
+	if (hulls.empty())
+		return;
+
+	// Per hull counts, then every hull's data back to back
+	std::vector<unsigned int> counts;
+	std::vector<XMFLOAT3> allVertices;
+	std::vector<unsigned int> allIndices;
+	std::vector<XMFLOAT4> allPlanes;
+	for (size_t h = 0; h < hulls.size(); h++)
+	{
+		const ConvexHull& hull = hulls[h];
+		counts.push_back((unsigned int)hull.vertices.size());
+		counts.push_back((unsigned int)hull.indices.size());
+		counts.push_back((unsigned int)hull.planes.size());
+		allVertices.insert(allVertices.end(), hull.vertices.begin(), hull.vertices.end());
+		allIndices.insert(allIndices.end(), hull.indices.begin(), hull.indices.end());
+		allPlanes.insert(allPlanes.end(), hull.planes.begin(), hull.planes.end());
+	}
+
+	writer.AddChunk(MESH_CHUNK_HULL_COUNTS, counts.data(), counts.size() * sizeof(unsigned int), MESH_ENCODING_LZ);
+	writer.AddChunk(MESH_CHUNK_HULL_VERTICES, allVertices.data(), allVertices.size() * sizeof(XMFLOAT3),
+		MESH_ENCODING_BYTE_PLANES, sizeof(XMFLOAT3));
+	writer.AddChunk(MESH_CHUNK_HULL_INDICES, allIndices.data(), allIndices.size() * sizeof(unsigned int),
+		MESH_ENCODING_LZ);
+	writer.AddChunk(MESH_CHUNK_HULL_PLANES, allPlanes.data(), allPlanes.size() * sizeof(XMFLOAT4),
+		MESH_ENCODING_BYTE_PLANES, sizeof(XMFLOAT4));
+}
+
+bool ConvexHull::Read(MeshCache& cache, std::vector<ConvexHull>& hulls)
+{
+	hulls.clear();
+	const MeshCacheChunk* countChunk = cache.FindChunk(MESH_CHUNK_HULL_COUNTS);
+	const MeshCacheChunk* vertexChunk = cache.FindChunk(MESH_CHUNK_HULL_VERTICES);
+	const MeshCacheChunk* indexChunk = cache.FindChunk(MESH_CHUNK_HULL_INDICES);
+	const MeshCacheChunk* planeChunk = cache.FindChunk(MESH_CHUNK_HULL_PLANES);
+	if (!countChunk || !vertexChunk || !indexChunk || !planeChunk)
+		return false;
+	if (countChunk->rawSize == 0 || countChunk->rawSize % (sizeof(unsigned int) * 3) != 0 ||
+		vertexChunk->rawSize % sizeof(XMFLOAT3) != 0 || indexChunk->rawSize % sizeof(unsigned int) != 0 ||
+		planeChunk->rawSize % sizeof(XMFLOAT4) != 0)
+		return false;
+
+	std::vector<unsigned int> counts((size_t)(countChunk->rawSize / sizeof(unsigned int)));
+	std::vector<XMFLOAT3> allVertices((size_t)(vertexChunk->rawSize / sizeof(XMFLOAT3)));
+	std::vector<unsigned int> allIndices((size_t)(indexChunk->rawSize / sizeof(unsigned int)));
+	std::vector<XMFLOAT4> allPlanes((size_t)(planeChunk->rawSize / sizeof(XMFLOAT4)));
+	if (!cache.ReadChunk(countChunk, counts.data()) || !cache.ReadChunk(vertexChunk, allVertices.data()) ||
+		!cache.ReadChunk(indexChunk, allIndices.data()) || !cache.ReadChunk(planeChunk, allPlanes.data()))
+		return false;
+
+	// Slices the shared arrays back into hulls, checking every range
+	size_t vertexStart = 0, indexStart = 0, planeStart = 0;
+	for (size_t h = 0; h < counts.size(); h += 3)
+	{
+		size_t vertexCount = counts[h], indexCount = counts[h + 1], planeCount = counts[h + 2];
+		if (vertexCount > allVertices.size() - vertexStart || indexCount > allIndices.size() - indexStart ||
+			planeCount > allPlanes.size() - planeStart || indexCount % 3 != 0)
+		{
+			hulls.clear();
+			return false;
+		}
+
+		ConvexHull hull;
+		hull.vertices.assign(allVertices.begin() + vertexStart, allVertices.begin() + vertexStart + vertexCount);
+		hull.indices.assign(allIndices.begin() + indexStart, allIndices.begin() + indexStart + indexCount);
+		hull.planes.assign(allPlanes.begin() + planeStart, allPlanes.begin() + planeStart + planeCount);
+		for (size_t i = 0; i < hull.indices.size(); i++)
+		{
+			if (hull.indices[i] >= vertexCount)
+			{
+				hulls.clear();
+				return false;
+			}
+		}
+		hulls.push_back(hull);
+		vertexStart += vertexCount;
+		indexStart += indexCount;
+		planeStart += planeCount;
+	}
+	return true;
+}
+
+float ConvexHull::GetDistance(XMFLOAT3 point)
+{
+	float distance = -FLT_MAX;
+	for (size_t p = 0; p < planes.size(); p++)
+	{
+		float planeDistance = planes[p].x * point.x + planes[p].y * point.y + planes[p].z * point.z - planes[p].w;
+		if (planeDistance > distance)
+			distance = planeDistance;
+	}
+	return distance;
+}
+
+bool ConvexHull::IntersectsSphere(XMFLOAT3 center, float radius)
+{
+	return !planes.empty() && GetDistance(center) <= radius;
+}
+
+float ConvexHull::GetVolume()
+{
+	// Sum of the tetrahedra from the origin to each face
+	float volume = 0;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const XMFLOAT3& a = vertices[indices[i]];
+		const XMFLOAT3& b = vertices[indices[i + 1]];
+		const XMFLOAT3& c = vertices[indices[i + 2]];
+		volume += Dot(a, Cross(b, c));
+	}
+	return volume / 6.0f;
+}
+
+bool ConvexHull::IsEmpty() { return planes.empty(); }
+
+const std::vector<XMFLOAT3>& ConvexHull::GetVertices() { return vertices; }
+
+const std::vector<unsigned int>& ConvexHull::GetIndices() { return indices; }
+
+const std::vector<XMFLOAT4>& ConvexHull::GetPlanes() { return planes; }
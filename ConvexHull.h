@@ -0,0 +1,55 @@
+#pragma once
+#include "Vertex.h"
+
+#include <DirectXMath.h>
+#include <vector>
+
+class MeshCache;
+class MeshCacheWriter;
+
+// --------------------------------------------------------
+// A convex collision proxy: a handful of vertices and the
+// planes bounding them, so physics and camera collision
+// test a few dozen planes instead of every render triangle.
+//
+// Built with quickhull, which adds the farthest outside
+// point each step, so stopping at a vertex limit keeps the
+// most important corners. The planes are then pushed out
+// to enclose every source point, keeping the proxy
+// conservative even when the vertex limit was hit.
+// --------------------------------------------------------
+class ConvexHull
+{
+private:
+	std::vector<DirectX::XMFLOAT3> vertices;
+	std::vector<unsigned int> indices;		// Outward facing triangles
+	std::vector<DirectX::XMFLOAT4> planes;	// Unit normal in xyz, inside where dot(normal, p) <= w
+
+public:
+	ConvexHull();
+
+	// Builds the hull of a point cloud with at most maxVertices corners (4 or more).
+	// Flat input is given a little thickness; returns false if it's a line or a point.
+	bool Build(const std::vector<DirectX::XMFLOAT3>& points, int maxVertices = 32);
+
+	// Splits a concave mesh into up to maxHulls hulls, splitting pieces for as
+	// long as that shrinks the total hull volume noticeably
+	static void Decompose(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+		int maxHulls, int maxVertices, std::vector<ConvexHull>& hulls);
+
+	// Saves a mesh's hulls into and loads them from a mesh cache
+	static void Write(const std::vector<ConvexHull>& hulls, MeshCacheWriter& writer);
+	static bool Read(MeshCache& cache, std::vector<ConvexHull>& hulls);
+
+	// Largest plane distance of a point: positive outside, negative inside
+	float GetDistance(DirectX::XMFLOAT3 point);
+
+	// Conservative sphere test against the planes
+	bool IntersectsSphere(DirectX::XMFLOAT3 center, float radius);
+
+	float GetVolume();
+	bool IsEmpty();
+	const std::vector<DirectX::XMFLOAT3>& GetVertices();
+	const std::vector<unsigned int>& GetIndices();
+	const std::vector<DirectX::XMFLOAT4>& GetPlanes();
+};
@@ -3,46 +3,60 @@
 Entity::Entity(Transform transform, std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material)
 {
 	this->transform = transform;
-	this->mesh = mesh;
-	this->material = material;
+	this->mesh = Resources::GetInstance().GetMeshes().Add(mesh);
+	this->materials.push_back(Resources::GetInstance().GetMaterials().Add(material));
 }
 
-void Entity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
-	std::shared_ptr<Camera> camera, float totalTime,
-	DirectX::XMFLOAT3 ambientColor, std::vector<Light> lights)
+Entity::Entity(Transform transform, std::shared_ptr<Mesh> mesh, std::vector<std::shared_ptr<Material>> materials)
 {
-	// Sets the appropriate shaders
-	material->GetVertexShader()->SetShader();
-	material->GetPixelShader()->SetShader();
-
-	// Creates a struct to represent the data to put in the vertex constant buffer
-	std::shared_ptr<SimpleVertexShader> vs = material->GetVertexShader();
-	vs->SetMatrix4x4("worldMatrix", transform.GetWorldMatrix());
-	vs->SetMatrix4x4("worldInvMatrix", transform.GetworldInverseTransposeMatrix());
-	vs->SetMatrix4x4("viewMatrix", camera->GetViewMatrix());
-	vs->SetMatrix4x4("projectionMatrix", camera->GetProjectionMatrix()); 
-
-	// Creates a struct to represent the data to put in the pixel constant buffer
-	std::shared_ptr<SimplePixelShader> ps = material->GetPixelShader();
-	material->PrepareMaterial(ps);
-	ps->SetFloat4("colorTint", material->GetColorTint());
-	ps->SetFloat("totalTime", totalTime);
-	ps->SetFloat3("cameraPos", camera->GetTransform()->GetPosition());
-	ps->SetFloat3("ambient", ambientColor);
-	ps->SetData("lights", &lights[0], sizeof(Light) * (int)lights.size());
-
-	// Copies the data to the constant buffer
-	vs->CopyAllBufferData();
-	ps->CopyAllBufferData();
-
-	// Draws mesh
-	mesh->Draw(context);
+	this->transform = transform;
+	this->mesh = Resources::GetInstance().GetMeshes().Add(mesh);
+	for (std::shared_ptr<Material> material : materials)
+		this->materials.push_back(Resources::GetInstance().GetMaterials().Add(material));
+
+	// Slot 0 always exists, so everything below can fall back to it
+	if (this->materials.empty())
+		this->materials.push_back(MaterialHandle());
 }
 
-std::shared_ptr<Mesh> Entity::GetMesh() { return mesh; }
+Entity::Entity(Transform transform, MeshHandle mesh, MaterialHandle material)
+{
+	this->transform = transform;
+	this->mesh = mesh;
+	this->materials.push_back(material);
+}
+
+std::shared_ptr<Mesh> Entity::GetMesh() { return Resources::GetInstance().GetMeshes().GetShared(mesh); }
+
+MeshHandle Entity::GetMeshHandle() { return mesh; }
 
 Transform* Entity::GetTransform(){ return &transform; }
 
-std::shared_ptr<Material> Entity::GetMaterial(){ return material; }
+std::shared_ptr<Material> Entity::GetMaterial(){ return Resources::GetInstance().GetMaterials().GetShared(materials[0]); }
+
+std::shared_ptr<Material> Entity::GetMaterial(int slot)
+{
+	return Resources::GetInstance().GetMaterials().GetShared(GetMaterialHandle(slot));
+}
+
+MaterialHandle Entity::GetMaterialHandle(int slot)
+{
+	return slot >= 0 && slot < (int)materials.size() ? materials[slot] : materials[0];
+}
+
+int Entity::GetMaterialCount() { return (int)materials.size(); }
+
+void Entity::SetMaterial(std::shared_ptr<Material> material) { materials[0] = Resources::GetInstance().GetMaterials().Add(material); }
+
+void Entity::SetMaterial(int slot, std::shared_ptr<Material> material)
+{
+	if (slot < 0)
+		return;
+	if (slot >= (int)materials.size())
+		materials.resize(slot + 1, materials[0]);
+	materials[slot] = Resources::GetInstance().GetMaterials().Add(material);
+}
+
+bool Entity::IsStatic() { return transform.IsStatic(); }
 
-void Entity::SetMaterial(std::shared_ptr<Material> material) { this->material = material; }
+void Entity::SetStatic(bool isStatic) { transform.SetStatic(isStatic); }
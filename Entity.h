@@ -4,28 +4,44 @@
 #include "Camera.h"
 #include "Material.h"
 #include "Lights.h"
+#include "Resources.h"
 #include <memory>
+#include <vector>
 
 class Entity
 {
 private:
 	Transform transform;
-	std::shared_ptr<Mesh> mesh;
-	std::shared_ptr<Material> material;
+	MeshHandle mesh;						// Into the Resources pools
+	std::vector<MaterialHandle> materials;	// One per mesh material slot
+
 public:
-	// Ctor
+	// Ctor (adds the mesh and material to the Resources pools if they aren't yet)
 	Entity(Transform transform, std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material);
 
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
-		std::shared_ptr<Camera> camera, float totalTime,
-		DirectX::XMFLOAT3 ambientColor, std::vector<Light> lights);
+	// Ctor for meshes with several material slots (an empty list leaves
+	// slot 0 null, so nothing is drawn until a material is set)
+	Entity(Transform transform, std::shared_ptr<Mesh> mesh, std::vector<std::shared_ptr<Material>> materials);
+
+	// Ctor for what's already pooled
+	Entity(Transform transform, MeshHandle mesh, MaterialHandle material);
 
 	// Getters and setters
 	std::shared_ptr<Mesh> GetMesh();
+	MeshHandle GetMeshHandle();
 
 	Transform* GetTransform();
 
+	// Slot 0 is used for any mesh slot that has no material of its own
 	std::shared_ptr<Material> GetMaterial();
+	std::shared_ptr<Material> GetMaterial(int slot);
+	MaterialHandle GetMaterialHandle(int slot);
+	int GetMaterialCount();
 	void SetMaterial(std::shared_ptr<Material> material);
+	void SetMaterial(int slot, std::shared_ptr<Material> material);
+
+	// Never moves, so it can be baked into a static batch (kept on the transform)
+	bool IsStatic();
+	void SetStatic(bool isStatic);
 };
 
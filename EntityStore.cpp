@@ -0,0 +1,275 @@
+#include "EntityStore.h"
+
+#include <cstring>
+#include <mutex>
+
+// Sizes of every registered component type, by type number
+static std::vector<size_t> componentSizes;
+static std::mutex componentMutex;
+
+int EntityStore::RegisterComponentType(size_t size)
+{
+	std::lock_guard<std::mutex> lock(componentMutex);
+	componentSizes.push_back(size);
+	return (int)componentSizes.size() - 1;
+}
+
+size_t EntityStore::GetComponentSize(int type)
+{
+	std::lock_guard<std::mutex> lock(componentMutex);
+	return componentSizes[type];
+}
+
+EntityStore::EntityStore()
+	: count(0)
+{
+}
+
+int EntityStore::GetCount() { return count; }
+
+int EntityStore::GetArchetypeCount() { return (int)archetypes.size(); }
+
+EntityId EntityStore::Create()
+{
+	// Reuses a dead entity's index when there is one
+	unsigned int index;
+	if (!freeIndices.empty())
+	{
+		index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		if (records.size() > HANDLE_INDEX_MASK)
+			return EntityId();
+
+		index = (unsigned int)records.size();
+		records.push_back({ -1, 0, 0, 1, false });
+	}
+
+	EntityRecord& record = records[index];
+	record.archetype = -1;
+	record.alive = true;
+
+	EntityId id = EntityId::Make(index, record.generation);
+	QueueCommand(COMMAND_CREATE, id, 0, 0, 0);
+	return id;
+}
+
+void EntityStore::Destroy(EntityId id)
+{
+	QueueCommand(COMMAND_DESTROY, id, 0, 0, 0);
+}
+
+bool EntityStore::IsAlive(EntityId id)
+{
+	unsigned int index = id.GetIndex();
+	return index < records.size() && records[index].alive && records[index].generation == id.GetGeneration();
+}
+
+void EntityStore::Flush()
+{
+	// Commands for the same entity tend to come together (create, then
+	// each component), so each run of them is folded into one move
+	size_t i = 0;
+	while (i < commands.size())
+	{
+		EntityId id = commands[i].id;
+		size_t runEnd = i;
+		while (runEnd < commands.size() && commands[runEnd].id == id)
+			runEnd++;
+
+		if (!IsAlive(id))
+		{
+			i = runEnd;
+			continue;
+		}
+
+		EntityRecord& record = records[id.GetIndex()];
+		unsigned int mask = record.archetype >= 0 ? archetypes[record.archetype].mask : 0;
+		bool created = record.archetype >= 0;
+		bool destroyed = false;
+		for (size_t c = i; c < runEnd; c++)
+		{
+			switch (commands[c].type)
+			{
+			case COMMAND_CREATE: created = true; break;
+			case COMMAND_DESTROY: destroyed = true; break;
+			case COMMAND_ADD: mask |= 1u << commands[c].component; break;
+			case COMMAND_REMOVE: mask &= ~(1u << commands[c].component); break;
+			}
+		}
+
+		if (destroyed)
+		{
+			// Bumping the generation is what makes old ids stop matching
+			if (record.archetype >= 0)
+			{
+				RemoveRow(record.archetype, record.chunk, record.row);
+				count--;
+			}
+			record.archetype = -1;
+			record.alive = false;
+			record.generation = NextHandleGeneration(record.generation);
+			freeIndices.push_back(id.GetIndex());
+		}
+		else if (created)
+		{
+			if (record.archetype < 0)
+				count++;
+			MoveEntity(id, mask);
+
+			// Later values win when a component was added more than once
+			Archetype& archetype = archetypes[record.archetype];
+			Chunk& chunk = archetype.chunks[record.chunk];
+			for (size_t c = i; c < runEnd; c++)
+			{
+				const Command& command = commands[c];
+				size_t size = archetype.sizes[command.component];
+				if (command.type == COMMAND_ADD && size > 0)
+					memcpy(GetComponent(archetype, chunk, command.component, record.row), &commandData[command.dataOffset], size);
+			}
+		}
+
+		i = runEnd;
+	}
+
+	commands.clear();
+	commandData.clear();
+}
+
+int EntityStore::GetArchetype(unsigned int mask)
+{
+	std::unordered_map<unsigned int, int>::iterator existing = archetypeIndices.find(mask);
+	if (existing != archetypeIndices.end())
+		return existing->second;
+
+	Archetype archetype;
+	archetype.mask = mask;
+
+	// Bytes per entity, plus room to align the start of each array
+	size_t entityBytes = sizeof(EntityId);
+	size_t alignmentSlack = alignof(std::max_align_t);
+	for (int type = 0; type < ENTITY_STORE_MAX_COMPONENTS; type++)
+	{
+		if (mask & (1u << type))
+		{
+			entityBytes += GetComponentSize(type);
+			alignmentSlack += alignof(std::max_align_t);
+		}
+	}
+	archetype.capacity = (int)((ENTITY_STORE_CHUNK_BYTES - alignmentSlack) / entityBytes);
+	if (archetype.capacity < 1)
+		archetype.capacity = 1;
+
+	// Lays out the arrays one after another, each starting aligned
+	size_t offset = sizeof(EntityId) * archetype.capacity;
+	for (int type = 0; type < ENTITY_STORE_MAX_COMPONENTS; type++)
+	{
+		archetype.offsets[type] = 0;
+		archetype.sizes[type] = 0;
+		if (!(mask & (1u << type)))
+			continue;
+
+		offset = (offset + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+		archetype.offsets[type] = offset;
+		archetype.sizes[type] = GetComponentSize(type);
+		offset += archetype.sizes[type] * archetype.capacity;
+	}
+	archetype.chunkBytes = offset;
+
+	archetypes.push_back(std::move(archetype));
+	archetypeIndices[mask] = (int)archetypes.size() - 1;
+	return (int)archetypes.size() - 1;
+}
+
+EntityId* EntityStore::GetIds(Archetype& archetype, Chunk& chunk)
+{
+	return (EntityId*)chunk.data.get();
+}
+
+unsigned char* EntityStore::GetComponent(Archetype& archetype, Chunk& chunk, int type, int row)
+{
+	return chunk.data.get() + archetype.offsets[type] + archetype.sizes[type] * row;
+}
+
+void EntityStore::MoveEntity(EntityId id, unsigned int mask)
+{
+	// Looked up first, since adding an archetype can move the others
+	int target = GetArchetype(mask);
+	EntityRecord& record = records[id.GetIndex()];
+	if (record.archetype == target)
+		return;
+
+	// Appends to the last chunk, starting a new one when it's full
+	Archetype& to = archetypes[target];
+	if (to.chunks.empty() || to.chunks.back().count == to.capacity)
+	{
+		Chunk chunk;
+		chunk.data.reset(new unsigned char[to.chunkBytes]);
+		chunk.count = 0;
+		to.chunks.push_back(std::move(chunk));
+	}
+	int toChunk = (int)to.chunks.size() - 1;
+	int toRow = to.chunks[toChunk].count++;
+	GetIds(to, to.chunks[toChunk])[toRow] = id;
+
+	if (record.archetype >= 0)
+	{
+		Archetype& from = archetypes[record.archetype];
+		for (int type = 0; type < ENTITY_STORE_MAX_COMPONENTS; type++)
+		{
+			if ((from.mask & (1u << type)) && to.sizes[type] > 0)
+			{
+				memcpy(GetComponent(to, to.chunks[toChunk], type, toRow),
+					GetComponent(from, from.chunks[record.chunk], type, record.row), to.sizes[type]);
+			}
+		}
+		RemoveRow(record.archetype, record.chunk, record.row);
+	}
+
+	record.archetype = target;
+	record.chunk = toChunk;
+	record.row = toRow;
+}
+
+void EntityStore::RemoveRow(int archetypeIndex, int chunkIndex, int row)
+{
+	Archetype& archetype = archetypes[archetypeIndex];
+	int lastChunk = (int)archetype.chunks.size() - 1;
+	int lastRow = archetype.chunks[lastChunk].count - 1;
+
+	// Keeps every chunk but the last one full
+	if (lastChunk != chunkIndex || lastRow != row)
+	{
+		Chunk& chunk = archetype.chunks[chunkIndex];
+		Chunk& last = archetype.chunks[lastChunk];
+		EntityId moved = GetIds(archetype, last)[lastRow];
+		GetIds(archetype, chunk)[row] = moved;
+		for (int type = 0; type < ENTITY_STORE_MAX_COMPONENTS; type++)
+		{
+			if (archetype.sizes[type] > 0)
+			{
+				memcpy(GetComponent(archetype, chunk, type, row),
+					GetComponent(archetype, last, type, lastRow), archetype.sizes[type]);
+			}
+		}
+
+		records[moved.GetIndex()].chunk = chunkIndex;
+		records[moved.GetIndex()].row = row;
+	}
+
+	if (--archetype.chunks[lastChunk].count == 0)
+		archetype.chunks.pop_back();
+}
+
+void EntityStore::QueueCommand(CommandType type, EntityId id, int component, const void* data, size_t size)
+{
+	Command command = { type, id, component, commandData.size() };
+	commands.push_back(command);
+	if (size > 0)
+	{
+		commandData.resize(commandData.size() + size);
+		memcpy(&commandData[command.dataOffset], data, size);
+	}
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include "Handle.h"
+#include "JobSystem.h"
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Target size of one chunk of an archetype's entities
+#define ENTITY_STORE_CHUNK_BYTES 16384
+
+// Component types are bits in a 32 bit mask
+#define ENTITY_STORE_MAX_COMPONENTS 32
+
+// Below this many matching chunks, parallel queries just run on the calling thread
+#define ENTITY_STORE_PARALLEL_MIN_CHUNKS 4
+
+// A generational handle like the resource ones, so an id kept after its
+// entity is destroyed never refers to whatever reuses the index
+class EntityStore;
+typedef Handle<EntityStore> EntityId;
+
+// --------------------------------------------------------
+// Entities and their components, grouped by archetype (the
+// exact set of components an entity has). Each archetype
+// keeps its entities in fixed size chunks holding one
+// tightly packed array per component, so a query walks
+// straight through memory instead of chasing pointers.
+//
+// Components are plain structs (trivially copyable, since
+// they're moved around with memcpy); empty structs work as
+// tags that take no space. Creating, destroying, adding
+// and removing only queue the change, which is applied by
+// Flush, so queries never see the layout shift under them.
+// --------------------------------------------------------
+class EntityStore
+{
+private:
+	struct Chunk
+	{
+		std::unique_ptr<unsigned char[]> data;	// Ids first, then one array per component
+		int count;
+	};
+
+	struct Archetype
+	{
+		unsigned int mask;
+		int capacity;								// Entities per chunk
+		size_t chunkBytes;
+		size_t offsets[ENTITY_STORE_MAX_COMPONENTS];	// Of each component's array in a chunk
+		size_t sizes[ENTITY_STORE_MAX_COMPONENTS];		// Zero for tags and missing components
+		std::vector<Chunk> chunks;					// All full but the last
+	};
+
+	// Where an entity lives (archetype -1 until its creation is flushed)
+	struct EntityRecord
+	{
+		int archetype;
+		int chunk;
+		int row;
+		unsigned int generation;
+		bool alive;
+	};
+
+	enum CommandType { COMMAND_CREATE, COMMAND_DESTROY, COMMAND_ADD, COMMAND_REMOVE };
+
+	struct Command
+	{
+		CommandType type;
+		EntityId id;
+		int component;
+		size_t dataOffset;	// Of the added value in commandData
+	};
+
+	std::vector<Archetype> archetypes;
+	std::unordered_map<unsigned int, int> archetypeIndices;
+	std::vector<EntityRecord> records;
+	std::vector<unsigned int> freeIndices;
+	std::vector<Command> commands;
+	std::vector<unsigned char> commandData;
+	int count;
+
+	// Component types are numbered the first time each is used
+	static int RegisterComponentType(size_t size);
+	static size_t GetComponentSize(int type);
+
+	int GetArchetype(unsigned int mask);
+	static EntityId* GetIds(Archetype& archetype, Chunk& chunk);
+	static unsigned char* GetComponent(Archetype& archetype, Chunk& chunk, int type, int row);
+
+	// Moves a live entity into another archetype, keeping the components both have
+	void MoveEntity(EntityId id, unsigned int mask);
+
+	// Fills a hole by moving the archetype's last entity into it
+	void RemoveRow(int archetype, int chunk, int row);
+
+	void QueueCommand(CommandType type, EntityId id, int component, const void* data, size_t size);
+
+public:
+	EntityStore();
+
+	// Number of entities whose creation has been flushed
+	int GetCount();
+	int GetArchetypeCount();
+
+	// Reserves an id now; the entity shows up in queries after the next Flush.
+	// Returns a null id once every index is in use.
+	EntityId Create();
+	void Destroy(EntityId id);
+
+	// Alive from Create until its Destroy is flushed
+	bool IsAlive(EntityId id);
+
+	// Applies every queued change, moving each entity between
+	// archetypes at most once however many changes it had
+	void Flush();
+
+	// Gets the bit of a component type, for the masks queries can exclude
+	template<typename T> static int GetComponentType()
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Components are moved with memcpy");
+		static_assert(alignof(T) <= alignof(std::max_align_t), "Chunks are only aligned for fundamental types");
+		static const int type = RegisterComponentType(std::is_empty<T>::value ? 0 : sizeof(T));
+		return type;
+	}
+
+	template<typename... T> static unsigned int GetMask()
+	{
+		unsigned int bits[] = { 0u, (1u << GetComponentType<T>())... };
+		unsigned int mask = 0;
+		for (unsigned int bit : bits)
+			mask |= bit;
+		return mask;
+	}
+
+	// Queues adding (or overwriting) a component
+	template<typename T> void Add(EntityId id, const T& component)
+	{
+		QueueCommand(COMMAND_ADD, id, GetComponentType<T>(), &component, std::is_empty<T>::value ? 0 : sizeof(T));
+	}
+
+	template<typename T> void Remove(EntityId id)
+	{
+		QueueCommand(COMMAND_REMOVE, id, GetComponentType<T>(), 0, 0);
+	}
+
+	// Null if the entity doesn't have the component (yet), or for tags
+	template<typename T> T* Get(EntityId id)
+	{
+		if (!IsAlive(id) || records[id.GetIndex()].archetype < 0)
+			return 0;
+
+		EntityRecord& record = records[id.GetIndex()];
+		Archetype& archetype = archetypes[record.archetype];
+		int type = GetComponentType<T>();
+		if (archetype.sizes[type] == 0)
+			return 0;
+		return (T*)GetComponent(archetype, archetype.chunks[record.chunk], type, record.row);
+	}
+
+	template<typename T> bool Has(EntityId id)
+	{
+		return IsAlive(id) && records[id.GetIndex()].archetype >= 0 &&
+			(archetypes[records[id.GetIndex()].archetype].mask & (1u << GetComponentType<T>())) != 0;
+	}
+
+	// Calls func(count, ids, T* arrays...) once per chunk of every archetype
+	// that has all of T and none of the excluded components
+	template<typename... T, typename F> void ForEachChunk(F func, unsigned int excludeMask = 0)
+	{
+		unsigned int mask = GetMask<T...>();
+		for (Archetype& archetype : archetypes)
+		{
+			if ((archetype.mask & mask) != mask || (archetype.mask & excludeMask))
+				continue;
+
+			for (Chunk& chunk : archetype.chunks)
+				func(chunk.count, GetIds(archetype, chunk), (T*)GetComponent(archetype, chunk, GetComponentType<T>(), 0)...);
+		}
+	}
+
+	// Calls func(id, T&...) for every matching entity
+	template<typename... T, typename F> void ForEach(F func, unsigned int excludeMask = 0)
+	{
+		ForEachChunk<T...>([&func](int count, EntityId* ids, T*... components)
+		{
+			for (int i = 0; i < count; i++)
+				func(ids[i], components[i]...);
+		}, excludeMask);
+	}
+
+	// Same, but with the matching chunks spread over the JobSystem's threads,
+	// so func must only touch the entity it's given
+	template<typename... T, typename F> void ParallelForEach(F func, unsigned int excludeMask = 0)
+	{
+		unsigned int mask = GetMask<T...>();
+		std::vector<std::pair<Archetype*, Chunk*>> matching;
+		for (Archetype& archetype : archetypes)
+		{
+			if ((archetype.mask & mask) != mask || (archetype.mask & excludeMask))
+				continue;
+			for (Chunk& chunk : archetype.chunks)
+				matching.push_back(std::make_pair(&archetype, &chunk));
+		}
+
+		auto runChunks = [&func, &matching](size_t first, size_t last)
+		{
+			auto runChunk = [&func](int count, EntityId* ids, T*... components)
+			{
+				for (int i = 0; i < count; i++)
+					func(ids[i], components[i]...);
+			};
+
+			for (size_t c = first; c < last; c++)
+			{
+				Archetype& archetype = *matching[c].first;
+				Chunk& chunk = *matching[c].second;
+				runChunk(chunk.count, GetIds(archetype, chunk), (T*)GetComponent(archetype, chunk, GetComponentType<T>(), 0)...);
+			}
+		};
+
+		if (matching.size() < ENTITY_STORE_PARALLEL_MIN_CHUNKS)
+		{
+			runChunks(0, matching.size());
+			return;
+		}
+
+		// A chunk per piece, so no two threads share one
+		JobSystem::GetInstance().ParallelFor(matching.size(), 1, runChunks);
+	}
+};
+
@@ -2,6 +2,7 @@
 #include "Vertex.h"
 #include "Input.h"
 #include "WICTextureLoader.h"
+#include "Benchmark.h"
 
 // Needed for a helper function to read compiled shader files from the hard drive
 #pragma comment(lib, "d3dcompiler.lib")
@@ -10,6 +11,41 @@
 // For the DirectX Math library
 using namespace DirectX;
 
+// Copies a transform's world matrices into its component if they were
+// rebuilt since the last copy
+static void SyncTransform(TransformComponent& transform)
+{
+	transform.transform->UpdateMatrices();
+	if (transform.transform->GetVersion() == transform.version)
+		return;
+
+	transform.worldMatrix = transform.transform->GetWorldMatrix();
+	transform.worldInverseTransposeMatrix = transform.transform->GetworldInverseTransposeMatrix();
+	transform.version = transform.transform->GetVersion();
+}
+
+// Refits a renderable's world box if its transform moved since the last fit
+// (the local box's center moved by the matrix, its extents by the absolute
+// value of the matrix)
+static void FitBounds(const TransformComponent& transform, BoundsComponent& bounds)
+{
+	if (transform.version == bounds.transformVersion)
+		return;
+
+	XMMATRIX worldMat = XMLoadFloat4x4(&transform.worldMatrix);
+	XMVECTOR localMin = XMLoadFloat3(&bounds.localMin);
+	XMVECTOR localMax = XMLoadFloat3(&bounds.localMax);
+	XMVECTOR center = XMVector3Transform((localMin + localMax) * 0.5f, worldMat);
+	XMVECTOR extents = (localMax - localMin) * 0.5f;
+	extents =
+		XMVectorAbs(worldMat.r[0]) * XMVectorSplatX(extents) +
+		XMVectorAbs(worldMat.r[1]) * XMVectorSplatY(extents) +
+		XMVectorAbs(worldMat.r[2]) * XMVectorSplatZ(extents);
+	XMStoreFloat3(&bounds.boundsMin, center - extents);
+	XMStoreFloat3(&bounds.boundsMax, center + extents);
+	bounds.transformVersion = transform.version;
+}
+
 // --------------------------------------------------------
 // Constructor
 //
@@ -33,7 +69,10 @@ Game::Game(HINSTANCE hInstance)
 	bloomLevels(5),
 	bloomThreshold(1.0f),
 	bloomLevelIntensities{ 1,1,1,1,1 },
-	drawBloomTextures(true)
+	drawBloomTextures(true),
+	staticBatchesBuilt(false),
+	bakedStaticVersion(0),
+	pickedEntity(-1)
 {
 #if defined(DEBUG) || defined(_DEBUG)
 	// Do we want a console window?  Probably only in debug mode
@@ -58,6 +97,16 @@ Game::~Game()
 	// - If we weren't using smart pointers, we'd need
 	//   to call Release() on each DirectX object created in Game
 
+	// Stops any mesh streaming still in flight
+	delete& MeshStreamer::GetInstance();
+	delete& MeshResidency::GetInstance();
+
+	// The batches give their meshes back to the pools as they go
+	staticBatches.clear();
+	delete& Resources::GetInstance();
+
+	// Nothing else runs jobs by now
+	delete& JobSystem::GetInstance();
 }
 
 // --------------------------------------------------------
@@ -73,7 +122,9 @@ void Game::Init()
 
 	LoadAssetsAndCreateEntities();
 
-	GenerateLights();
+#ifdef RUN_BENCHMARKS
+	Benchmark::Run(meshes, entities);
+#endif
 
 	// Create post process resources
 	ResizeAllPostProcessResources();
@@ -169,55 +220,75 @@ void Game::LoadTextures(std::wstring fileName)
 }
 
 
-// --------------------------------------------------------
-// Loads all necessary assets and creates various entities
-// --------------------------------------------------------
-void Game::LoadAssetsAndCreateEntities()
+// Loads a model from its binary mesh cache, rebuilding the cache
+// from the .obj when it's missing or older than the .obj.
+// Cached models stream in, so this returns quickly for them.
+// Concave models can ask for more than one collision hull.
+void Game::LoadMesh(std::string fileName, int maxCollisionHulls)
 {
-	// Loads textures
-	// Bronze
-	LoadTextures(L"cobblestone");
-
-	// Wood
-	LoadTextures(L"wood");
-
-	// Cobblestone
-	LoadTextures(L"bronze");
-
-	// Floor
-	LoadTextures(L"floor");
-
-	// Paint
-	LoadTextures(L"rough");
-
-	// Scratched metal
-	LoadTextures(L"scratched");
-
-	// Rough
-	LoadTextures(L"paint");
-
-	// Arcade room
-	LoadTextures(L"arcade_room");
-
-	// Counter
-	LoadTextures(L"counter");
+	std::string objPath = GetFullPathTo("../../Assets/Models/" + fileName + ".obj");
+	std::string cachePath = GetFullPathTo("../../Assets/Models/" + fileName + ".mesh");
+
+	WIN32_FILE_ATTRIBUTE_DATA objInfo = {};
+	WIN32_FILE_ATTRIBUTE_DATA cacheInfo = {};
+	bool hasObj = GetFileAttributesExA(objPath.c_str(), GetFileExInfoStandard, &objInfo) != 0;
+	bool hasCache = GetFileAttributesExA(cachePath.c_str(), GetFileExInfoStandard, &cacheInfo) != 0;
+	if (hasCache && (!hasObj || CompareFileTime(&cacheInfo.ftLastWriteTime, &objInfo.ftLastWriteTime) >= 0))
+	{
+		// Only the coarsest level is loaded here, the rest streams in
+		std::shared_ptr<Mesh> mesh = MeshStreamer::GetInstance().Load(cachePath, device);
+		if (mesh)
+		{
+			MeshResidency::GetInstance().Register(mesh, cachePath);
+			meshes.push_back(mesh);
+			return;
+		}
+	}
 
-	// Skeeball
-	LoadTextures(L"skeeball_1");
-	LoadTextures(L"skeeball_2");
-	LoadTextures(L"skeeball_3");
+	// Slow path, which also leaves a cache (with the BVH and hulls) behind for next time
+	std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(objPath.c_str(), device);
+	mesh->BuildBVH();
+	mesh->BuildCollisionHulls(maxCollisionHulls);
+	if (mesh->SaveCache(cachePath.c_str()))
+		MeshResidency::GetInstance().Register(mesh, cachePath);
+	meshes.push_back(mesh);
 
-	// Arcade machine
-	LoadTextures(L"arcade_machine_1");
-	LoadTextures(L"arcade_machine_2");
-	LoadTextures(L"arcade_machine_3");
+#if defined(DEBUG) || defined(_DEBUG)
+	const MeshImportStats& stats = mesh->GetImportStats();
+	printf("Imported %s.obj: %zu verts, %zu indices, peak %.2f MB, %d collision hulls\n", fileName.c_str(),
+		stats.vertexCount, stats.indexCount, stats.peakBytes / (1024.0 * 1024.0), mesh->GetCollisionHullCount());
+#endif
+}
 
-	// DDR
-	LoadTextures(L"ddr");
+// Loads a scene from its compiled .sceneb, recompiling it
+// from the .scene text when it's missing or older than the text.
+bool Game::LoadScene(SceneFile& scene, std::string fileName)
+{
+	std::string textPath = GetFullPathTo("../../Assets/Scenes/" + fileName + ".scene");
+	std::string binaryPath = GetFullPathTo("../../Assets/Scenes/" + fileName + ".sceneb");
+
+	WIN32_FILE_ATTRIBUTE_DATA textInfo = {};
+	WIN32_FILE_ATTRIBUTE_DATA binaryInfo = {};
+	bool hasText = GetFileAttributesExA(textPath.c_str(), GetFileExInfoStandard, &textInfo) != 0;
+	bool hasBinary = GetFileAttributesExA(binaryPath.c_str(), GetFileExInfoStandard, &binaryInfo) != 0;
+	if (hasBinary && (!hasText || CompareFileTime(&binaryInfo.ftLastWriteTime, &textInfo.ftLastWriteTime) >= 0))
+	{
+		if (scene.LoadBinary(binaryPath.c_str()))
+			return true;
+	}
 
-	// Ticket Machine
-	LoadTextures(L"ticket_machine");
+	// Slow path, which leaves the binary behind for next time
+	if (!scene.LoadText(textPath.c_str()))
+		return false;
+	scene.SaveBinary(binaryPath.c_str());
+	return true;
+}
 
+// --------------------------------------------------------
+// Loads all necessary assets and creates various entities
+// --------------------------------------------------------
+void Game::LoadAssetsAndCreateEntities()
+{
 	// Creates sampler state
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState;
 
@@ -231,184 +302,160 @@ void Game::LoadAssetsAndCreateEntities()
 
 	device->CreateSamplerState(&samplerDesc, &samplerState);
 
-	// Creates some materials
-	// Purple
-	/*materials.push_back(std::make_shared<Material>(
-		XMFLOAT4(1.0f, 0.0f, 1.0f, 1.0f), vertexShader, pixelShader));
-	// Yellow
-	materials.push_back(std::make_shared<Material>(
-		XMFLOAT4(1.0f, 1.0f, 0.0f, 1.0f), vertexShader, pixelShader));
-	// Cyan
-	materials.push_back(std::make_shared<Material>(
-		XMFLOAT4(0.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader));*/
-		// White material
-	for (int i = 0; i < albedoSVPtrs.size(); i++)
+	// Everything else comes from the scene file
+	SceneFile scene;
+	if (!LoadScene(scene, "arcade"))
 	{
-		materials.push_back(std::make_shared<Material>(
-			XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader));
-	}
-
-	// Adds SRV's and samplers to materials
-	for (int i = 0; i < materials.size(); i++)
-	{
-		materials[i]->AddTextureSRV("Albedo", albedoSVPtrs[i]);
-		materials[i]->AddTextureSRV("MetallicMap", metallicSVPtrs[i]);
-		materials[i]->AddTextureSRV("NormalMap", normalSVPtrs[i]);
-		materials[i]->AddTextureSRV("RoughnessMap", roughnessSVPtrs[i]);
-		materials[i]->AddSampler("BasicSampler", samplerState);
+#if defined(DEBUG) || defined(_DEBUG)
+		printf("Couldn't load the arcade scene\n");
+#endif
+		return;
 	}
 
-	// Loads meshes and creates some geometry
-	// Creates basic meshes
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/quad.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/quad_double_sided.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/torus.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/sphere.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/cylinder.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/cube.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/helix.obj").c_str(), device));
-	// Creates extra meshes
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/arcade_room.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/counter.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/skeeball.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/arcade_machine.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/ddr.obj").c_str(), device));
-	meshes.push_back(std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/ticket_machine.obj").c_str(), device));
-
-	// Creates the entities from the meshes
-	for (int i = 0; i < meshes.size(); i++)
+	// One material per texture set
+	for (int i = 0; i < scene.GetMaterialCount(); i++)
 	{
-		// Adds entity to vector
-		int matIndex = i;
-		if (matIndex > materials.size() - 1)
-		{
-			matIndex = 0;
-		}
-
-		// Adds multiple entities for machines
-		switch (i)
+		const SceneMaterial& sceneMaterial = scene.GetMaterial(i);
+		std::string textures = sceneMaterial.textures;
+		LoadTextures(std::wstring(textures.begin(), textures.end()));
+
+		std::shared_ptr<Material> material = std::make_shared<Material>(
+			sceneMaterial.colorTint, vertexShader, pixelShader);
+		material->AddTextureSRV("Albedo", albedoSVPtrs.back());
+		material->AddTextureSRV("MetallicMap", metallicSVPtrs.back());
+		material->AddTextureSRV("NormalMap", normalSVPtrs.back());
+		material->AddTextureSRV("RoughnessMap", roughnessSVPtrs.back());
+		material->AddSampler("BasicSampler", samplerState);
+		materials.push_back(material);
+
+		// Arcade machines pulse gently in attract mode, each set a little out of step
+		if (strncmp(sceneMaterial.name, "arcade_machine", 14) == 0)
 		{
-		// 4 sleeball machines
-		case 9:
-			for (int x = 0; x < 4; x++)
-			{
-				int offset = x % 3;
-				entities.push_back(std::make_shared<Entity>(Transform(), meshes[i], materials[(matIndex + offset)]));
-			}
-			break;
-		// 12 arcade machines
-		case 10:
-			for (int x = 0; x < 12; x++)
-			{
-				int offset = x % 3;
-				entities.push_back(std::make_shared<Entity>(Transform(), meshes[i], materials[(matIndex + 2 + offset)]));
-			}
-			break;
-		// 1 DDR machine
-		case 11:
-			entities.push_back(std::make_shared<Entity>(Transform(), meshes[i], materials[(matIndex + 4)]));
-			break;
-		// 4 ticket machines
-		case 12:
-			for (int x = 0; x < 4; x++)
-			{
-				entities.push_back(std::make_shared<Entity>(Transform(), meshes[i], materials[(matIndex + 4)]));
-			}			
-			break;
-		default:
-			entities.push_back(std::make_shared<Entity>(Transform(), meshes[i], materials[matIndex]));
-			break;
+			XMFLOAT4 tint = sceneMaterial.colorTint;
+			XMFLOAT4 bright(tint.x * 1.2f, tint.y * 1.2f, tint.z * 1.2f, tint.w);
+			AnimationTrackHandle pulse = animationSystem.AddTween(material.get(), tint, bright,
+				1.5f, ANIMATION_INTERPOLATION_HERMITE, ANIMATION_LOOP_PING_PONG);
+			animationSystem.SetTime(pulse, i * 0.5f);
 		}
 	}
 
-	// Sets positions for basic meshes
-	for (int i = 0; i <= 6; i++)
+	for (int i = 0; i < scene.GetMeshCount(); i++)
 	{
-		entities[i]->GetTransform()->SetPosition((float)i * 4, -5, 0);
+		const SceneMesh& sceneMesh = scene.GetMesh(i);
+		LoadMesh(sceneMesh.name, sceneMesh.maxCollisionHulls);
 	}
 
-	// Rotates quads
-	entities[0]->GetTransform()->SetRotation(-45, -1, 45);
-	entities[1]->GetTransform()->SetRotation(-45, -1, 45);
-
-	// Rotates torus
-	entities[2]->GetTransform()->SetRotation(0, 45, 45);
-
-	// Sets appropriate transform for arcade room
-	entities[7]->GetTransform()->SetRotation(XM_PIDIV2, 0, 0);
-	entities[7]->GetTransform()->SetScale(.05f, .05f, .05f);
-	entities[7]->GetTransform()->SetPosition(12, -5, 20);
-
-	// Sets appropriate transform for counter
-	entities[8]->GetTransform()->SetRotation(XM_PIDIV2, -XM_PIDIV2, 0);
-	entities[8]->GetTransform()->SetScale(.01f, .01f, .01f);
-	entities[8]->GetTransform()->SetPosition(20, -5, 10);
-
-	// Sets appropriate transform for skeeball machines
-	for (int i = 9; i < 11; i++)
+	// Parents always come before their children, so they already exist
+	for (int i = 0; i < scene.GetEntityCount(); i++)
 	{
-		entities[i]->GetTransform()->SetRotation(0, XM_PIDIV2, 0);
-		entities[i]->GetTransform()->SetScale(.75f, .75f, .75f);
-		entities[i]->GetTransform()->SetPosition(23.5f, -4.5f, 33.5 - (i - 9) * 6.5f);
-	}
-	for (int i = 11; i < 13; i++)
-	{
-		entities[i]->GetTransform()->SetRotation(0, -XM_PIDIV2, 0);
-		entities[i]->GetTransform()->SetScale(.75f, .75f, .75f);
-		entities[i]->GetTransform()->SetPosition(0.5f, -4.5f, 9.5f - (i - 11) * 3);
+		const SceneEntity& sceneEntity = scene.GetEntity(i);
+		std::shared_ptr<Entity> entity = std::make_shared<Entity>(
+			Transform(), meshes[sceneEntity.mesh], materials[sceneEntity.material]);
+
+		Transform* transform = entity->GetTransform();
+		transform->SetPosition(sceneEntity.position.x, sceneEntity.position.y, sceneEntity.position.z);
+		transform->SetRotation(sceneEntity.rotation);
+		transform->SetScale(sceneEntity.scale.x, sceneEntity.scale.y, sceneEntity.scale.z);
+		if (sceneEntity.parent >= 0)
+			transform->SetParent(entities[sceneEntity.parent]->GetTransform());
+
+		// Static ones are baked into world space and merged by material. A
+		// child of something that moves moves with it, so it can't be static.
+		entity->SetStatic((sceneEntity.flags & SCENE_ENTITY_STATIC) != 0 &&
+			(sceneEntity.parent < 0 || entities[sceneEntity.parent]->IsStatic()));
+		entities.push_back(entity);
 	}
 
-	// Sets appropriate transform for arcade machines
-	for (int i = 13; i < 15; i++)
-	{
-		entities[i]->GetTransform()->SetPosition(19 - (i - 13) * 3.5f, -3.2f, 34);
-	}
-	for (int i = 15; i < 18; i++)
-	{
-		entities[i]->GetTransform()->SetPosition(7 - (i - 15) * 3.5f, -3.2f, 34);
-	}
-	for (int i = 18; i < 20; i++)
+	// Dynamic transforms are updated in one pass each frame; static ones
+	// are baked on the first update and then left alone
+	for (const std::shared_ptr<Entity>& entity : entities)
 	{
-		entities[i]->GetTransform()->SetRotation(0, XM_PI, 0);
-		entities[i]->GetTransform()->SetPosition(5 - (i - 18) * 3.5f, -3.2f, 26);
+		if (entity->IsStatic())
+			staticTransformHierarchy.Add(entity->GetTransform());
+		else
+			transformHierarchy.Add(entity->GetTransform());
 	}
-	for (int i = 20; i < 22; i++)
+
+	// Puts each entity in the store, where static ones end up in their own
+	// archetype so drawing can skip them as a whole
+	std::vector<EntityId> ids;
+	std::vector<BoundsComponent> entityBounds;
+	std::vector<SceneBVHItem> items;
+	for (const std::shared_ptr<Entity>& entity : entities)
 	{
-		entities[i]->GetTransform()->SetPosition(5 - (i - 20) * 3.5f, -3.2f, 14);
+		EntityId id = entityStore.Create();
+
+		TransformComponent transform = {};
+		transform.transform = entity->GetTransform();
+		transform.version = transform.transform->GetVersion() - 1;
+		SyncTransform(transform);
+		entityStore.Add(id, transform);
+
+		RenderComponent render = {};
+		render.mesh = entity->GetMeshHandle();
+		render.firstMaterial = (unsigned int)materialSlots.size();
+		render.materialCount = (unsigned int)entity->GetMaterialCount();
+		for (int slot = 0; slot < entity->GetMaterialCount(); slot++)
+			materialSlots.push_back(entity->GetMaterialHandle(slot));
+		entityStore.Add(id, render);
+
+		if (entity->IsStatic())
+			entityStore.Add(id, StaticComponent());
+
+		// The mesh's box is stored in its cache, so even one that's still
+		// streaming in has it. Only older caches don't, and their entities get
+		// a box (and a place in the scene tree) once the full level arrives.
+		BoundsComponent bounds = {};
+		bounds.sceneProxy = -1;
+		bounds.transformVersion = transform.version - 1;
+		if (entity->GetMesh()->GetBounds(bounds.localMin, bounds.localMax))
+		{
+			FitBounds(transform, bounds);
+
+			SceneBVHItem item = { bounds.boundsMin, bounds.boundsMax, id.value };
+			bounds.sceneProxy = (int)items.size();
+			items.push_back(item);
+		}
+		else
+			unboundedEntities.push_back(id);
+
+		ids.push_back(id);
+		entityBounds.push_back(bounds);
 	}
-	for (int i = 22; i < 24; i++)
+
+	// Everything with a box goes in the scene tree at once, so it starts out balanced
+	std::vector<int> proxies;
+	sceneBVH.Build(items, proxies);
+	for (size_t i = 0; i < ids.size(); i++)
 	{
-		entities[i]->GetTransform()->SetRotation(0, -XM_PIDIV2, 0);
-		entities[i]->GetTransform()->SetPosition(-2, -3.2f, 31 - (i - 22) * 3.5f);
+		if (entityBounds[i].sceneProxy >= 0)
+			entityBounds[i].sceneProxy = proxies[entityBounds[i].sceneProxy];
+		entityStore.Add(ids[i], entityBounds[i]);
 	}
-	entities[24]->GetTransform()->SetRotation(0, -XM_PIDIV2, 0);
-	entities[24]->GetTransform()->SetPosition(-2, -3.2f, 13);
 
-	// Sets appropriate transform for DDR machine
-	entities[25]->GetTransform()->SetScale(.4f, .4f, .4f);
-	entities[25]->GetTransform()->SetPosition(11.5f, -4.65f, 31.5f);
+	// (their batches are built in Update once the meshes finish streaming)
 
-	// Sets appropriate transform for ticket machines
-	for (int i = 26; i < 28; i++)
-	{
-		entities[i]->GetTransform()->SetRotation(0, XM_PI, 0);
-		entities[i]->GetTransform()->SetScale(.25f, .25f, .25f);
-		entities[i]->GetTransform()->SetPosition(8.5f - (i - 26) * 2.5f, -3.1f, 5.5f);
-	}
-	for (int i = 28; i < 30; i++)
+	// The lights live in the store; the list sent to the shaders is
+	// gathered from it into each frame's render snapshot
+	for (int i = 0; i < scene.GetLightCount(); i++)
 	{
-		entities[i]->GetTransform()->SetRotation(0, XM_PI, 0);
-		entities[i]->GetTransform()->SetScale(.25f, .25f, .25f);
-		entities[i]->GetTransform()->SetPosition(18 - (i - 28) * 2.5f, -3.1f, 5.5f);
+		LightComponent component = {};
+		component.light = scene.GetLight(i);
+		entityStore.Add(entityStore.Create(), component);
 	}
 
+	ambientColor = scene.GetAmbientColor();
+
 	// Creates sky box
-	skyBox = std::make_shared<Sky>(meshes[5], samplerState, device,
-		GetFullPathTo_Wide(L"../../Assets/Textures/skies/SunnyCubeMap.dds").c_str(),
-		skyVertexShader, skyPixelShader);
+	if (scene.HasSky())
+	{
+		std::string cubeMap = scene.GetSky().cubeMap;
+		skyBox = std::make_shared<Sky>(meshes[scene.GetSky().mesh], samplerState, device,
+			GetFullPathTo_Wide(L"../../Assets/Textures/" + std::wstring(cubeMap.begin(), cubeMap.end())).c_str(),
+			skyVertexShader, skyPixelShader);
+	}
 }
 
-
 // ------------------------------------------------------------
 // Resizes (by releasing and re-creating) the resources
 // required for post processing.
@@ -474,94 +521,6 @@ void Game::ResizeOnePostProcessResource(
 }
 
 
-// Generates lights in scene
-void Game::GenerateLights()
-{
-	// Lights
-	// Red directional right
-	lights.push_back({});
-	lights[0].Type = LIGHT_TYPE_DIRECTIONAL;
-	lights[0].Direction = XMFLOAT3(1, 0, 0);
-	lights[0].Color = XMFLOAT3(1, 0, 0);
-	//lights[0].Intensity = 0.2f;
-	lights[0].Intensity = 0;
-
-	// Green directional down
-	lights.push_back({});
-	lights[1].Type = LIGHT_TYPE_DIRECTIONAL;
-	lights[1].Direction = XMFLOAT3(0, -1, 0);
-	lights[1].Color = XMFLOAT3(1, 1, 1);
-	//lights[1].Intensity = 0.2f;
-	lights[1].Intensity = 0;
-
-	// Blue directional up at an angle
-	lights.push_back({});
-	lights[2].Type = LIGHT_TYPE_DIRECTIONAL;
-	lights[2].Direction = XMFLOAT3(-1, 1, -0.5f);
-	lights[2].Color = XMFLOAT3(1, 1, 1);
-	//lights[2].Intensity = 0.2f;
-	lights[2].Intensity = 0;
-
-	// White blue light with range 10 positioned between sphere and helix
-	lights.push_back({});
-	lights[3].Type = LIGHT_TYPE_POINT;
-	lights[3].Range = 10;
-	lights[3].Position = XMFLOAT3(10, 0, -2);
-	lights[3].Color = XMFLOAT3(0, 0, 1);
-	lights[3].Intensity = 1;
-
-	// Dim green point light with range 10 positioned between sphere and torus
-	lights.push_back({});
-	lights[4].Type = LIGHT_TYPE_POINT;
-	lights[4].Range = 10;
-	lights[4].Position = XMFLOAT3(14, 0, -2);
-	lights[4].Color = XMFLOAT3(0, 1, 0);
-	lights[4].Intensity = 1;
-
-	// White directional forward
-	lights.push_back({});
-	lights[5].Type = LIGHT_TYPE_DIRECTIONAL;
-	lights[5].Direction = XMFLOAT3(0, 0, 1);
-	lights[5].Color = XMFLOAT3(1, 1, 1);
-	//lights[5].Intensity = 0.2f;
-	lights[5].Intensity = 0;
-
-	// Creates 20 white point lights on ceiling
-	for (int i = 6; i < 26; i++)
-	{
-		int zPos = 7;
-		if (i >= 10 && i < 14)
-		{
-			zPos = 13;
-		}
-		else if (i >= 14 && i < 18)
-		{
-			zPos = 28;
-		}
-		else if (i >= 17 && i < 22)
-		{
-			zPos = 32;
-		}
-
-		lights.push_back({});
-		lights[i].Type = LIGHT_TYPE_POINT;
-		lights[i].Range = 10;
-		lights[i].Position = XMFLOAT3(2 + ((i - 6) % 4) * 6.75f, 2, zPos);
-		lights[i].Color = XMFLOAT3(.6f, .2f, 1);
-		lights[i].Intensity = 10;
-
-		// Middle lights
-		if (i >= 22 && i < 24)
-		{
-			lights[i].Position = XMFLOAT3(9 + ((i - 6) % 2) * 6, 2, 17);
-		}
-		else if (i >= 24)
-		{
-			lights[i].Position = XMFLOAT3(9 + ((i - 6) % 2) * 6, 2, 23);
-		}
-	}
-}
-
 // --------------------------------------------------------
 // Handle resizing DirectX "stuff" to match the new window size.
 // For instance, updating our projection matrix's aspect ratio.
@@ -578,6 +537,74 @@ void Game::OnResize()
 	ResizeAllPostProcessResources();
 }
 
+// --------------------------------------------------------
+// Updates the static entities' world matrices and boxes.
+// Runs on the first update and again only when a static
+// entity was moved anyway, in which case any batch that
+// baked it in is rebuilt too.
+// --------------------------------------------------------
+void Game::BakeStaticEntities()
+{
+	staticTransformHierarchy.Update();
+
+	// Dynamic boxes were already fit this frame, so only static ones change here
+	entityStore.ForEach<TransformComponent, BoundsComponent>([this](EntityId id, TransformComponent& transform, BoundsComponent& bounds)
+	{
+		SyncTransform(transform);
+		FitBounds(transform, bounds);
+		if (bounds.sceneProxy >= 0)
+			sceneBVH.Move(bounds.sceneProxy, bounds.boundsMin, bounds.boundsMax);
+	});
+
+	if (staticBatchesBuilt && !staticTransformHierarchy.GetChanged().empty())
+	{
+		for (const std::shared_ptr<StaticBatch>& batch : staticBatches)
+		{
+			if (batch->IsStale(entityStore))
+			{
+				staticBatches.clear();
+				staticBatchesBuilt = false;
+				break;
+			}
+		}
+	}
+
+	bakedStaticVersion = Transform::GetStaticVersion();
+}
+
+// --------------------------------------------------------
+// Gives entities whose mesh (from a cache without stored
+// bounds) has finished streaming in since load the box they
+// couldn't have then, and puts them in the scene tree
+// --------------------------------------------------------
+void Game::BoundStreamedEntities()
+{
+	for (size_t i = 0; i < unboundedEntities.size();)
+	{
+		EntityId id = unboundedEntities[i];
+		TransformComponent* transform = entityStore.Get<TransformComponent>(id);
+		RenderComponent* render = entityStore.Get<RenderComponent>(id);
+		BoundsComponent* bounds = entityStore.Get<BoundsComponent>(id);
+		if (transform && render && bounds)
+		{
+			Mesh* mesh = Resources::GetInstance().GetMeshes().Get(render->mesh);
+			if (!mesh || !mesh->GetBounds(bounds->localMin, bounds->localMax))
+			{
+				i++;
+				continue;
+			}
+
+			bounds->transformVersion = transform->version - 1;
+			FitBounds(*transform, *bounds);
+			bounds->sceneProxy = sceneBVH.Insert(bounds->boundsMin, bounds->boundsMax, id.value);
+		}
+
+		// Bounded now (or destroyed), so it's off the list
+		unboundedEntities[i] = unboundedEntities.back();
+		unboundedEntities.pop_back();
+	}
+}
+
 // --------------------------------------------------------
 // Update your game here - user input, move objects, AI, etc.
 // --------------------------------------------------------
@@ -589,16 +616,37 @@ void Game::Update(float deltaTime, float totalTime)
 	if (input.KeyDown(VK_ESCAPE))
 		Quit();
 
-	// Makes entities change their transforms with sin
-	for (int i = 0; i < entities.size(); i++)
+	// Entities created, destroyed or changed since last frame go in now,
+	// before anything iterates the store
+	entityStore.Flush();
+
+	// Animations set their targets' values first, so the passes below see them
+	animationSystem.Update(deltaTime);
+
+	// Brings every dynamic world matrix (children included) up to date in one pass
+	transformHierarchy.Update();
+
+	// Copies out the matrices and refits the world box of any dynamic entity that moved
+	entityStore.ParallelForEach<TransformComponent, BoundsComponent>([](EntityId id, TransformComponent& transform, BoundsComponent& bounds)
 	{
-		if (i < entities.size() - 1)
-		{
-			//entities[i]->GetTransform()->SetPosition(sin(totalTime) * (float)i / 1.5f, 0, 0);
-			//entities[i]->GetTransform()->SetScale(sin(totalTime) / 4, sin(totalTime) / 4, sin(totalTime) / 4);
-			//entities[i]->GetTransform()->Rotate(0, sin(deltaTime), 0);
-		}
-	}
+		SyncTransform(transform);
+		FitBounds(transform, bounds);
+	}, entityStore.GetMask<StaticComponent>());
+
+	// The scene tree follows them; only a box that leaves its leaf's margin changes it
+	entityStore.ForEach<BoundsComponent>([this](EntityId id, BoundsComponent& bounds)
+	{
+		if (bounds.sceneProxy >= 0)
+			sceneBVH.Move(bounds.sceneProxy, bounds.boundsMin, bounds.boundsMax);
+	}, entityStore.GetMask<StaticComponent>());
+
+	if (!unboundedEntities.empty())
+		BoundStreamedEntities();
+
+	// Static entities are only looked at again if one of them changed. Most
+	// frames none did, so this is just the version check.
+	if (bakedStaticVersion != Transform::GetStaticVersion())
+		BakeStaticEntities();
 
 	// Adjusts blur amount w/ arrow keys
 	if (input.KeyPress(VK_UP)) { additionalBlurAmount++; }
@@ -607,9 +655,38 @@ void Game::Update(float deltaTime, float totalTime)
 	// Toggles bluring
 	if (input.KeyPress('Q')) { blurMultiplier > 0 ? blurMultiplier = 0 : blurMultiplier = .6f; }
 
+	// Static batches bake in the meshes' geometry, so they're built once
+	// every static mesh has streamed in its full level of detail. (When
+	// re-baking, evicted ones reload as they're drawn unbatched meanwhile.)
+	if (!staticBatchesBuilt && MeshStreamer::GetInstance().GetPendingCount() == 0)
+	{
+		bool allResident = true;
+		entityStore.ForEach<RenderComponent, StaticComponent>([&allResident](EntityId id, RenderComponent& render, StaticComponent&)
+		{
+			// Also swaps in any level that was still waiting
+			Mesh* mesh = Resources::GetInstance().GetMeshes().Get(render.mesh);
+			if (mesh && !mesh->IsFullyResident())
+				allResident = false;
+		});
+
+		if (allResident)
+		{
+			staticBatches = StaticBatch::Build(entityStore, materialSlots, device);
+			staticBatchesBuilt = true;
+		}
+	}
+
+	// Meshes can only be evicted once the batches have copied what they need
+	if (staticBatchesBuilt)
+		MeshResidency::GetInstance().Update();
+
 	// Updates camera
 	camera->Update(deltaTime);
 
+	// Right click picks the entity under the cursor
+	if (input.MouseRightPress())
+		PickEntity(input.GetMouseX(), input.GetMouseY());
+
 	// Adjusts blur amount based on camera speed
 	blurAmount = camera->getCurrentMoveSpeed() * blurMultiplier + additionalBlurAmount;
 	blurAmount = min(max(blurAmount, 0), 15); // Clamp between 0 and 15
@@ -624,6 +701,130 @@ void Game::Update(float deltaTime, float totalTime)
 	bloomLevels = max(min(bloomLevels, MaxBloomLevels), 0);
 
 	if (input.KeyPress('E')) { drawBloomTextures = !drawBloomTextures; }
+
+	// Last, once everything has moved for this frame
+	WriteRenderSnapshot(totalTime);
+}
+
+// --------------------------------------------------------
+// Copies what this frame's draws need (visible entities,
+// static batches, lights and the camera) into the next
+// render snapshot and hands it over to Draw
+// --------------------------------------------------------
+void Game::WriteRenderSnapshot(float totalTime)
+{
+	RenderSnapshot& snapshot = renderSnapshots.BeginWrite();
+	snapshot.SetView(camera.get(), totalTime, ambientColor);
+
+	entityStore.ForEach<LightComponent>([&](EntityId id, LightComponent& light)
+	{
+		snapshot.AddLight(light.light);
+	});
+
+	// What's in view comes from the scene tree. Entities without a box yet
+	// can't be culled, and static ones are drawn through their batch instead
+	// (once it exists).
+	visibleEntities.clear();
+	sceneBVH.QueryFrustum(snapshot.GetView().frustumPlanes, visibleEntities);
+	for (EntityId id : unboundedEntities)
+		visibleEntities.push_back(id.value);
+
+	for (unsigned int value : visibleEntities)
+	{
+		EntityId id = { value };
+		if (staticBatchesBuilt && entityStore.Has<StaticComponent>(id))
+		{
+			// Flagged so only its part of the batch is drawn
+			if (visibleStatic.size() <= id.GetIndex())
+				visibleStatic.resize(id.GetIndex() + 1, 0);
+			visibleStatic[id.GetIndex()] = 1;
+			continue;
+		}
+
+		TransformComponent* transform = entityStore.Get<TransformComponent>(id);
+		RenderComponent* render = entityStore.Get<RenderComponent>(id);
+		if (transform && render)
+		{
+			snapshot.AddMesh(render->mesh, &materialSlots[render->firstMaterial], render->materialCount,
+				transform->worldMatrix, transform->worldInverseTransposeMatrix);
+		}
+	}
+
+	// Each batch draws only the ranges of the entities the scene tree found
+	// in view, with ranges next to each other in its index buffer merged.
+	// Batches are already in world space.
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+	for (const std::shared_ptr<StaticBatch>& batch : staticBatches)
+	{
+		visibleBatchRanges.clear();
+		for (const StaticBatchRange& range : batch->GetRanges())
+		{
+			unsigned int index = range.entity.GetIndex();
+			if (index >= visibleStatic.size() || !visibleStatic[index])
+				continue;
+
+			if (!visibleBatchRanges.empty() &&
+				visibleBatchRanges.back().startIndex + visibleBatchRanges.back().indexCount == range.startIndex)
+			{
+				visibleBatchRanges.back().indexCount += range.indexCount;
+				continue;
+			}
+
+			Submesh visibleRange = {};
+			visibleRange.startIndex = range.startIndex;
+			visibleRange.indexCount = range.indexCount;
+			visibleBatchRanges.push_back(visibleRange);
+		}
+
+		if (visibleBatchRanges.empty())
+			continue;
+
+		MaterialHandle material = batch->GetMaterial();
+		snapshot.AddMesh(batch->GetMesh(), &material, 1, identity, identity,
+			&visibleBatchRanges[0], (unsigned int)visibleBatchRanges.size());
+	}
+	visibleStatic.assign(visibleStatic.size(), 0);
+
+	if (skyBox)
+		snapshot.SetSkyMesh(skyBox->GetMesh().get());
+
+	renderSnapshots.Publish();
+}
+
+// --------------------------------------------------------
+// Casts a ray from the camera through the cursor and
+// remembers which entity it hits first
+// --------------------------------------------------------
+void Game::PickEntity(int mouseX, int mouseY)
+{
+	// Unprojects the cursor at the near and far planes
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 proj = camera->GetProjectionMatrix();
+	XMMATRIX inverseViewProj = XMMatrixInverse(0, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj));
+	float x = mouseX * 2.0f / width - 1.0f;
+	float y = 1.0f - mouseY * 2.0f / height;
+	XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(x, y, 0, 1), inverseViewProj);
+	XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(x, y, 1, 1), inverseViewProj);
+
+	Ray ray;
+	XMStoreFloat3(&ray.origin, nearPoint);
+	XMStoreFloat3(&ray.direction, XMVector3Normalize(farPoint - nearPoint));
+	ray.maxDistance = XMVectorGetX(XMVector3Length(farPoint - nearPoint));
+
+	// Kept between picks, so only entities that moved since need redoing
+	if (!pickQuery)
+		pickQuery = std::make_shared<RayQuery>(entities);
+	else
+		pickQuery->Refresh(entities);
+
+	RayQueryHit hit;
+	pickedEntity = pickQuery->Cast(ray, hit) ? hit.entity : -1;
+
+#if defined(DEBUG) || defined(_DEBUG)
+	if (pickedEntity >= 0)
+		printf("Picked entity %d (triangle %u, %.2f units away)\n", pickedEntity, hit.triangle, hit.distance);
+#endif
 }
 
 // --------------------------------------------------------
@@ -661,13 +862,16 @@ void Game::Draw(float deltaTime, float totalTime)
 	context->OMSetRenderTargets(1, ppRTV.GetAddressOf(), depthStencilView.Get());
 
 	// -----------------------DRAWS ENTITIES-------------------------
-	for (std::shared_ptr<Entity> entity : entities)
+	// Everything comes from the newest snapshot Update has finished
+	const RenderSnapshot* snapshot = renderSnapshots.AcquireLatest();
+	if (snapshot)
 	{
-		entity->Draw(context, camera, totalTime, ambientColor, lights);
-	}
+		snapshot->Draw(context.Get());
 
-	// Draws sky box after entities
-	skyBox->Draw(context, camera);
+		// Draws sky box after entities
+		if (skyBox)
+			skyBox->Draw(context, *snapshot);
+	}
 
 	// ----------------------------POST PROCESS POST DRAW----------------------
 	// Post process drawing - need to swap output back to back buffer
@@ -3,12 +3,24 @@
 #include "DXCore.h"
 #include "Mesh.h"
 #include "Transform.h"
+#include "TransformHierarchy.h"
 #include "Entity.h"
+#include "EntityStore.h"
+#include "Components.h"
 #include "camera.h"
 #include "SimpleShader.h"
 #include "Material.h"
 #include "Lights.h"
 #include "Sky.h"
+#include "StaticBatch.h"
+#include "RayQuery.h"
+#include "SceneFile.h"
+#include "MeshStreamer.h"
+#include "MeshResidency.h"
+#include "JobSystem.h"
+#include "AnimationSystem.h"
+#include "RenderSnapshot.h"
+#include "SceneBVH.h"
 
 #include <DirectXMath.h>
 #include <memory>
@@ -38,8 +50,9 @@ private:
 	// Initialization helper methods - feel free to customize, combine, etc.
 	void LoadShaders();
 	void LoadTextures(std::wstring fileName);
+	void LoadMesh(std::string fileName, int maxCollisionHulls = 1);
+	bool LoadScene(SceneFile& scene, std::string fileName);
 	void LoadAssetsAndCreateEntities();
-	void GenerateLights();
 
 	// Camera
 	std::shared_ptr<Camera> camera;
@@ -47,9 +60,51 @@ private:
 	// A vector to hold any number of meshes
 	// This makes things easy to draw and clean up, too!
 	std::vector<std::shared_ptr<Mesh>> meshes;
-	std::vector<std::shared_ptr<Entity>> entities;
 	std::vector<std::shared_ptr<Material>> materials;
 
+	// Own the transforms (which the hierarchies link by pointer); nothing
+	// that runs every frame walks them, it walks the entity store instead
+	std::vector<std::shared_ptr<Entity>> entities;
+
+	// Updates the entities' world matrices, parents before children. Static
+	// ones are kept apart and only updated when one of them changes.
+	TransformHierarchy transformHierarchy;
+	TransformHierarchy staticTransformHierarchy;
+	unsigned int bakedStaticVersion;
+	void BakeStaticEntities();
+
+	// Keyframe tracks on the entities' transforms and the materials
+	AnimationSystem animationSystem;
+
+	// What the per-frame systems iterate: one store entity per
+	// Entity (transform, render, bounds and, if static, static
+	// components) plus one per light
+	EntityStore entityStore;
+
+	// Every render component's material slots, one run per component
+	std::vector<MaterialHandle> materialSlots;
+
+	// Every entity's world box (by EntityId), for culling and other spatial
+	// queries. Entities whose mesh hadn't streamed in at load wait outside
+	// it until their box is known.
+	SceneBVH sceneBVH;
+	std::vector<EntityId> unboundedEntities;
+	std::vector<unsigned int> visibleEntities;
+	void BoundStreamedEntities();
+
+	// Static entities merged into one buffer per material. Each frame the
+	// visible static entities are flagged (by EntityId index) and only
+	// their ranges of the batches are drawn.
+	std::vector<std::shared_ptr<StaticBatch>> staticBatches;
+	bool staticBatchesBuilt;
+	std::vector<unsigned char> visibleStatic;
+	std::vector<Submesh> visibleBatchRanges;
+
+	// Entity last clicked on with the right mouse button (-1 for none)
+	int pickedEntity;
+	std::shared_ptr<RayQuery> pickQuery;
+	void PickEntity(int mouseX, int mouseY);
+
 	// Note the usage of ComPtr below
 	//  - This is a smart pointer for objects that abide by the
 	//    Component Object Model, which DirectX objects do
@@ -68,9 +123,13 @@ private:
 	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> normalSVPtrs;
 	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> roughnessSVPtrs;
 
-	// Lighting
+	// Lighting (the lights themselves are in the entity store)
 	DirectX::XMFLOAT3 ambientColor;
-	std::vector<Light> lights;
+
+	// What Update hands to Draw each frame. Draw reads only from the
+	// snapshot, never the live entities and camera.
+	RenderSnapshotRing renderSnapshots;
+	void WriteRenderSnapshot(float totalTime);
 
 	// Sky box
 	std::shared_ptr<Sky> skyBox;
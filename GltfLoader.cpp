@@ -0,0 +1,664 @@
+#include "GltfLoader.h"
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+using namespace DirectX;
+
+// GLB container constants
+static const unsigned int GlbMagic = 0x46546C67;		// "glTF"
+static const unsigned int GlbChunkJson = 0x4E4F534A;	// "JSON"
+static const unsigned int GlbChunkBin = 0x004E4942;	// "BIN\0"
+
+// glTF accessor component types
+static const int ComponentUnsignedByte = 5121;
+static const int ComponentUnsignedShort = 5123;
+static const int ComponentUnsignedInt = 5125;
+static const int ComponentFloat = 5126;
+
+// --------------------------------------------------------
+// Minimal JSON document, just enough for a glTF header
+// --------------------------------------------------------
+struct JsonValue
+{
+	enum Type { Null, Bool, Number, String, Array, Object };
+
+	Type type = Null;
+	double number = 0;
+	std::string string;
+	std::vector<JsonValue> elements;						// Array items
+	std::vector<std::pair<std::string, JsonValue>> members;	// Object members
+
+	// Returns the member with this key, or null if there isn't one
+	const JsonValue* Find(const char* key) const
+	{
+		for (const auto& m : members)
+		{
+			if (m.first == key)
+				return &m.second;
+		}
+		return 0;
+	}
+
+	// Returns a numeric member, or the fallback if it's missing
+	double GetNumber(const char* key, double fallback) const
+	{
+		const JsonValue* v = Find(key);
+		return v && v->type == Number ? v->number : fallback;
+	}
+
+	int GetInt(const char* key, int fallback) const { return (int)GetNumber(key, fallback); }
+};
+
+// Recursive descent parser over a JSON chunk
+class JsonParser
+{
+private:
+	const char* p;
+	const char* end;
+
+	void SkipWhitespace()
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+			p++;
+	}
+
+	bool ParseString(std::string& out)
+	{
+		if (p >= end || *p != '"')
+			return false;
+		p++;
+
+		while (p < end && *p != '"')
+		{
+			char c = *p++;
+			if (c != '\\')
+			{
+				out.push_back(c);
+				continue;
+			}
+
+			if (p >= end)
+				return false;
+			c = *p++;
+			switch (c)
+			{
+			case 'b': out.push_back('\b'); break;
+			case 'f': out.push_back('\f'); break;
+			case 'n': out.push_back('\n'); break;
+			case 'r': out.push_back('\r'); break;
+			case 't': out.push_back('\t'); break;
+			case 'u':
+			{
+				// Encodes the code point as UTF-8 (surrogate pairs aren't needed for names)
+				if (end - p < 4)
+					return false;
+				char hex[5] = { p[0], p[1], p[2], p[3], 0 };
+				unsigned int code = (unsigned int)strtoul(hex, 0, 16);
+				p += 4;
+				if (code < 0x80)
+				{
+					out.push_back((char)code);
+				}
+				else if (code < 0x800)
+				{
+					out.push_back((char)(0xC0 | (code >> 6)));
+					out.push_back((char)(0x80 | (code & 0x3F)));
+				}
+				else
+				{
+					out.push_back((char)(0xE0 | (code >> 12)));
+					out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+					out.push_back((char)(0x80 | (code & 0x3F)));
+				}
+				break;
+			}
+			default: out.push_back(c); break;
+			}
+		}
+
+		if (p >= end)
+			return false;
+		p++;
+		return true;
+	}
+
+public:
+	JsonParser(const char* text, size_t length) : p(text), end(text + length) {}
+
+	bool Parse(JsonValue& value)
+	{
+		SkipWhitespace();
+		if (p >= end)
+			return false;
+
+		if (*p == '{')
+		{
+			value.type = JsonValue::Object;
+			p++;
+			SkipWhitespace();
+			if (p < end && *p == '}') { p++; return true; }
+
+			while (true)
+			{
+				std::pair<std::string, JsonValue> member;
+				SkipWhitespace();
+				if (!ParseString(member.first))
+					return false;
+				SkipWhitespace();
+				if (p >= end || *p++ != ':')
+					return false;
+				if (!Parse(member.second))
+					return false;
+				value.members.push_back(std::move(member));
+
+				SkipWhitespace();
+				if (p >= end)
+					return false;
+				if (*p == ',') { p++; continue; }
+				if (*p == '}') { p++; return true; }
+				return false;
+			}
+		}
+		else if (*p == '[')
+		{
+			value.type = JsonValue::Array;
+			p++;
+			SkipWhitespace();
+			if (p < end && *p == ']') { p++; return true; }
+
+			while (true)
+			{
+				value.elements.push_back(JsonValue());
+				if (!Parse(value.elements.back()))
+					return false;
+
+				SkipWhitespace();
+				if (p >= end)
+					return false;
+				if (*p == ',') { p++; continue; }
+				if (*p == ']') { p++; return true; }
+				return false;
+			}
+		}
+		else if (*p == '"')
+		{
+			value.type = JsonValue::String;
+			return ParseString(value.string);
+		}
+		else if (end - p >= 4 && strncmp(p, "true", 4) == 0)
+		{
+			value.type = JsonValue::Bool;
+			value.number = 1;
+			p += 4;
+			return true;
+		}
+		else if (end - p >= 5 && strncmp(p, "false", 5) == 0)
+		{
+			value.type = JsonValue::Bool;
+			p += 5;
+			return true;
+		}
+		else if (end - p >= 4 && strncmp(p, "null", 4) == 0)
+		{
+			p += 4;
+			return true;
+		}
+
+		// Anything else must be a number (the chunk isn't null terminated, so copy it out)
+		char digits[64];
+		int length = 0;
+		while (p < end && length < 63 && strchr("+-0123456789.eE", *p))
+			digits[length++] = *p++;
+		if (length == 0)
+			return false;
+		digits[length] = 0;
+		value.type = JsonValue::Number;
+		value.number = strtod(digits, 0);
+		return true;
+	}
+};
+
+// --------------------------------------------------------
+// A typed, strided window onto the binary chunk
+// --------------------------------------------------------
+struct AccessorView
+{
+	const unsigned char* data;
+	unsigned int count;
+	unsigned int stride;
+	unsigned int bufferView;
+	int componentType;
+	int components;
+	bool normalized;
+};
+
+// Resolves an accessor to a pointer into the binary chunk
+static bool GetAccessorView(const JsonValue& gltf, int accessorIndex,
+	const unsigned char* bin, size_t binSize, AccessorView& view)
+{
+	const JsonValue* accessors = gltf.Find("accessors");
+	const JsonValue* bufferViews = gltf.Find("bufferViews");
+	if (!accessors || !bufferViews || accessorIndex < 0 || accessorIndex >= (int)accessors->elements.size())
+		return false;
+
+	// Sparse and buffer-less accessors aren't supported
+	const JsonValue& accessor = accessors->elements[accessorIndex];
+	int viewIndex = accessor.GetInt("bufferView", -1);
+	if (accessor.Find("sparse") || viewIndex < 0 || viewIndex >= (int)bufferViews->elements.size())
+		return false;
+
+	// Only the GLB's own binary chunk (buffer 0) can be read in place
+	const JsonValue& bufferView = bufferViews->elements[viewIndex];
+	if (bufferView.GetInt("buffer", 0) != 0)
+		return false;
+
+	const JsonValue* type = accessor.Find("type");
+	if (!type)
+		return false;
+	view.components =
+		type->string == "SCALAR" ? 1 :
+		type->string == "VEC2" ? 2 :
+		type->string == "VEC3" ? 3 :
+		type->string == "VEC4" ? 4 : 0;
+	if (view.components == 0)
+		return false;
+
+	view.componentType = accessor.GetInt("componentType", 0);
+	unsigned int componentSize =
+		view.componentType == ComponentFloat || view.componentType == ComponentUnsignedInt ? 4 :
+		view.componentType == ComponentUnsignedShort || view.componentType == 5122 ? 2 : 1;
+
+	const JsonValue* normalized = accessor.Find("normalized");
+	view.normalized = normalized && normalized->number != 0;
+	view.count = (unsigned int)accessor.GetNumber("count", 0);
+	view.bufferView = viewIndex;
+	view.stride = (unsigned int)bufferView.GetNumber("byteStride", 0);
+	if (view.stride == 0)
+		view.stride = componentSize * view.components;
+
+	// Makes sure the last element is inside the chunk
+	size_t offset = (size_t)bufferView.GetNumber("byteOffset", 0) + (size_t)accessor.GetNumber("byteOffset", 0);
+	size_t lastByte = offset + (view.count > 0 ? (size_t)(view.count - 1) * view.stride + componentSize * view.components : 0);
+	if (lastByte > binSize)
+		return false;
+
+	view.data = bin + offset;
+	return true;
+}
+
+// Reads one float component, expanding normalized integer formats
+static float ReadComponent(const unsigned char* element, int componentType, bool normalized, int component)
+{
+	switch (componentType)
+	{
+	case ComponentFloat: return ((const float*)element)[component];
+	case ComponentUnsignedShort: return ((const unsigned short*)element)[component] / (normalized ? 65535.0f : 1.0f);
+	case ComponentUnsignedByte: return element[component] / (normalized ? 255.0f : 1.0f);
+	default: return 0.0f;
+	}
+}
+
+// Builds a node's local matrix from either "matrix" or translation/rotation/scale
+static XMMATRIX GetNodeMatrix(const JsonValue& node)
+{
+	const JsonValue* matrix = node.Find("matrix");
+	if (matrix && matrix->elements.size() == 16)
+	{
+		// glTF matrices are column major, which read row by row is
+		// exactly the row-vector matrix DirectXMath expects
+		XMFLOAT4X4 m;
+		for (int i = 0; i < 16; i++)
+			m.m[i / 4][i % 4] = (float)matrix->elements[i].number;
+		return XMLoadFloat4x4(&m);
+	}
+
+	XMMATRIX local = XMMatrixIdentity();
+	const JsonValue* s = node.Find("scale");
+	const JsonValue* r = node.Find("rotation");
+	const JsonValue* t = node.Find("translation");
+	if (s && s->elements.size() == 3)
+	{
+		local = local * XMMatrixScaling((float)s->elements[0].number, (float)s->elements[1].number, (float)s->elements[2].number);
+	}
+	if (r && r->elements.size() == 4)
+	{
+		local = local * XMMatrixRotationQuaternion(XMVectorSet(
+			(float)r->elements[0].number, (float)r->elements[1].number,
+			(float)r->elements[2].number, (float)r->elements[3].number));
+	}
+	if (t && t->elements.size() == 3)
+	{
+		local = local * XMMatrixTranslation((float)t->elements[0].number, (float)t->elements[1].number, (float)t->elements[2].number);
+	}
+	return local;
+}
+
+// A mesh placed in the scene by a node
+struct MeshInstance
+{
+	int mesh;
+	XMFLOAT4X4 world;
+};
+
+// Walks the node hierarchy, collecting every mesh with its world matrix
+static void CollectMeshInstances(const JsonValue& gltf, int nodeIndex, FXMMATRIX parent,
+	std::vector<MeshInstance>& instances, int depth)
+{
+	const JsonValue* nodes = gltf.Find("nodes");
+	if (!nodes || nodeIndex < 0 || nodeIndex >= (int)nodes->elements.size() || depth > 64)
+		return;
+
+	const JsonValue& node = nodes->elements[nodeIndex];
+	XMMATRIX world = GetNodeMatrix(node) * parent;
+
+	int mesh = node.GetInt("mesh", -1);
+	if (mesh >= 0)
+	{
+		MeshInstance instance;
+		instance.mesh = mesh;
+		XMStoreFloat4x4(&instance.world, world);
+		instances.push_back(instance);
+	}
+
+	const JsonValue* children = node.Find("children");
+	if (children)
+	{
+		for (const JsonValue& child : children->elements)
+			CollectMeshInstances(gltf, (int)child.number, world, instances, depth + 1);
+	}
+}
+
+GltfLoader::GltfLoader(const char* glbFile, bool convertToLeftHanded)
+	: file(glbFile),
+	valid(false),
+	convertToLeftHanded(convertToLeftHanded),
+	vertices(0),
+	vertexCount(0),
+	indices(0),
+	indexCount(0)
+{
+	if (file.IsOpen())
+		valid = Parse();
+}
+
+bool GltfLoader::Parse()
+{
+	const unsigned char* data = file.GetData();
+	size_t size = file.GetSize();
+
+	// Header: magic, version, total length
+	if (size < 20)
+		return false;
+	const unsigned int* header = (const unsigned int*)data;
+	if (header[0] != GlbMagic || header[1] != 2 || header[2] > size)
+		return false;
+
+	// First chunk must be the JSON document
+	unsigned int jsonLength = header[3];
+	if (header[4] != GlbChunkJson || 20 + (size_t)jsonLength > size)
+		return false;
+
+	JsonValue gltf;
+	JsonParser parser((const char*)data + 20, jsonLength);
+	if (!parser.Parse(gltf) || gltf.type != JsonValue::Object)
+		return false;
+
+	// Optional second chunk holds the binary buffer
+	const unsigned char* bin = 0;
+	size_t binSize = 0;
+	size_t binHeader = 20 + (size_t)((jsonLength + 3) & ~3u);
+	if (binHeader + 8 <= size)
+	{
+		const unsigned int* chunk = (const unsigned int*)(data + binHeader);
+		if (chunk[1] == GlbChunkBin && binHeader + 8 + chunk[0] <= size)
+		{
+			bin = data + binHeader + 8;
+			binSize = chunk[0];
+		}
+	}
+	if (!bin)
+		return false;
+
+	// Material slots follow the file's material array
+	const JsonValue* materials = gltf.Find("materials");
+	if (materials)
+	{
+		for (const JsonValue& material : materials->elements)
+		{
+			const JsonValue* name = material.Find("name");
+			materialNames.push_back(name ? name->string : "");
+		}
+	}
+
+	// Finds every mesh placed by the default scene, or every mesh if there's no scene
+	std::vector<MeshInstance> instances;
+	const JsonValue* scenes = gltf.Find("scenes");
+	int sceneIndex = gltf.GetInt("scene", 0);
+	if (scenes && sceneIndex < (int)scenes->elements.size())
+	{
+		const JsonValue* roots = scenes->elements[sceneIndex].Find("nodes");
+		if (roots)
+		{
+			for (const JsonValue& root : roots->elements)
+				CollectMeshInstances(gltf, (int)root.number, XMMatrixIdentity(), instances, 0);
+		}
+	}
+	const JsonValue* meshes = gltf.Find("meshes");
+	if (!meshes)
+		return false;
+	if (instances.empty())
+	{
+		for (int m = 0; m < (int)meshes->elements.size(); m++)
+		{
+			MeshInstance instance;
+			instance.mesh = m;
+			XMStoreFloat4x4(&instance.world, XMMatrixIdentity());
+			instances.push_back(instance);
+		}
+	}
+
+	// Gathers the triangle primitives to load
+	struct PrimitiveViews
+	{
+		AccessorView position, normal, uv, tangent, index;
+		bool hasNormal, hasUV, hasTangent, hasIndex;
+		unsigned int materialSlot;
+		int instance;
+	};
+	std::vector<PrimitiveViews> primitiveViews;
+
+	for (int i = 0; i < (int)instances.size(); i++)
+	{
+		if (instances[i].mesh < 0 || instances[i].mesh >= (int)meshes->elements.size())
+			continue;
+
+		const JsonValue* meshPrimitives = meshes->elements[instances[i].mesh].Find("primitives");
+		if (!meshPrimitives)
+			continue;
+
+		for (const JsonValue& primitive : meshPrimitives->elements)
+		{
+			// Only triangle lists (mode 4, the default) are drawable here
+			const JsonValue* attributes = primitive.Find("attributes");
+			if (primitive.GetInt("mode", 4) != 4 || !attributes)
+				continue;
+
+			PrimitiveViews views = {};
+			views.instance = i;
+			if (!GetAccessorView(gltf, attributes->GetInt("POSITION", -1), bin, binSize, views.position) ||
+				views.position.componentType != ComponentFloat || views.position.components != 3)
+				continue;
+
+			views.hasNormal = GetAccessorView(gltf, attributes->GetInt("NORMAL", -1), bin, binSize, views.normal) &&
+				views.normal.componentType == ComponentFloat && views.normal.count == views.position.count;
+			views.hasUV = GetAccessorView(gltf, attributes->GetInt("TEXCOORD_0", -1), bin, binSize, views.uv) &&
+				views.uv.count == views.position.count;
+			views.hasTangent = GetAccessorView(gltf, attributes->GetInt("TANGENT", -1), bin, binSize, views.tangent) &&
+				views.tangent.componentType == ComponentFloat && views.tangent.components >= 3 &&
+				views.tangent.count == views.position.count;
+
+			// Indices must be unsigned bytes, shorts or ints. A primitive whose
+			// indices can't be read is skipped rather than drawn unindexed.
+			int indexAccessor = primitive.GetInt("indices", -1);
+			views.hasIndex = indexAccessor >= 0;
+			if (views.hasIndex &&
+				(!GetAccessorView(gltf, indexAccessor, bin, binSize, views.index) || views.index.components != 1 ||
+				(views.index.componentType != ComponentUnsignedByte &&
+				views.index.componentType != ComponentUnsignedShort &&
+				views.index.componentType != ComponentUnsignedInt)))
+				continue;
+
+			// Primitives without a material get their own unnamed slot
+			int material = primitive.GetInt("material", -1);
+			if (material < 0 || material >= (int)materialNames.size())
+			{
+				material = (int)materialNames.size();
+				materialNames.push_back("");
+			}
+			views.materialSlot = material;
+
+			primitiveViews.push_back(views);
+		}
+	}
+	if (primitiveViews.empty())
+		return false;
+
+	// Every primitive is converted in one pass into the merged buffers
+	size_t totalVertices = 0, totalIndices = 0;
+	for (const PrimitiveViews& views : primitiveViews)
+	{
+		totalVertices += views.position.count;
+		totalIndices += views.hasIndex ? views.index.count : views.position.count;
+	}
+	convertedVertices.resize(totalVertices);
+	convertedIndices.reserve(totalIndices);
+
+	// Mirrors Z when going from right to left handed space
+	XMMATRIX handedness = convertToLeftHanded ? XMMatrixScaling(1, 1, -1) : XMMatrixIdentity();
+	unsigned int baseVertex = 0;
+
+	for (const PrimitiveViews& views : primitiveViews)
+	{
+		Submesh submesh = {};
+		submesh.startIndex = (unsigned int)convertedIndices.size();
+		submesh.materialSlot = views.materialSlot;
+
+		// Positions and tangents use the world matrix, normals its inverse transpose
+		XMMATRIX world = XMLoadFloat4x4(&instances[views.instance].world) * handedness;
+		XMMATRIX normalMatrix = XMMatrixInverse(0, XMMatrixTranspose(world));
+		Vertex* out = &convertedVertices[baseVertex];
+
+		// glTF's bitangent is cross(normal, tangent) * w. The pixel shader uses
+		// cross(tangent, normal) * w, which only agrees once the space has been
+		// mirrored, so w flips for instances that don't end up mirrored.
+		float handednessSign = XMVectorGetX(XMMatrixDeterminant(world)) < 0 ? 1.0f : -1.0f;
+
+		for (unsigned int v = 0; v < views.position.count; v++)
+		{
+			XMVECTOR pos = XMLoadFloat3((const XMFLOAT3*)(views.position.data + v * views.position.stride));
+			XMStoreFloat3(&out[v].Position, XMVector3Transform(pos, world));
+
+			if (views.hasNormal)
+			{
+				XMVECTOR normal = XMLoadFloat3((const XMFLOAT3*)(views.normal.data + v * views.normal.stride));
+				XMStoreFloat3(&out[v].Normal, XMVector3Normalize(XMVector3TransformNormal(normal, normalMatrix)));
+			}
+			else
+			{
+				out[v].Normal = XMFLOAT3(0, 1, 0);
+			}
+
+			if (views.hasTangent)
+			{
+				// TANGENT is a VEC4 whose w (+1 or -1) says which way the bitangent points
+				const float* tangent = (const float*)(views.tangent.data + v * views.tangent.stride);
+				float w = views.tangent.components == 4 && tangent[3] < 0 ? -1.0f : 1.0f;
+				XMStoreFloat4(&out[v].Tangent, XMVectorSetW(XMVector3Normalize(
+					XMVector3TransformNormal(XMLoadFloat3((const XMFLOAT3*)tangent), world)), w * handednessSign));
+			}
+			else
+			{
+				out[v].Tangent = XMFLOAT4(0, 0, 0, 1);
+			}
+
+			// glTF already puts (0,0) at the top left like DirectX, so no flip is needed
+			if (views.hasUV)
+			{
+				const unsigned char* uv = views.uv.data + v * views.uv.stride;
+				out[v].UV.x = ReadComponent(uv, views.uv.componentType, views.uv.normalized, 0);
+				out[v].UV.y = ReadComponent(uv, views.uv.componentType, views.uv.normalized, 1);
+			}
+			else
+			{
+				out[v].UV = XMFLOAT2(0, 0);
+			}
+		}
+
+		// Keeps the file's indexing, rebased onto the merged vertex buffer. Only
+		// whole triangles are kept, so a stray index or two at the end can't
+		// shift every later primitive's triangles.
+		unsigned int count = views.hasIndex ? views.index.count : views.position.count;
+		count -= count % 3;
+		size_t start = convertedIndices.size();
+		for (unsigned int i = 0; i < count; i++)
+		{
+			unsigned int index = i;
+			if (views.hasIndex)
+			{
+				const unsigned char* element = views.index.data + i * views.index.stride;
+				index =
+					views.index.componentType == ComponentUnsignedInt ? *(const unsigned int*)element :
+					views.index.componentType == ComponentUnsignedShort ? *(const unsigned short*)element :
+					*element;
+
+				// An index past the primitive's vertices would read and write outside them
+				if (index >= views.position.count)
+					return false;
+			}
+			convertedIndices.push_back(baseVertex + index);
+		}
+
+		// Mirroring flips the winding, so swap two corners of every triangle
+		if (convertToLeftHanded)
+		{
+			for (size_t i = start; i + 2 < convertedIndices.size(); i += 3)
+				std::swap(convertedIndices[i + 1], convertedIndices[i + 2]);
+		}
+
+		submesh.indexCount = count;
+		submeshes.push_back(submesh);
+
+		GltfPrimitive primitive = {};
+		primitive.firstVertex = baseVertex;
+		primitive.vertexCount = views.position.count;
+		primitive.hasTangents = views.hasTangent;
+		primitives.push_back(primitive);
+		baseVertex += views.position.count;
+	}
+
+	vertices = convertedVertices.data();
+	vertexCount = (unsigned int)convertedVertices.size();
+	indices = convertedIndices.data();
+	indexCount = (unsigned int)convertedIndices.size();
+
+	return vertexCount > 0 && indexCount > 0;
+}
+
+bool GltfLoader::IsValid() { return valid; }
+
+const Vertex* GltfLoader::GetVertices() { return vertices; }
+
+unsigned int GltfLoader::GetVertexCount() { return vertexCount; }
+
+const unsigned int* GltfLoader::GetIndices() { return indices; }
+
+unsigned int GltfLoader::GetIndexCount() { return indexCount; }
+
+std::vector<Vertex>& GltfLoader::GetConvertedVertices() { return convertedVertices; }
+
+const std::vector<Submesh>& GltfLoader::GetSubmeshes() { return submeshes; }
+
+const std::vector<GltfPrimitive>& GltfLoader::GetPrimitives() { return primitives; }
+
+const std::vector<std::string>& GltfLoader::GetMaterialNames() { return materialNames; }
@@ -0,0 +1,69 @@
+#pragma once
+#include "Mesh.h"
+#include "MappedFile.h"
+#include "Vertex.h"
+
+#include <string>
+#include <vector>
+
+// Where one primitive's vertices are in the merged buffer (its
+// submesh has the same index), and whether the file gave them tangents
+struct GltfPrimitive
+{
+	unsigned int firstVertex;
+	unsigned int vertexCount;
+	bool hasTangents;
+};
+
+// --------------------------------------------------------
+// Loads the triangle geometry of a binary glTF 2.0 (.glb)
+// file. The file is memory mapped and accessors are read
+// in place, converting every primitive into one merged
+// vertex and index buffer in a single pass. The file's own
+// indexing and tangents (with their handedness) are kept.
+// --------------------------------------------------------
+class GltfLoader
+{
+private:
+	MappedFile file;
+	bool valid;
+	bool convertToLeftHanded;
+
+	// Upload-ready data, pointing into the converted copies
+	const Vertex* vertices;
+	unsigned int vertexCount;
+	const unsigned int* indices;
+	unsigned int indexCount;
+	std::vector<Vertex> convertedVertices;
+	std::vector<unsigned int> convertedIndices;
+
+	// One submesh per primitive, slots follow the file's material array
+	std::vector<Submesh> submeshes;
+	std::vector<GltfPrimitive> primitives;
+	std::vector<std::string> materialNames;
+
+	bool Parse();
+
+public:
+	// Ctor - glTF is right handed, so by default geometry is mirrored
+	// into DirectX's left handed space (which always needs a conversion)
+	GltfLoader(const char* glbFile, bool convertToLeftHanded = true);
+
+	bool IsValid();
+
+	// Vertex and index data ready for CreateBuffer
+	const Vertex* GetVertices();
+	unsigned int GetVertexCount();
+	const unsigned int* GetIndices();
+	unsigned int GetIndexCount();
+
+	// Converted vertices, which can be edited
+	std::vector<Vertex>& GetConvertedVertices();
+
+	const std::vector<Submesh>& GetSubmeshes();
+	const std::vector<std::string>& GetMaterialNames();
+
+	// Primitives without a TANGENT attribute need their tangents built
+	const std::vector<GltfPrimitive>& GetPrimitives();
+};
+
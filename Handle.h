@@ -0,0 +1,129 @@
+#pragma once
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// A handle's 32 bits are split into a slot index and the slot's generation
+#define HANDLE_INDEX_BITS 20
+#define HANDLE_GENERATION_BITS 12
+#define HANDLE_INDEX_MASK ((1u << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GENERATION_MASK ((1u << HANDLE_GENERATION_BITS) - 1)
+
+// --------------------------------------------------------
+// A 32 bit reference to something in a pool. The slot's
+// generation goes up each time it's freed, so a handle kept
+// past its object's removal just stops resolving instead of
+// pointing at whatever reuses the slot. Generations start
+// at 1, so a zeroed handle is always null.
+// --------------------------------------------------------
+template<typename T> struct Handle
+{
+	unsigned int value;
+
+	static Handle Make(unsigned int index, unsigned int generation)
+	{
+		Handle handle = { (generation << HANDLE_INDEX_BITS) | (index & HANDLE_INDEX_MASK) };
+		return handle;
+	}
+
+	unsigned int GetIndex() const { return value & HANDLE_INDEX_MASK; }
+	unsigned int GetGeneration() const { return value >> HANDLE_INDEX_BITS; }
+	bool IsNull() const { return value == 0; }
+};
+
+template<typename T> inline bool operator==(Handle<T> a, Handle<T> b) { return a.value == b.value; }
+template<typename T> inline bool operator!=(Handle<T> a, Handle<T> b) { return a.value != b.value; }
+
+// Next generation for a freed slot, wrapping around but never back to 0
+inline unsigned int NextHandleGeneration(unsigned int generation)
+{
+	return generation >= HANDLE_GENERATION_MASK ? 1 : generation + 1;
+}
+
+// --------------------------------------------------------
+// Owns shared objects and hands out handles to them. The
+// pool holds the only reference the render paths need, so
+// resolving a handle is an index and a compare that gives
+// back a plain pointer, with no reference counting.
+//
+// Adding and removing are for the main thread; resolving
+// is safe from any thread while nothing is being added.
+// --------------------------------------------------------
+template<typename T> class HandlePool
+{
+private:
+	struct Slot
+	{
+		std::shared_ptr<T> object;
+		unsigned int generation;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<unsigned int> freeIndices;
+	std::unordered_map<T*, unsigned int> indices;	// Of each object, so it's only added once
+
+public:
+	// Adds an object, or gets its existing handle if it's already in the pool.
+	// Returns a null handle for null objects or once every index is in use.
+	Handle<T> Add(std::shared_ptr<T> object)
+	{
+		Handle<T> handle = {};
+		if (!object)
+			return handle;
+
+		typename std::unordered_map<T*, unsigned int>::iterator existing = indices.find(object.get());
+		if (existing != indices.end())
+			return Handle<T>::Make(existing->second, slots[existing->second].generation);
+
+		unsigned int index;
+		if (!freeIndices.empty())
+		{
+			index = freeIndices.back();
+			freeIndices.pop_back();
+		}
+		else
+		{
+			if (slots.size() > HANDLE_INDEX_MASK)
+				return handle;
+
+			index = (unsigned int)slots.size();
+			Slot slot = { 0, 1 };
+			slots.push_back(slot);
+		}
+
+		slots[index].object = object;
+		indices[object.get()] = index;
+		return Handle<T>::Make(index, slots[index].generation);
+	}
+
+	// Lets go of the object; handles to it stop resolving
+	void Remove(Handle<T> handle)
+	{
+		if (!Get(handle))
+			return;
+
+		Slot& slot = slots[handle.GetIndex()];
+		indices.erase(slot.object.get());
+		slot.object.reset();
+		slot.generation = NextHandleGeneration(slot.generation);
+		freeIndices.push_back(handle.GetIndex());
+	}
+
+	// Null if the handle is null or its object was removed
+	T* Get(Handle<T> handle) const
+	{
+		unsigned int index = handle.GetIndex();
+		if (index >= slots.size() || slots[index].generation != handle.GetGeneration())
+			return 0;
+		return slots[index].object.get();
+	}
+
+	// For code that needs to share ownership (not for drawing)
+	std::shared_ptr<T> GetShared(Handle<T> handle) const
+	{
+		return Get(handle) ? slots[handle.GetIndex()].object : std::shared_ptr<T>();
+	}
+
+	int GetCount() const { return (int)indices.size(); }
+};
+
@@ -0,0 +1,125 @@
+#include "JobSystem.h"
+
+JobSystem* JobSystem::instance;
+
+// Set on the workers, and on any thread while it runs pieces
+static thread_local bool inJob = false;
+
+JobSystem::JobSystem()
+	: stopping(false), threadLimit(0), batchNumber(0), busyWorkers(0), func(0), count(0), pieceSize(1), pieceCount(0), nextPiece(0)
+{
+	// The thread calling ParallelFor works as well, so one fewer worker than cores
+	unsigned int cores = std::thread::hardware_concurrency();
+	unsigned int workerCount = cores > 1 ? cores - 1 : 0;
+	for (unsigned int i = 0; i < workerCount; i++)
+		workers.push_back(std::thread(&JobSystem::WorkerLoop, this, (int)i));
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		stopping = true;
+	}
+	batchReady.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	instance = 0;
+}
+
+int JobSystem::GetThreadCount() { return (int)workers.size() + 1; }
+
+void JobSystem::SetThreadLimit(int threads)
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+	threadLimit = threads > 0 && threads < GetThreadCount() ? threads : 0;
+}
+
+int JobSystem::GetThreadLimit()
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+	return threadLimit > 0 ? threadLimit : GetThreadCount();
+}
+
+void JobSystem::ParallelFor(size_t count, size_t pieceSize, const std::function<void(size_t, size_t)>& func)
+{
+	if (count == 0)
+		return;
+	if (pieceSize == 0)
+		pieceSize = 1;
+
+	// Nothing to share it with, or already inside a job (threadLimit only
+	// changes between ParallelFors, on the thread that calls them)
+	if (workers.empty() || threadLimit == 1 || count <= pieceSize || inJob)
+	{
+		bool wasInJob = inJob;
+		inJob = true;
+		for (size_t first = 0; first < count; first += pieceSize)
+			func(first, first + pieceSize < count ? first + pieceSize : count);
+		inJob = wasInJob;
+		return;
+	}
+
+	std::lock_guard<std::mutex> batchLock(batchMutex);
+	{
+		// A worker that woke late for the last batch may still be looking at it
+		std::unique_lock<std::mutex> lock(stateMutex);
+		workersIdle.wait(lock, [this]() { return busyWorkers == 0; });
+
+		this->func = &func;
+		this->count = count;
+		this->pieceSize = pieceSize;
+		pieceCount = (count + pieceSize - 1) / pieceSize;
+		nextPiece = 0;
+		batchNumber++;
+	}
+	batchReady.notify_all();
+
+	inJob = true;
+	RunPieces();
+	inJob = false;
+
+	// Every piece has been taken; wait for the ones still running
+	std::unique_lock<std::mutex> lock(stateMutex);
+	workersIdle.wait(lock, [this]() { return busyWorkers == 0; });
+}
+
+void JobSystem::WorkerLoop(int index)
+{
+	inJob = true;
+	unsigned int seenBatch = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(stateMutex);
+			batchReady.wait(lock, [this, seenBatch]() { return stopping || batchNumber != seenBatch; });
+			if (stopping)
+				return;
+
+			seenBatch = batchNumber;
+			if (threadLimit > 0 && index + 1 >= threadLimit)
+				continue;
+			busyWorkers++;
+		}
+
+		RunPieces();
+
+		{
+			std::lock_guard<std::mutex> lock(stateMutex);
+			busyWorkers--;
+		}
+		workersIdle.notify_all();
+	}
+}
+
+void JobSystem::RunPieces()
+{
+	// Pieces are claimed in any order, but each always covers the same indices
+	size_t piece;
+	while ((piece = nextPiece++) < pieceCount)
+	{
+		size_t first = piece * pieceSize;
+		(*func)(first, first + pieceSize < count ? first + pieceSize : count);
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// A pool of worker threads for data-parallel work over
+// index ranges, started once instead of per call.
+//
+// ParallelFor splits the range into pieces that depend only
+// on the count and piece size, never on timing, so work that
+// writes only to its own indices gives the same results on
+// any number of cores. The calling thread works too, and a
+// ParallelFor started from inside a job just runs inline.
+// --------------------------------------------------------
+class JobSystem
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static JobSystem& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new JobSystem();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	JobSystem(JobSystem const&) = delete;
+	void operator=(JobSystem const&) = delete;
+
+private:
+	static JobSystem* instance;
+	JobSystem();
+#pragma endregion
+
+public:
+	// Stops the workers (nothing can be running by then)
+	~JobSystem();
+
+	// Calls func(first, last) for pieces of [0, count) at most pieceSize long,
+	// spread over the workers, and returns once every piece is done
+	void ParallelFor(size_t count, size_t pieceSize, const std::function<void(size_t, size_t)>& func);
+
+	// Threads that take pieces, counting the one calling ParallelFor
+	int GetThreadCount();
+
+	// Caps how many of those threads take pieces (0 for all of them), so
+	// scaling can be measured. Not to be called during a ParallelFor.
+	void SetThreadLimit(int threads);
+	int GetThreadLimit();
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex batchMutex;		// Held by the thread running a ParallelFor
+	std::mutex stateMutex;		// Guards everything below but nextPiece
+	std::condition_variable batchReady;
+	std::condition_variable workersIdle;
+	bool stopping;
+	int threadLimit;			// 0, or workers numbered threadLimit - 1 and up sit batches out
+	unsigned int batchNumber;	// Bumped per ParallelFor, so workers know there's new work
+	int busyWorkers;
+
+	// The current ParallelFor, only changed while no worker is busy
+	const std::function<void(size_t, size_t)>* func;
+	size_t count;
+	size_t pieceSize;
+	size_t pieceCount;
+	std::atomic<size_t> nextPiece;
+
+	void WorkerLoop(int index);
+	void RunPieces();
+};
+
@@ -0,0 +1,30 @@
+#pragma once
+#include <Windows.h>
+
+// --------------------------------------------------------
+// A read-only memory-mapped view of a whole file. The
+// mapping stays valid for the lifetime of this object, so
+// loaders can point straight into the file's bytes.
+// --------------------------------------------------------
+class MappedFile
+{
+private:
+	HANDLE file;
+	HANDLE mapping;
+	const unsigned char* data;
+	size_t size;
+
+public:
+	// Maps the entire file, leaving the object empty on failure
+	MappedFile(const char* fileName);
+	~MappedFile();
+
+	// Mappings own OS handles, so they can't be copied
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool IsOpen();
+	const unsigned char* GetData();
+	size_t GetSize();
+};
+
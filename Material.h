@@ -1,4 +1,5 @@
 #pragma once
+#include "Handle.h"
 #include "SimpleShader.h"
 
 #include <DirectXMath.h>
@@ -9,8 +10,8 @@ class Material
 {
 private:
 	DirectX::XMFLOAT4 colorTint;
-	std::shared_ptr<SimpleVertexShader> vertexShader;
-	std::shared_ptr<SimplePixelShader> pixelShader;
+	Handle<SimpleVertexShader> vertexShader;	// Into the Resources shader pools
+	Handle<SimplePixelShader> pixelShader;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
 
@@ -30,10 +31,14 @@ public:
 	std::shared_ptr<SimplePixelShader> GetPixelShader();
 	void SetPixelShader(std::shared_ptr<SimplePixelShader> pixelShader);
 
+	// What drawing uses, since resolving these doesn't touch reference counts
+	Handle<SimpleVertexShader> GetVertexShaderHandle();
+	Handle<SimplePixelShader> GetPixelShaderHandle();
+
 	// Methods
 	void AddTextureSRV(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	void AddSampler(std::string samplerName, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
 
-	void PrepareMaterial(std::shared_ptr<SimplePixelShader> ps);
+	void PrepareMaterial(SimplePixelShader* ps);
 };
 
@@ -1,16 +1,94 @@
 #include "Mesh.h"
+#include "GltfLoader.h"
+#include "MeshBVH.h"
+#include "MeshCache.h"
+#include "MeshResidency.h"
+#include "MeshSimplifier.h"
 #include <fstream>
 #include <vector>
+#include <cstring>
+#include <memory>
+
+// Reads the material names declared in an .mtl file, in declaration order,
+// so material slots line up with the order the artist authored them in
+static void LoadMaterialSlotNames(const std::string& mtlFile, std::vector<std::string>& names)
+{
+	std::ifstream mtl(mtlFile);
+	if (!mtl.is_open())
+		return;
+
+	std::string line;
+	while (std::getline(mtl, line))
+	{
+		if (line.compare(0, 7, "newmtl ") != 0)
+			continue;
+
+		std::string name = line.substr(7);
+		while (!name.empty() && (name.back() == '\r' || name.back() == ' '))
+			name.pop_back();
+		names.push_back(name);
+	}
+}
+
+// Returns the slot for a material name, adding a new slot if it hasn't been seen
+static unsigned int FindOrAddMaterialSlot(const std::string& name,
+	std::vector<std::string>& names, std::vector<unsigned int>& slotTriangles)
+{
+	for (unsigned int i = 0; i < names.size(); i++)
+	{
+		if (names[i] == name)
+			return i;
+	}
+
+	names.push_back(name);
+	slotTriangles.resize(names.size());
+	return (unsigned int)names.size() - 1;
+}
+
+// Counts the corners of an OBJ face line ("f 1/1/1 2/2/2 3/3/3" has 3)
+static int CountFaceCorners(const char* line)
+{
+	int corners = 0;
+	for (const char* c = line + 1; *c; c++)
+	{
+		if (*c != ' ' && *c != '\t' && *c != '\r' && (c[-1] == ' ' || c[-1] == '\t'))
+			corners++;
+	}
+	return corners;
+}
 
 // Constructor
 Mesh::Mesh(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount,
 	Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: importStats(), hasBounds(false), levelCount(1), residentLevel(0), streamPending(false)
 {
 	CreateMesh(vertices, vertexCount, indices, indexCount, device);
 }
 
+Mesh::Mesh(MeshCache& cache, int level, Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: importStats(), hasBounds(false), levelCount(1), residentLevel(0), streamPending(false)
+{
+	LoadLevel(cache, level, device);
+}
+
 Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: importStats(), hasBounds(false), levelCount(1), residentLevel(0), streamPending(false)
 {
+	// Binary glTF has its own, much cheaper, loading path
+	size_t nameLength = strlen(objFile);
+	if (nameLength > 4 && _stricmp(objFile + nameLength - 4, ".glb") == 0)
+	{
+		LoadGLB(objFile, device);
+		return;
+	}
+
+	// As do pre-processed mesh caches
+	if (nameLength > 5 && _stricmp(objFile + nameLength - 5, ".mesh") == 0)
+	{
+		LoadCache(objFile, device);
+		return;
+	}
+
 	// Author: Chris Cascioli
 // Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
 // 
@@ -29,14 +107,103 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 		return;
 
 	// Variables used while reading the file
-	std::vector<XMFLOAT3> positions;	// Positions from the file
-	std::vector<XMFLOAT3> normals;		// Normals from the file
-	std::vector<XMFLOAT2> uvs;		// UVs from the file
-	std::vector<Vertex> verts;		// Verts we're assembling
-	std::vector<UINT> indices;		// Indices of these verts
+	unsigned int positionCount = 0;		// Number of "v" lines
+	unsigned int normalCount = 0;		// Number of "vn" lines
+	unsigned int uvCount = 0;		// Number of "vt" lines
+	std::vector<unsigned int> slotTriangles;	// Triangles in each usemtl material slot
+	int currentSlot = -1;			// Material slot of the faces being read
+	char chars[100];			// String for line reading
+
+	// Pre-scan: count everything first so every array can be allocated once,
+	// at its exact size, instead of growing (and briefly doubling) as we go
+	while (obj.good())
+	{
+		// Get the line (100 characters should be more than enough)
+		obj.getline(chars, 100);
+
+		// Check the type of line
+		if (strncmp(chars, "mtllib ", 7) == 0)
+		{
+			// Seed the material slots from the .mtl next to the .obj
+			std::string objPath(objFile);
+			size_t slash = objPath.find_last_of("/\\");
+			std::string folder = slash == std::string::npos ? "" : objPath.substr(0, slash + 1);
+			std::string mtlName(chars + 7);
+			while (!mtlName.empty() && (mtlName.back() == '\r' || mtlName.back() == ' '))
+				mtlName.pop_back();
+
+			LoadMaterialSlotNames(folder + mtlName, materialNames);
+			slotTriangles.resize(materialNames.size());
+		}
+		else if (strncmp(chars, "usemtl ", 7) == 0)
+		{
+			// Following faces belong to this material's submesh
+			std::string name(chars + 7);
+			while (!name.empty() && (name.back() == '\r' || name.back() == ' '))
+				name.pop_back();
+
+			currentSlot = FindOrAddMaterialSlot(name, materialNames, slotTriangles);
+		}
+		else if (chars[0] == 'v' && chars[1] == 'n')
+			normalCount++;
+		else if (chars[0] == 'v' && chars[1] == 't')
+			uvCount++;
+		else if (chars[0] == 'v')
+			positionCount++;
+		else if (chars[0] == 'f')
+		{
+			// Faces before any usemtl go into an unnamed slot
+			if (currentSlot < 0)
+				currentSlot = FindOrAddMaterialSlot("", materialNames, slotTriangles);
+
+			// A 4th corner (the most the face reader below uses) adds a second triangle
+			slotTriangles[currentSlot] += CountFaceCorners(chars) >= 4 ? 2 : 1;
+		}
+	}
+
+	// Each material's triangles get a contiguous range of the index buffer,
+	// so every usemtl group becomes one submesh within a single shared buffer
+	std::vector<unsigned int> slotStarts(slotTriangles.size());	// First index of each slot
+	unsigned int triangleCount = 0;
+	for (unsigned int slot = 0; slot < slotTriangles.size(); slot++)
+	{
+		slotStarts[slot] = triangleCount * 3;
+		triangleCount += slotTriangles[slot];
+	}
+	std::vector<unsigned int> slotCursors(slotStarts);	// Next index to write per slot
+	if (triangleCount == 0)
+		return;
+
+	// One scratch allocation holds every attribute read from the file (plus
+	// room for the fallback uv), while the vertices and indices are built
+	// straight into the mesh's own CPU copies, which also stage the upload
+	size_t scratchFloats = positionCount * 3 + normalCount * 3 + (uvCount + 1) * 2;
+	std::unique_ptr<float[]> scratch(new float[scratchFloats]);
+	XMFLOAT3* positions = (XMFLOAT3*)scratch.get();			// Positions from the file
+	XMFLOAT3* normals = (XMFLOAT3*)(scratch.get() + positionCount * 3);	// Normals from the file
+	XMFLOAT2* uvs = (XMFLOAT2*)(scratch.get() + positionCount * 3 + normalCount * 3);	// UVs from the file
+	vertices.resize(triangleCount * 3);	// Verts we're assembling
+	indices.resize(triangleCount * 3);	// Indices of these verts
+	Vertex* verts = &vertices[0];
+	unsigned int positionCounter = 0;	// Count of positions read
+	unsigned int normalCounter = 0;		// Count of normals read
+	unsigned int uvCounter = 0;		// Count of uvs read
 	int vertCounter = 0;			// Count of vertices
 	int indexCounter = 0;			// Count of indices
-	char chars[100];			// String for line reading
+	currentSlot = -1;
+
+	importStats.positionCount = positionCount;
+	importStats.normalCount = normalCount;
+	importStats.uvCount = uvCount;
+	importStats.vertexCount = triangleCount * 3;
+	importStats.indexCount = triangleCount * 3;
+	importStats.scratchBytes = scratchFloats * sizeof(float);
+	importStats.peakBytes = importStats.scratchBytes +
+		vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+
+	// Second pass reads the actual data
+	obj.clear();
+	obj.seekg(0);
 
 	// Still have data left?
 	while (obj.good())
@@ -45,7 +212,16 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 		obj.getline(chars, 100);
 
 		// Check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n')
+		if (strncmp(chars, "usemtl ", 7) == 0)
+		{
+			// Following faces belong to this material's submesh
+			std::string name(chars + 7);
+			while (!name.empty() && (name.back() == '\r' || name.back() == ' '))
+				name.pop_back();
+
+			currentSlot = FindOrAddMaterialSlot(name, materialNames, slotTriangles);
+		}
+		else if (chars[0] == 'v' && chars[1] == 'n')
 		{
 			// Read the 3 numbers directly into an XMFLOAT3
 			XMFLOAT3 norm;
@@ -55,7 +231,7 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 				&norm.x, &norm.y, &norm.z);
 
 			// Add to the list of normals
-			normals.push_back(norm);
+			normals[normalCounter++] = norm;
 		}
 		else if (chars[0] == 'v' && chars[1] == 't')
 		{
@@ -67,7 +243,7 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 				&uv.x, &uv.y);
 
 			// Add to the list of uv's
-			uvs.push_back(uv);
+			uvs[uvCounter++] = uv;
 		}
 		else if (chars[0] == 'v')
 		{
@@ -79,7 +255,7 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 				&pos.x, &pos.y, &pos.z);
 
 			// Add to the positions
-			positions.push_back(pos);
+			positions[positionCounter++] = pos;
 		}
 		else if (chars[0] == 'f')
 		{
@@ -120,10 +296,22 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 
 				// If we have no UVs, create a single UV coordinate
 				// that will be used for all vertices
-				if (uvs.size() == 0)
-					uvs.push_back(XMFLOAT2(0, 0));
+				if (uvCounter == 0)
+					uvs[uvCounter++] = XMFLOAT2(0, 0);
 			}
 
+			// Faces before any usemtl go into an unnamed slot
+			if (currentSlot < 0)
+				currentSlot = FindOrAddMaterialSlot("", materialNames, slotTriangles);
+			unsigned int& faceCursor = slotCursors[currentSlot];
+
+			// Faces the pre-scan sized differently (malformed lines) are dropped
+			// rather than allowed to run into the next slot's range
+			int faceTriangles = (numbersRead == 12 || numbersRead == 8) ? 2 : 1;
+			unsigned int slotEnd = slotStarts[currentSlot] + slotTriangles[currentSlot] * 3;
+			if (faceCursor + faceTriangles * 3 > slotEnd)
+				continue;
+
 			// - Create the verts by looking up
 			//    corresponding data from vectors
 			// - OBJ File indices are 1-based, so
@@ -170,15 +358,16 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 			v3.Normal.z *= -1.0f;
 
 			// Add the verts to the vector (flipping the winding order)
-			verts.push_back(v1);
-			verts.push_back(v3);
-			verts.push_back(v2);
+			verts[vertCounter] = v1;
+			verts[vertCounter + 1] = v3;
+			verts[vertCounter + 2] = v2;
+
+			// Add three more indices to this material's group
+			indices[faceCursor++] = vertCounter;
+			indices[faceCursor++] = vertCounter + 1;
+			indices[faceCursor++] = vertCounter + 2;
 			vertCounter += 3;
-
-			// Add three more indices
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
+			indexCounter += 3;
 
 			// Was there a 4th face?
 			// - 12 numbers read means 4 faces WITH uv's
@@ -197,15 +386,16 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 				v4.Normal.z *= -1.0f;
 
 				// Add a whole triangle (flipping the winding order)
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
+				verts[vertCounter] = v1;
+				verts[vertCounter + 1] = v4;
+				verts[vertCounter + 2] = v3;
+
+				// Add three more indices to this material's group
+				indices[faceCursor++] = vertCounter;
+				indices[faceCursor++] = vertCounter + 1;
+				indices[faceCursor++] = vertCounter + 2;
 				vertCounter += 3;
-
-				// Add three more indices
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
+				indexCounter += 3;
 			}
 		}
 	}
@@ -213,6 +403,30 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 	// Close the file and create the actual buffers
 	obj.close();
 
+	// Build the submesh table, closing any gaps left by dropped faces
+	indexCounter = 0;
+	for (unsigned int slot = 0; slot < slotTriangles.size(); slot++)
+	{
+		unsigned int start = slotStarts[slot];
+		unsigned int count = slotCursors[slot] - start;
+		if (count == 0)
+			continue;
+
+		Submesh submesh = {};
+		submesh.startIndex = indexCounter;
+		submesh.indexCount = count;
+		submesh.materialSlot = slot;
+		submeshes.push_back(submesh);
+
+		if (start != (unsigned int)indexCounter)
+			memmove(&indices[indexCounter], &indices[start], count * sizeof(unsigned int));
+		indexCounter += count;
+	}
+	vertices.resize(vertCounter);
+	indices.resize(indexCounter);
+	if (indexCounter == 0)
+		return;
+
 	// - At this point, "verts" is a vector of Vertex structs, and can be used
 	//    directly to create a vertex buffer:  &verts[0] is the address of the first vert
 	//
@@ -226,9 +440,9 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 	//    and detect duplicate vertices, but at that point it would be better to use a more
 	//    sophisticated model loading library like TinyOBJLoader or AssImp (yes, that's its name)
 	
-	// Creates vertex and index buffers
-	CalculateTangents(&verts[0], vertCounter, &indices[0], indexCounter);
-	CreateMesh(&verts[0], vertCounter, &indices[0], indexCounter, device);
+	// Creates vertex and index buffers, straight from the CPU copies
+	CalculateTangents(&vertices[0], vertCounter, &indices[0], indexCounter);
+	CreateMesh(&vertices[0], vertCounter, &indices[0], indexCounter, device);
 }
 
 Mesh::~Mesh()
@@ -237,15 +451,15 @@ Mesh::~Mesh()
 }
 
 // Returns vertex buffer ptr
-Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer()
+ID3D11Buffer* Mesh::GetVertexBuffer()
 {
-	return vertexBuffer;
+	return vertexBuffer.Get();
 }
 
 // Returns index buffer ptr
-Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer()
+ID3D11Buffer* Mesh::GetIndexBuffer()
 {
-	return indexBuffer;
+	return indexBuffer.Get();
 }
 
 // Returns index count for mesh
@@ -254,9 +468,28 @@ int Mesh::GetIndexCount()
 	return indexCount;
 }
 
+// Returns the CPU copies of the geometry
+const std::vector<Vertex>& Mesh::GetVertices() { return vertices; }
+const std::vector<unsigned int>& Mesh::GetIndices() { return indices; }
+
+// Returns the OBJ import memory report
+const MeshImportStats& Mesh::GetImportStats() { return importStats; }
+
+// Returns the submesh table
+int Mesh::GetSubmeshCount() { return (int)submeshes.size(); }
+const Submesh& Mesh::GetSubmesh(int index) { return submeshes[index]; }
+
+// Returns the material slot table
+int Mesh::GetMaterialSlotCount() { return (int)materialNames.size(); }
+const std::string& Mesh::GetMaterialSlotName(int slot) { return materialNames[slot]; }
+
 // Sets buffers and tells DirectX to draw the correct number of indices
 void Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
 {
+	// Whatever PrepareToDraw() last made resident (nothing if the mesh is evicted)
+	if (!vertexBuffer)
+		return;
+
 	// Set buffers in the input assembler
 	//  - Do this ONCE PER OBJECT you're drawing, since each object might
 	//    have different geometry.
@@ -279,12 +512,65 @@ void Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
 		0);    // Offset to add to each index when looking up vertices
 }
 
-void Mesh::CreateMesh(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount,
+// Keeps the mesh resident and up to date for a frame that's about to draw it
+bool Mesh::PrepareToDraw()
+{
+	// Reloads an evicted mesh in the background, then swaps in the finest level so far
+	MeshResidency::GetInstance().Touch(this);
+	ApplyStreamedLevel();
+	return !IsEvicted();
+}
+
+// Binds the vertex and index buffers once so several submeshes can share them
+void Mesh::SetBuffers(ID3D11DeviceContext* context)
+{
+	UINT stride = sizeof(Vertex);
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
+	context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+}
+
+// Draws one submesh's range of the already-bound index buffer
+void Mesh::DrawSubmesh(ID3D11DeviceContext* context, int index)
+{
+	const Submesh& submesh = submeshes[index];
+	context->DrawIndexed(submesh.indexCount, submesh.startIndex, 0);
+}
+
+void Mesh::CreateMesh(const Vertex* vertices, int vertexCount, const unsigned int* indices, int indexCount,
 	Microsoft::WRL::ComPtr<ID3D11Device> device)
 {
 	// Sets fields
+	this->device = device;
 	this->indexCount = indexCount;
 
+	// Keeps CPU copies (the OBJ loader already builds its geometry in them)
+	if (vertices != this->vertices.data())
+		this->vertices.assign(vertices, vertices + vertexCount);
+	if (indices != this->indices.data())
+		this->indices.assign(indices, indices + indexCount);
+
+	// Meshes built without material groups are a single submesh
+	if (submeshes.empty())
+	{
+		Submesh submesh = {};
+		submesh.startIndex = 0;
+		submesh.indexCount = indexCount;
+		submesh.materialSlot = 0;
+		submeshes.push_back(submesh);
+	}
+	if (materialNames.empty())
+		materialNames.push_back("");
+
+	if (!hasBounds && residentLevel == levelCount - 1)
+		ComputeBounds();
+
+	CreateBuffers(vertices, vertexCount, indices, indexCount, vertexBuffer, indexBuffer);
+}
+
+void Mesh::CreateBuffers(const Vertex* vertices, int vertexCount, const unsigned int* indices, int indexCount,
+	Microsoft::WRL::ComPtr<ID3D11Buffer>& vertexBufferOut, Microsoft::WRL::ComPtr<ID3D11Buffer>& indexBufferOut)
+{
 	// Create the VERTEX BUFFER description -----------------------------------
 	// - The description is created on the stack because we only need
 	//    it to create the buffer.  The description is then useless.
@@ -303,7 +589,7 @@ void Mesh::CreateMesh(Vertex* vertices, int vertexCount, unsigned int* indices,
 
 	// Actually create the buffer with the initial data
 	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&vbd, &initialVertexData, vertexBuffer.GetAddressOf());
+	device->CreateBuffer(&vbd, &initialVertexData, vertexBufferOut.ReleaseAndGetAddressOf());
 
 	// Create the INDEX BUFFER description ------------------------------------
 	// - The description is created on the stack because we only need
@@ -323,25 +609,292 @@ void Mesh::CreateMesh(Vertex* vertices, int vertexCount, unsigned int* indices,
 
 	// Actually create the buffer with the initial data
 	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&ibd, &initialIndexData, indexBuffer.GetAddressOf());
+	device->CreateBuffer(&ibd, &initialIndexData, indexBufferOut.ReleaseAndGetAddressOf());
+}
+
+void Mesh::LoadGLB(const char* glbFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	// Maps the file and reads its accessors in place
+	GltfLoader glb(glbFile);
+	if (!glb.IsValid())
+		return;
+
+	submeshes = glb.GetSubmeshes();
+	materialNames = glb.GetMaterialNames();
+
+	// glTF keeps its indexing and usually its tangents, so unlike OBJ there's
+	// nothing to re-triangulate and tangents are only built for the
+	// primitives that lack them (each has its own run of vertices)
+	std::vector<Vertex>& verts = glb.GetConvertedVertices();
+	const std::vector<GltfPrimitive>& primitives = glb.GetPrimitives();
+	for (size_t p = 0; p < primitives.size(); p++)
+	{
+		if (primitives[p].hasTangents || primitives[p].vertexCount == 0)
+			continue;
+
+		CalculateTangents(&verts[primitives[p].firstVertex], (int)primitives[p].vertexCount,
+			(unsigned int*)glb.GetIndices() + submeshes[p].startIndex, (int)submeshes[p].indexCount,
+			primitives[p].firstVertex);
+	}
+
+	CreateMesh(glb.GetVertices(), (int)glb.GetVertexCount(),
+		glb.GetIndices(), (int)glb.GetIndexCount(), device);
+}
+
+void Mesh::LoadCache(const char* cacheFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	MeshCache cache(cacheFile);
+	if (!cache.IsValid() || cache.GetLevelCount() == 0)
+		return;
+
+	LoadLevel(cache, cache.GetLevelCount() - 1, device);
+}
+
+void Mesh::LoadLevel(MeshCache& cache, int level, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	if (!cache.IsValid() || level < 0 || level >= (int)cache.GetLevelCount())
+		return;
+
+	// Everything was processed when the cache was written, so this
+	// is just decoding the chunks and uploading them
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> cacheIndices;
+	if (!cache.ReadLevel(level, verts, cacheIndices, submeshes) || !cache.ReadMaterialNames(materialNames))
+	{
+		submeshes.clear();
+		materialNames.clear();
+		return;
+	}
+
+	// Hulls and bounds are shared by every level, but the BVH only covers the full one
+	ConvexHull::Read(cache, collisionHulls);
+	hasBounds = cache.ReadBounds(boundsMin, boundsMax);
+	levelCount = (int)cache.GetLevelCount();
+	residentLevel = level;
+	if (level == levelCount - 1)
+	{
+		std::shared_ptr<MeshBVH> cachedBVH = std::make_shared<MeshBVH>();
+		if (cachedBVH->Read(cache))
+			bvh = cachedBVH;
+	}
+	CreateMesh(&verts[0], (int)verts.size(), &cacheIndices[0], (int)cacheIndices.size(), device);
+}
+
+bool Mesh::SaveCache(const char* cacheFile, bool compress)
+{
+	if (vertices.empty() || indices.empty() || !IsFullyResident())
+		return false;
+
+	// Clusters from finer to coarser grids, keeping a level only when it
+	// at least halves the triangles of the next finer level kept
+	const int resolutions[] = { 48, 16 };
+	std::vector<std::vector<Vertex>> lodVertices;
+	std::vector<std::vector<unsigned int>> lodIndices;
+	std::vector<std::vector<Submesh>> lodSubmeshes;
+	size_t finerIndexCount = indices.size();
+	for (int i = 0; i < 2; i++)
+	{
+		std::vector<Vertex> lodVerts;
+		std::vector<unsigned int> lodInds;
+		std::vector<Submesh> lodSubs;
+		MeshSimplifier::Cluster(vertices, indices, submeshes, resolutions[i], lodVerts, lodInds, lodSubs);
+		if (lodInds.empty() || lodInds.size() * 2 > finerIndexCount)
+			continue;
+
+		finerIndexCount = lodInds.size();
+		lodVertices.push_back(std::move(lodVerts));
+		lodIndices.push_back(std::move(lodInds));
+		lodSubmeshes.push_back(std::move(lodSubs));
+	}
+
+	// Written coarsest first, so a streaming reader gets something to draw soonest
+	MeshCacheWriter writer(compress);
+	writer.AddMaterialNames(materialNames);
+	for (size_t i = lodVertices.size(); i-- > 0;)
+	{
+		unsigned int level = (unsigned int)(lodVertices.size() - 1 - i);
+		writer.AddLod(level, lodVertices[i], lodIndices[i], lodSubmeshes[i]);
+	}
+	writer.AddGeometry(vertices, indices, submeshes);
+	if (hasBounds)
+		writer.AddBounds(boundsMin, boundsMax);
+	if (bvh)
+		bvh->Write(writer);
+	ConvexHull::Write(collisionHulls, writer);
+	return writer.Save(cacheFile);
+}
+
+bool Mesh::BuildBVH(bool parallel)
+{
+	if (indices.empty() || !IsFullyResident())
+		return false;
+
+	std::shared_ptr<MeshBVH> built = std::make_shared<MeshBVH>();
+	built->Build(vertices, indices, parallel);
+	bvh = built;
+	return true;
+}
+
+std::shared_ptr<MeshBVH> Mesh::GetBVH()
+{
+	ApplyStreamedLevel();
+	return bvh;
+}
+
+bool Mesh::GetBounds(XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+	ApplyStreamedLevel();
+	if (!hasBounds)
+		return false;
+
+	boundsMin = this->boundsMin;
+	boundsMax = this->boundsMax;
+	return true;
+}
+
+void Mesh::ComputeBounds()
+{
+	if (vertices.empty())
+		return;
+
+	boundsMin = boundsMax = vertices[0].Position;
+	for (size_t i = 1; i < vertices.size(); i++)
+	{
+		const XMFLOAT3& position = vertices[i].Position;
+		boundsMin.x = position.x < boundsMin.x ? position.x : boundsMin.x;
+		boundsMin.y = position.y < boundsMin.y ? position.y : boundsMin.y;
+		boundsMin.z = position.z < boundsMin.z ? position.z : boundsMin.z;
+		boundsMax.x = position.x > boundsMax.x ? position.x : boundsMax.x;
+		boundsMax.y = position.y > boundsMax.y ? position.y : boundsMax.y;
+		boundsMax.z = position.z > boundsMax.z ? position.z : boundsMax.z;
+	}
+	hasBounds = true;
+}
+
+bool Mesh::BuildCollisionHulls(int maxHulls, int maxVertices)
+{
+	if (indices.empty() || !IsFullyResident())
+		return false;
+
+	ConvexHull::Decompose(vertices, indices, maxHulls, maxVertices, collisionHulls);
+	return !collisionHulls.empty();
+}
+
+int Mesh::GetCollisionHullCount() { return (int)collisionHulls.size(); }
+
+ConvexHull& Mesh::GetCollisionHull(int index) { return collisionHulls[index]; }
+
+// Returns the level of detail info
+int Mesh::GetLevelCount() { return levelCount; }
+
+int Mesh::GetResidentLevel()
+{
+	ApplyStreamedLevel();
+	return residentLevel;
+}
+
+bool Mesh::IsFullyResident()
+{
+	ApplyStreamedLevel();
+	return residentLevel == levelCount - 1;
+}
+
+void Mesh::Evict()
+{
+	// Swapping with empty vectors is what actually gives their memory back
+	vertexBuffer.Reset();
+	indexBuffer.Reset();
+	indexCount = 0;
+	std::vector<Vertex>().swap(vertices);
+	std::vector<unsigned int>().swap(indices);
+	residentLevel = -1;
+}
+
+bool Mesh::IsEvicted() { return residentLevel < 0; }
+
+size_t Mesh::GetGPUBytes()
+{
+	if (!vertexBuffer)
+		return 0;
+	return vertices.size() * sizeof(Vertex) + indexCount * sizeof(unsigned int);
+}
+
+size_t Mesh::GetCPUBytes()
+{
+	return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+}
+
+void Mesh::PublishLevel(int level, std::vector<Vertex>& vertices,
+	std::vector<unsigned int>& indices, std::vector<Submesh>& submeshes,
+	std::shared_ptr<MeshBVH> levelBVH)
+{
+	if (vertices.empty() || indices.empty())
+		return;
+
+	// The device is free threaded, so the upload happens here on the streaming
+	// thread and the updating thread only has to swap a few pointers
+	StreamedLevel streamed;
+	streamed.level = level;
+	CreateBuffers(&vertices[0], (int)vertices.size(), &indices[0], (int)indices.size(),
+		streamed.vertexBuffer, streamed.indexBuffer);
+	streamed.vertices = std::move(vertices);
+	streamed.indices = std::move(indices);
+	streamed.submeshes = std::move(submeshes);
+	streamed.bvh = levelBVH;
+
+	// Only ever replace what's waiting with something finer
+	std::lock_guard<std::mutex> lock(streamMutex);
+	if (streamPending && pending.level >= level)
+		return;
+	pending = std::move(streamed);
+	streamPending = true;
+}
+
+void Mesh::ApplyStreamedLevel()
+{
+	// Cheap check first, since this runs for every draw
+	if (!streamPending)
+		return;
+
+	std::lock_guard<std::mutex> lock(streamMutex);
+	if (pending.level > residentLevel)
+	{
+		vertexBuffer = pending.vertexBuffer;
+		indexBuffer = pending.indexBuffer;
+		indexCount = (int)pending.indices.size();
+		vertices.swap(pending.vertices);
+		indices.swap(pending.indices);
+		submeshes.swap(pending.submeshes);
+		if (pending.bvh)
+			bvh = pending.bvh;
+		residentLevel = pending.level;
+
+		// Caches without stored bounds only get them with the full level
+		if (!hasBounds && residentLevel == levelCount - 1)
+			ComputeBounds();
+	}
+	pending = StreamedLevel();
+	streamPending = false;
 }
 
 // Calculates tangents
-void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
+void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices,
+	unsigned int baseVertex)
 {
-	// Reset tangents
+	// Reset tangents. Their w sums each triangle's vote on which way the
+	// bitangent points, so no per-vertex bitangents need to be kept.
 	for (int i = 0; i < numVerts; i++)
 	{
-		verts[i].Tangent = XMFLOAT3(0, 0, 0);
+		verts[i].Tangent = XMFLOAT4(0, 0, 0, 0);
 	}
 
 	// Calculate tangents one whole triangle at a time
 	for (int i = 0; i < numIndices;)
 	{
 		// Grab indices and vertices of first triangle
-		unsigned int i1 = indices[i++];
-		unsigned int i2 = indices[i++];
-		unsigned int i3 = indices[i++];
+		unsigned int i1 = indices[i++] - baseVertex;
+		unsigned int i2 = indices[i++] - baseVertex;
+		unsigned int i3 = indices[i++] - baseVertex;
 		Vertex* v1 = &verts[i1];
 		Vertex* v2 = &verts[i2];
 		Vertex* v3 = &verts[i3];
@@ -369,6 +922,10 @@ void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices,
 		float ty = (t2 * y1 - t1 * y2) * r;
 		float tz = (t2 * z1 - t1 * z2) * r;
 
+		float bx = (s1 * x2 - s2 * x1) * r;
+		float by = (s1 * y2 - s2 * y1) * r;
+		float bz = (s1 * z2 - s2 * z1) * r;
+
 		// Adjust tangents of each vert of the triangle
 		v1->Tangent.x += tx;
 		v1->Tangent.y += ty;
@@ -381,6 +938,18 @@ void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices,
 		v3->Tangent.x += tx;
 		v3->Tangent.y += ty;
 		v3->Tangent.z += tz;
+
+		// The shader's bitangent is cross(tangent, normal) * w, which should
+		// point up the texture (towards decreasing v, against b). Each corner
+		// votes for -1 when cross(tangent, normal) points along b.
+		XMVECTOR triangleTangent = XMVectorSet(tx, ty, tz, 0);
+		XMVECTOR triangleBitangent = XMVectorSet(bx, by, bz, 0);
+		Vertex* corners[3] = { v1, v2, v3 };
+		for (Vertex* corner : corners)
+		{
+			corner->Tangent.w += XMVectorGetX(XMVector3Dot(
+				XMVector3Cross(triangleTangent, XMLoadFloat3(&corner->Normal)), triangleBitangent));
+		}
 	}
 
 	// Ensure all of the tangents are orthogonal to the normals
@@ -388,14 +957,17 @@ void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices,
 	{
 		// Grab the two vectors
 		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
-		XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
+		XMVECTOR tangent = XMVectorSetW(XMLoadFloat4(&verts[i].Tangent), 0);
 
 		// Use Gram-Schmidt orthonormalize to ensure
 		// the normal and tangent are exactly 90 degrees apart
 		tangent = XMVector3Normalize(
 			tangent - normal * XMVector3Dot(normal, tangent));
 
+		// Mirrored UVs get -1
+		float w = verts[i].Tangent.w > 0 ? -1.0f : 1.0f;
+
 		// Store the tangent
-		XMStoreFloat3(&verts[i].Tangent, tangent);
+		XMStoreFloat4(&verts[i].Tangent, XMVectorSetW(tangent, w));
 	}
 }
@@ -1,44 +1,220 @@
 #pragma once
 #include <d3d11.h>
 #include "Vertex.h"
+#include "ConvexHull.h"
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 using namespace DirectX;
 
+// --------------------------------------------------------
+// A contiguous range of the index buffer that is drawn
+// with a single material (one per OBJ "usemtl" group)
+// --------------------------------------------------------
+struct Submesh
+{
+	unsigned int startIndex;	// First index of the range
+	unsigned int indexCount;	// Number of indices in the range
+	unsigned int materialSlot;	// Which of the entity's materials to draw with
+};
+
+// --------------------------------------------------------
+// What the OBJ importer allocated, so imports of huge files
+// can be checked against a known memory bound
+// --------------------------------------------------------
+struct MeshImportStats
+{
+	size_t positionCount;	// Attribute counts found by the pre-scan
+	size_t normalCount;
+	size_t uvCount;
+	size_t vertexCount;		// Vertices and indices built from the faces
+	size_t indexCount;
+	size_t scratchBytes;	// The one allocation holding the file's attributes
+	size_t peakBytes;		// Most CPU memory held at once while importing
+};
+
+class MeshBVH;
+class MeshCache;
+
 class Mesh
 {
 private:
+	// A level of detail uploaded by a streaming thread
+	struct StreamedLevel
+	{
+		int level;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		std::vector<Submesh> submeshes;
+		std::shared_ptr<MeshBVH> bvh;
+	};
+
 	// ComPtr's to the vertex and index buffers and device
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
 	int indexCount;
+
+	// CPU copies of the geometry for build steps like static batching
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+
+	// Index ranges and the material slot names they refer to
+	std::vector<Submesh> submeshes;
+	std::vector<std::string> materialNames;
+
+	// Optional triangle BVH over the full level, for ray queries
+	std::shared_ptr<MeshBVH> bvh;
+
+	// Local box around the full level, known before it streams in if the cache has it
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+	bool hasBounds;
+
+	// Optional convex collision proxies (the same for every level)
+	std::vector<ConvexHull> collisionHulls;
+
+	// Memory used by the last OBJ import
+	MeshImportStats importStats;
+
+	// Kept for uploading levels of detail that stream in later
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+
+	// How many levels of detail the source has and which one is drawn
+	int levelCount;
+	int residentLevel;
+
+	// The newest streamed level, waiting for the updating thread to swap it in
+	std::mutex streamMutex;
+	std::atomic<bool> streamPending;
+	StreamedLevel pending;
+
+	// Swaps in a finer level if one has been streamed (updating thread only)
+	void ApplyStreamedLevel();
+
+	// Fits the bounds to the CPU copy of the vertices (which must be the full level)
+	void ComputeBounds();
+
+	// Creates immutable vertex and index buffers
+	void CreateBuffers(const Vertex* vertices, int vertexCount, const unsigned int* indices, int indexCount,
+		Microsoft::WRL::ComPtr<ID3D11Buffer>& vertexBufferOut, Microsoft::WRL::ComPtr<ID3D11Buffer>& indexBufferOut);
 public:
 	// Constructor
 	Mesh(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount,
 		Microsoft::WRL::ComPtr<ID3D11Device> device);
 
-	// Ctor for loading mesh from file
+	// Ctor for loading mesh from file (.obj, binary glTF .glb, or a .mesh cache)
 	Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device);
 
+	// Ctor for one level of detail of a mesh cache, so finer ones can be streamed in
+	Mesh(MeshCache& cache, int level, Microsoft::WRL::ComPtr<ID3D11Device> device);
+
 	~Mesh();
 
-	// Returns vertex buffer ptr
-	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
+	// Returns vertex buffer ptr (without a reference of its own)
+	ID3D11Buffer* GetVertexBuffer();
 
-	// Returns index buffer ptr
-	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
+	// Returns index buffer ptr (without a reference of its own)
+	ID3D11Buffer* GetIndexBuffer();
 
 	// Returns index count for mesh
 	int GetIndexCount();
 
+	// Returns the CPU copies of the vertices and indices
+	const std::vector<Vertex>& GetVertices();
+	const std::vector<unsigned int>& GetIndices();
+
+	// Returns what the OBJ importer allocated (all zero for other sources)
+	const MeshImportStats& GetImportStats();
+
+	// Levels of detail (0 is the coarsest) and the one currently drawn (-1 while evicted)
+	int GetLevelCount();
+	int GetResidentLevel();
+	bool IsFullyResident();
+
+	// Frees the geometry (GPU buffers and CPU copies) until a level is loaded
+	// again; the BVH and collision hulls stay, so queries still work
+	void Evict();
+	bool IsEvicted();
+
+	// Memory held by the resident level's buffers and CPU copies
+	size_t GetGPUBytes();
+	size_t GetCPUBytes();
+
+	// Uploads a finer level from a streaming thread and queues it for the
+	// updating thread; the vectors are moved from. The full level can bring its BVH.
+	void PublishLevel(int level, std::vector<Vertex>& vertices,
+		std::vector<unsigned int>& indices, std::vector<Submesh>& submeshes,
+		std::shared_ptr<MeshBVH> levelBVH = std::shared_ptr<MeshBVH>());
+
+	// Builds a triangle BVH over the full level (needs it to be resident)
+	bool BuildBVH(bool parallel = true);
+
+	// Returns the BVH, or null if none was built or loaded
+	std::shared_ptr<MeshBVH> GetBVH();
+
+	// Gets the local box around the full level, or returns false while it isn't
+	// known yet (only for caches without stored bounds, until the full level arrives)
+	bool GetBounds(DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax);
+
+	// Builds convex collision proxies from the full level; more than one hull
+	// decomposes concave meshes (needs the full level to be resident)
+	bool BuildCollisionHulls(int maxHulls = 1, int maxVertices = 32);
+
+	// Returns the collision proxies (none if they were never built)
+	int GetCollisionHullCount();
+	ConvexHull& GetCollisionHull(int index);
+
+	// Returns the submesh table
+	int GetSubmeshCount();
+	const Submesh& GetSubmesh(int index);
+
+	// Returns the number of material slots and the name of each (from usemtl)
+	int GetMaterialSlotCount();
+	const std::string& GetMaterialSlotName(int slot);
+
 	// Sets buffers and tells DirectX to draw the correct number of indices
+	// (like SetBuffers(), this leaves residency and streaming alone)
 	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
+	// Marks the mesh as drawn this frame and swaps in any streamed level, on
+	// the updating thread before its buffers are handed to the renderer.
+	// Returns false while the mesh is evicted (and has nothing to draw).
+	bool PrepareToDraw();
+
+	// Binds the vertex and index buffers to the input assembler (leaves
+	// residency and streaming alone, so call PrepareToDraw() first)
+	void SetBuffers(ID3D11DeviceContext* context);
+
+	// Draws a single submesh, assuming SetBuffers() was already called
+	void DrawSubmesh(ID3D11DeviceContext* context, int index);
+
 	// Creates meshes. Used for both CTORS
-	void CreateMesh(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount,
+	void CreateMesh(const Vertex* vertices, int vertexCount, const unsigned int* indices, int indexCount,
 		Microsoft::WRL::ComPtr<ID3D11Device> device);
 
-	// Calculates tangents
-	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+	// Loads a binary glTF file straight from a memory mapping
+	void LoadGLB(const char* glbFile, Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Loads the full level of a binary mesh cache written by SaveCache()
+	void LoadCache(const char* cacheFile, Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Loads one level of an already open mesh cache
+	void LoadLevel(MeshCache& cache, int level, Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Writes the CPU copies to a binary mesh cache with generated levels of
+	// detail, plus the BVH and collision hulls if there are any, optionally
+	// compressed (needs the full level to be resident)
+	bool SaveCache(const char* cacheFile, bool compress = true);
+
+	// Calculates tangents (indices may be into a merged buffer in which
+	// verts starts at baseVertex, so one part of it can be done alone)
+	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices,
+		unsigned int baseVertex = 0);
 };
 
@@ -0,0 +1,473 @@
+#include "MeshBVH.h"
+#include "MeshCache.h"
+#include <atomic>
+#include <cfloat>
+#include <thread>
+#include <unordered_map>
+
+using namespace DirectX;
+
+// Build settings
+#define BVH_BIN_COUNT 16			// Candidate split planes per axis
+#define BVH_MAX_LEAF_SIZE 4			// Leaves never hold more than this
+#define BVH_PARALLEL_MIN_SIZE 8192	// Subtrees smaller than this aren't worth a thread
+#define BVH_PARALLEL_MAX_DEPTH 4	// Up to 2^4 threads at once
+#define BVH_STACK_SIZE 64			// Deeper trees traverse with a heap allocated stack
+
+// Positions are welded by exact bit pattern
+struct WeldKey
+{
+	unsigned int x, y, z;
+	bool operator==(const WeldKey& other) const { return x == other.x && y == other.y && z == other.z; }
+};
+
+struct WeldKeyHash
+{
+	size_t operator()(const WeldKey& key) const
+	{
+		return (size_t)(key.x * 73856093u ^ key.y * 19349663u ^ key.z * 83492791u);
+	}
+};
+
+// Per triangle data only needed while building
+struct BuildTriangle
+{
+	XMFLOAT3 boundsMin;
+	XMFLOAT3 boundsMax;
+	XMFLOAT3 centroid;
+};
+
+// Everything the recursive build steps share
+struct BuildState
+{
+	std::vector<BuildTriangle> buildTriangles;
+	std::vector<unsigned int> order;	// Triangle ids, partitioned in place
+	std::vector<BVHNode>* nodes;
+	std::atomic<unsigned int> nodeCount;
+	bool parallel;
+};
+
+static float SurfaceArea(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+	float x = boundsMax.x - boundsMin.x;
+	float y = boundsMax.y - boundsMin.y;
+	float z = boundsMax.z - boundsMin.z;
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+static void GrowBounds(XMFLOAT3& boundsMin, XMFLOAT3& boundsMax, const XMFLOAT3& pMin, const XMFLOAT3& pMax)
+{
+	if (pMin.x < boundsMin.x) boundsMin.x = pMin.x;
+	if (pMin.y < boundsMin.y) boundsMin.y = pMin.y;
+	if (pMin.z < boundsMin.z) boundsMin.z = pMin.z;
+	if (pMax.x > boundsMax.x) boundsMax.x = pMax.x;
+	if (pMax.y > boundsMax.y) boundsMax.y = pMax.y;
+	if (pMax.z > boundsMax.z) boundsMax.z = pMax.z;
+}
+
+static float Component(const XMFLOAT3& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// Builds the subtree for order[first .. first + count) into the given node
+static void BuildNode(BuildState& state, unsigned int nodeIndex, unsigned int first, unsigned int count, int depth)
+{
+	BVHNode& node = (*state.nodes)[nodeIndex];
+
+	// Node bounds, plus the bounds of the centroids to place the bins in
+	XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX), boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	XMFLOAT3 centroidMin(FLT_MAX, FLT_MAX, FLT_MAX), centroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		const BuildTriangle& tri = state.buildTriangles[state.order[i]];
+		GrowBounds(boundsMin, boundsMax, tri.boundsMin, tri.boundsMax);
+		GrowBounds(centroidMin, centroidMax, tri.centroid, tri.centroid);
+	}
+	node.boundsMin = boundsMin;
+	node.boundsMax = boundsMax;
+	node.leftOrFirst = first;
+	node.triangleCount = count;
+
+	// Splits across the longest axis of the centroids
+	int axis = 0;
+	float extent = centroidMax.x - centroidMin.x;
+	if (centroidMax.y - centroidMin.y > extent) { axis = 1; extent = centroidMax.y - centroidMin.y; }
+	if (centroidMax.z - centroidMin.z > extent) { axis = 2; extent = centroidMax.z - centroidMin.z; }
+	if (count <= 1)
+		return;
+
+	// Coincident centroids all land in the first bin, leaving no usable plane,
+	// so runs of them too big for one leaf are halved below
+	if (extent <= 0)
+		extent = 1.0f;
+
+	// Drops every triangle into a bin by its centroid
+	XMFLOAT3 binMin[BVH_BIN_COUNT], binMax[BVH_BIN_COUNT];
+	unsigned int binCount[BVH_BIN_COUNT] = {};
+	for (int b = 0; b < BVH_BIN_COUNT; b++)
+	{
+		binMin[b] = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		binMax[b] = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	}
+	float axisMin = Component(centroidMin, axis);
+	float binScale = BVH_BIN_COUNT / extent;
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		const BuildTriangle& tri = state.buildTriangles[state.order[i]];
+		int b = (int)((Component(tri.centroid, axis) - axisMin) * binScale);
+		if (b >= BVH_BIN_COUNT) b = BVH_BIN_COUNT - 1;
+		binCount[b]++;
+		GrowBounds(binMin[b], binMax[b], tri.boundsMin, tri.boundsMax);
+	}
+
+	// Sweeps from the right to get the cost of everything past each plane...
+	float rightArea[BVH_BIN_COUNT];
+	unsigned int rightCount[BVH_BIN_COUNT];
+	XMFLOAT3 sweepMin(FLT_MAX, FLT_MAX, FLT_MAX), sweepMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	unsigned int sweepCount = 0;
+	for (int b = BVH_BIN_COUNT - 1; b > 0; b--)
+	{
+		GrowBounds(sweepMin, sweepMax, binMin[b], binMax[b]);
+		sweepCount += binCount[b];
+		rightArea[b] = sweepCount > 0 ? SurfaceArea(sweepMin, sweepMax) : 0;
+		rightCount[b] = sweepCount;
+	}
+
+	// ...then from the left, picking the cheapest plane
+	int bestPlane = -1;
+	float bestCost = FLT_MAX;
+	sweepMin = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	sweepMax = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	sweepCount = 0;
+	for (int b = 0; b < BVH_BIN_COUNT - 1; b++)
+	{
+		GrowBounds(sweepMin, sweepMax, binMin[b], binMax[b]);
+		sweepCount += binCount[b];
+		if (sweepCount == 0 || rightCount[b + 1] == 0)
+			continue;
+
+		float cost = sweepCount * SurfaceArea(sweepMin, sweepMax) + rightCount[b + 1] * rightArea[b + 1];
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestPlane = b;
+		}
+	}
+
+	// Small nodes stay leaves when splitting wouldn't pay for the extra traversal step
+	float nodeArea = SurfaceArea(boundsMin, boundsMax);
+	float leafCost = count * nodeArea;
+	float splitCost = nodeArea + bestCost;
+	if (count <= BVH_MAX_LEAF_SIZE && (bestPlane < 0 || splitCost >= leafCost))
+		return;
+
+	// Partitions the triangles around the chosen plane
+	unsigned int middle = first;
+	if (bestPlane >= 0)
+	{
+		unsigned int last = first + count;
+		while (middle < last)
+		{
+			const BuildTriangle& tri = state.buildTriangles[state.order[middle]];
+			int b = (int)((Component(tri.centroid, axis) - axisMin) * binScale);
+			if (b >= BVH_BIN_COUNT) b = BVH_BIN_COUNT - 1;
+			if (b <= bestPlane)
+				middle++;
+			else
+				std::swap(state.order[middle], state.order[--last]);
+		}
+	}
+
+	// Every centroid in one bin (or no usable plane), so just halve the range
+	unsigned int leftCount = middle - first;
+	if (leftCount == 0 || leftCount == count)
+		leftCount = count / 2;
+
+	// Children are allocated as a pair so only the left one needs storing
+	unsigned int left = state.nodeCount.fetch_add(2);
+	node.leftOrFirst = left;
+	node.triangleCount = 0;
+
+	unsigned int rightCountTotal = count - leftCount;
+	if (state.parallel && count >= BVH_PARALLEL_MIN_SIZE && depth < BVH_PARALLEL_MAX_DEPTH)
+	{
+		// The left half gets its own thread while this one does the right
+		std::thread leftThread(BuildNode, std::ref(state), left, first, leftCount, depth + 1);
+		BuildNode(state, left + 1, first + leftCount, rightCountTotal, depth + 1);
+		leftThread.join();
+	}
+	else
+	{
+		BuildNode(state, left, first, leftCount, depth + 1);
+		BuildNode(state, left + 1, first + leftCount, rightCountTotal, depth + 1);
+	}
+}
+
+// Slab test against a node, returning the entry distance (or FLT_MAX on a miss)
+static float IntersectNode(const BVHNode& node, const XMFLOAT3& origin, const XMFLOAT3& inverseDirection, float maxDistance)
+{
+	float x1 = (node.boundsMin.x - origin.x) * inverseDirection.x;
+	float x2 = (node.boundsMax.x - origin.x) * inverseDirection.x;
+	float y1 = (node.boundsMin.y - origin.y) * inverseDirection.y;
+	float y2 = (node.boundsMax.y - origin.y) * inverseDirection.y;
+	float z1 = (node.boundsMin.z - origin.z) * inverseDirection.z;
+	float z2 = (node.boundsMax.z - origin.z) * inverseDirection.z;
+	float tMin = x1 < x2 ? x1 : x2;
+	float tMax = x1 < x2 ? x2 : x1;
+	float yMin = y1 < y2 ? y1 : y2;
+	float yMax = y1 < y2 ? y2 : y1;
+	float zMin = z1 < z2 ? z1 : z2;
+	float zMax = z1 < z2 ? z2 : z1;
+	tMin = tMin > yMin ? tMin : yMin;
+	tMin = tMin > zMin ? tMin : zMin;
+	tMax = tMax < yMax ? tMax : yMax;
+	tMax = tMax < zMax ? tMax : zMax;
+	return (tMax >= tMin && tMax > 0 && tMin < maxDistance) ? tMin : FLT_MAX;
+}
+
+MeshBVH::MeshBVH()
+	: depth(0)
+{
+}
+
+void MeshBVH::ComputeDepth()
+{
+	// Children always come after their parent, so one forward pass is enough
+	std::vector<int> nodeDepths(nodes.size(), 0);
+	depth = 0;
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (nodeDepths[i] > depth)
+			depth = nodeDepths[i];
+		if (nodes[i].triangleCount == 0)
+		{
+			nodeDepths[nodes[i].leftOrFirst] = nodeDepths[i] + 1;
+			nodeDepths[nodes[i].leftOrFirst + 1] = nodeDepths[i] + 1;
+		}
+	}
+}
+
+void MeshBVH::Build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, bool parallel)
+{
+	positions.clear();
+	triangles.clear();
+	triangleIds.clear();
+	nodes.clear();
+	depth = 0;
+	unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+	if (triangleCount == 0)
+		return;
+
+	// Welds vertices that share a position (adding 0 turns -0 into +0)
+	std::unordered_map<WeldKey, unsigned int, WeldKeyHash> welded;
+	welded.reserve(vertices.size());
+	std::vector<unsigned int> weldedIndex(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		XMFLOAT3 p(vertices[i].Position.x + 0.0f, vertices[i].Position.y + 0.0f, vertices[i].Position.z + 0.0f);
+		WeldKey key;
+		memcpy(&key.x, &p.x, sizeof(float));
+		memcpy(&key.y, &p.y, sizeof(float));
+		memcpy(&key.z, &p.z, sizeof(float));
+
+		std::pair<std::unordered_map<WeldKey, unsigned int, WeldKeyHash>::iterator, bool> result =
+			welded.insert(std::make_pair(key, (unsigned int)positions.size()));
+		if (result.second)
+			positions.push_back(p);
+		weldedIndex[i] = result.first->second;
+	}
+
+	// Bounds and centroid of every triangle
+	BuildState state;
+	state.buildTriangles.resize(triangleCount);
+	state.order.resize(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		const XMFLOAT3& a = positions[weldedIndex[indices[t * 3]]];
+		const XMFLOAT3& b = positions[weldedIndex[indices[t * 3 + 1]]];
+		const XMFLOAT3& c = positions[weldedIndex[indices[t * 3 + 2]]];
+		BuildTriangle& tri = state.buildTriangles[t];
+		tri.boundsMin = a;
+		tri.boundsMax = a;
+		GrowBounds(tri.boundsMin, tri.boundsMax, b, b);
+		GrowBounds(tri.boundsMin, tri.boundsMax, c, c);
+		tri.centroid = XMFLOAT3((a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f, (a.z + b.z + c.z) / 3.0f);
+		state.order[t] = t;
+	}
+
+	// A binary tree with N leaves has at most 2N - 1 nodes
+	nodes.resize(triangleCount * 2);
+	state.nodes = &nodes;
+	state.nodeCount = 1;
+	state.parallel = parallel;
+	BuildNode(state, 0, 0, triangleCount, 0);
+	nodes.resize(state.nodeCount);
+	ComputeDepth();
+
+	// Stores the triangles in leaf order so each leaf is one contiguous run
+	triangles.resize(triangleCount * 3);
+	triangleIds = state.order;
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		unsigned int t = state.order[i];
+		triangles[i * 3] = weldedIndex[indices[t * 3]];
+		triangles[i * 3 + 1] = weldedIndex[indices[t * 3 + 1]];
+		triangles[i * 3 + 2] = weldedIndex[indices[t * 3 + 2]];
+	}
+}
+
+bool MeshBVH::Raycast(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, RayHit& hit)
+{
+	if (nodes.empty())
+		return false;
+
+	XMFLOAT3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	bool found = false;
+	hit.distance = maxDistance;
+
+	// Each level leaves at most one sibling waiting, so depth + 1 entries always fit
+	unsigned int localStack[BVH_STACK_SIZE];
+	std::vector<unsigned int> deepStack;
+	unsigned int* stack = localStack;
+	if (depth + 1 > BVH_STACK_SIZE)
+	{
+		deepStack.resize(depth + 1);
+		stack = deepStack.data();
+	}
+	int stackSize = 0;
+	if (IntersectNode(nodes[0], origin, inverseDirection, hit.distance) == FLT_MAX)
+		return false;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const BVHNode& node = nodes[stack[--stackSize]];
+		if (node.triangleCount > 0)
+		{
+			// Moller-Trumbore against each triangle in the leaf, in plain floats
+			// since it's all dot and cross products of single vectors
+			for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.triangleCount; i++)
+			{
+				const XMFLOAT3& a = positions[triangles[i * 3]];
+				const XMFLOAT3& b = positions[triangles[i * 3 + 1]];
+				const XMFLOAT3& c = positions[triangles[i * 3 + 2]];
+				XMFLOAT3 edge1(b.x - a.x, b.y - a.y, b.z - a.z);
+				XMFLOAT3 edge2(c.x - a.x, c.y - a.y, c.z - a.z);
+				XMFLOAT3 p(direction.y * edge2.z - direction.z * edge2.y,
+					direction.z * edge2.x - direction.x * edge2.z,
+					direction.x * edge2.y - direction.y * edge2.x);
+				float determinant = edge1.x * p.x + edge1.y * p.y + edge1.z * p.z;
+				if (fabsf(determinant) < 1e-12f)
+					continue;
+
+				float inverseDeterminant = 1.0f / determinant;
+				XMFLOAT3 s(origin.x - a.x, origin.y - a.y, origin.z - a.z);
+				float u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverseDeterminant;
+				if (u < 0 || u > 1)
+					continue;
+				XMFLOAT3 q(s.y * edge1.z - s.z * edge1.y, s.z * edge1.x - s.x * edge1.z, s.x * edge1.y - s.y * edge1.x);
+				float v = (direction.x * q.x + direction.y * q.y + direction.z * q.z) * inverseDeterminant;
+				if (v < 0 || u + v > 1)
+					continue;
+				float t = (edge2.x * q.x + edge2.y * q.y + edge2.z * q.z) * inverseDeterminant;
+				if (t <= 0 || t >= hit.distance)
+					continue;
+
+				hit.distance = t;
+				hit.triangle = triangleIds[i];
+				hit.u = u;
+				hit.v = v;
+				found = true;
+			}
+			continue;
+		}
+
+		// Visits the nearer child first by pushing it last
+		unsigned int nearChild = node.leftOrFirst;
+		unsigned int farChild = nearChild + 1;
+		float nearDistance = IntersectNode(nodes[nearChild], origin, inverseDirection, hit.distance);
+		float farDistance = IntersectNode(nodes[farChild], origin, inverseDirection, hit.distance);
+		if (nearDistance > farDistance)
+		{
+			std::swap(nearDistance, farDistance);
+			std::swap(nearChild, farChild);
+		}
+		if (farDistance != FLT_MAX)
+			stack[stackSize++] = farChild;
+		if (nearDistance != FLT_MAX)
+			stack[stackSize++] = nearChild;
+	}
+	return found;
+}
+
+void MeshBVH::Write(MeshCacheWriter& writer)
+{
+	if (nodes.empty())
+		return;
+
+	writer.AddChunk(MESH_CHUNK_BVH_NODES, nodes.data(), nodes.size() * sizeof(BVHNode),
+		MESH_ENCODING_BYTE_PLANES, sizeof(BVHNode));
+	writer.AddChunk(MESH_CHUNK_BVH_POSITIONS, positions.data(), positions.size() * sizeof(XMFLOAT3),
+		MESH_ENCODING_BYTE_PLANES, sizeof(XMFLOAT3));
+	writer.AddChunk(MESH_CHUNK_BVH_TRIANGLES, triangles.data(), triangles.size() * sizeof(unsigned int),
+		MESH_ENCODING_INDICES);
+	writer.AddChunk(MESH_CHUNK_BVH_TRIANGLE_IDS, triangleIds.data(), triangleIds.size() * sizeof(unsigned int),
+		MESH_ENCODING_INDICES);
+}
+
+bool MeshBVH::Read(MeshCache& cache)
+{
+	const MeshCacheChunk* nodeChunk = cache.FindChunk(MESH_CHUNK_BVH_NODES);
+	const MeshCacheChunk* positionChunk = cache.FindChunk(MESH_CHUNK_BVH_POSITIONS);
+	const MeshCacheChunk* triangleChunk = cache.FindChunk(MESH_CHUNK_BVH_TRIANGLES);
+	const MeshCacheChunk* idChunk = cache.FindChunk(MESH_CHUNK_BVH_TRIANGLE_IDS);
+	if (!nodeChunk || !positionChunk || !triangleChunk || !idChunk)
+		return false;
+	if (nodeChunk->rawSize == 0 || nodeChunk->rawSize % sizeof(BVHNode) != 0 ||
+		positionChunk->rawSize == 0 || positionChunk->rawSize % sizeof(XMFLOAT3) != 0 ||
+		triangleChunk->rawSize == 0 || triangleChunk->rawSize % (sizeof(unsigned int) * 3) != 0 ||
+		idChunk->rawSize * 3 != triangleChunk->rawSize)
+		return false;
+
+	nodes.resize((size_t)(nodeChunk->rawSize / sizeof(BVHNode)));
+	positions.resize((size_t)(positionChunk->rawSize / sizeof(XMFLOAT3)));
+	triangles.resize((size_t)(triangleChunk->rawSize / sizeof(unsigned int)));
+	triangleIds.resize((size_t)(idChunk->rawSize / sizeof(unsigned int)));
+	bool valid = cache.ReadChunk(nodeChunk, &nodes[0]) && cache.ReadChunk(positionChunk, &positions[0]) &&
+		cache.ReadChunk(triangleChunk, &triangles[0]) && cache.ReadChunk(idChunk, &triangleIds[0]);
+
+	// Makes sure traversal can't wander outside the arrays
+	for (size_t i = 0; valid && i < nodes.size(); i++)
+	{
+		const BVHNode& node = nodes[i];
+		if (node.triangleCount == 0)
+			valid = node.leftOrFirst > i && node.leftOrFirst + 1 < nodes.size();
+		else
+			valid = node.leftOrFirst <= triangleIds.size() && node.triangleCount <= triangleIds.size() - node.leftOrFirst;
+	}
+	for (size_t i = 0; valid && i < triangles.size(); i++)
+		valid = triangles[i] < positions.size();
+
+	if (!valid)
+	{
+		nodes.clear();
+		positions.clear();
+		triangles.clear();
+		triangleIds.clear();
+	}
+	ComputeDepth();
+	return valid;
+}
+
+bool MeshBVH::IsEmpty() { return nodes.empty(); }
+
+int MeshBVH::GetDepth() { return depth; }
+
+const std::vector<BVHNode>& MeshBVH::GetNodes() { return nodes; }
+
+const std::vector<XMFLOAT3>& MeshBVH::GetPositions() { return positions; }
+
+const std::vector<unsigned int>& MeshBVH::GetTriangles() { return triangles; }
+
+const std::vector<unsigned int>& MeshBVH::GetTriangleIds() { return triangleIds; }
@@ -0,0 +1,67 @@
+#pragma once
+#include "Vertex.h"
+
+#include <DirectXMath.h>
+#include <vector>
+
+class MeshCache;
+class MeshCacheWriter;
+
+// One node of the flattened tree (32 bytes, two to a cache line)
+struct BVHNode
+{
+	DirectX::XMFLOAT3 boundsMin;
+	unsigned int leftOrFirst;	// Left child (right is the next node), or first triangle of a leaf
+	DirectX::XMFLOAT3 boundsMax;
+	unsigned int triangleCount;	// 0 for interior nodes
+};
+
+// Closest hit found by a ray query
+struct RayHit
+{
+	float distance;			// Along the (normalized) ray direction
+	unsigned int triangle;	// Triangle number in the mesh's index buffer
+	float u, v;				// Barycentrics of the hit (weights of the 2nd and 3rd corners)
+};
+
+// --------------------------------------------------------
+// A CPU side bounding volume hierarchy over a mesh's
+// triangles. Vertices are welded by position first, so
+// OBJ style "three vertices per triangle" meshes don't
+// blow up the working set. Built top-down with binned SAH,
+// with big subtrees split across threads, and stored as
+// a flat node array so traversal and saving are trivial.
+// --------------------------------------------------------
+class MeshBVH
+{
+private:
+	std::vector<DirectX::XMFLOAT3> positions;	// Welded positions
+	std::vector<unsigned int> triangles;		// 3 welded indices per triangle, in leaf order
+	std::vector<unsigned int> triangleIds;		// Original triangle number of each, in leaf order
+	std::vector<BVHNode> nodes;					// Node 0 is the root
+	int depth;									// Levels below the root, which sizes traversal stacks
+
+	void ComputeDepth();
+
+public:
+	MeshBVH();
+
+	// Builds the tree, spreading large subtrees across threads if asked
+	void Build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+		bool parallel = true);
+
+	// Finds the closest hit closer than maxDistance, for a normalized direction
+	bool Raycast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, RayHit& hit);
+
+	// Saves into and loads from a mesh cache
+	void Write(MeshCacheWriter& writer);
+	bool Read(MeshCache& cache);
+
+	bool IsEmpty();
+	int GetDepth();
+	const std::vector<BVHNode>& GetNodes();
+	const std::vector<DirectX::XMFLOAT3>& GetPositions();
+	const std::vector<unsigned int>& GetTriangles();
+	const std::vector<unsigned int>& GetTriangleIds();
+};
+
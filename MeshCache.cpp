@@ -0,0 +1,320 @@
+#include "MeshCache.h"
+#include "MeshCodec.h"
+#include <fstream>
+#include <cstring>
+#include <memory>
+
+// Chunk data starts on 16 byte boundaries so raw chunks can be read in place
+#define MESH_CACHE_ALIGNMENT 16
+
+// The longest varint a 32 bit index delta can take
+#define MESH_CACHE_MAX_INDEX_BYTES 5
+
+MeshCache::MeshCache(const char* cacheFile)
+	: file(cacheFile), chunks(0), chunkCount(0)
+{
+	if (!file.IsOpen() || file.GetSize() < sizeof(MeshCacheHeader))
+		return;
+
+	MeshCacheHeader header;
+	memcpy(&header, file.GetData(), sizeof(header));
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION)
+		return;
+
+	// The chunk table and every chunk must be inside the file
+	unsigned long long fileSize = file.GetSize();
+	unsigned long long tableEnd = sizeof(MeshCacheHeader) + (unsigned long long)header.chunkCount * sizeof(MeshCacheChunk);
+	if (tableEnd > fileSize)
+		return;
+
+	const MeshCacheChunk* table = (const MeshCacheChunk*)(file.GetData() + sizeof(MeshCacheHeader));
+	for (unsigned int i = 0; i < header.chunkCount; i++)
+	{
+		const MeshCacheChunk& chunk = table[i];
+		if (chunk.offset > fileSize || chunk.storedSize > fileSize - chunk.offset)
+			return;
+		if (chunk.encoding == MESH_ENCODING_RAW && chunk.storedSize != chunk.rawSize)
+			return;
+		if (chunk.encoding == MESH_ENCODING_BYTE_PLANES &&
+			(chunk.stride == 0 || chunk.rawSize % chunk.stride != 0 || chunk.encodedSize != chunk.rawSize))
+			return;
+		// No index takes more than five bytes, so a bigger encoded size is
+		// corrupt (and would otherwise size the decode scratch)
+		if (chunk.encoding == MESH_ENCODING_INDICES &&
+			(chunk.rawSize % sizeof(unsigned int) != 0 ||
+			chunk.encodedSize > chunk.rawSize / sizeof(unsigned int) * MESH_CACHE_MAX_INDEX_BYTES))
+			return;
+		if (chunk.encoding > MESH_ENCODING_INDICES)
+			return;
+	}
+
+	chunks = table;
+	chunkCount = header.chunkCount;
+}
+
+bool MeshCache::IsValid() { return chunks != 0; }
+
+unsigned int MeshCache::GetChunkCount() { return chunkCount; }
+
+const MeshCacheChunk* MeshCache::GetChunk(unsigned int index) { return &chunks[index]; }
+
+const MeshCacheChunk* MeshCache::FindChunk(unsigned int type, unsigned int level)
+{
+	for (unsigned int i = 0; i < chunkCount; i++)
+	{
+		if (chunks[i].type == type && chunks[i].level == level)
+			return &chunks[i];
+	}
+	return 0;
+}
+
+bool MeshCache::ReadChunk(const MeshCacheChunk* chunk, void* out)
+{
+	const unsigned char* stored = file.GetData() + chunk->offset;
+	size_t storedSize = (size_t)chunk->storedSize;
+	size_t rawSize = (size_t)chunk->rawSize;
+
+	switch (chunk->encoding)
+	{
+	case MESH_ENCODING_RAW:
+		memcpy(out, stored, rawSize);
+		return true;
+
+	case MESH_ENCODING_LZ:
+		return MeshCodec::Decompress(stored, storedSize, (unsigned char*)out, rawSize);
+
+	case MESH_ENCODING_BYTE_PLANES:
+	{
+		// Scratch is left uninitialized since it's about to be overwritten
+		std::unique_ptr<unsigned char[]> planes(new unsigned char[rawSize + 1]);
+		if (!MeshCodec::Decompress(stored, storedSize, planes.get(), rawSize))
+			return false;
+		MeshCodec::UnfilterBytePlanes(planes.get(), rawSize / chunk->stride, chunk->stride, out);
+		return true;
+	}
+
+	case MESH_ENCODING_INDICES:
+	{
+		size_t encodedSize = (size_t)chunk->encodedSize;
+		std::unique_ptr<unsigned char[]> encoded(new unsigned char[encodedSize + 1]);
+		if (!MeshCodec::Decompress(stored, storedSize, encoded.get(), encodedSize))
+			return false;
+		return MeshCodec::DecodeIndices(encoded.get(), encodedSize,
+			(unsigned int*)out, rawSize / sizeof(unsigned int));
+	}
+	}
+
+	return false;
+}
+
+unsigned int MeshCache::GetLevelCount()
+{
+	// LOD levels are numbered from 0 with no gaps, and the full mesh follows them
+	unsigned int levels = 0;
+	while (FindChunk(MESH_CHUNK_LOD_VERTICES, levels))
+		levels++;
+	return FindChunk(MESH_CHUNK_VERTICES) ? levels + 1 : 0;
+}
+
+bool MeshCache::ReadLevel(unsigned int level, std::vector<Vertex>& vertices,
+	std::vector<unsigned int>& indices, std::vector<Submesh>& submeshes)
+{
+	// The last level is the full mesh, stored in the plain geometry chunks
+	unsigned int levelCount = GetLevelCount();
+	if (level >= levelCount)
+		return false;
+	bool full = level == levelCount - 1;
+	const MeshCacheChunk* vertexChunk = full ? FindChunk(MESH_CHUNK_VERTICES) : FindChunk(MESH_CHUNK_LOD_VERTICES, level);
+	const MeshCacheChunk* indexChunk = full ? FindChunk(MESH_CHUNK_INDICES) : FindChunk(MESH_CHUNK_LOD_INDICES, level);
+	const MeshCacheChunk* submeshChunk = full ? FindChunk(MESH_CHUNK_SUBMESHES) : FindChunk(MESH_CHUNK_LOD_SUBMESHES, level);
+	if (!vertexChunk || !indexChunk || !submeshChunk)
+		return false;
+	if (vertexChunk->rawSize == 0 || vertexChunk->rawSize % sizeof(Vertex) != 0 ||
+		indexChunk->rawSize == 0 || indexChunk->rawSize % sizeof(unsigned int) != 0 ||
+		submeshChunk->rawSize % sizeof(Submesh) != 0)
+		return false;
+
+	vertices.resize((size_t)(vertexChunk->rawSize / sizeof(Vertex)));
+	indices.resize((size_t)(indexChunk->rawSize / sizeof(unsigned int)));
+	submeshes.resize((size_t)(submeshChunk->rawSize / sizeof(Submesh)));
+	if (!ReadChunk(vertexChunk, &vertices[0]) || !ReadChunk(indexChunk, &indices[0]))
+		return false;
+	if (!submeshes.empty() && !ReadChunk(submeshChunk, &submeshes[0]))
+		return false;
+
+	// Reject ranges that would read outside the index buffer
+	for (size_t i = 0; i < submeshes.size(); i++)
+	{
+		if (submeshes[i].startIndex > indices.size() ||
+			submeshes[i].indexCount > indices.size() - submeshes[i].startIndex)
+			return false;
+	}
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (indices[i] >= vertices.size())
+			return false;
+	}
+	return true;
+}
+
+bool MeshCache::ReadBounds(DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax)
+{
+	// Caches written before bounds were stored don't have the chunk
+	const MeshCacheChunk* boundsChunk = FindChunk(MESH_CHUNK_BOUNDS);
+	if (!boundsChunk || boundsChunk->rawSize != sizeof(DirectX::XMFLOAT3) * 2)
+		return false;
+
+	DirectX::XMFLOAT3 bounds[2];
+	if (!ReadChunk(boundsChunk, bounds))
+		return false;
+	boundsMin = bounds[0];
+	boundsMax = bounds[1];
+	return true;
+}
+
+bool MeshCache::ReadMaterialNames(std::vector<std::string>& materialNames)
+{
+	const MeshCacheChunk* materialChunk = FindChunk(MESH_CHUNK_MATERIALS);
+	if (!materialChunk)
+		return false;
+
+	// Material names are stored back to back, each ending in a null
+	std::vector<char> names((size_t)materialChunk->rawSize);
+	if (!names.empty() && !ReadChunk(materialChunk, &names[0]))
+		return false;
+	materialNames.clear();
+	size_t start = 0;
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (names[i] != 0)
+			continue;
+		materialNames.push_back(std::string(&names[start], i - start));
+		start = i + 1;
+	}
+	return true;
+}
+
+MeshCacheWriter::MeshCacheWriter(bool compress)
+	: compress(compress)
+{
+}
+
+void MeshCacheWriter::AddChunk(unsigned int type, const void* data, size_t size,
+	unsigned int encoding, unsigned int stride, unsigned int level)
+{
+	MeshCacheChunk chunk = {};
+	chunk.type = type;
+	chunk.level = level;
+	chunk.encoding = MESH_ENCODING_RAW;
+	chunk.rawSize = size;
+	chunk.encodedSize = size;
+
+	std::vector<unsigned char> stored;
+	if (compress && size > 0 && encoding != MESH_ENCODING_RAW)
+	{
+		// Filter first so the compressor sees the more repetitive form
+		std::vector<unsigned char> filtered;
+		if (encoding == MESH_ENCODING_BYTE_PLANES && stride > 0 && size % stride == 0)
+			MeshCodec::FilterBytePlanes(data, size / stride, stride, filtered);
+		else if (encoding == MESH_ENCODING_INDICES && size % sizeof(unsigned int) == 0)
+			MeshCodec::EncodeIndices((const unsigned int*)data, size / sizeof(unsigned int), filtered);
+		else
+			encoding = MESH_ENCODING_LZ;
+
+		if (encoding == MESH_ENCODING_LZ)
+			MeshCodec::Compress((const unsigned char*)data, size, stored);
+		else
+			MeshCodec::Compress(&filtered[0], filtered.size(), stored);
+
+		// Only keep the encoded form when it's actually smaller
+		if (stored.size() < size)
+		{
+			chunk.encoding = encoding;
+			chunk.stride = encoding == MESH_ENCODING_BYTE_PLANES ? stride : 0;
+			chunk.encodedSize = encoding == MESH_ENCODING_LZ ? size : filtered.size();
+		}
+	}
+
+	if (chunk.encoding == MESH_ENCODING_RAW)
+		stored.assign((const unsigned char*)data, (const unsigned char*)data + size);
+	chunk.storedSize = stored.size();
+
+	chunks.push_back(chunk);
+	chunkData.push_back(std::move(stored));
+}
+
+void MeshCacheWriter::AddMaterialNames(const std::vector<std::string>& materialNames)
+{
+	std::vector<char> names;
+	for (size_t i = 0; i < materialNames.size(); i++)
+	{
+		names.insert(names.end(), materialNames[i].begin(), materialNames[i].end());
+		names.push_back(0);
+	}
+	AddChunk(MESH_CHUNK_MATERIALS, names.data(), names.size(), MESH_ENCODING_RAW);
+}
+
+void MeshCacheWriter::AddBounds(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax)
+{
+	DirectX::XMFLOAT3 bounds[2] = { boundsMin, boundsMax };
+	AddChunk(MESH_CHUNK_BOUNDS, bounds, sizeof(bounds), MESH_ENCODING_RAW);
+}
+
+void MeshCacheWriter::AddLod(unsigned int level, const std::vector<Vertex>& vertices,
+	const std::vector<unsigned int>& indices, const std::vector<Submesh>& submeshes)
+{
+	AddChunk(MESH_CHUNK_LOD_VERTICES, vertices.data(), vertices.size() * sizeof(Vertex),
+		MESH_ENCODING_BYTE_PLANES, sizeof(Vertex), level);
+	AddChunk(MESH_CHUNK_LOD_INDICES, indices.data(), indices.size() * sizeof(unsigned int),
+		MESH_ENCODING_INDICES, 0, level);
+	AddChunk(MESH_CHUNK_LOD_SUBMESHES, submeshes.data(), submeshes.size() * sizeof(Submesh),
+		MESH_ENCODING_RAW, 0, level);
+}
+
+void MeshCacheWriter::AddGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+	const std::vector<Submesh>& submeshes)
+{
+	AddChunk(MESH_CHUNK_VERTICES, vertices.data(), vertices.size() * sizeof(Vertex),
+		MESH_ENCODING_BYTE_PLANES, sizeof(Vertex));
+	AddChunk(MESH_CHUNK_INDICES, indices.data(), indices.size() * sizeof(unsigned int),
+		MESH_ENCODING_INDICES);
+	AddChunk(MESH_CHUNK_SUBMESHES, submeshes.data(), submeshes.size() * sizeof(Submesh),
+		MESH_ENCODING_RAW);
+}
+
+bool MeshCacheWriter::Save(const char* cacheFile)
+{
+	// Lay out the chunk data after the header and chunk table
+	unsigned long long offset = sizeof(MeshCacheHeader) + chunks.size() * sizeof(MeshCacheChunk);
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		offset = (offset + MESH_CACHE_ALIGNMENT - 1) & ~(unsigned long long)(MESH_CACHE_ALIGNMENT - 1);
+		chunks[i].offset = offset;
+		offset += chunks[i].storedSize;
+	}
+
+	std::ofstream out(cacheFile, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		return false;
+
+	MeshCacheHeader header = {};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.chunkCount = (unsigned int)chunks.size();
+	out.write((const char*)&header, sizeof(header));
+	if (!chunks.empty())
+		out.write((const char*)&chunks[0], chunks.size() * sizeof(MeshCacheChunk));
+
+	// Pad up to each chunk's offset before writing it
+	static const char padding[MESH_CACHE_ALIGNMENT] = {};
+	unsigned long long written = sizeof(MeshCacheHeader) + chunks.size() * sizeof(MeshCacheChunk);
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		out.write(padding, (std::streamsize)(chunks[i].offset - written));
+		if (!chunkData[i].empty())
+			out.write((const char*)&chunkData[i][0], chunkData[i].size());
+		written = chunks[i].offset + chunks[i].storedSize;
+	}
+
+	return out.good();
+}
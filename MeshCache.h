@@ -0,0 +1,137 @@
+#pragma once
+#include "Mesh.h"
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+
+// Chunk ids are four characters so they're readable in a hex dump
+#define MESH_CHUNK_ID(a, b, c, d) \
+	((unsigned int)(a) | ((unsigned int)(b) << 8) | ((unsigned int)(c) << 16) | ((unsigned int)(d) << 24))
+#define MESH_CHUNK_VERTICES		MESH_CHUNK_ID('V', 'E', 'R', 'T')
+#define MESH_CHUNK_INDICES		MESH_CHUNK_ID('I', 'N', 'D', 'X')
+#define MESH_CHUNK_SUBMESHES	MESH_CHUNK_ID('S', 'U', 'B', 'M')
+#define MESH_CHUNK_MATERIALS	MESH_CHUNK_ID('M', 'T', 'L', 'N')
+#define MESH_CHUNK_BOUNDS		MESH_CHUNK_ID('B', 'N', 'D', 'S')
+#define MESH_CHUNK_LOD_VERTICES		MESH_CHUNK_ID('L', 'V', 'R', 'T')
+#define MESH_CHUNK_LOD_INDICES		MESH_CHUNK_ID('L', 'I', 'D', 'X')
+#define MESH_CHUNK_LOD_SUBMESHES	MESH_CHUNK_ID('L', 'S', 'U', 'B')
+#define MESH_CHUNK_BVH_NODES		MESH_CHUNK_ID('B', 'V', 'H', 'N')
+#define MESH_CHUNK_BVH_POSITIONS	MESH_CHUNK_ID('B', 'V', 'H', 'P')
+#define MESH_CHUNK_BVH_TRIANGLES	MESH_CHUNK_ID('B', 'V', 'H', 'T')
+#define MESH_CHUNK_BVH_TRIANGLE_IDS	MESH_CHUNK_ID('B', 'V', 'H', 'I')
+#define MESH_CHUNK_HULL_COUNTS		MESH_CHUNK_ID('H', 'U', 'L', 'C')
+#define MESH_CHUNK_HULL_VERTICES	MESH_CHUNK_ID('H', 'U', 'L', 'V')
+#define MESH_CHUNK_HULL_INDICES		MESH_CHUNK_ID('H', 'U', 'L', 'I')
+#define MESH_CHUNK_HULL_PLANES		MESH_CHUNK_ID('H', 'U', 'L', 'P')
+
+// How a chunk's bytes are stored on disk
+#define MESH_ENCODING_RAW			0	// As is
+#define MESH_ENCODING_LZ			1	// Compressed
+#define MESH_ENCODING_BYTE_PLANES	2	// Split into byte planes, then compressed
+#define MESH_ENCODING_INDICES		3	// Delta/zigzag/varint indices, then compressed
+
+#define MESH_CACHE_MAGIC	MESH_CHUNK_ID('M', 'E', 'S', 'H')
+#define MESH_CACHE_VERSION	5
+
+struct MeshCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int chunkCount;
+	unsigned int reserved;
+};
+
+// One entry of the chunk table that follows the header
+struct MeshCacheChunk
+{
+	unsigned int type;				// MESH_CHUNK_ id
+	unsigned int encoding;			// MESH_ENCODING_ value
+	unsigned int stride;			// Record size used by byte plane filtering
+	unsigned int level;				// Which level of detail LOD chunks belong to
+	unsigned long long offset;		// From the start of the file
+	unsigned long long storedSize;	// Bytes on disk
+	unsigned long long encodedSize;	// Bytes after decompression, before unfiltering
+	unsigned long long rawSize;		// Bytes once fully decoded
+};
+
+// --------------------------------------------------------
+// Reads a binary mesh cache (.mesh) through a memory
+// mapping. The file is a header, a chunk table and the
+// chunk data, so new kinds of data can be added without
+// breaking older readers.
+//
+// Geometry is stored as levels of detail, coarsest first
+// in the file: any LOD chunks, then the full mesh as the
+// last (finest) level. Material names come before them.
+// --------------------------------------------------------
+class MeshCache
+{
+private:
+	MappedFile file;
+	const MeshCacheChunk* chunks;
+	unsigned int chunkCount;
+
+public:
+	MeshCache(const char* cacheFile);
+
+	bool IsValid();
+
+	// Chunk table access
+	unsigned int GetChunkCount();
+	const MeshCacheChunk* GetChunk(unsigned int index);
+	const MeshCacheChunk* FindChunk(unsigned int type, unsigned int level = 0);
+
+	// Decodes a chunk into "out", which must hold rawSize bytes
+	bool ReadChunk(const MeshCacheChunk* chunk, void* out);
+
+	// Number of levels of detail, including the full mesh
+	unsigned int GetLevelCount();
+
+	// Reads one level of detail (GetLevelCount() - 1 is the full mesh)
+	bool ReadLevel(unsigned int level, std::vector<Vertex>& vertices,
+		std::vector<unsigned int>& indices, std::vector<Submesh>& submeshes);
+
+	// Reads the material slot names shared by every level
+	bool ReadMaterialNames(std::vector<std::string>& materialNames);
+
+	// Reads the full level's local bounding box, so it's known before that level streams in
+	bool ReadBounds(DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax);
+};
+
+// --------------------------------------------------------
+// Builds a binary mesh cache chunk by chunk, encoding each
+// one as it's added, then writes it out in one go
+// --------------------------------------------------------
+class MeshCacheWriter
+{
+private:
+	bool compress;
+	std::vector<MeshCacheChunk> chunks;
+	std::vector<std::vector<unsigned char>> chunkData;
+
+public:
+	// Ctor - without compression every chunk is stored raw
+	MeshCacheWriter(bool compress = true);
+
+	// Encodes and adds a chunk, falling back to raw if encoding doesn't help
+	void AddChunk(unsigned int type, const void* data, size_t size,
+		unsigned int encoding, unsigned int stride = 0, unsigned int level = 0);
+
+	// Adds the material slot names
+	void AddMaterialNames(const std::vector<std::string>& materialNames);
+
+	// Adds the full level's local bounding box
+	void AddBounds(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax);
+
+	// Adds a coarse level of detail; add them coarsest first, before the full mesh
+	void AddLod(unsigned int level, const std::vector<Vertex>& vertices,
+		const std::vector<unsigned int>& indices, const std::vector<Submesh>& submeshes);
+
+	// Adds the full resolution vertex, index and submesh chunks
+	void AddGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+		const std::vector<Submesh>& submeshes);
+
+	bool Save(const char* cacheFile);
+};
+
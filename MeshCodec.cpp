@@ -0,0 +1,339 @@
+#include "MeshCodec.h"
+#include <cstring>
+#include <emmintrin.h>
+
+// Compressor settings
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+
+// Reads 4 bytes without alignment requirements
+static unsigned int Read32(const unsigned char* p)
+{
+	unsigned int value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+// Multiplicative hash of the next 4 bytes
+static unsigned int Hash32(unsigned int value)
+{
+	return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Writes a length that didn't fit in its 4 bit token field
+static void WriteExtendedLength(size_t length, std::vector<unsigned char>& out)
+{
+	while (length >= 255)
+	{
+		out.push_back(255);
+		length -= 255;
+	}
+	out.push_back((unsigned char)length);
+}
+
+// Reads the rest of a length whose token field was maxed out
+static bool ReadExtendedLength(const unsigned char*& in, const unsigned char* end, size_t& length)
+{
+	unsigned char b;
+	do
+	{
+		if (in >= end)
+			return false;
+		b = *in++;
+		length += b;
+	} while (b == 255);
+	return true;
+}
+
+// Writes one sequence: literals followed by an optional match
+static void WriteSequence(const unsigned char* literals, size_t literalLength,
+	size_t offset, size_t matchLength, std::vector<unsigned char>& out)
+{
+	size_t matchCode = matchLength > 0 ? matchLength - LZ_MIN_MATCH : 0;
+	unsigned char token = (unsigned char)(((literalLength < 15 ? literalLength : 15) << 4) |
+		(matchCode < 15 ? matchCode : 15));
+	out.push_back(token);
+	if (literalLength >= 15)
+		WriteExtendedLength(literalLength - 15, out);
+	out.insert(out.end(), literals, literals + literalLength);
+
+	// The final sequence has no match, which is how the decoder knows to stop
+	if (matchLength == 0)
+		return;
+
+	out.push_back((unsigned char)(offset & 0xFF));
+	out.push_back((unsigned char)(offset >> 8));
+	if (matchCode >= 15)
+		WriteExtendedLength(matchCode - 15, out);
+}
+
+void MeshCodec::EncodeIndices(const unsigned int* indices, size_t count, std::vector<unsigned char>& out)
+{
+	// Neighbouring triangles share vertices, so deltas are small and
+	// zigzag keeps small negative deltas small once they're unsigned
+	out.clear();
+	out.reserve(count * 2);
+	unsigned int previous = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		int delta = (int)(indices[i] - previous);
+		unsigned int zigzag = ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31);
+		previous = indices[i];
+
+		// 7 bits per byte, high bit set while more bytes follow
+		while (zigzag >= 0x80)
+		{
+			out.push_back((unsigned char)(zigzag | 0x80));
+			zigzag >>= 7;
+		}
+		out.push_back((unsigned char)zigzag);
+	}
+}
+
+bool MeshCodec::DecodeIndices(const unsigned char* data, size_t size, unsigned int* indices, size_t count)
+{
+	const unsigned char* in = data;
+	const unsigned char* end = data + size;
+	unsigned int previous = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned int zigzag;
+		if (end - in >= 5)
+		{
+			// Room for the longest varint, so no bounds checks needed
+			// (almost every delta fits in the first byte or two)
+			unsigned int b = *in++;
+			zigzag = b & 0x7F;
+			if (b & 0x80)
+			{
+				b = *in++; zigzag |= (b & 0x7F) << 7;
+				if (b & 0x80)
+				{
+					b = *in++; zigzag |= (b & 0x7F) << 14;
+					if (b & 0x80)
+					{
+						b = *in++; zigzag |= (b & 0x7F) << 21;
+						if (b & 0x80)
+						{
+							b = *in++; zigzag |= b << 28;
+							if (b > 0x0F)
+								return false;
+						}
+					}
+				}
+			}
+		}
+		else
+		{
+			zigzag = 0;
+			unsigned int shift = 0;
+			unsigned char b;
+			do
+			{
+				if (in >= end || shift > 28)
+					return false;
+				b = *in++;
+				zigzag |= (unsigned int)(b & 0x7F) << shift;
+				shift += 7;
+			} while (b & 0x80);
+		}
+
+		int delta = (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+		previous += (unsigned int)delta;
+		indices[i] = previous;
+	}
+	return in == end;
+}
+
+void MeshCodec::FilterBytePlanes(const void* records, size_t count, size_t stride, std::vector<unsigned char>& out)
+{
+	const unsigned char* src = (const unsigned char*)records;
+	out.resize(count * stride);
+	for (size_t b = 0; b < stride; b++)
+	{
+		unsigned char* plane = &out[0] + b * count;
+		for (size_t i = 0; i < count; i++)
+			plane[i] = src[i * stride + b];
+	}
+}
+
+void MeshCodec::UnfilterBytePlanes(const unsigned char* planes, size_t count, size_t stride, void* records)
+{
+	// Works through the records in blocks small enough to stay in the L1
+	// cache while every plane writes its byte into them
+	const size_t blockSize = 256;
+	unsigned char* dst = (unsigned char*)records;
+	for (size_t start = 0; start < count; start += blockSize)
+	{
+		size_t end = start + blockSize < count ? start + blockSize : count;
+
+		// Records made of 4 byte fields (floats, ints) are rebuilt a field at a time
+		size_t b = 0;
+		for (; b + 4 <= stride && stride % 4 == 0; b += 4)
+		{
+			const unsigned char* p0 = planes + b * count;
+			const unsigned char* p1 = p0 + count;
+			const unsigned char* p2 = p1 + count;
+			const unsigned char* p3 = p2 + count;
+			size_t i = start;
+			for (; i + 16 <= end; i += 16)
+			{
+				__m128i b0 = _mm_loadu_si128((const __m128i*)(p0 + i));
+				__m128i b1 = _mm_loadu_si128((const __m128i*)(p1 + i));
+				__m128i b2 = _mm_loadu_si128((const __m128i*)(p2 + i));
+				__m128i b3 = _mm_loadu_si128((const __m128i*)(p3 + i));
+				__m128i lo01 = _mm_unpacklo_epi8(b0, b1), hi01 = _mm_unpackhi_epi8(b0, b1);
+				__m128i lo23 = _mm_unpacklo_epi8(b2, b3), hi23 = _mm_unpackhi_epi8(b2, b3);
+				unsigned int fields[16];
+				_mm_storeu_si128((__m128i*)fields + 0, _mm_unpacklo_epi16(lo01, lo23));
+				_mm_storeu_si128((__m128i*)fields + 1, _mm_unpackhi_epi16(lo01, lo23));
+				_mm_storeu_si128((__m128i*)fields + 2, _mm_unpacklo_epi16(hi01, hi23));
+				_mm_storeu_si128((__m128i*)fields + 3, _mm_unpackhi_epi16(hi01, hi23));
+				for (int k = 0; k < 16; k++)
+					memcpy(dst + (i + k) * stride + b, &fields[k], 4);
+			}
+			for (; i < end; i++)
+			{
+				unsigned int field = p0[i] | (p1[i] << 8) | (p2[i] << 16) | ((unsigned int)p3[i] << 24);
+				memcpy(dst + i * stride + b, &field, sizeof(field));
+			}
+		}
+
+		for (; b < stride; b++)
+		{
+			const unsigned char* plane = planes + b * count;
+			for (size_t i = start; i < end; i++)
+				dst[i * stride + b] = plane[i];
+		}
+	}
+}
+
+void MeshCodec::Compress(const unsigned char* data, size_t size, std::vector<unsigned char>& out)
+{
+	out.clear();
+	out.reserve(size + size / 255 + 16);
+
+	// Most recent position of each hashed 4 byte sequence
+	std::vector<unsigned int> table((size_t)1 << LZ_HASH_BITS, 0);
+
+	size_t anchor = 0;	// Start of the literals not yet written
+	size_t pos = 1;		// Position 0 can't match anything
+	size_t misses = 0;	// Skip ahead faster through data that won't compress
+	while (size >= LZ_MIN_MATCH && pos + LZ_MIN_MATCH <= size)
+	{
+		unsigned int sequence = Read32(data + pos);
+		unsigned int hash = Hash32(sequence);
+		size_t candidate = table[hash];
+		table[hash] = (unsigned int)pos;
+
+		if (candidate >= pos || pos - candidate > LZ_MAX_OFFSET || Read32(data + candidate) != sequence)
+		{
+			pos += 1 + (misses++ >> 6);
+			continue;
+		}
+		misses = 0;
+
+		// Extend the match forwards...
+		size_t matchLength = LZ_MIN_MATCH;
+		while (pos + matchLength < size && data[candidate + matchLength] == data[pos + matchLength])
+			matchLength++;
+
+		// ...and backwards into the pending literals
+		while (pos > anchor && candidate > 0 && data[pos - 1] == data[candidate - 1])
+		{
+			pos--;
+			candidate--;
+			matchLength++;
+		}
+
+		WriteSequence(data + anchor, pos - anchor, pos - candidate, matchLength, out);
+		pos += matchLength;
+		anchor = pos;
+
+		// Keep the table warm with a position inside the match
+		if (pos - 2 + LZ_MIN_MATCH <= size)
+			table[Hash32(Read32(data + pos - 2))] = (unsigned int)(pos - 2);
+	}
+
+	// Whatever is left goes out as literals in the final sequence
+	WriteSequence(data + anchor, size - anchor, 0, 0, out);
+}
+
+bool MeshCodec::Decompress(const unsigned char* data, size_t size, unsigned char* out, size_t outSize)
+{
+	const unsigned char* in = data;
+	const unsigned char* inEnd = data + size;
+	unsigned char* op = out;
+	unsigned char* outEnd = out + outSize;
+
+	while (in < inEnd)
+	{
+		unsigned char token = *in++;
+
+		// Literals
+		size_t literalLength = token >> 4;
+		if (literalLength == 15 && !ReadExtendedLength(in, inEnd, literalLength))
+			return false;
+		if (literalLength > (size_t)(inEnd - in) || literalLength > (size_t)(outEnd - op))
+			return false;
+		if (literalLength <= 16 && inEnd - in >= 16 && outEnd - op >= 16)
+			memcpy(op, in, 16);	// Fixed size copies are a couple of instructions
+		else
+			memcpy(op, in, literalLength);
+		in += literalLength;
+		op += literalLength;
+
+		// The last sequence ends right after its literals
+		if (in == inEnd)
+			break;
+
+		// Match
+		if (inEnd - in < 2)
+			return false;
+		size_t offset = in[0] | ((size_t)in[1] << 8);
+		in += 2;
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !ReadExtendedLength(in, inEnd, matchLength))
+			return false;
+		matchLength += LZ_MIN_MATCH;
+		if (offset == 0 || offset > (size_t)(op - out) || matchLength > (size_t)(outEnd - op))
+			return false;
+
+		const unsigned char* match = op - offset;
+		unsigned char* copyEnd = op + matchLength;
+		if (outEnd - op >= 16)
+		{
+			// A short repeating pattern can also be copied from any multiple
+			// of its period back, so lay down enough of it to reach 8 bytes
+			if (offset < 8)
+			{
+				size_t period = offset;
+				while (period < 8)
+					period += offset;
+				for (size_t i = 0; i < period; i++)
+					op[i] = match[i];
+				op += period;
+				match = op - period;
+			}
+
+			// 8 byte copies now never read bytes this match hasn't written yet.
+			// They may run up to 7 bytes past the match, which later sequences
+			// rewrite, so stop while that still lands inside the output
+			unsigned char* fastEnd = copyEnd < outEnd - 16 ? copyEnd : outEnd - 16;
+			while (op < fastEnd)
+			{
+				memcpy(op, match, 8);
+				op += 8;
+				match += 8;
+			}
+		}
+
+		// Finish exactly near the end of the output
+		while (op < copyEnd)
+			*op++ = *match++;
+		op = copyEnd;
+	}
+
+	return op == outEnd;
+}
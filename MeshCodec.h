@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// --------------------------------------------------------
+// Encoders used by the binary mesh cache to shrink its
+// chunks on disk. Each stage is lossless:
+//  - Indices become zigzag deltas written as varints
+//  - Fixed size records are split into byte planes, so
+//    similar bytes (exponents, signs) sit next to each other
+//  - Either result is then run through a small LZ77 style
+//    compressor whose decoder is just copies and a few
+//    branches, so decoding is limited by memory bandwidth
+// --------------------------------------------------------
+class MeshCodec
+{
+public:
+	// Delta + zigzag + varint coding of an index stream
+	static void EncodeIndices(const unsigned int* indices, size_t count, std::vector<unsigned char>& out);
+	static bool DecodeIndices(const unsigned char* data, size_t size, unsigned int* indices, size_t count);
+
+	// Transposes "count" records of "stride" bytes into stride planes of count bytes
+	static void FilterBytePlanes(const void* records, size_t count, size_t stride, std::vector<unsigned char>& out);
+	static void UnfilterBytePlanes(const unsigned char* planes, size_t count, size_t stride, void* records);
+
+	// General purpose byte compression
+	static void Compress(const unsigned char* data, size_t size, std::vector<unsigned char>& out);
+	static bool Decompress(const unsigned char* data, size_t size, unsigned char* out, size_t outSize);
+};
+
@@ -0,0 +1,138 @@
+#include "MeshResidency.h"
+#include "MeshStreamer.h"
+
+#include <algorithm>
+#include <cstdio>
+
+MeshResidency* MeshResidency::instance;
+
+MeshResidency::MeshResidency()
+	: gpuBudget(MESH_RESIDENCY_GPU_BUDGET), cpuBudget(MESH_RESIDENCY_CPU_BUDGET),
+	frame(0), evictionCount(0), reloadCount(0)
+{
+}
+
+MeshResidency::~MeshResidency()
+{
+	instance = 0;
+}
+
+void MeshResidency::Register(std::shared_ptr<Mesh> mesh, const std::string& cacheFile)
+{
+	if (!mesh || entryIndices.count(mesh.get()))
+		return;
+
+	// Counts as just drawn, so a mesh isn't evicted before it's ever seen
+	Entry entry;
+	entry.mesh = mesh;
+	entry.cacheFile = cacheFile;
+	entry.lastDrawnFrame = frame;
+	entry.reloadQueued = false;
+	entry.reloadFailed = false;
+	entryIndices[mesh.get()] = entries.size();
+	entries.push_back(entry);
+}
+
+void MeshResidency::SetBudget(size_t gpuBytes, size_t cpuBytes)
+{
+	gpuBudget = gpuBytes;
+	cpuBudget = cpuBytes;
+}
+
+void MeshResidency::Touch(Mesh* mesh)
+{
+	std::unordered_map<Mesh*, size_t>::iterator found = entryIndices.find(mesh);
+	if (found == entryIndices.end())
+		return;
+
+	Entry& entry = entries[found->second];
+	entry.lastDrawnFrame = frame;
+	if (!mesh->IsEvicted())
+	{
+		entry.reloadQueued = false;
+		return;
+	}
+
+	// Skipping the mesh for a few frames beats stalling the frame on its cache
+	if (entry.reloadQueued || entry.reloadFailed)
+		return;
+	MeshStreamer::GetInstance().Reload(entry.mesh, entry.cacheFile);
+	entry.reloadQueued = true;
+	reloadCount++;
+}
+
+void MeshResidency::Update()
+{
+	frame++;
+
+	MeshStreamer::GetInstance().TakeFailedReloads(failedReloads);
+	for (size_t i = 0; i < failedReloads.size(); i++)
+	{
+		std::unordered_map<Mesh*, size_t>::iterator found = entryIndices.find(failedReloads[i].get());
+		if (found == entryIndices.end())
+			continue;
+
+		Entry& entry = entries[found->second];
+		entry.reloadQueued = false;
+		entry.reloadFailed = true;
+
+#if defined(DEBUG) || defined(_DEBUG)
+		printf("Couldn't reload %s\n", entry.cacheFile.c_str());
+#endif
+	}
+	failedReloads.clear();
+
+	size_t gpuBytes = GetGPUBytes();
+	size_t cpuBytes = GetCPUBytes();
+	if (gpuBytes <= gpuBudget && cpuBytes <= cpuBudget)
+		return;
+
+	// Only fully streamed meshes are evicted, so no level is still on its way in
+	std::vector<size_t> candidates;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		Entry& entry = entries[i];
+		if (entry.lastDrawnFrame + MESH_RESIDENCY_MIN_IDLE_FRAMES < frame &&
+			!entry.mesh->IsEvicted() && entry.mesh->IsFullyResident())
+			candidates.push_back(i);
+	}
+
+	// Least recently drawn first
+	std::sort(candidates.begin(), candidates.end(), [this](size_t a, size_t b) {
+		return entries[a].lastDrawnFrame < entries[b].lastDrawnFrame;
+	});
+
+	for (size_t i = 0; i < candidates.size() && (gpuBytes > gpuBudget || cpuBytes > cpuBudget); i++)
+	{
+		Mesh* mesh = entries[candidates[i]].mesh.get();
+		gpuBytes -= mesh->GetGPUBytes();
+		cpuBytes -= mesh->GetCPUBytes();
+		mesh->Evict();
+		evictionCount++;
+
+#if defined(DEBUG) || defined(_DEBUG)
+		printf("Evicted %s (idle %llu frames)\n", entries[candidates[i]].cacheFile.c_str(),
+			frame - entries[candidates[i]].lastDrawnFrame);
+#endif
+	}
+}
+
+size_t MeshResidency::GetGPUBytes()
+{
+	size_t total = 0;
+	for (size_t i = 0; i < entries.size(); i++)
+		total += entries[i].mesh->GetGPUBytes();
+	return total;
+}
+
+size_t MeshResidency::GetCPUBytes()
+{
+	size_t total = 0;
+	for (size_t i = 0; i < entries.size(); i++)
+		total += entries[i].mesh->GetCPUBytes();
+	return total;
+}
+
+int MeshResidency::GetEvictionCount() { return evictionCount; }
+
+int MeshResidency::GetReloadCount() { return reloadCount; }
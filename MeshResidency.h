@@ -0,0 +1,97 @@
+#pragma once
+#include "Mesh.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Default budgets, sized for the low-end cabinet GPUs
+#define MESH_RESIDENCY_GPU_BUDGET (256 * 1024 * 1024)
+#define MESH_RESIDENCY_CPU_BUDGET (256 * 1024 * 1024)
+
+// Meshes drawn within this many frames are never evicted, so
+// something just off screen doesn't bounce in and out every frame
+#define MESH_RESIDENCY_MIN_IDLE_FRAMES 120
+
+// --------------------------------------------------------
+// Keeps the meshes loaded from caches within a memory
+// budget. When the geometry of every registered mesh no
+// longer fits, the least recently drawn ones are evicted.
+// The next time an evicted mesh is drawn its reload is
+// queued with the MeshStreamer, and draws skip it until
+// its coarsest level is back. A mesh whose cache can't be
+// read is left evicted instead of being retried.
+//
+// Updating thread only (render snapshots touch the meshes
+// they draw as they're written).
+// --------------------------------------------------------
+class MeshResidency
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static MeshResidency& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new MeshResidency();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	MeshResidency(MeshResidency const&) = delete;
+	void operator=(MeshResidency const&) = delete;
+
+private:
+	static MeshResidency* instance;
+	MeshResidency();
+#pragma endregion
+
+public:
+	~MeshResidency();
+
+	// Lets a mesh be evicted, reloading it from the given cache when needed
+	void Register(std::shared_ptr<Mesh> mesh, const std::string& cacheFile);
+
+	// Sets the most geometry memory registered meshes may hold at once
+	void SetBudget(size_t gpuBytes, size_t cpuBytes);
+
+	// Marks a mesh as drawn this frame, queuing a reload if it was evicted
+	// (Mesh calls this itself; unregistered meshes are ignored)
+	void Touch(Mesh* mesh);
+
+	// Starts a new frame, noting failed reloads and evicting meshes until the budget is met
+	void Update();
+
+	// Memory held by the registered meshes right now
+	size_t GetGPUBytes();
+	size_t GetCPUBytes();
+
+	// How many evictions and reloads have happened so far
+	int GetEvictionCount();
+	int GetReloadCount();
+
+private:
+	// A registered mesh and where to reload it from
+	struct Entry
+	{
+		std::shared_ptr<Mesh> mesh;
+		std::string cacheFile;
+		unsigned long long lastDrawnFrame;
+		bool reloadQueued;		// Until the mesh is back or the reload fails
+		bool reloadFailed;		// The cache couldn't be read, so it's never tried again
+	};
+
+	std::vector<Entry> entries;
+	std::unordered_map<Mesh*, size_t> entryIndices;
+	std::vector<std::shared_ptr<Mesh>> failedReloads;
+
+	size_t gpuBudget;
+	size_t cpuBudget;
+	unsigned long long frame;
+	int evictionCount;
+	int reloadCount;
+};
@@ -0,0 +1,130 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <unordered_map>
+
+void MeshSimplifier::Cluster(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+	const std::vector<Submesh>& submeshes, int resolution,
+	std::vector<Vertex>& outVertices, std::vector<unsigned int>& outIndices,
+	std::vector<Submesh>& outSubmeshes)
+{
+	outVertices.clear();
+	outIndices.clear();
+	outSubmeshes.clear();
+	if (vertices.empty() || resolution < 1)
+		return;
+
+	// Square cells sized from the longest side of the bounds
+	XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const XMFLOAT3& p = vertices[i].Position;
+		if (p.x < boundsMin.x) boundsMin.x = p.x;
+		if (p.y < boundsMin.y) boundsMin.y = p.y;
+		if (p.z < boundsMin.z) boundsMin.z = p.z;
+		if (p.x > boundsMax.x) boundsMax.x = p.x;
+		if (p.y > boundsMax.y) boundsMax.y = p.y;
+		if (p.z > boundsMax.z) boundsMax.z = p.z;
+	}
+	float extent = boundsMax.x - boundsMin.x;
+	if (boundsMax.y - boundsMin.y > extent) extent = boundsMax.y - boundsMin.y;
+	if (boundsMax.z - boundsMin.z > extent) extent = boundsMax.z - boundsMin.z;
+	float cellScale = extent > 0 ? resolution / extent : 0;
+
+	// Sums of everything that lands in each cluster, averaged at the end
+	std::vector<Vertex> sums;
+	std::vector<unsigned int> counts;
+	std::unordered_map<unsigned long long, unsigned int> clusters;
+	std::vector<unsigned int> remap(vertices.size(), UINT_MAX);
+
+	for (size_t s = 0; s < submeshes.size(); s++)
+	{
+		const Submesh& submesh = submeshes[s];
+		Submesh outSubmesh = {};
+		outSubmesh.startIndex = (unsigned int)outIndices.size();
+		outSubmesh.materialSlot = submesh.materialSlot;
+
+		// Clusters never span submeshes, so a vertex used by two
+		// submeshes is clustered once for each of them
+		clusters.clear();
+		std::fill(remap.begin(), remap.end(), UINT_MAX);
+		for (unsigned int i = submesh.startIndex; i + 2 < submesh.startIndex + submesh.indexCount; i += 3)
+		{
+			unsigned int corners[3];
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int index = indices[i + c];
+				if (remap[index] == UINT_MAX)
+				{
+					// 21 bits per axis makes the key
+					const Vertex& v = vertices[index];
+					unsigned long long cx = (unsigned long long)((v.Position.x - boundsMin.x) * cellScale) & 0x1FFFFF;
+					unsigned long long cy = (unsigned long long)((v.Position.y - boundsMin.y) * cellScale) & 0x1FFFFF;
+					unsigned long long cz = (unsigned long long)((v.Position.z - boundsMin.z) * cellScale) & 0x1FFFFF;
+					unsigned long long key = (cx | (cy << 21) | (cz << 42));
+
+					std::unordered_map<unsigned long long, unsigned int>::iterator found = clusters.find(key);
+					if (found == clusters.end())
+					{
+						Vertex zero = {};
+						found = clusters.insert(std::make_pair(key, (unsigned int)sums.size())).first;
+						sums.push_back(zero);
+						counts.push_back(0);
+					}
+
+					Vertex& sum = sums[found->second];
+					sum.Position.x += v.Position.x; sum.Position.y += v.Position.y; sum.Position.z += v.Position.z;
+					sum.Normal.x += v.Normal.x; sum.Normal.y += v.Normal.y; sum.Normal.z += v.Normal.z;
+					sum.UV.x += v.UV.x; sum.UV.y += v.UV.y;
+					sum.Tangent.x += v.Tangent.x; sum.Tangent.y += v.Tangent.y; sum.Tangent.z += v.Tangent.z; sum.Tangent.w += v.Tangent.w;
+					counts[found->second]++;
+					remap[index] = found->second;
+				}
+				corners[c] = remap[index];
+			}
+
+			// Triangles that collapsed into a line or point disappear
+			if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2])
+				continue;
+			outIndices.push_back(corners[0]);
+			outIndices.push_back(corners[1]);
+			outIndices.push_back(corners[2]);
+		}
+
+		outSubmesh.indexCount = (unsigned int)outIndices.size() - outSubmesh.startIndex;
+		if (outSubmesh.indexCount > 0)
+			outSubmeshes.push_back(outSubmesh);
+	}
+
+	// Average each cluster, keeping normals and tangents unit length
+	outVertices.resize(sums.size());
+	for (size_t i = 0; i < sums.size(); i++)
+	{
+		float scale = 1.0f / counts[i];
+		Vertex v = sums[i];
+		v.Position = XMFLOAT3(v.Position.x * scale, v.Position.y * scale, v.Position.z * scale);
+		v.UV = XMFLOAT2(v.UV.x * scale, v.UV.y * scale);
+		XMStoreFloat3(&v.Normal, XMVector3Normalize(XMLoadFloat3(&v.Normal)));
+		XMStoreFloat4(&v.Tangent, XMVectorSetW(XMVector3Normalize(XMLoadFloat4(&v.Tangent)), v.Tangent.w < 0 ? -1.0f : 1.0f));
+		outVertices[i] = v;
+	}
+
+	// Clusters only referenced by dropped triangles still take up a slot,
+	// so compact the vertex array down to what's actually used
+	std::vector<unsigned int> used(outVertices.size(), UINT_MAX);
+	std::vector<Vertex> compacted;
+	compacted.reserve(outVertices.size());
+	for (size_t i = 0; i < outIndices.size(); i++)
+	{
+		unsigned int& index = outIndices[i];
+		if (used[index] == UINT_MAX)
+		{
+			used[index] = (unsigned int)compacted.size();
+			compacted.push_back(outVertices[index]);
+		}
+		index = used[index];
+	}
+	outVertices.swap(compacted);
+}
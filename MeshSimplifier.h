@@ -0,0 +1,23 @@
+#pragma once
+#include "Mesh.h"
+
+#include <vector>
+
+// --------------------------------------------------------
+// Builds coarse levels of detail by vertex clustering:
+// the mesh's bounds are cut into a grid, every vertex in a
+// cell is merged into one, and triangles that collapse are
+// dropped. Quality is modest but it's fast, needs no
+// topology and never fails, which is what streaming needs.
+// --------------------------------------------------------
+class MeshSimplifier
+{
+public:
+	// Clusters on a grid with "resolution" cells along the longest axis.
+	// Vertices are only merged within a material slot, so submeshes survive.
+	static void Cluster(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+		const std::vector<Submesh>& submeshes, int resolution,
+		std::vector<Vertex>& outVertices, std::vector<unsigned int>& outIndices,
+		std::vector<Submesh>& outSubmeshes);
+};
+
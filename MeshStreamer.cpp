@@ -0,0 +1,142 @@
+#include "MeshStreamer.h"
+#include "MeshBVH.h"
+#include "MeshCache.h"
+
+MeshStreamer* MeshStreamer::instance;
+
+MeshStreamer::MeshStreamer()
+	: stopping(false), pendingCount(0)
+{
+	// Streaming is mostly waiting on storage, so a couple of workers
+	// keep it busy without competing with the game for cores
+	unsigned int cores = std::thread::hardware_concurrency();
+	unsigned int workerCount = cores > 4 ? 2 : 1;
+	for (unsigned int i = 0; i < workerCount; i++)
+		workers.push_back(std::thread(&MeshStreamer::WorkerLoop, this));
+}
+
+MeshStreamer::~MeshStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stopping = true;
+		jobs.clear();
+	}
+	jobReady.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	instance = 0;
+}
+
+std::shared_ptr<Mesh> MeshStreamer::Load(const std::string& cacheFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	// The coarsest level is loaded right away so there's always something to draw
+	MeshCache cache(cacheFile.c_str());
+	if (!cache.IsValid() || cache.GetLevelCount() == 0)
+		return 0;
+
+	std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(cache, 0, device);
+	if (mesh->GetVertices().empty())
+		return 0;
+	if (!mesh->IsFullyResident())
+		QueueLevels(mesh, cacheFile, 1);
+	return mesh;
+}
+
+void MeshStreamer::Reload(std::shared_ptr<Mesh> mesh, const std::string& cacheFile)
+{
+	// Opening the cache and uploading even the coarsest level would stall a frame
+	QueueLevels(mesh, cacheFile, 0);
+}
+
+void MeshStreamer::TakeFailedReloads(std::vector<std::shared_ptr<Mesh>>& failed)
+{
+	std::lock_guard<std::mutex> lock(jobMutex);
+	failed.swap(failedReloads);
+	failedReloads.clear();
+}
+
+void MeshStreamer::QueueLevels(std::shared_ptr<Mesh> mesh, const std::string& cacheFile, int firstLevel)
+{
+	// The job keeps the mesh alive until it's done with it
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		jobs.push_back(std::bind(&MeshStreamer::StreamLevels, this, mesh, cacheFile, firstLevel));
+		pendingCount++;
+	}
+	jobReady.notify_one();
+}
+
+int MeshStreamer::GetPendingCount()
+{
+	std::lock_guard<std::mutex> lock(jobMutex);
+	return pendingCount;
+}
+
+void MeshStreamer::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping)
+				return;
+
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		job();
+
+		std::lock_guard<std::mutex> lock(jobMutex);
+		pendingCount--;
+	}
+}
+
+void MeshStreamer::StreamLevels(std::shared_ptr<Mesh> mesh, std::string cacheFile, int firstLevel)
+{
+	// Reads the remaining levels in file order, which is coarse to fine
+	MeshCache cache(cacheFile.c_str());
+	if (firstLevel == 0 && (!cache.IsValid() || cache.GetLevelCount() == 0))
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		failedReloads.push_back(mesh);
+		return;
+	}
+
+	for (int level = firstLevel; level < (int)cache.GetLevelCount(); level++)
+	{
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			if (stopping)
+				return;
+		}
+
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		std::vector<Submesh> submeshes;
+		if (!cache.ReadLevel(level, vertices, indices, submeshes) || vertices.empty() || indices.empty())
+		{
+			// Without its coarsest level a reloading mesh would never come back
+			if (level == 0)
+			{
+				std::lock_guard<std::mutex> lock(jobMutex);
+				failedReloads.push_back(mesh);
+			}
+			return;
+		}
+
+		// The full level brings its BVH along, if the cache has one
+		std::shared_ptr<MeshBVH> bvh;
+		if (level == (int)cache.GetLevelCount() - 1)
+		{
+			bvh = std::make_shared<MeshBVH>();
+			if (!bvh->Read(cache))
+				bvh.reset();
+		}
+		mesh->PublishLevel(level, vertices, indices, submeshes, bvh);
+	}
+}
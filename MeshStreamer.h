@@ -0,0 +1,76 @@
+#pragma once
+#include "Mesh.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// Streams meshes in from their caches on background
+// threads. Loading returns as soon as the coarsest level
+// is uploaded; the finer levels follow in the background
+// and each Mesh swaps them in when it's next drawn.
+// Reloading an evicted mesh happens entirely in the
+// background, coarsest level included.
+// --------------------------------------------------------
+class MeshStreamer
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static MeshStreamer& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new MeshStreamer();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	MeshStreamer(MeshStreamer const&) = delete;
+	void operator=(MeshStreamer const&) = delete;
+
+private:
+	static MeshStreamer* instance;
+	MeshStreamer();
+#pragma endregion
+
+public:
+	// Stops the workers, dropping any levels not streamed yet
+	~MeshStreamer();
+
+	// Loads the coarsest level of a mesh cache now and queues the rest.
+	// Returns null if the cache can't be read.
+	std::shared_ptr<Mesh> Load(const std::string& cacheFile, Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Queues a mesh that was evicted to be refilled from its cache. It stays
+	// evicted until its coarsest level has streamed in and been swapped in.
+	void Reload(std::shared_ptr<Mesh> mesh, const std::string& cacheFile);
+
+	// Hands over the meshes whose reload couldn't read their cache since the last call
+	void TakeFailedReloads(std::vector<std::shared_ptr<Mesh>>& failed);
+
+	// Number of meshes still streaming
+	int GetPendingCount();
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex jobMutex;
+	std::condition_variable jobReady;
+	bool stopping;
+	int pendingCount;
+	std::vector<std::shared_ptr<Mesh>> failedReloads;	// Guarded by jobMutex
+
+	void WorkerLoop();
+	void QueueLevels(std::shared_ptr<Mesh> mesh, const std::string& cacheFile, int firstLevel);
+	void StreamLevels(std::shared_ptr<Mesh> mesh, std::string cacheFile, int firstLevel);
+};
+
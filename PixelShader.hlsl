@@ -26,7 +26,7 @@ float4 main(VertexToPixel input) : SV_TARGET
     input.normal = normalize(input.normal);
 	
 	// Normalizes the tangents
-    input.tangent = normalize(input.tangent);
+    float3 tangent = normalize(input.tangent.xyz);
 	
 	// Gets texture colors
     float3 albedo = pow(Albedo.Sample(BasicSampler, input.uv).rgb, 2.2f);
@@ -41,9 +41,9 @@ float4 main(VertexToPixel input) : SV_TARGET
     float3 unpackedNormal = NormalMap.Sample(BasicSampler, input.uv).rgb * 2 - 1;
 	
 	// Gets tangent, bi-tangent, and normal
-    input.tangent = normalize(input.tangent - input.normal * dot(input.tangent, input.normal)); // Gram-Schmidt assumes T&N are normalized!
-    float3 B = cross(input.tangent, input.normal);
-    float3x3 TBN = float3x3(input.tangent, B, input.normal);
+    tangent = normalize(tangent - input.normal * dot(tangent, input.normal)); // Gram-Schmidt assumes T&N are normalized!
+    float3 B = cross(tangent, input.normal) * (input.tangent.w < 0 ? -1.0f : 1.0f); // Flipped where the UVs are mirrored
+    float3x3 TBN = float3x3(tangent, B, input.normal);
 	
     input.normal = normalize(mul(unpackedNormal, TBN));
 	
@@ -0,0 +1,383 @@
+#include "RayQuery.h"
+#include <cfloat>
+
+using namespace DirectX;
+
+#define RAY_QUERY_STACK_SIZE 64	// Deeper trees traverse with a heap allocated stack
+
+// Four rays in SoA form, one per lane
+struct RayPacket
+{
+	XMVECTOR originX, originY, originZ;
+	XMVECTOR directionX, directionY, directionZ;
+	XMVECTOR inverseX, inverseY, inverseZ;
+};
+
+// Closest hits of a packet so far. Unused lanes start with a negative
+// distance, so they fail every test without needing a separate mask.
+struct PacketHits
+{
+	XMVECTOR distance;
+	XMVECTOR u, v;
+	XMVECTOR triangle;	// Integer lanes
+	XMVECTOR entity;	// Integer lanes, -1 until something is hit
+};
+
+static bool AnyLane(FXMVECTOR mask)
+{
+	return !XMVector4EqualInt(mask, XMVectorFalseInt());
+}
+
+// Slab test of a box against all four rays, returning a lane mask and
+// each lane's entry distance
+static XMVECTOR IntersectBox(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax,
+	const RayPacket& packet, FXMVECTOR maxDistance, XMVECTOR& entry)
+{
+	XMVECTOR x1 = (XMVectorReplicate(boundsMin.x) - packet.originX) * packet.inverseX;
+	XMVECTOR x2 = (XMVectorReplicate(boundsMax.x) - packet.originX) * packet.inverseX;
+	XMVECTOR y1 = (XMVectorReplicate(boundsMin.y) - packet.originY) * packet.inverseY;
+	XMVECTOR y2 = (XMVectorReplicate(boundsMax.y) - packet.originY) * packet.inverseY;
+	XMVECTOR z1 = (XMVectorReplicate(boundsMin.z) - packet.originZ) * packet.inverseZ;
+	XMVECTOR z2 = (XMVectorReplicate(boundsMax.z) - packet.originZ) * packet.inverseZ;
+
+	XMVECTOR tMin = XMVectorMax(XMVectorMax(XMVectorMin(x1, x2), XMVectorMin(y1, y2)),
+		XMVectorMax(XMVectorMin(z1, z2), XMVectorZero()));
+	XMVECTOR tMax = XMVectorMin(XMVectorMin(XMVectorMax(x1, x2), XMVectorMax(y1, y2)),
+		XMVectorMin(XMVectorMax(z1, z2), maxDistance));
+	entry = tMin;
+	return XMVectorLessOrEqual(tMin, tMax);
+}
+
+// Moller-Trumbore of one triangle against all four rays, keeping closer hits
+static void IntersectTriangle(const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c, unsigned int triangle,
+	const RayPacket& packet, PacketHits& best)
+{
+	XMVECTOR edge1X = XMVectorReplicate(b.x - a.x);
+	XMVECTOR edge1Y = XMVectorReplicate(b.y - a.y);
+	XMVECTOR edge1Z = XMVectorReplicate(b.z - a.z);
+	XMVECTOR edge2X = XMVectorReplicate(c.x - a.x);
+	XMVECTOR edge2Y = XMVectorReplicate(c.y - a.y);
+	XMVECTOR edge2Z = XMVectorReplicate(c.z - a.z);
+
+	// p = direction x edge2
+	XMVECTOR pX = XMVectorNegativeMultiplySubtract(packet.directionZ, edge2Y, packet.directionY * edge2Z);
+	XMVECTOR pY = XMVectorNegativeMultiplySubtract(packet.directionX, edge2Z, packet.directionZ * edge2X);
+	XMVECTOR pZ = XMVectorNegativeMultiplySubtract(packet.directionY, edge2X, packet.directionX * edge2Y);
+	XMVECTOR determinant = XMVectorMultiplyAdd(edge1X, pX, XMVectorMultiplyAdd(edge1Y, pY, edge1Z * pZ));
+	XMVECTOR inverseDeterminant = XMVectorReciprocal(determinant);
+
+	// s = origin - a, q = s x edge1
+	XMVECTOR sX = packet.originX - XMVectorReplicate(a.x);
+	XMVECTOR sY = packet.originY - XMVectorReplicate(a.y);
+	XMVECTOR sZ = packet.originZ - XMVectorReplicate(a.z);
+	XMVECTOR u = XMVectorMultiplyAdd(sX, pX, XMVectorMultiplyAdd(sY, pY, sZ * pZ)) * inverseDeterminant;
+	XMVECTOR qX = XMVectorNegativeMultiplySubtract(sZ, edge1Y, sY * edge1Z);
+	XMVECTOR qY = XMVectorNegativeMultiplySubtract(sX, edge1Z, sZ * edge1X);
+	XMVECTOR qZ = XMVectorNegativeMultiplySubtract(sY, edge1X, sX * edge1Y);
+	XMVECTOR v = XMVectorMultiplyAdd(packet.directionX, qX,
+		XMVectorMultiplyAdd(packet.directionY, qY, packet.directionZ * qZ)) * inverseDeterminant;
+	XMVECTOR t = XMVectorMultiplyAdd(edge2X, qX, XMVectorMultiplyAdd(edge2Y, qY, edge2Z * qZ)) * inverseDeterminant;
+
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR hit = XMVectorGreater(XMVectorAbs(determinant), XMVectorReplicate(1e-12f));
+	hit = XMVectorAndInt(hit, XMVectorGreaterOrEqual(u, zero));
+	hit = XMVectorAndInt(hit, XMVectorGreaterOrEqual(v, zero));
+	hit = XMVectorAndInt(hit, XMVectorLessOrEqual(u + v, XMVectorSplatOne()));
+	hit = XMVectorAndInt(hit, XMVectorGreater(t, zero));
+	hit = XMVectorAndInt(hit, XMVectorLess(t, best.distance));
+	if (!AnyLane(hit))
+		return;
+
+	best.distance = XMVectorSelect(best.distance, t, hit);
+	best.u = XMVectorSelect(best.u, u, hit);
+	best.v = XMVectorSelect(best.v, v, hit);
+	best.triangle = XMVectorSelect(best.triangle, XMVectorReplicateInt(triangle), hit);
+}
+
+// Walks one BVH with a packet already in the mesh's space
+static void TraverseBVH(MeshBVH& bvh, const RayPacket& packet, PacketHits& best)
+{
+	const std::vector<BVHNode>& nodes = bvh.GetNodes();
+	const std::vector<XMFLOAT3>& positions = bvh.GetPositions();
+	const std::vector<unsigned int>& triangles = bvh.GetTriangles();
+	const std::vector<unsigned int>& triangleIds = bvh.GetTriangleIds();
+
+	XMVECTOR entry;
+	if (!AnyLane(IntersectBox(nodes[0].boundsMin, nodes[0].boundsMax, packet, best.distance, entry)))
+		return;
+
+	// Each level leaves at most one sibling waiting, so depth + 1 entries always fit
+	unsigned int localStack[RAY_QUERY_STACK_SIZE];
+	std::vector<unsigned int> deepStack;
+	unsigned int* stack = localStack;
+	if (bvh.GetDepth() + 1 > RAY_QUERY_STACK_SIZE)
+	{
+		deepStack.resize(bvh.GetDepth() + 1);
+		stack = deepStack.data();
+	}
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const BVHNode& node = nodes[stack[--stackSize]];
+		if (node.triangleCount > 0)
+		{
+			for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.triangleCount; i++)
+			{
+				IntersectTriangle(positions[triangles[i * 3]], positions[triangles[i * 3 + 1]],
+					positions[triangles[i * 3 + 2]], triangleIds[i], packet, best);
+			}
+			continue;
+		}
+
+		// Tests both children, so only the ones some lane still needs get pushed
+		unsigned int nearChild = node.leftOrFirst;
+		unsigned int farChild = nearChild + 1;
+		XMVECTOR nearEntry, farEntry;
+		XMVECTOR nearMask = IntersectBox(nodes[nearChild].boundsMin, nodes[nearChild].boundsMax,
+			packet, best.distance, nearEntry);
+		XMVECTOR farMask = IntersectBox(nodes[farChild].boundsMin, nodes[farChild].boundsMax,
+			packet, best.distance, farEntry);
+		bool nearHit = AnyLane(nearMask);
+		bool farHit = AnyLane(farMask);
+
+		// The child some lane enters first goes on top of the stack
+		if (nearHit && farHit)
+		{
+			XMVECTOR infinity = XMVectorSplatInfinity();
+			XMFLOAT4 nearEntries, farEntries;
+			XMStoreFloat4(&nearEntries, XMVectorSelect(infinity, nearEntry, nearMask));
+			XMStoreFloat4(&farEntries, XMVectorSelect(infinity, farEntry, farMask));
+			float nearest = nearEntries.x, farthest = farEntries.x;
+			if (nearEntries.y < nearest) nearest = nearEntries.y;
+			if (nearEntries.z < nearest) nearest = nearEntries.z;
+			if (nearEntries.w < nearest) nearest = nearEntries.w;
+			if (farEntries.y < farthest) farthest = farEntries.y;
+			if (farEntries.z < farthest) farthest = farEntries.z;
+			if (farEntries.w < farthest) farthest = farEntries.w;
+			if (farthest < nearest)
+				std::swap(nearChild, farChild);
+		}
+		else if (farHit)
+		{
+			std::swap(nearChild, farChild);
+			std::swap(nearHit, farHit);
+		}
+
+		if (farHit)
+			stack[stackSize++] = farChild;
+		if (nearHit)
+			stack[stackSize++] = nearChild;
+	}
+}
+
+RayQuery::RayQuery(const std::vector<std::shared_ptr<Entity>>& entities)
+{
+	for (int e = 0; e < (int)entities.size(); e++)
+	{
+		std::shared_ptr<Mesh> mesh = entities[e]->GetMesh();
+		std::shared_ptr<MeshBVH> bvh = mesh ? mesh->GetBVH() : std::shared_ptr<MeshBVH>();
+		if (!bvh || bvh->IsEmpty())
+			continue;
+
+		Instance instance;
+		instance.bvh = bvh;
+		instance.entity = e;
+		UpdateInstance(instance, entities[e]->GetTransform());
+		instances.push_back(instance);
+	}
+
+	// All in one go, for a balanced tree to start with
+	std::vector<SceneBVHItem> items(instances.size());
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		items[i].boundsMin = instances[i].boundsMin;
+		items[i].boundsMax = instances[i].boundsMax;
+		items[i].userData = (unsigned int)i;
+	}
+	std::vector<int> proxies;
+	tree.Build(items, proxies);
+	for (size_t i = 0; i < instances.size(); i++)
+		instances[i].proxy = proxies[i];
+}
+
+void RayQuery::Refresh(const std::vector<std::shared_ptr<Entity>>& entities)
+{
+	// Starts over if the entities that can be hit are no longer the same ones
+	size_t next = 0;
+	for (int e = 0; e < (int)entities.size(); e++)
+	{
+		std::shared_ptr<Mesh> mesh = entities[e]->GetMesh();
+		std::shared_ptr<MeshBVH> bvh = mesh ? mesh->GetBVH() : std::shared_ptr<MeshBVH>();
+		if (!bvh || bvh->IsEmpty())
+			continue;
+
+		if (next >= instances.size() || instances[next].entity != e || instances[next].bvh != bvh)
+		{
+			*this = RayQuery(entities);
+			return;
+		}
+
+		// Most entities never move, and those are only a version check
+		Transform* transform = entities[e]->GetTransform();
+		transform->UpdateMatrices();
+		if (transform->GetVersion() != instances[next].transformVersion)
+		{
+			UpdateInstance(instances[next], transform);
+			tree.Move(instances[next].proxy, instances[next].boundsMin, instances[next].boundsMax);
+		}
+		next++;
+	}
+
+	if (next != instances.size())
+		*this = RayQuery(entities);
+}
+
+void RayQuery::UpdateInstance(Instance& instance, Transform* transform)
+{
+	XMFLOAT4X4 world = transform->GetWorldMatrix();
+	XMMATRIX worldMat = XMLoadFloat4x4(&world);
+	XMStoreFloat4x4(&instance.worldInverse, XMMatrixInverse(0, worldMat));
+	instance.transformVersion = transform->GetVersion();
+
+	// World bounds from the corners of the root node's box
+	const BVHNode& root = instance.bvh->GetNodes()[0];
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	for (int corner = 0; corner < 8; corner++)
+	{
+		XMVECTOR p = XMVectorSet(
+			(corner & 1) ? root.boundsMax.x : root.boundsMin.x,
+			(corner & 2) ? root.boundsMax.y : root.boundsMin.y,
+			(corner & 4) ? root.boundsMax.z : root.boundsMin.z, 1);
+		p = XMVector3TransformCoord(p, worldMat);
+		boundsMin = XMVectorMin(boundsMin, p);
+		boundsMax = XMVectorMax(boundsMax, p);
+	}
+	XMStoreFloat3(&instance.boundsMin, boundsMin);
+	XMStoreFloat3(&instance.boundsMax, boundsMax);
+}
+
+void RayQuery::CastPacket(const Ray* rays, int count, RayQueryHit* hits) const
+{
+	// Short packets repeat the first ray in the unused lanes
+	const Ray& r0 = rays[0];
+	const Ray& r1 = rays[count > 1 ? 1 : 0];
+	const Ray& r2 = rays[count > 2 ? 2 : 0];
+	const Ray& r3 = rays[count > 3 ? 3 : 0];
+
+	RayPacket world;
+	world.originX = XMVectorSet(r0.origin.x, r1.origin.x, r2.origin.x, r3.origin.x);
+	world.originY = XMVectorSet(r0.origin.y, r1.origin.y, r2.origin.y, r3.origin.y);
+	world.originZ = XMVectorSet(r0.origin.z, r1.origin.z, r2.origin.z, r3.origin.z);
+	world.directionX = XMVectorSet(r0.direction.x, r1.direction.x, r2.direction.x, r3.direction.x);
+	world.directionY = XMVectorSet(r0.direction.y, r1.direction.y, r2.direction.y, r3.direction.y);
+	world.directionZ = XMVectorSet(r0.direction.z, r1.direction.z, r2.direction.z, r3.direction.z);
+	world.inverseX = XMVectorReciprocal(world.directionX);
+	world.inverseY = XMVectorReciprocal(world.directionY);
+	world.inverseZ = XMVectorReciprocal(world.directionZ);
+
+	PacketHits best;
+	best.distance = XMVectorSet(r0.maxDistance, count > 1 ? r1.maxDistance : -1.0f,
+		count > 2 ? r2.maxDistance : -1.0f, count > 3 ? r3.maxDistance : -1.0f);
+	best.u = XMVectorZero();
+	best.v = XMVectorZero();
+	best.triangle = XMVectorZero();
+	best.entity = XMVectorReplicateInt(0xFFFFFFFF);
+
+	// Walks the tree over the instances, skipping whole groups no lane reaches
+	// (sized from the tree's height the same way, though rotations keep it short)
+	const std::vector<SceneBVHNode>& nodes = tree.GetNodes();
+	int localStack[SCENE_BVH_STACK_SIZE];
+	std::vector<int> deepStack;
+	int* stack = localStack;
+	if (tree.GetHeight() + 1 > SCENE_BVH_STACK_SIZE)
+	{
+		deepStack.resize(tree.GetHeight() + 1);
+		stack = deepStack.data();
+	}
+	int stackSize = 0;
+	if (tree.GetRoot() >= 0)
+		stack[stackSize++] = tree.GetRoot();
+	while (stackSize > 0)
+	{
+		const SceneBVHNode& node = nodes[stack[--stackSize]];
+		XMVECTOR entry;
+		if (!AnyLane(IntersectBox(node.boundsMin, node.boundsMax, world, best.distance, entry)))
+			continue;
+
+		if (node.left >= 0)
+		{
+			stack[stackSize++] = node.right;
+			stack[stackSize++] = node.left;
+			continue;
+		}
+
+		// Leaves are a little bigger than their instance, so it's tested itself too
+		const Instance& instance = instances[node.userData];
+		if (!AnyLane(IntersectBox(instance.boundsMin, instance.boundsMax, world, best.distance, entry)))
+			continue;
+
+		// Into the mesh's space; directions aren't renormalized, so distances stay in world units
+		const XMFLOAT4X4& m = instance.worldInverse;
+		RayPacket local;
+		local.originX = XMVectorMultiplyAdd(world.originX, XMVectorReplicate(m._11), XMVectorMultiplyAdd(world.originY,
+			XMVectorReplicate(m._21), XMVectorMultiplyAdd(world.originZ, XMVectorReplicate(m._31), XMVectorReplicate(m._41))));
+		local.originY = XMVectorMultiplyAdd(world.originX, XMVectorReplicate(m._12), XMVectorMultiplyAdd(world.originY,
+			XMVectorReplicate(m._22), XMVectorMultiplyAdd(world.originZ, XMVectorReplicate(m._32), XMVectorReplicate(m._42))));
+		local.originZ = XMVectorMultiplyAdd(world.originX, XMVectorReplicate(m._13), XMVectorMultiplyAdd(world.originY,
+			XMVectorReplicate(m._23), XMVectorMultiplyAdd(world.originZ, XMVectorReplicate(m._33), XMVectorReplicate(m._43))));
+		local.directionX = XMVectorMultiplyAdd(world.directionX, XMVectorReplicate(m._11), XMVectorMultiplyAdd(world.directionY,
+			XMVectorReplicate(m._21), world.directionZ * XMVectorReplicate(m._31)));
+		local.directionY = XMVectorMultiplyAdd(world.directionX, XMVectorReplicate(m._12), XMVectorMultiplyAdd(world.directionY,
+			XMVectorReplicate(m._22), world.directionZ * XMVectorReplicate(m._32)));
+		local.directionZ = XMVectorMultiplyAdd(world.directionX, XMVectorReplicate(m._13), XMVectorMultiplyAdd(world.directionY,
+			XMVectorReplicate(m._23), world.directionZ * XMVectorReplicate(m._33)));
+		local.inverseX = XMVectorReciprocal(local.directionX);
+		local.inverseY = XMVectorReciprocal(local.directionY);
+		local.inverseZ = XMVectorReciprocal(local.directionZ);
+
+		// Lanes that got closer belong to this entity now
+		XMVECTOR previous = best.distance;
+		TraverseBVH(*instance.bvh, local, best);
+		best.entity = XMVectorSelect(best.entity, XMVectorReplicateInt((unsigned int)instance.entity),
+			XMVectorLess(best.distance, previous));
+	}
+
+	for (int lane = 0; lane < count; lane++)
+	{
+		RayQueryHit& hit = hits[lane];
+		hit.entity = (int)XMVectorGetIntByIndex(best.entity, lane);
+		hit.triangle = XMVectorGetIntByIndex(best.triangle, lane);
+		hit.u = XMVectorGetByIndex(best.u, lane);
+		hit.v = XMVectorGetByIndex(best.v, lane);
+		hit.distance = XMVectorGetByIndex(best.distance, lane);
+	}
+}
+
+void RayQuery::Cast(const Ray* rays, size_t count, RayQueryHit* hits) const
+{
+	for (size_t i = 0; i < count; i += 4)
+		CastPacket(rays + i, count - i < 4 ? (int)(count - i) : 4, hits + i);
+}
+
+bool RayQuery::Cast(const Ray& ray, RayQueryHit& hit) const
+{
+	CastPacket(&ray, 1, &hit);
+	return hit.entity >= 0;
+}
+
+int RayQuery::GetInstanceCount() const { return (int)instances.size(); }
+
+void RayQuery::GetBounds(XMFLOAT3& boundsMin, XMFLOAT3& boundsMax) const
+{
+	XMVECTOR sceneMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR sceneMax = XMVectorReplicate(-FLT_MAX);
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		sceneMin = XMVectorMin(sceneMin, XMLoadFloat3(&instances[i].boundsMin));
+		sceneMax = XMVectorMax(sceneMax, XMLoadFloat3(&instances[i].boundsMax));
+	}
+	XMStoreFloat3(&boundsMin, sceneMin);
+	XMStoreFloat3(&boundsMax, sceneMax);
+}
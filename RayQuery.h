@@ -0,0 +1,81 @@
+#pragma once
+#include "Entity.h"
+#include "MeshBVH.h"
+#include "SceneBVH.h"
+
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+
+// One ray of a batch, in world space
+struct Ray
+{
+	DirectX::XMFLOAT3 origin;
+	DirectX::XMFLOAT3 direction;	// Normalized, so hit distances are in world units
+	float maxDistance;
+};
+
+// Closest hit of one ray of a batch
+struct RayQueryHit
+{
+	int entity;				// Index into the entity list the query was built from, or -1 on a miss
+	unsigned int triangle;	// Triangle number in that entity's mesh
+	float u, v;				// Barycentrics (weights of the 2nd and 3rd corners)
+	float distance;
+};
+
+// --------------------------------------------------------
+// Casts batches of rays against every entity whose mesh
+// has a BVH. Rays are traced four at a time as packets
+// (one per XMVECTOR lane), sharing each node and triangle
+// test, which pays off for the coherent rays picking,
+// line of sight fans and baking tend to produce. The
+// entities' world bounds are kept in a SceneBVH, so a
+// packet only visits the meshes it can actually reach.
+//
+// The query is a snapshot of the entities' transforms
+// taken when it's built, and casting never changes it,
+// so any number of threads can cast against one query.
+// --------------------------------------------------------
+class RayQuery
+{
+private:
+	// One entity as seen by the query
+	struct Instance
+	{
+		std::shared_ptr<MeshBVH> bvh;
+		DirectX::XMFLOAT4X4 worldInverse;	// Takes rays into the mesh's space
+		DirectX::XMFLOAT3 boundsMin;		// World space bounds
+		DirectX::XMFLOAT3 boundsMax;
+		int entity;
+		unsigned int transformVersion;		// Of the transform the above came from
+		int proxy;							// In the tree
+	};
+
+	std::vector<Instance> instances;
+	SceneBVH tree;						// Over the instances' world bounds
+
+	// Fills in an instance's matrix and bounds from its entity's transform
+	void UpdateInstance(Instance& instance, Transform* transform);
+
+	// Casts up to four rays as one packet
+	void CastPacket(const Ray* rays, int count, RayQueryHit* hits) const;
+
+public:
+	// Snapshots the entities (call on the thread that owns them)
+	RayQuery(const std::vector<std::shared_ptr<Entity>>& entities);
+
+	// Brings the snapshot up to date with the same entity list, redoing only
+	// the entities that moved (not while anything is casting)
+	void Refresh(const std::vector<std::shared_ptr<Entity>>& entities);
+
+	// Finds the closest hit of every ray; safe to call from several threads at once
+	void Cast(const Ray* rays, size_t count, RayQueryHit* hits) const;
+
+	// Single ray version, returning whether anything was hit
+	bool Cast(const Ray& ray, RayQueryHit& hit) const;
+
+	// Number of entities that can be hit, and the world bounds around all of them
+	int GetInstanceCount() const;
+	void GetBounds(DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax) const;
+};
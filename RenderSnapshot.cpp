@@ -0,0 +1,237 @@
+#include "RenderSnapshot.h"
+
+using namespace DirectX;
+
+RenderSnapshot::RenderSnapshot()
+	: frame(0), totalTime(0), view(), ambientColor(0, 0, 0), skyVertexBuffer(0), skyIndexBuffer(0), skyIndexCount(0)
+{
+}
+
+void RenderSnapshot::Reset(unsigned int frame)
+{
+	this->frame = frame;
+	items.clear();
+	submeshes.clear();
+	materials.clear();
+	lights.clear();
+	skyVertexBuffer = 0;
+	skyIndexBuffer = 0;
+	skyIndexCount = 0;
+}
+
+void RenderSnapshot::SetView(Camera* camera, float totalTime, XMFLOAT3 ambientColor)
+{
+	this->totalTime = totalTime;
+	this->ambientColor = ambientColor;
+	view.viewMatrix = camera->GetViewMatrix();
+	view.projectionMatrix = camera->GetProjectionMatrix();
+	view.position = camera->GetTransform()->GetPosition();
+
+	// With row vectors, each plane is a sum or difference of the
+	// view-projection's columns (rows of its transpose). Depth runs 0 to 1.
+	XMMATRIX columns = XMMatrixTranspose(XMLoadFloat4x4(&view.viewMatrix) * XMLoadFloat4x4(&view.projectionMatrix));
+	XMVECTOR planes[6] =
+	{
+		columns.r[3] + columns.r[0],	// Left
+		columns.r[3] - columns.r[0],	// Right
+		columns.r[3] + columns.r[1],	// Bottom
+		columns.r[3] - columns.r[1],	// Top
+		columns.r[2],					// Near
+		columns.r[3] - columns.r[2]		// Far
+	};
+	for (int i = 0; i < 6; i++)
+		XMStoreFloat4(&view.frustumPlanes[i], XMPlaneNormalize(planes[i]));
+}
+
+bool RenderSnapshot::IsVisible(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax) const
+{
+	XMVECTOR boxMin = XMLoadFloat3(&boundsMin);
+	XMVECTOR boxMax = XMLoadFloat3(&boundsMax);
+	for (int i = 0; i < 6; i++)
+	{
+		// The box corner furthest along the plane's normal
+		XMVECTOR plane = XMLoadFloat4(&view.frustumPlanes[i]);
+		XMVECTOR corner = XMVectorSelect(boxMin, boxMax, XMVectorGreaterOrEqual(plane, XMVectorZero()));
+		if (XMVectorGetX(XMPlaneDotCoord(plane, corner)) < 0)
+			return false;
+	}
+	return true;
+}
+
+void RenderSnapshot::AddMesh(MeshHandle mesh, const MaterialHandle* materials, unsigned int materialCount,
+	const XMFLOAT4X4& worldMatrix, const XMFLOAT4X4& worldInverseTransposeMatrix,
+	const Submesh* ranges, unsigned int rangeCount)
+{
+	// Resolving and touching the mesh here keeps all of its state on the
+	// updating thread; Draw only sees the buffers and ranges copied out
+	Resources& resources = Resources::GetInstance();
+	Mesh* liveMesh = resources.GetMeshes().Get(mesh);
+	if (!liveMesh || !liveMesh->PrepareToDraw() || materialCount == 0)
+		return;
+
+	RenderItem item;
+	item.vertexBuffer = liveMesh->GetVertexBuffer();
+	item.indexBuffer = liveMesh->GetIndexBuffer();
+	item.firstSubmesh = (unsigned int)submeshes.size();
+	item.submeshCount = ranges ? rangeCount : (unsigned int)liveMesh->GetSubmeshCount();
+	item.firstMaterial = (unsigned int)this->materials.size();
+	item.materialCount = materialCount;
+	item.worldMatrix = worldMatrix;
+	item.worldInverseTransposeMatrix = worldInverseTransposeMatrix;
+	items.push_back(item);
+
+	if (ranges)
+		submeshes.insert(submeshes.end(), ranges, ranges + rangeCount);
+	else
+	{
+		for (int i = 0; i < liveMesh->GetSubmeshCount(); i++)
+			submeshes.push_back(liveMesh->GetSubmesh(i));
+	}
+
+	for (unsigned int slot = 0; slot < materialCount; slot++)
+	{
+		RenderMaterial material;
+		material.material = materials[slot];
+		Material* liveMaterial = resources.GetMaterials().Get(material.material);
+		material.colorTint = liveMaterial ? liveMaterial->GetColorTint() : XMFLOAT4(1, 1, 1, 1);
+		this->materials.push_back(material);
+	}
+}
+
+void RenderSnapshot::AddLight(const Light& light)
+{
+	lights.push_back(light);
+}
+
+void RenderSnapshot::SetSkyMesh(Mesh* mesh)
+{
+	if (!mesh || !mesh->PrepareToDraw())
+		return;
+
+	skyVertexBuffer = mesh->GetVertexBuffer();
+	skyIndexBuffer = mesh->GetIndexBuffer();
+	skyIndexCount = mesh->GetIndexCount();
+}
+
+void RenderSnapshot::Draw(ID3D11DeviceContext* context) const
+{
+	Resources& resources = Resources::GetInstance();
+	for (const RenderItem& item : items)
+	{
+		// Binds the vertex and index buffers once for every submesh
+		UINT stride = sizeof(Vertex);
+		UINT offset = 0;
+		context->IASetVertexBuffers(0, 1, &item.vertexBuffer, &stride, &offset);
+		context->IASetIndexBuffer(item.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+		// Draws each submesh with the material in its slot (slot 0 for any
+		// slot the entity had no material for)
+		MaterialHandle previous = {};
+		for (unsigned int i = 0; i < item.submeshCount; i++)
+		{
+			const Submesh& submesh = submeshes[item.firstSubmesh + i];
+			unsigned int slot = submesh.materialSlot;
+			const RenderMaterial& material = materials[item.firstMaterial + (slot < item.materialCount ? slot : 0)];
+
+			// Only re-sends shader data when the material changes
+			if (material.material != previous)
+			{
+				Material* drawnMaterial = resources.GetMaterials().Get(material.material);
+				if (!drawnMaterial)
+					continue;
+
+				PrepareMaterial(item, material, drawnMaterial);
+				previous = material.material;
+			}
+
+			context->DrawIndexed(submesh.indexCount, submesh.startIndex, 0);
+		}
+	}
+}
+
+void RenderSnapshot::DrawSkyMesh(ID3D11DeviceContext* context) const
+{
+	if (!skyVertexBuffer)
+		return;
+
+	UINT stride = sizeof(Vertex);
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, &skyVertexBuffer, &stride, &offset);
+	context->IASetIndexBuffer(skyIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	context->DrawIndexed(skyIndexCount, 0, 0);
+}
+
+void RenderSnapshot::PrepareMaterial(const RenderItem& item, const RenderMaterial& material, Material* drawnMaterial) const
+{
+	Resources& resources = Resources::GetInstance();
+	SimpleVertexShader* vs = resources.GetVertexShaders().Get(drawnMaterial->GetVertexShaderHandle());
+	SimplePixelShader* ps = resources.GetPixelShaders().Get(drawnMaterial->GetPixelShaderHandle());
+
+	// Sets the appropriate shaders
+	vs->SetShader();
+	ps->SetShader();
+
+	// Per-draw vertex data, all from the snapshot
+	vs->SetMatrix4x4("worldMatrix", item.worldMatrix);
+	// Normals only need the upper 3x3, so only its three (padded) rows are sent
+	vs->SetData("worldInvMatrix", &item.worldInverseTransposeMatrix, sizeof(float) * 11);
+	vs->SetMatrix4x4("viewMatrix", view.viewMatrix);
+	vs->SetMatrix4x4("projectionMatrix", view.projectionMatrix);
+
+	// Textures come from the material itself, which only changes when loaded
+	drawnMaterial->PrepareMaterial(ps);
+	ps->SetFloat4("colorTint", material.colorTint);
+	ps->SetFloat("totalTime", totalTime);
+	ps->SetFloat3("cameraPos", view.position);
+	ps->SetFloat3("ambient", ambientColor);
+	ps->SetData("lights", lights.data(), sizeof(Light) * (int)lights.size());
+
+	// Copies the data to the constant buffer
+	vs->CopyAllBufferData();
+	ps->CopyAllBufferData();
+}
+
+unsigned int RenderSnapshot::GetFrame() const { return frame; }
+
+float RenderSnapshot::GetTotalTime() const { return totalTime; }
+
+const RenderView& RenderSnapshot::GetView() const { return view; }
+
+const std::vector<RenderItem>& RenderSnapshot::GetItems() const { return items; }
+
+const std::vector<Submesh>& RenderSnapshot::GetSubmeshes() const { return submeshes; }
+
+const std::vector<RenderMaterial>& RenderSnapshot::GetMaterials() const { return materials; }
+
+const std::vector<Light>& RenderSnapshot::GetLights() const { return lights; }
+
+RenderSnapshotRing::RenderSnapshotRing()
+	: writeSlot(0), readSlot(1), waitingSlot(2), framesWritten(0)
+{
+}
+
+RenderSnapshot& RenderSnapshotRing::BeginWrite()
+{
+	slots[writeSlot].Reset(++framesWritten);
+	return slots[writeSlot];
+}
+
+void RenderSnapshotRing::Publish()
+{
+	// Release makes the writes visible to whoever takes the slot; acquire
+	// makes sure Draw is done with the slot we get back before we reuse it
+	int previous = waitingSlot.exchange(writeSlot | RENDER_SNAPSHOT_FRESH, std::memory_order_acq_rel);
+	writeSlot = previous & RENDER_SNAPSHOT_SLOT_MASK;
+}
+
+const RenderSnapshot* RenderSnapshotRing::AcquireLatest()
+{
+	if (waitingSlot.load(std::memory_order_relaxed) & RENDER_SNAPSHOT_FRESH)
+	{
+		int previous = waitingSlot.exchange(readSlot, std::memory_order_acq_rel);
+		readSlot = previous & RENDER_SNAPSHOT_SLOT_MASK;
+	}
+
+	// The read slot starts out never written
+	return slots[readSlot].GetFrame() != 0 ? &slots[readSlot] : 0;
+}
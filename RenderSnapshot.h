@@ -0,0 +1,160 @@
+#pragma once
+#include "Mesh.h"
+#include "Material.h"
+#include "Camera.h"
+#include "Lights.h"
+#include "Resources.h"
+
+#include <DirectXMath.h>
+#include <wrl/client.h>
+#include <atomic>
+#include <vector>
+
+// Three slots let Update always have one to write while Draw reads another,
+// with the third waiting between them, so neither ever waits on the other
+#define RENDER_SNAPSHOT_SLOTS 3
+
+// Set on the handed-over slot index until Draw takes it
+#define RENDER_SNAPSHOT_FRESH 0x100
+#define RENDER_SNAPSHOT_SLOT_MASK 0xFF
+
+// The camera as it was when the snapshot was taken
+struct RenderView
+{
+	DirectX::XMFLOAT4X4 viewMatrix;
+	DirectX::XMFLOAT4X4 projectionMatrix;
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT4 frustumPlanes[6];	// Normals face inward
+};
+
+// One mesh to draw: its buffers (borrowed from the mesh), its run of the
+// snapshot's submesh list and its materials' run of the snapshot's material list
+struct RenderItem
+{
+	ID3D11Buffer* vertexBuffer;
+	ID3D11Buffer* indexBuffer;
+	unsigned int firstSubmesh;
+	unsigned int submeshCount;
+	unsigned int firstMaterial;
+	unsigned int materialCount;
+	DirectX::XMFLOAT4X4 worldMatrix;
+	DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
+};
+
+// A material as it was when the snapshot was taken (its tint can be animated)
+struct RenderMaterial
+{
+	MaterialHandle material;
+	DirectX::XMFLOAT4 colorTint;
+};
+
+// --------------------------------------------------------
+// Everything one frame's draws need, copied out of the
+// entities, camera and lights at the end of Update. Drawing
+// from it never touches those live objects, so the next
+// Update can change them while this frame is submitted.
+//
+// Meshes are resolved while the snapshot is written, which
+// is also when they're marked as drawn and swap in newly
+// streamed levels. The snapshot copies their submesh ranges
+// but only borrows their buffers (so no reference counts
+// change per item): meshes are only evicted, re-streamed,
+// batched or removed during Update before the snapshot is
+// written, and Draw takes it right after. Materials are
+// referenced by handle: one that is removed in the
+// meantime just stops resolving, and its draws are skipped.
+// --------------------------------------------------------
+class RenderSnapshot
+{
+private:
+	unsigned int frame;		// 0 until first written
+	float totalTime;
+	RenderView view;
+	DirectX::XMFLOAT3 ambientColor;
+	std::vector<RenderItem> items;
+	std::vector<Submesh> submeshes;
+	std::vector<RenderMaterial> materials;
+	std::vector<Light> lights;
+
+	// The sky's mesh, drawn on its own after the items (no buffers if there's no sky)
+	ID3D11Buffer* skyVertexBuffer;
+	ID3D11Buffer* skyIndexBuffer;
+	int skyIndexCount;
+
+	// Sets shaders and uploads per-draw data for one item and material
+	void PrepareMaterial(const RenderItem& item, const RenderMaterial& material, Material* drawnMaterial) const;
+
+public:
+	RenderSnapshot();
+
+	// Empties the snapshot for a new frame, keeping its memory
+	void Reset(unsigned int frame);
+
+	// Copies the camera's matrices and the frame-wide shader values
+	void SetView(Camera* camera, float totalTime, DirectX::XMFLOAT3 ambientColor);
+
+	// Whether a world space box is at least partly inside the view's frustum
+	bool IsVisible(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax) const;
+
+	// Copies a mesh's buffers and submeshes along with the world matrices and
+	// materials (one per mesh slot) to draw it with, skipping meshes that are
+	// gone or evicted. Given ranges, only those parts of its index buffer are
+	// drawn instead of its submeshes.
+	void AddMesh(MeshHandle mesh, const MaterialHandle* materials, unsigned int materialCount,
+		const DirectX::XMFLOAT4X4& worldMatrix, const DirectX::XMFLOAT4X4& worldInverseTransposeMatrix,
+		const Submesh* ranges = 0, unsigned int rangeCount = 0);
+	void AddLight(const Light& light);
+
+	// Copies the sky mesh's buffers, the same way AddMesh() does
+	void SetSkyMesh(Mesh* mesh);
+
+	// Draws every item with the snapshot's camera and lights
+	void Draw(ID3D11DeviceContext* context) const;
+
+	// Draws the sky mesh with whatever shaders and states are set
+	void DrawSkyMesh(ID3D11DeviceContext* context) const;
+
+	// Getters
+	unsigned int GetFrame() const;
+	float GetTotalTime() const;
+	const RenderView& GetView() const;
+	const std::vector<RenderItem>& GetItems() const;
+	const std::vector<Submesh>& GetSubmeshes() const;
+	const std::vector<RenderMaterial>& GetMaterials() const;
+	const std::vector<Light>& GetLights() const;
+};
+
+// --------------------------------------------------------
+// The hand-over between Update and Draw. Update writes the
+// slot it owns and publishes it; Draw takes the newest
+// published one. Each side swaps its slot with the waiting
+// one in a single atomic exchange, so no locks are needed
+// and Draw never sees a snapshot that's still being written.
+// If Update publishes twice before Draw takes one, the
+// older is simply written over.
+//
+// BeginWrite and Publish are for the updating thread only,
+// AcquireLatest for the drawing thread only.
+// --------------------------------------------------------
+class RenderSnapshotRing
+{
+private:
+	RenderSnapshot slots[RENDER_SNAPSHOT_SLOTS];
+	int writeSlot;					// Owned by the updating thread
+	int readSlot;					// Owned by the drawing thread
+	std::atomic<int> waitingSlot;	// Between them, with RENDER_SNAPSHOT_FRESH if not yet taken
+	unsigned int framesWritten;
+
+public:
+	RenderSnapshotRing();
+
+	// The slot to fill this frame, already reset
+	RenderSnapshot& BeginWrite();
+
+	// Hands the slot written since BeginWrite over to Draw
+	void Publish();
+
+	// The newest published snapshot (which stays valid until the next
+	// call), or null if nothing has been published yet
+	const RenderSnapshot* AcquireLatest();
+};
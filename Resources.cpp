@@ -0,0 +1,20 @@
+#include "Resources.h"
+
+Resources* Resources::instance;
+
+Resources::Resources()
+{
+}
+
+Resources::~Resources()
+{
+	instance = 0;
+}
+
+HandlePool<Mesh>& Resources::GetMeshes() { return meshes; }
+
+HandlePool<Material>& Resources::GetMaterials() { return materials; }
+
+HandlePool<SimpleVertexShader>& Resources::GetVertexShaders() { return vertexShaders; }
+
+HandlePool<SimplePixelShader>& Resources::GetPixelShaders() { return pixelShaders; }
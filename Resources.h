@@ -0,0 +1,57 @@
+#pragma once
+#include "Handle.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "SimpleShader.h"
+
+typedef Handle<Mesh> MeshHandle;
+typedef Handle<Material> MaterialHandle;
+typedef Handle<SimpleVertexShader> VertexShaderHandle;
+typedef Handle<SimplePixelShader> PixelShaderHandle;
+
+// --------------------------------------------------------
+// The pools every mesh, material and shader that gets drawn
+// is kept in. Entities and materials hold handles into them,
+// so drawing resolves plain pointers instead of copying
+// shared_ptrs. Anything in a pool lives until it's removed.
+// --------------------------------------------------------
+class Resources
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static Resources& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new Resources();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	Resources(Resources const&) = delete;
+	void operator=(Resources const&) = delete;
+
+private:
+	static Resources* instance;
+	Resources();
+#pragma endregion
+
+public:
+	// Releases everything still in the pools
+	~Resources();
+
+	HandlePool<Mesh>& GetMeshes();
+	HandlePool<Material>& GetMaterials();
+	HandlePool<SimpleVertexShader>& GetVertexShaders();
+	HandlePool<SimplePixelShader>& GetPixelShaders();
+
+private:
+	HandlePool<Mesh> meshes;
+	HandlePool<Material> materials;
+	HandlePool<SimpleVertexShader> vertexShaders;
+	HandlePool<SimplePixelShader> pixelShaders;
+};
+
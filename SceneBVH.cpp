@@ -0,0 +1,444 @@
+#include "SceneBVH.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+// How a node's box relates to a query's shape
+enum SceneBVHContainment { CONTAINMENT_OUTSIDE, CONTAINMENT_PARTIAL, CONTAINMENT_INSIDE };
+
+// Half the surface area of a box, which is all the insertion cost needs
+static float Area(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+	float x = boundsMax.x - boundsMin.x;
+	float y = boundsMax.y - boundsMin.y;
+	float z = boundsMax.z - boundsMin.z;
+	return x * y + y * z + z * x;
+}
+
+static float UnionArea(const SceneBVHNode& a, const SceneBVHNode& b)
+{
+	XMFLOAT3 boundsMin, boundsMax;
+	XMStoreFloat3(&boundsMin, XMVectorMin(XMLoadFloat3(&a.boundsMin), XMLoadFloat3(&b.boundsMin)));
+	XMStoreFloat3(&boundsMax, XMVectorMax(XMLoadFloat3(&a.boundsMax), XMLoadFloat3(&b.boundsMax)));
+	return Area(boundsMin, boundsMax);
+}
+
+SceneBVH::SceneBVH()
+	: root(-1), freeList(-1), count(0)
+{
+}
+
+int SceneBVH::AllocateNode()
+{
+	int node;
+	if (freeList >= 0)
+	{
+		node = freeList;
+		freeList = nodes[node].parent;
+	}
+	else
+	{
+		node = (int)nodes.size();
+		nodes.push_back(SceneBVHNode());
+	}
+
+	SceneBVHNode& allocated = nodes[node];
+	allocated.parent = -1;
+	allocated.left = -1;
+	allocated.right = -1;
+	allocated.height = 0;
+	allocated.userData = 0;
+	return node;
+}
+
+void SceneBVH::FreeNode(int node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+void SceneBVH::FitNode(int node)
+{
+	SceneBVHNode& fitted = nodes[node];
+	const SceneBVHNode& left = nodes[fitted.left];
+	const SceneBVHNode& right = nodes[fitted.right];
+	XMStoreFloat3(&fitted.boundsMin, XMVectorMin(XMLoadFloat3(&left.boundsMin), XMLoadFloat3(&right.boundsMin)));
+	XMStoreFloat3(&fitted.boundsMax, XMVectorMax(XMLoadFloat3(&left.boundsMax), XMLoadFloat3(&right.boundsMax)));
+	fitted.height = 1 + (left.height > right.height ? left.height : right.height);
+}
+
+void SceneBVH::InsertLeaf(int leaf)
+{
+	if (root < 0)
+	{
+		root = leaf;
+		nodes[leaf].parent = -1;
+		return;
+	}
+
+	// Walks down to the sibling that adds the least surface area to the tree:
+	// stopping here costs a new parent around both, going further costs the
+	// growth of this node plus whatever the child would add
+	int index = root;
+	while (nodes[index].left >= 0)
+	{
+		const SceneBVHNode& node = nodes[index];
+		float area = Area(node.boundsMin, node.boundsMax);
+		float combinedArea = UnionArea(node, nodes[leaf]);
+		float cost = 2 * combinedArea;
+		float inheritance = 2 * (combinedArea - area);
+
+		float childCosts[2];
+		int children[2] = { node.left, node.right };
+		for (int i = 0; i < 2; i++)
+		{
+			const SceneBVHNode& child = nodes[children[i]];
+			childCosts[i] = UnionArea(child, nodes[leaf]) + inheritance;
+			if (child.left >= 0)
+				childCosts[i] -= Area(child.boundsMin, child.boundsMax);
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1])
+			break;
+		index = childCosts[0] < childCosts[1] ? children[0] : children[1];
+	}
+
+	// A new parent takes the sibling's place, with the sibling and leaf under it
+	int sibling = index;
+	int oldParent = nodes[sibling].parent;
+	int newParent = AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].left = sibling;
+	nodes[newParent].right = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+	if (oldParent < 0)
+		root = newParent;
+	else if (nodes[oldParent].left == sibling)
+		nodes[oldParent].left = newParent;
+	else
+		nodes[oldParent].right = newParent;
+
+	// Everything above grew, and may now be out of balance
+	for (index = newParent; index >= 0; index = nodes[index].parent)
+	{
+		FitNode(index);
+		index = Balance(index);
+	}
+}
+
+void SceneBVH::RemoveLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = -1;
+		return;
+	}
+
+	// The leaf's sibling takes their parent's place
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+	nodes[sibling].parent = grandParent;
+	FreeNode(parent);
+	nodes[leaf].parent = -1;
+
+	if (grandParent < 0)
+	{
+		root = sibling;
+		return;
+	}
+
+	if (nodes[grandParent].left == parent)
+		nodes[grandParent].left = sibling;
+	else
+		nodes[grandParent].right = sibling;
+
+	for (int index = grandParent; index >= 0; index = nodes[index].parent)
+	{
+		FitNode(index);
+		index = Balance(index);
+	}
+}
+
+int SceneBVH::Balance(int node)
+{
+	const SceneBVHNode& balanced = nodes[node];
+	if (balanced.left < 0 || balanced.height < 2)
+		return node;
+
+	int balance = nodes[balanced.right].height - nodes[balanced.left].height;
+	if (balance > 1)
+		return RotateUp(node, balanced.right);
+	if (balance < -1)
+		return RotateUp(node, balanced.left);
+	return node;
+}
+
+int SceneBVH::RotateUp(int node, int child)
+{
+	// The child (tall enough to have children of its own) takes the node's
+	// place. It keeps its taller child and gives the shorter to the node,
+	// in the slot it came from.
+	SceneBVHNode& above = nodes[node];
+	SceneBVHNode& raised = nodes[child];
+	int taller = raised.left;
+	int shorter = raised.right;
+	if (nodes[taller].height < nodes[shorter].height)
+		std::swap(taller, shorter);
+
+	raised.parent = above.parent;
+	raised.left = node;
+	raised.right = taller;
+	above.parent = child;
+	if (above.left == child)
+		above.left = shorter;
+	else
+		above.right = shorter;
+	nodes[shorter].parent = node;
+
+	if (raised.parent < 0)
+		root = child;
+	else if (nodes[raised.parent].left == node)
+		nodes[raised.parent].left = child;
+	else
+		nodes[raised.parent].right = child;
+
+	FitNode(node);
+	FitNode(child);
+	return child;
+}
+
+int SceneBVH::BuildRange(std::vector<int>& leaves, size_t first, size_t last)
+{
+	if (last - first == 1)
+		return leaves[first];
+
+	// Splits at the median of whichever axis the leaves' centers spread along most
+	XMVECTOR centerMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR centerMax = XMVectorReplicate(-FLT_MAX);
+	for (size_t i = first; i < last; i++)
+	{
+		const SceneBVHNode& leaf = nodes[leaves[i]];
+		XMVECTOR center = XMLoadFloat3(&leaf.boundsMin) + XMLoadFloat3(&leaf.boundsMax);
+		centerMin = XMVectorMin(centerMin, center);
+		centerMax = XMVectorMax(centerMax, center);
+	}
+	XMFLOAT3 spread;
+	XMStoreFloat3(&spread, centerMax - centerMin);
+	int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+
+	size_t middle = (first + last) / 2;
+	std::nth_element(leaves.begin() + first, leaves.begin() + middle, leaves.begin() + last,
+		[this, axis](int a, int b)
+		{
+			return (&nodes[a].boundsMin.x)[axis] + (&nodes[a].boundsMax.x)[axis] <
+				(&nodes[b].boundsMin.x)[axis] + (&nodes[b].boundsMax.x)[axis];
+		});
+
+	int left = BuildRange(leaves, first, middle);
+	int right = BuildRange(leaves, middle, last);
+	int node = AllocateNode();
+	nodes[node].left = left;
+	nodes[node].right = right;
+	nodes[left].parent = node;
+	nodes[right].parent = node;
+	FitNode(node);
+	return node;
+}
+
+void SceneBVH::Build(const std::vector<SceneBVHItem>& items, std::vector<int>& proxies)
+{
+	Clear();
+	nodes.reserve(items.size() * 2);
+	proxies.resize(items.size());
+
+	XMVECTOR margin = XMVectorReplicate(SCENE_BVH_MARGIN);
+	std::vector<int> leaves(items.size());
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		int leaf = AllocateNode();
+		XMStoreFloat3(&nodes[leaf].boundsMin, XMLoadFloat3(&items[i].boundsMin) - margin);
+		XMStoreFloat3(&nodes[leaf].boundsMax, XMLoadFloat3(&items[i].boundsMax) + margin);
+		nodes[leaf].userData = items[i].userData;
+		leaves[i] = leaf;
+		proxies[i] = leaf;
+	}
+
+	count = (int)items.size();
+	if (!leaves.empty())
+		root = BuildRange(leaves, 0, leaves.size());
+}
+
+int SceneBVH::Insert(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, unsigned int userData)
+{
+	XMVECTOR margin = XMVectorReplicate(SCENE_BVH_MARGIN);
+	int leaf = AllocateNode();
+	XMStoreFloat3(&nodes[leaf].boundsMin, XMLoadFloat3(&boundsMin) - margin);
+	XMStoreFloat3(&nodes[leaf].boundsMax, XMLoadFloat3(&boundsMax) + margin);
+	nodes[leaf].userData = userData;
+	InsertLeaf(leaf);
+	count++;
+	return leaf;
+}
+
+void SceneBVH::Remove(int proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	count--;
+}
+
+void SceneBVH::Clear()
+{
+	nodes.clear();
+	root = -1;
+	freeList = -1;
+	count = 0;
+}
+
+bool SceneBVH::Move(int proxy, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+	// Nothing to do while the item is still inside its widened box
+	SceneBVHNode& leaf = nodes[proxy];
+	if (boundsMin.x >= leaf.boundsMin.x && boundsMin.y >= leaf.boundsMin.y && boundsMin.z >= leaf.boundsMin.z &&
+		boundsMax.x <= leaf.boundsMax.x && boundsMax.y <= leaf.boundsMax.y && boundsMax.z <= leaf.boundsMax.z)
+		return false;
+
+	RemoveLeaf(proxy);
+	XMVECTOR margin = XMVectorReplicate(SCENE_BVH_MARGIN);
+	XMStoreFloat3(&nodes[proxy].boundsMin, XMLoadFloat3(&boundsMin) - margin);
+	XMStoreFloat3(&nodes[proxy].boundsMax, XMLoadFloat3(&boundsMax) + margin);
+	InsertLeaf(proxy);
+	return true;
+}
+
+template<typename Test> void SceneBVH::Traverse(Test test, std::vector<unsigned int>& results) const
+{
+	if (root < 0)
+		return;
+
+	int stack[SCENE_BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = root;
+	while (stackSize > 0)
+	{
+		int index = stack[--stackSize];
+		const SceneBVHNode& node = nodes[index];
+		int containment = test(node.boundsMin, node.boundsMax);
+		if (containment == CONTAINMENT_OUTSIDE)
+			continue;
+
+		// A subtree entirely inside needs no more tests
+		if (node.left < 0)
+			results.push_back(node.userData);
+		else if (containment == CONTAINMENT_INSIDE || stackSize + 2 > SCENE_BVH_STACK_SIZE)
+			CollectLeaves(index, results);
+		else
+		{
+			stack[stackSize++] = node.right;
+			stack[stackSize++] = node.left;
+		}
+	}
+}
+
+void SceneBVH::CollectLeaves(int node, std::vector<unsigned int>& results) const
+{
+	const SceneBVHNode& collected = nodes[node];
+	if (collected.left < 0)
+	{
+		results.push_back(collected.userData);
+		return;
+	}
+	CollectLeaves(collected.left, results);
+	CollectLeaves(collected.right, results);
+}
+
+void SceneBVH::QueryBox(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, std::vector<unsigned int>& results) const
+{
+	Traverse([&](const XMFLOAT3& nodeMin, const XMFLOAT3& nodeMax)
+	{
+		if (nodeMin.x > boundsMax.x || nodeMin.y > boundsMax.y || nodeMin.z > boundsMax.z ||
+			nodeMax.x < boundsMin.x || nodeMax.y < boundsMin.y || nodeMax.z < boundsMin.z)
+			return CONTAINMENT_OUTSIDE;
+		if (nodeMin.x >= boundsMin.x && nodeMin.y >= boundsMin.y && nodeMin.z >= boundsMin.z &&
+			nodeMax.x <= boundsMax.x && nodeMax.y <= boundsMax.y && nodeMax.z <= boundsMax.z)
+			return CONTAINMENT_INSIDE;
+		return CONTAINMENT_PARTIAL;
+	}, results);
+}
+
+void SceneBVH::QuerySphere(const XMFLOAT3& center, float radius, std::vector<unsigned int>& results) const
+{
+	XMVECTOR sphereCenter = XMLoadFloat3(&center);
+	float radiusSquared = radius * radius;
+	Traverse([&](const XMFLOAT3& nodeMin, const XMFLOAT3& nodeMax)
+	{
+		// Nearest point of the box to the center, then the corner furthest from it
+		XMVECTOR boxMin = XMLoadFloat3(&nodeMin);
+		XMVECTOR boxMax = XMLoadFloat3(&nodeMax);
+		XMVECTOR nearest = XMVectorClamp(sphereCenter, boxMin, boxMax);
+		if (XMVectorGetX(XMVector3LengthSq(nearest - sphereCenter)) > radiusSquared)
+			return CONTAINMENT_OUTSIDE;
+		XMVECTOR furthest = XMVectorSelect(boxMin, boxMax, XMVectorLess(sphereCenter, (boxMin + boxMax) * 0.5f));
+		if (XMVectorGetX(XMVector3LengthSq(furthest - sphereCenter)) <= radiusSquared)
+			return CONTAINMENT_INSIDE;
+		return CONTAINMENT_PARTIAL;
+	}, results);
+}
+
+void SceneBVH::QueryFrustum(const XMFLOAT4 planes[6], std::vector<unsigned int>& results) const
+{
+	XMVECTOR planeVectors[6];
+	for (int i = 0; i < 6; i++)
+		planeVectors[i] = XMLoadFloat4(&planes[i]);
+
+	Traverse([&](const XMFLOAT3& nodeMin, const XMFLOAT3& nodeMax)
+	{
+		XMVECTOR boxMin = XMLoadFloat3(&nodeMin);
+		XMVECTOR boxMax = XMLoadFloat3(&nodeMax);
+		int containment = CONTAINMENT_INSIDE;
+		for (int i = 0; i < 6; i++)
+		{
+			// Outside if even the corner furthest along the normal is behind the
+			// plane; only partly inside if the corner furthest against it is
+			XMVECTOR alongNormal = XMVectorGreaterOrEqual(planeVectors[i], XMVectorZero());
+			XMVECTOR furthest = XMVectorSelect(boxMin, boxMax, alongNormal);
+			if (XMVectorGetX(XMPlaneDotCoord(planeVectors[i], furthest)) < 0)
+				return (int)CONTAINMENT_OUTSIDE;
+			XMVECTOR nearest = XMVectorSelect(boxMax, boxMin, alongNormal);
+			if (XMVectorGetX(XMPlaneDotCoord(planeVectors[i], nearest)) < 0)
+				containment = CONTAINMENT_PARTIAL;
+		}
+		return containment;
+	}, results);
+}
+
+void SceneBVH::QueryRay(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance,
+	std::vector<unsigned int>& results) const
+{
+	XMFLOAT3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	Traverse([&](const XMFLOAT3& nodeMin, const XMFLOAT3& nodeMax)
+	{
+		// Slab test, clipped to the ray's length
+		float x1 = (nodeMin.x - origin.x) * inverse.x, x2 = (nodeMax.x - origin.x) * inverse.x;
+		float y1 = (nodeMin.y - origin.y) * inverse.y, y2 = (nodeMax.y - origin.y) * inverse.y;
+		float z1 = (nodeMin.z - origin.z) * inverse.z, z2 = (nodeMax.z - origin.z) * inverse.z;
+		float entry = fmaxf(fmaxf(fminf(x1, x2), fminf(y1, y2)), fmaxf(fminf(z1, z2), 0.0f));
+		float exit = fminf(fminf(fmaxf(x1, x2), fmaxf(y1, y2)), fminf(fmaxf(z1, z2), maxDistance));
+		return entry <= exit ? CONTAINMENT_PARTIAL : CONTAINMENT_OUTSIDE;
+	}, results);
+}
+
+unsigned int SceneBVH::GetUserData(int proxy) const { return nodes[proxy].userData; }
+
+int SceneBVH::GetCount() const { return count; }
+
+int SceneBVH::GetHeight() const { return root >= 0 ? nodes[root].height : 0; }
+
+int SceneBVH::GetRoot() const { return root; }
+
+const std::vector<SceneBVHNode>& SceneBVH::GetNodes() const { return nodes; }
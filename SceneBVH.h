@@ -0,0 +1,112 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+// Leaves are kept this much (in world units) bigger than their item on every
+// side, so small moves only need a containment check
+#define SCENE_BVH_MARGIN 0.25f
+
+// Queries walk the tree with a fixed stack. Rotations keep it balanced, so
+// even a million items stay around 30 levels deep.
+#define SCENE_BVH_STACK_SIZE 64
+
+// One item for a bulk build
+struct SceneBVHItem
+{
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+	unsigned int userData;
+};
+
+// One node of the tree. A leaf holds one item (with its box widened
+// by the margin); an interior node always has two children.
+struct SceneBVHNode
+{
+	DirectX::XMFLOAT3 boundsMin;
+	int parent;					// -1 for the root (next free node while unused)
+	DirectX::XMFLOAT3 boundsMax;
+	int left;					// -1 for leaves
+	int right;
+	int height;					// 0 for leaves, -1 while unused
+	unsigned int userData;		// Leaves only
+};
+
+// --------------------------------------------------------
+// A dynamic bounding volume tree over world space boxes,
+// for finding what's in a frustum, sphere, box or along a
+// ray without looking at everything in the scene.
+//
+// Items are referred to by proxy (the index of their leaf,
+// which never changes while they're in the tree). Inserting
+// picks the sibling that grows the tree least, and rotations
+// on the way back up keep it balanced. Moving an item that
+// stays inside its widened leaf does nothing at all; one
+// that leaves it is taken out and put back in. A bulk build
+// makes a balanced tree over many items at once.
+//
+// Queries report each item's user data, and test the
+// widened boxes, so they can include items up to the margin
+// outside. They never change the tree, so any number of
+// threads can query while nothing is being changed.
+// --------------------------------------------------------
+class SceneBVH
+{
+private:
+	std::vector<SceneBVHNode> nodes;
+	int root;
+	int freeList;
+	int count;
+
+	int AllocateNode();
+	void FreeNode(int node);
+
+	// Links a leaf in and takes it out, rebalancing on the way back up
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+
+	// Recomputes a node's box and height from its children
+	void FitNode(int node);
+
+	// Rotates a taller child up if the node is out of balance, returning
+	// whichever node now heads the subtree
+	int Balance(int node);
+	int RotateUp(int node, int child);
+
+	// Builds a balanced subtree over a range of leaves by median splits
+	int BuildRange(std::vector<int>& leaves, size_t first, size_t last);
+
+	// Walks the tree, asking "test" how each node's box relates to the query
+	template<typename Test> void Traverse(Test test, std::vector<unsigned int>& results) const;
+	void CollectLeaves(int node, std::vector<unsigned int>& results) const;
+
+public:
+	SceneBVH();
+
+	// Replaces everything with a balanced tree over the items (far faster than
+	// inserting them one at a time). proxies[i] is given item i's proxy.
+	void Build(const std::vector<SceneBVHItem>& items, std::vector<int>& proxies);
+
+	// Adds one item, returning its proxy
+	int Insert(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, unsigned int userData);
+	void Remove(int proxy);
+	void Clear();
+
+	// Gives an item its new box, returning whether the tree had to change
+	bool Move(int proxy, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax);
+
+	// Append the user data of every item whose box touches the query's shape.
+	// Frustum planes face inward, as a RenderView's do.
+	void QueryBox(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax,
+		std::vector<unsigned int>& results) const;
+	void QuerySphere(const DirectX::XMFLOAT3& center, float radius, std::vector<unsigned int>& results) const;
+	void QueryFrustum(const DirectX::XMFLOAT4 planes[6], std::vector<unsigned int>& results) const;
+	void QueryRay(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance,
+		std::vector<unsigned int>& results) const;
+
+	// Getters
+	unsigned int GetUserData(int proxy) const;
+	int GetCount() const;
+	int GetHeight() const;
+	int GetRoot() const;
+	const std::vector<SceneBVHNode>& GetNodes() const;
+};
@@ -0,0 +1,322 @@
+#include "SceneFile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace DirectX;
+
+// Reads "count" comma separated floats, failing on anything else
+static bool ParseFloats(const std::string& text, float* out, int count)
+{
+	const char* c = text.c_str();
+	for (int i = 0; i < count; i++)
+	{
+		char* end;
+		out[i] = strtof(c, &end);
+		if (end == c || *end != (i == count - 1 ? '\0' : ','))
+			return false;
+		c = end + 1;
+	}
+	return true;
+}
+
+// Copies a name into a fixed size record field, failing if it doesn't fit
+static bool CopyName(const std::string& name, char* out, size_t size)
+{
+	if (name.empty() || name.size() >= size)
+		return false;
+	memcpy(out, name.c_str(), name.size() + 1);
+	return true;
+}
+
+// Takes "count" records off what's left of a file, failing if they don't fit.
+// The count is checked before it's multiplied, so it can't wrap on 32 bit builds.
+static bool TakeRecords(size_t& remaining, unsigned int count, size_t recordSize)
+{
+	if (count > remaining / recordSize)
+		return false;
+	remaining -= count * recordSize;
+	return true;
+}
+
+// Splits "key=value"; a bare word is a key with an empty value
+static void SplitProperty(const std::string& token, std::string& key, std::string& value)
+{
+	size_t equals = token.find('=');
+	key = token.substr(0, equals);
+	value = equals == std::string::npos ? std::string() : token.substr(equals + 1);
+}
+
+SceneFile::SceneFile()
+	: header(), meshes(0), materials(0), entities(0), lights(0)
+{
+	header.sky.mesh = -1;
+}
+
+bool SceneFile::LoadText(const char* sceneFile)
+{
+	*this = SceneFile();
+
+	std::ifstream in(sceneFile);
+	if (!in.is_open())
+		return false;
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line))
+	{
+		lineNumber++;
+		if (!ParseLine(line))
+		{
+#if defined(DEBUG) || defined(_DEBUG)
+			printf("%s(%d): can't read \"%s\"\n", sceneFile, lineNumber, line.c_str());
+#endif
+			*this = SceneFile();
+			return false;
+		}
+	}
+
+	header.magic = SCENE_FILE_MAGIC;
+	header.version = SCENE_FILE_VERSION;
+	header.meshCount = (unsigned int)parsedMeshes.size();
+	header.materialCount = (unsigned int)parsedMaterials.size();
+	header.entityCount = (unsigned int)parsedEntities.size();
+	header.lightCount = (unsigned int)parsedLights.size();
+	meshes = parsedMeshes.data();
+	materials = parsedMaterials.data();
+	entities = parsedEntities.data();
+	lights = parsedLights.data();
+	return true;
+}
+
+bool SceneFile::ParseLine(const std::string& line)
+{
+	std::istringstream tokens(line.substr(0, line.find('#')));
+	std::string kind;
+	if (!(tokens >> kind))
+		return true;	// Blank or comment only
+
+	// Meshes and materials are referred to by name, stored as an index
+	std::string token, key, value;
+	if (kind == "ambient")
+	{
+		return (tokens >> value) && ParseFloats(value, &header.ambientColor.x, 3);
+	}
+	else if (kind == "mesh")
+	{
+		SceneMesh mesh = {};
+		mesh.maxCollisionHulls = 1;
+		if (!(tokens >> value) || !CopyName(value, mesh.name, sizeof(mesh.name)))
+			return false;
+		while (tokens >> token)
+		{
+			SplitProperty(token, key, value);
+			if (key != "hulls")
+				return false;
+			mesh.maxCollisionHulls = atoi(value.c_str());
+		}
+		parsedMeshes.push_back(mesh);
+		return mesh.maxCollisionHulls > 0;
+	}
+	else if (kind == "material")
+	{
+		SceneMaterial material = {};
+		material.colorTint = XMFLOAT4(1, 1, 1, 1);
+		if (!(tokens >> value) || !CopyName(value, material.name, sizeof(material.name)))
+			return false;
+		while (tokens >> token)
+		{
+			SplitProperty(token, key, value);
+			if (key == "textures") { if (!CopyName(value, material.textures, sizeof(material.textures))) return false; }
+			else if (key == "tint") { if (!ParseFloats(value, &material.colorTint.x, 4)) return false; }
+			else return false;
+		}
+		parsedMaterials.push_back(material);
+		return material.textures[0] != 0;
+	}
+	else if (kind == "entity")
+	{
+		SceneEntity entity = {};
+		entity.mesh = -1;
+		entity.material = -1;
+		entity.parent = -1;
+		entity.rotation = XMFLOAT4(0, 0, 0, 1);
+		entity.scale = XMFLOAT3(1, 1, 1);
+		while (tokens >> token)
+		{
+			SplitProperty(token, key, value);
+			if (key == "mesh")
+			{
+				for (size_t i = 0; i < parsedMeshes.size(); i++)
+					if (value == parsedMeshes[i].name) entity.mesh = (int)i;
+			}
+			else if (key == "material")
+			{
+				for (size_t i = 0; i < parsedMaterials.size(); i++)
+					if (value == parsedMaterials[i].name) entity.material = (int)i;
+			}
+			else if (key == "position") { if (!ParseFloats(value, &entity.position.x, 3)) return false; }
+			else if (key == "scale") { if (!ParseFloats(value, &entity.scale.x, 3)) return false; }
+			else if (key == "rotation")
+			{
+				// Authored as angles, stored the way Transform keeps it
+				float angles[3];
+				if (!ParseFloats(value, angles, 3))
+					return false;
+				XMStoreFloat4(&entity.rotation, XMQuaternionRotationRollPitchYaw(angles[0], angles[1], angles[2]));
+			}
+			else if (key == "parent")
+			{
+				// Only earlier entities, so parents are always created first
+				entity.parent = atoi(value.c_str());
+				if (entity.parent < 0 || entity.parent >= (int)parsedEntities.size())
+					return false;
+			}
+			else if (key == "static") { entity.flags |= SCENE_ENTITY_STATIC; }
+			else return false;
+		}
+		parsedEntities.push_back(entity);
+		return entity.mesh >= 0 && entity.material >= 0;
+	}
+	else if (kind == "light")
+	{
+		Light light = {};
+		light.Type = -1;
+		while (tokens >> token)
+		{
+			SplitProperty(token, key, value);
+			if (key == "type")
+			{
+				if (value == "directional") light.Type = LIGHT_TYPE_DIRECTIONAL;
+				else if (value == "point") light.Type = LIGHT_TYPE_POINT;
+				else if (value == "spot") light.Type = LIGHT_TYPE_SPOT;
+				else return false;
+			}
+			else if (key == "direction") { if (!ParseFloats(value, &light.Direction.x, 3)) return false; }
+			else if (key == "position") { if (!ParseFloats(value, &light.Position.x, 3)) return false; }
+			else if (key == "color") { if (!ParseFloats(value, &light.Color.x, 3)) return false; }
+			else if (key == "intensity") { if (!ParseFloats(value, &light.Intensity, 1)) return false; }
+			else if (key == "range") { if (!ParseFloats(value, &light.Range, 1)) return false; }
+			else if (key == "falloff") { if (!ParseFloats(value, &light.SpotFalloff, 1)) return false; }
+			else return false;
+		}
+		parsedLights.push_back(light);
+		return light.Type >= 0;
+	}
+	else if (kind == "sky")
+	{
+		while (tokens >> token)
+		{
+			SplitProperty(token, key, value);
+			if (key == "mesh")
+			{
+				for (size_t i = 0; i < parsedMeshes.size(); i++)
+					if (value == parsedMeshes[i].name) header.sky.mesh = (int)i;
+			}
+			else if (key == "cubemap") { if (!CopyName(value, header.sky.cubeMap, sizeof(header.sky.cubeMap))) return false; }
+			else return false;
+		}
+		return header.sky.mesh >= 0 && header.sky.cubeMap[0] != 0;
+	}
+
+	return false;
+}
+
+bool SceneFile::LoadBinary(const char* binaryFile)
+{
+	*this = SceneFile();
+
+	std::unique_ptr<MappedFile> mapped(new MappedFile(binaryFile));
+	if (!mapped->IsOpen() || mapped->GetSize() < sizeof(SceneFileHeader))
+		return false;
+
+	// The header is copied out, the records are used where they are
+	SceneFileHeader fileHeader;
+	memcpy(&fileHeader, mapped->GetData(), sizeof(fileHeader));
+	if (fileHeader.magic != SCENE_FILE_MAGIC || fileHeader.version != SCENE_FILE_VERSION)
+		return false;
+
+	// The records must fill the rest of the file exactly
+	size_t remaining = mapped->GetSize() - sizeof(SceneFileHeader);
+	if (!TakeRecords(remaining, fileHeader.meshCount, sizeof(SceneMesh)) ||
+		!TakeRecords(remaining, fileHeader.materialCount, sizeof(SceneMaterial)) ||
+		!TakeRecords(remaining, fileHeader.entityCount, sizeof(SceneEntity)) ||
+		!TakeRecords(remaining, fileHeader.lightCount, sizeof(Light)) ||
+		remaining != 0)
+		return false;
+
+	const unsigned char* data = mapped->GetData() + sizeof(SceneFileHeader);
+	const SceneMesh* fileMeshes = (const SceneMesh*)data;
+	data += fileHeader.meshCount * sizeof(SceneMesh);
+	const SceneMaterial* fileMaterials = (const SceneMaterial*)data;
+	data += fileHeader.materialCount * sizeof(SceneMaterial);
+	const SceneEntity* fileEntities = (const SceneEntity*)data;
+	data += fileHeader.entityCount * sizeof(SceneEntity);
+	const Light* fileLights = (const Light*)data;
+
+	// Indices are checked once here, so users of the scene can trust them
+	for (unsigned int i = 0; i < fileHeader.entityCount; i++)
+	{
+		const SceneEntity& entity = fileEntities[i];
+		if (entity.mesh < 0 || entity.mesh >= (int)fileHeader.meshCount ||
+			entity.material < 0 || entity.material >= (int)fileHeader.materialCount ||
+			entity.parent < -1 || entity.parent >= (int)i)
+			return false;
+	}
+	for (unsigned int i = 0; i < fileHeader.meshCount; i++)
+	{
+		if (!memchr(fileMeshes[i].name, 0, SCENE_NAME_LENGTH))
+			return false;
+	}
+	for (unsigned int i = 0; i < fileHeader.materialCount; i++)
+	{
+		if (!memchr(fileMaterials[i].name, 0, SCENE_NAME_LENGTH) || !memchr(fileMaterials[i].textures, 0, SCENE_NAME_LENGTH))
+			return false;
+	}
+	if (fileHeader.sky.mesh < -1 || fileHeader.sky.mesh >= (int)fileHeader.meshCount ||
+		!memchr(fileHeader.sky.cubeMap, 0, SCENE_PATH_LENGTH))
+		return false;
+
+	header = fileHeader;
+	file = std::move(mapped);
+	meshes = fileMeshes;
+	materials = fileMaterials;
+	entities = fileEntities;
+	lights = fileLights;
+	return true;
+}
+
+bool SceneFile::SaveBinary(const char* binaryFile)
+{
+	std::ofstream out(binaryFile, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		return false;
+
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)meshes, header.meshCount * sizeof(SceneMesh));
+	out.write((const char*)materials, header.materialCount * sizeof(SceneMaterial));
+	out.write((const char*)entities, header.entityCount * sizeof(SceneEntity));
+	out.write((const char*)lights, header.lightCount * sizeof(Light));
+	return out.good();
+}
+
+int SceneFile::GetMeshCount() { return (int)header.meshCount; }
+const SceneMesh& SceneFile::GetMesh(int index) { return meshes[index]; }
+
+int SceneFile::GetMaterialCount() { return (int)header.materialCount; }
+const SceneMaterial& SceneFile::GetMaterial(int index) { return materials[index]; }
+
+int SceneFile::GetEntityCount() { return (int)header.entityCount; }
+const SceneEntity& SceneFile::GetEntity(int index) { return entities[index]; }
+
+int SceneFile::GetLightCount() { return (int)header.lightCount; }
+const Light& SceneFile::GetLight(int index) { return lights[index]; }
+
+XMFLOAT3 SceneFile::GetAmbientColor() { return header.ambientColor; }
+
+bool SceneFile::HasSky() { return header.sky.mesh >= 0; }
+
+const SceneSky& SceneFile::GetSky() { return header.sky; }
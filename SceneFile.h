@@ -0,0 +1,126 @@
+#pragma once
+#include "Lights.h"
+#include "MappedFile.h"
+
+#include <DirectXMath.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define SCENE_FILE_MAGIC	((unsigned int)'S' | ((unsigned int)'C' << 8) | ((unsigned int)'N' << 16) | ((unsigned int)'E' << 24))
+#define SCENE_FILE_VERSION	1
+
+// Names and paths are stored inline, so every record is a fixed size
+#define SCENE_NAME_LENGTH	64
+#define SCENE_PATH_LENGTH	260
+
+// Entity flags
+#define SCENE_ENTITY_STATIC	1
+
+// A model in Assets/Models, loaded through its mesh cache
+struct SceneMesh
+{
+	char name[SCENE_NAME_LENGTH];
+	int maxCollisionHulls;
+};
+
+// The four texture maps of a set in Assets/Textures, plus a tint
+struct SceneMaterial
+{
+	char name[SCENE_NAME_LENGTH];
+	char textures[SCENE_NAME_LENGTH];
+	DirectX::XMFLOAT4 colorTint;
+};
+
+struct SceneEntity
+{
+	int mesh;					// Index into the scene's meshes
+	int material;				// Index into the scene's materials
+	int parent;					// Index of an earlier entity, or -1
+	unsigned int flags;			// SCENE_ENTITY_ bits
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT4 rotation;	// Unit quaternion
+	DirectX::XMFLOAT3 scale;
+};
+
+struct SceneSky
+{
+	int mesh;							// Index into the scene's meshes, or -1 for no sky
+	char cubeMap[SCENE_PATH_LENGTH];	// Relative to Assets/Textures
+};
+
+// Starts a binary scene; the mesh, material, entity and light arrays follow it in that order
+struct SceneFileHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int meshCount;
+	unsigned int materialCount;
+	unsigned int entityCount;
+	unsigned int lightCount;
+	DirectX::XMFLOAT3 ambientColor;
+	SceneSky sky;
+};
+
+// --------------------------------------------------------
+// Everything a venue is made of: meshes, materials, the
+// entities placed with them, lights and the sky.
+//
+// Scenes are authored as text (.scene) and compiled to a
+// binary form (.sceneb) that's just the header followed by
+// the records. Loading a binary scene maps the file and
+// points straight at them, so there's nothing to parse.
+//
+// The text form is one item per line, with # comments:
+//   ambient r,g,b
+//   mesh <name> [hulls=n]
+//   material <name> textures=<set> [tint=r,g,b,a]
+//   entity mesh=<name> material=<name> [position=x,y,z]
+//     [rotation=pitch,yaw,roll] [scale=x,y,z] [parent=<entity number>] [static]
+//   light type=directional|point|spot [direction=x,y,z] [position=x,y,z]
+//     [color=r,g,b] [intensity=i] [range=r] [falloff=f]
+//   sky mesh=<name> cubemap=<path>
+// Meshes and materials must be declared before they're used,
+// and entities are numbered from 0 in the order they appear.
+// --------------------------------------------------------
+class SceneFile
+{
+private:
+	SceneFileHeader header;
+
+	// Where the records are: the parsed copies for text scenes, the mapping for binary ones
+	std::unique_ptr<MappedFile> file;
+	std::vector<SceneMesh> parsedMeshes;
+	std::vector<SceneMaterial> parsedMaterials;
+	std::vector<SceneEntity> parsedEntities;
+	std::vector<Light> parsedLights;
+	const SceneMesh* meshes;
+	const SceneMaterial* materials;
+	const SceneEntity* entities;
+	const Light* lights;
+
+	bool ParseLine(const std::string& line);
+
+public:
+	SceneFile();
+
+	// Both leave the scene empty and return false on any error
+	bool LoadText(const char* sceneFile);
+	bool LoadBinary(const char* binaryFile);
+
+	bool SaveBinary(const char* binaryFile);
+
+	int GetMeshCount();
+	const SceneMesh& GetMesh(int index);
+	int GetMaterialCount();
+	const SceneMaterial& GetMaterial(int index);
+	int GetEntityCount();
+	const SceneEntity& GetEntity(int index);
+	int GetLightCount();
+	const Light& GetLight(int index);
+
+	DirectX::XMFLOAT3 GetAmbientColor();
+	bool HasSky();
+	const SceneSky& GetSky();
+};
+
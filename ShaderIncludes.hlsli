@@ -20,7 +20,7 @@ struct VertexShaderInput
 	float3 localPosition	: POSITION;     // XYZ position
 	float3 normal			: NORMAL;       // Normal
 	float2 uv				: TEXCOORD;     // UV
-	float3 tangent			: TANGENT;     // UV
+	float4 tangent			: TANGENT;     // Tangent, w is the bitangent's sign
 };
 
 // Struct representing the data we're sending down the pipeline
@@ -39,7 +39,7 @@ struct VertexToPixel
 	float2 uv				: TEXCOORD;     // UV
 	float3 normal			: NORMAL;		// Normal
 	float3 worldPosition	: POSITION;		// World Position
-    float3 tangent			: TANGENT; // UV
+    float4 tangent			: TANGENT; // Tangent, w is the bitangent's sign
 };
 
 struct VertexToPixel_Sky
@@ -0,0 +1,330 @@
+#include "SkeletalClip.h"
+
+#include <cmath>
+
+using namespace DirectX;
+
+// Largest value of a quantized time or component
+#define CLIP_QUANTIZED_MAX 65535.0f
+
+// The three smallest components of a unit quaternion are within +-1/sqrt(2)
+#define CLIP_QUATERNION_COMPONENT_MAX 0.70710678f
+
+// Channels, in the order CompressTrack takes them
+#define CLIP_CHANNEL_POSITION	0
+#define CLIP_CHANNEL_ROTATION	1
+#define CLIP_CHANNEL_SCALE		2
+
+static unsigned short Quantize(float value, float rangeMin, float rangeExtent)
+{
+	if (rangeExtent <= 0)
+		return 0;
+	float scaled = (value - rangeMin) / rangeExtent * CLIP_QUANTIZED_MAX + 0.5f;
+	return (unsigned short)(scaled < 0 ? 0 : (scaled > CLIP_QUANTIZED_MAX ? CLIP_QUANTIZED_MAX : scaled));
+}
+
+static float Dequantize(unsigned short value, float rangeMin, float rangeExtent)
+{
+	return rangeMin + value / CLIP_QUANTIZED_MAX * rangeExtent;
+}
+
+// Drops the largest component (flipping the quaternion so it's positive)
+// and keeps the other three in 15 bits each
+static void PackQuaternion(XMFLOAT4 q, unsigned short& a, unsigned short& b, unsigned short& c)
+{
+	float components[4] = { q.x, q.y, q.z, q.w };
+	int largest = 0;
+	for (int i = 1; i < 4; i++)
+	{
+		if (fabsf(components[i]) > fabsf(components[largest]))
+			largest = i;
+	}
+	float sign = components[largest] < 0 ? -1.0f : 1.0f;
+
+	unsigned short packed[3];
+	for (int i = 0, p = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		float scaled = (components[i] * sign / CLIP_QUATERNION_COMPONENT_MAX * 0.5f + 0.5f) * 32767.0f + 0.5f;
+		packed[p++] = (unsigned short)(scaled < 0 ? 0 : (scaled > 32767.0f ? 32767.0f : scaled));
+	}
+	a = packed[0] | (unsigned short)((largest & 1) << 15);
+	b = packed[1] | (unsigned short)((largest >> 1) << 15);
+	c = packed[2];
+}
+
+static XMFLOAT4 UnpackQuaternion(unsigned short a, unsigned short b, unsigned short c)
+{
+	int largest = (a >> 15) | ((b >> 15) << 1);
+	unsigned short packed[3] = { (unsigned short)(a & 0x7FFF), (unsigned short)(b & 0x7FFF), c };
+
+	float components[4];
+	float sumSquares = 0;
+	for (int i = 0, p = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		components[i] = (packed[p++] / 32767.0f * 2.0f - 1.0f) * CLIP_QUATERNION_COMPONENT_MAX;
+		sumSquares += components[i] * components[i];
+	}
+	components[largest] = sqrtf(sumSquares < 1 ? 1 - sumSquares : 0);
+	return XMFLOAT4(components[0], components[1], components[2], components[3]);
+}
+
+// Blends two rotations the short way round, renormalized
+static XMVECTOR BlendRotations(FXMVECTOR a, FXMVECTOR b, float t)
+{
+	XMVECTOR end = XMVectorGetX(XMVector4Dot(a, b)) < 0 ? XMVectorNegate(b) : b;
+	return XMQuaternionNormalize(XMVectorLerp(a, end, t));
+}
+
+SkeletalClip::SkeletalClip()
+	: duration(0), sourceKeyCount(0)
+{
+}
+
+bool SkeletalClip::Compress(const std::vector<std::vector<BoneKey>>& boneKeys,
+	float positionTolerance, float rotationTolerance, float scaleTolerance)
+{
+	*this = SkeletalClip();
+
+	// Times are quantized over the whole clip, so its length comes first
+	for (const std::vector<BoneKey>& keys : boneKeys)
+	{
+		if (keys.empty() || keys[0].time < 0)
+			return false;
+		for (size_t i = 1; i < keys.size(); i++)
+		{
+			if (keys[i].time < keys[i - 1].time)
+				return false;
+		}
+		duration = keys.back().time > duration ? keys.back().time : duration;
+	}
+
+	for (const std::vector<BoneKey>& keys : boneKeys)
+	{
+		CompressTrack(keys, CLIP_CHANNEL_POSITION, positionTolerance);
+		CompressTrack(keys, CLIP_CHANNEL_ROTATION, rotationTolerance);
+		CompressTrack(keys, CLIP_CHANNEL_SCALE, scaleTolerance);
+		sourceKeyCount += (int)keys.size() * 3;
+	}
+	return true;
+}
+
+void SkeletalClip::CompressTrack(const std::vector<BoneKey>& keys, int channel, float tolerance)
+{
+	std::vector<unsigned short>& times =
+		channel == CLIP_CHANNEL_POSITION ? positionTimes : (channel == CLIP_CHANNEL_ROTATION ? rotationTimes : scaleTimes);
+	size_t count = keys.size();
+
+	// The channel's values, as they were given
+	std::vector<XMFLOAT4> values(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (channel == CLIP_CHANNEL_POSITION)
+			values[i] = XMFLOAT4(keys[i].position.x, keys[i].position.y, keys[i].position.z, 0);
+		else if (channel == CLIP_CHANNEL_ROTATION)
+			XMStoreFloat4(&values[i], XMQuaternionNormalize(XMLoadFloat4(&keys[i].rotation)));
+		else
+			values[i] = XMFLOAT4(keys[i].scale.x, keys[i].scale.y, keys[i].scale.z, 0);
+	}
+
+	// Vectors are quantized over the range this track covers
+	Track track = {};
+	track.firstKey = (unsigned int)times.size();
+	if (channel != CLIP_CHANNEL_ROTATION)
+	{
+		XMVECTOR rangeMin = XMLoadFloat4(&values[0]);
+		XMVECTOR rangeMax = rangeMin;
+		for (size_t i = 1; i < count; i++)
+		{
+			rangeMin = XMVectorMin(rangeMin, XMLoadFloat4(&values[i]));
+			rangeMax = XMVectorMax(rangeMax, XMLoadFloat4(&values[i]));
+		}
+		XMStoreFloat3(&track.rangeMin, rangeMin);
+		XMStoreFloat3(&track.rangeExtent, rangeMax - rangeMin);
+	}
+
+	// Each key's time and value as they'll come back out of the packed form,
+	// so the error checked below includes the quantization, and each key's
+	// exact time in the same units, which is where it's checked
+	std::vector<unsigned short> packedTimes(count);
+	std::vector<float> sampleTimes(count);
+	std::vector<PackedVector> packedVectors(count);
+	std::vector<PackedQuaternion> packedQuaternions(count);
+	std::vector<XMFLOAT4> stored(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		packedTimes[i] = Quantize(keys[i].time, 0, duration);
+		float sampleTime = duration > 0 ? keys[i].time / duration * CLIP_QUANTIZED_MAX : 0.0f;
+		sampleTimes[i] = sampleTime < 0 ? 0 : (sampleTime > CLIP_QUANTIZED_MAX ? CLIP_QUANTIZED_MAX : sampleTime);
+		if (channel == CLIP_CHANNEL_ROTATION)
+		{
+			PackedQuaternion& packed = packedQuaternions[i];
+			PackQuaternion(values[i], packed.a, packed.b, packed.c);
+			stored[i] = UnpackQuaternion(packed.a, packed.b, packed.c);
+		}
+		else
+		{
+			PackedVector& packed = packedVectors[i];
+			packed.x = Quantize(values[i].x, track.rangeMin.x, track.rangeExtent.x);
+			packed.y = Quantize(values[i].y, track.rangeMin.y, track.rangeExtent.y);
+			packed.z = Quantize(values[i].z, track.rangeMin.z, track.rangeExtent.z);
+			stored[i] = XMFLOAT4(
+				Dequantize(packed.x, track.rangeMin.x, track.rangeExtent.x),
+				Dequantize(packed.y, track.rangeMin.y, track.rangeExtent.y),
+				Dequantize(packed.z, track.rangeMin.z, track.rangeExtent.z), 0);
+		}
+	}
+
+	// How far a blend of stored keys is from a given key, in the tolerance's units
+	auto error = [channel](FXMVECTOR blended, FXMVECTOR given)
+	{
+		if (channel == CLIP_CHANNEL_POSITION)
+			return XMVectorGetX(XMVector3Length(blended - given));
+		if (channel == CLIP_CHANNEL_SCALE)
+		{
+			XMVECTOR difference = XMVectorAbs(blended - given);
+			return XMVectorGetX(XMVectorMax(XMVectorMax(difference, XMVectorSplatY(difference)), XMVectorSplatZ(difference)));
+		}
+		// The angle between them from the chord, which stays accurate where
+		// acos of their dot product doesn't: close together
+		XMVECTOR closer = XMVectorGetX(XMVector4Dot(blended, given)) < 0 ? XMVectorNegate(blended) : blended;
+		float chord = XMVectorGetX(XMVector4Length(closer - given)) * 0.5f;
+		return 4.0f * asinf(chord < 1 ? chord : 1);
+	};
+
+	// Whether blending keys "first" and "last" reproduces every key from one to
+	// the other, the two ends included (their own quantization), each sampled
+	// at its exact time rather than its quantized one
+	auto segmentFits = [&](size_t first, size_t last)
+	{
+		XMVECTOR a = XMLoadFloat4(&stored[first]);
+		XMVECTOR b = XMLoadFloat4(&stored[last]);
+		float length = (float)packedTimes[last] - packedTimes[first];
+		for (size_t i = first; i <= last; i++)
+		{
+			float t = length > 0 ? (sampleTimes[i] - packedTimes[first]) / length : 1.0f;
+			t = t < 0 ? 0 : (t > 1 ? 1 : t);
+			XMVECTOR blended = channel == CLIP_CHANNEL_ROTATION ? BlendRotations(a, b, t) : XMVectorLerp(a, b, t);
+			if (error(blended, XMLoadFloat4(&values[i])) > tolerance)
+				return false;
+		}
+		return true;
+	};
+
+	// A track that never really changes is one key
+	bool constant = true;
+	for (size_t i = 0; i < count && constant; i++)
+		constant = error(XMLoadFloat4(&stored[0]), XMLoadFloat4(&values[i])) <= tolerance;
+
+	// Otherwise each kept key reaches as far ahead as the blend stays close enough
+	std::vector<size_t> kept(1, 0);
+	while (!constant && kept.back() + 1 < count)
+	{
+		size_t next = kept.back() + 1;
+		while (next + 1 < count && segmentFits(kept.back(), next + 1))
+			next++;
+		kept.push_back(next);
+	}
+
+	for (size_t i : kept)
+	{
+		times.push_back(packedTimes[i]);
+		if (channel == CLIP_CHANNEL_POSITION)
+			positions.push_back(packedVectors[i]);
+		else if (channel == CLIP_CHANNEL_ROTATION)
+			rotations.push_back(packedQuaternions[i]);
+		else
+			scales.push_back(packedVectors[i]);
+	}
+	track.keyCount = (unsigned int)kept.size();
+
+	if (channel == CLIP_CHANNEL_POSITION)
+		positionTracks.push_back(track);
+	else if (channel == CLIP_CHANNEL_ROTATION)
+		rotationTracks.push_back(track);
+	else
+		scaleTracks.push_back(track);
+}
+
+void SkeletalClip::FindKeys(const Track& track, const std::vector<unsigned short>& times,
+	float time, unsigned int& before, unsigned int& after, float& t)
+{
+	// The last key at or before the time, by binary search
+	unsigned int low = track.firstKey;
+	unsigned int high = track.firstKey + track.keyCount - 1;
+	while (low < high)
+	{
+		unsigned int middle = (low + high + 1) / 2;
+		if (times[middle] <= time)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	before = low;
+	after = low + 1 < track.firstKey + track.keyCount ? low + 1 : low;
+	float length = (float)times[after] - times[before];
+	t = length > 0 ? (time - times[before]) / length : 0.0f;
+	t = t < 0 ? 0 : (t > 1 ? 1 : t);
+}
+
+void SkeletalClip::Sample(float time, XMFLOAT3* bonePositions, XMFLOAT4* boneRotations, XMFLOAT3* boneScales) const
+{
+	// In the same units as the stored times
+	float clipTime = duration > 0 ? time / duration * CLIP_QUANTIZED_MAX : 0.0f;
+	clipTime = clipTime < 0 ? 0 : (clipTime > CLIP_QUANTIZED_MAX ? CLIP_QUANTIZED_MAX : clipTime);
+
+	unsigned int before, after;
+	float t;
+	for (size_t bone = 0; bone < positionTracks.size(); bone++)
+	{
+		const Track& positionTrack = positionTracks[bone];
+		FindKeys(positionTrack, positionTimes, clipTime, before, after, t);
+		XMVECTOR a = XMVectorSet(
+			Dequantize(positions[before].x, positionTrack.rangeMin.x, positionTrack.rangeExtent.x),
+			Dequantize(positions[before].y, positionTrack.rangeMin.y, positionTrack.rangeExtent.y),
+			Dequantize(positions[before].z, positionTrack.rangeMin.z, positionTrack.rangeExtent.z), 0);
+		XMVECTOR b = XMVectorSet(
+			Dequantize(positions[after].x, positionTrack.rangeMin.x, positionTrack.rangeExtent.x),
+			Dequantize(positions[after].y, positionTrack.rangeMin.y, positionTrack.rangeExtent.y),
+			Dequantize(positions[after].z, positionTrack.rangeMin.z, positionTrack.rangeExtent.z), 0);
+		XMStoreFloat3(&bonePositions[bone], XMVectorLerp(a, b, t));
+
+		FindKeys(rotationTracks[bone], rotationTimes, clipTime, before, after, t);
+		XMFLOAT4 rotationBefore = UnpackQuaternion(rotations[before].a, rotations[before].b, rotations[before].c);
+		XMFLOAT4 rotationAfter = UnpackQuaternion(rotations[after].a, rotations[after].b, rotations[after].c);
+		XMStoreFloat4(&boneRotations[bone], BlendRotations(XMLoadFloat4(&rotationBefore), XMLoadFloat4(&rotationAfter), t));
+
+		const Track& scaleTrack = scaleTracks[bone];
+		FindKeys(scaleTrack, scaleTimes, clipTime, before, after, t);
+		a = XMVectorSet(
+			Dequantize(scales[before].x, scaleTrack.rangeMin.x, scaleTrack.rangeExtent.x),
+			Dequantize(scales[before].y, scaleTrack.rangeMin.y, scaleTrack.rangeExtent.y),
+			Dequantize(scales[before].z, scaleTrack.rangeMin.z, scaleTrack.rangeExtent.z), 0);
+		b = XMVectorSet(
+			Dequantize(scales[after].x, scaleTrack.rangeMin.x, scaleTrack.rangeExtent.x),
+			Dequantize(scales[after].y, scaleTrack.rangeMin.y, scaleTrack.rangeExtent.y),
+			Dequantize(scales[after].z, scaleTrack.rangeMin.z, scaleTrack.rangeExtent.z), 0);
+		XMStoreFloat3(&boneScales[bone], XMVectorLerp(a, b, t));
+	}
+}
+
+float SkeletalClip::GetDuration() const { return duration; }
+
+int SkeletalClip::GetBoneCount() const { return (int)positionTracks.size(); }
+
+int SkeletalClip::GetSourceKeyCount() const { return sourceKeyCount; }
+
+int SkeletalClip::GetKeyCount() const { return (int)(positionTimes.size() + rotationTimes.size() + scaleTimes.size()); }
+
+size_t SkeletalClip::GetSizeInBytes() const
+{
+	return sizeof(SkeletalClip) +
+		(positionTracks.size() + rotationTracks.size() + scaleTracks.size()) * sizeof(Track) +
+		(positionTimes.size() + rotationTimes.size() + scaleTimes.size()) * sizeof(unsigned short) +
+		(positions.size() + scales.size()) * sizeof(PackedVector) +
+		rotations.size() * sizeof(PackedQuaternion);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+// One sampled key of a bone, relative to its parent
+struct BoneKey
+{
+	float time;
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT4 rotation;	// Unit quaternion
+	DirectX::XMFLOAT3 scale;
+};
+
+// --------------------------------------------------------
+// A skeletal animation, stored compressed. Each bone has a
+// position, rotation and scale track, and each track keeps
+// only the keys its neighbours can't reproduce (within a
+// tolerance) by blending. What's kept is quantized:
+//  - times to 16 bits of the clip's length
+//  - positions and scales to 16 bits per component, over
+//    the range that track covers
+//  - rotations to 48 bits, as the three smallest components
+//    of the quaternion (the largest follows from them)
+// so a kept key is 8 bytes with its time, where a sampled
+// key of one channel is 16 to 20.
+// --------------------------------------------------------
+class SkeletalClip
+{
+private:
+	// A track's keys are one run of its channel's times and values
+	struct Track
+	{
+		unsigned int firstKey;
+		unsigned int keyCount;
+		DirectX::XMFLOAT3 rangeMin;		// Positions and scales only
+		DirectX::XMFLOAT3 rangeExtent;
+	};
+
+	struct PackedVector
+	{
+		unsigned short x, y, z;
+	};
+
+	// The top bits of a and b say which component was left out
+	struct PackedQuaternion
+	{
+		unsigned short a, b, c;
+	};
+
+	float duration;
+	int sourceKeyCount;
+
+	std::vector<Track> positionTracks, rotationTracks, scaleTracks;	// One per bone
+	std::vector<unsigned short> positionTimes, rotationTimes, scaleTimes;
+	std::vector<PackedVector> positions, scales;
+	std::vector<PackedQuaternion> rotations;
+
+	// Reduces and packs one channel of one bone; channel 0 is position, 1 rotation, 2 scale
+	void CompressTrack(const std::vector<BoneKey>& keys, int channel, float tolerance);
+
+	// Finds the keys on either side of a time and how far it is between them
+	static void FindKeys(const Track& track, const std::vector<unsigned short>& times,
+		float time, unsigned int& before, unsigned int& after, float& t);
+
+public:
+	SkeletalClip();
+
+	// Takes each bone's keys (time ordered, at least one per bone) and keeps
+	// what's needed for every channel to stay within its tolerance: a distance
+	// for positions, an angle in radians for rotations, and a factor for scales.
+	// That's checked at every key's exact time, kept keys included, so it holds
+	// unless the quantization alone is coarser (a key that moves further than
+	// the tolerance within a 16 bit time step, say).
+	// Returns false, leaving the clip empty, for bad keys.
+	bool Compress(const std::vector<std::vector<BoneKey>>& boneKeys,
+		float positionTolerance, float rotationTolerance, float scaleTolerance);
+
+	// Every bone's pose at a time (clamped to the clip), relative to its parent.
+	// Safe to call from several threads at once.
+	void Sample(float time, DirectX::XMFLOAT3* bonePositions, DirectX::XMFLOAT4* boneRotations,
+		DirectX::XMFLOAT3* boneScales) const;
+
+	float GetDuration() const;
+	int GetBoneCount() const;
+
+	// Keys given to Compress and kept by it (counting each channel separately),
+	// and the bytes they take up now
+	int GetSourceKeyCount() const;
+	int GetKeyCount() const;
+	size_t GetSizeInBytes() const;
+};
+
@@ -0,0 +1,59 @@
+#include "Skeleton.h"
+
+using namespace DirectX;
+
+Skeleton::Skeleton()
+{
+}
+
+int Skeleton::AddBone(const std::string& name, int parent, XMFLOAT3 position, XMFLOAT4 rotation, XMFLOAT3 scale)
+{
+	if (parent < -1 || parent >= (int)parents.size() || parents.size() >= SKELETON_MAX_BONES)
+		return -1;
+
+	XMStoreFloat4(&rotation, XMQuaternionNormalize(XMLoadFloat4(&rotation)));
+
+	// Built the same way as a Transform's world matrix: scale, rotation,
+	// translation, then the parent's
+	XMMATRIX bind = XMMatrixAffineTransformation(XMLoadFloat3(&scale), XMVectorZero(),
+		XMLoadFloat4(&rotation), XMLoadFloat3(&position));
+	if (parent >= 0)
+		bind = bind * XMLoadFloat4x4(&bindMatrices[parent]);
+
+	XMFLOAT4X4 bindMatrix, inverseBindMatrix;
+	XMStoreFloat4x4(&bindMatrix, bind);
+	XMStoreFloat4x4(&inverseBindMatrix, XMMatrixInverse(0, bind));
+
+	names.push_back(name);
+	parents.push_back(parent);
+	bindPositions.push_back(position);
+	bindRotations.push_back(rotation);
+	bindScales.push_back(scale);
+	bindMatrices.push_back(bindMatrix);
+	inverseBindMatrices.push_back(inverseBindMatrix);
+	return (int)parents.size() - 1;
+}
+
+int Skeleton::GetBoneCount() { return (int)parents.size(); }
+
+int Skeleton::FindBone(const std::string& name)
+{
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (names[i] == name)
+			return (int)i;
+	}
+	return -1;
+}
+
+const std::string& Skeleton::GetName(int bone) { return names[bone]; }
+
+int Skeleton::GetParent(int bone) { return parents[bone]; }
+
+XMFLOAT3 Skeleton::GetBindPosition(int bone) { return bindPositions[bone]; }
+
+XMFLOAT4 Skeleton::GetBindRotation(int bone) { return bindRotations[bone]; }
+
+XMFLOAT3 Skeleton::GetBindScale(int bone) { return bindScales[bone]; }
+
+const XMFLOAT4X4& Skeleton::GetInverseBindMatrix(int bone) { return inverseBindMatrices[bone]; }
@@ -0,0 +1,49 @@
+#pragma once
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+// Skinned vertices name their bones with a byte
+#define SKELETON_MAX_BONES 256
+
+// --------------------------------------------------------
+// The bones of a skinned mesh, each placed relative to its
+// parent like a Transform. Parents always come before their
+// children, so a pose can be built in a single pass.
+//
+// The bind pose is the one the mesh was modelled in; its
+// inverse takes the mesh's vertices into each bone's space.
+// --------------------------------------------------------
+class Skeleton
+{
+private:
+	std::vector<std::string> names;
+	std::vector<int> parents;
+	std::vector<DirectX::XMFLOAT3> bindPositions;
+	std::vector<DirectX::XMFLOAT4> bindRotations;
+	std::vector<DirectX::XMFLOAT3> bindScales;
+	std::vector<DirectX::XMFLOAT4X4> bindMatrices;			// Model space
+	std::vector<DirectX::XMFLOAT4X4> inverseBindMatrices;
+
+public:
+	Skeleton();
+
+	// Adds a bone with its bind pose relative to its parent, which must already
+	// be in the skeleton (-1 for a root). Returns the new bone's index, or -1 if
+	// the parent isn't there or the skeleton is full.
+	int AddBone(const std::string& name, int parent,
+		DirectX::XMFLOAT3 position, DirectX::XMFLOAT4 rotation, DirectX::XMFLOAT3 scale);
+
+	int GetBoneCount();
+	int FindBone(const std::string& name);	// -1 if there's no such bone
+	const std::string& GetName(int bone);
+	int GetParent(int bone);
+
+	// Bind pose, relative to the parent
+	DirectX::XMFLOAT3 GetBindPosition(int bone);
+	DirectX::XMFLOAT4 GetBindRotation(int bone);
+	DirectX::XMFLOAT3 GetBindScale(int bone);
+
+	const DirectX::XMFLOAT4X4& GetInverseBindMatrix(int bone);
+};
+
@@ -0,0 +1,124 @@
+#include "Skinning.h"
+#include "JobSystem.h"
+
+using namespace DirectX;
+
+SkinnedPose::SkinnedPose()
+{
+}
+
+void SkinnedPose::Evaluate(Skeleton& skeleton, const SkeletalClip& clip, float time)
+{
+	// A clip made for some other skeleton can't pose this one
+	if (clip.GetBoneCount() != skeleton.GetBoneCount())
+	{
+		SetBindPose(skeleton);
+		return;
+	}
+
+	size_t boneCount = (size_t)skeleton.GetBoneCount();
+	positions.resize(boneCount);
+	rotations.resize(boneCount);
+	scales.resize(boneCount);
+	clip.Sample(time, positions.data(), rotations.data(), scales.data());
+
+	BuildPalette(skeleton);
+}
+
+void SkinnedPose::SetBindPose(Skeleton& skeleton)
+{
+	size_t boneCount = (size_t)skeleton.GetBoneCount();
+	positions.resize(boneCount);
+	rotations.resize(boneCount);
+	scales.resize(boneCount);
+	for (size_t bone = 0; bone < boneCount; bone++)
+	{
+		positions[bone] = skeleton.GetBindPosition((int)bone);
+		rotations[bone] = skeleton.GetBindRotation((int)bone);
+		scales[bone] = skeleton.GetBindScale((int)bone);
+	}
+
+	BuildPalette(skeleton);
+}
+
+void SkinnedPose::BuildPalette(Skeleton& skeleton)
+{
+	size_t boneCount = positions.size();
+	modelMatrices.resize(boneCount);
+	palette.resize(boneCount);
+
+	// Parents come first, so theirs are always ready
+	for (size_t bone = 0; bone < boneCount; bone++)
+	{
+		XMMATRIX model = XMMatrixAffineTransformation(XMLoadFloat3(&scales[bone]), XMVectorZero(),
+			XMLoadFloat4(&rotations[bone]), XMLoadFloat3(&positions[bone]));
+		int parent = skeleton.GetParent((int)bone);
+		if (parent >= 0)
+			model = model * XMLoadFloat4x4(&modelMatrices[parent]);
+		XMStoreFloat4x4(&modelMatrices[bone], model);
+
+		// Out of the bind pose into the bone's space, then back out where the bone is now
+		XMStoreFloat4x4(&palette[bone], XMLoadFloat4x4(&skeleton.GetInverseBindMatrix((int)bone)) * model);
+	}
+}
+
+const std::vector<XMFLOAT4X4>& SkinnedPose::GetPalette() { return palette; }
+
+const XMFLOAT4X4& SkinnedPose::GetModelMatrix(int bone) { return modelMatrices[bone]; }
+
+void Skinning::EvaluatePoses(Skeleton& skeleton, const SkeletalClip& clip,
+	const float* times, SkinnedPose* poses, size_t count, bool parallel)
+{
+	auto evaluate = [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+			poses[i].Evaluate(skeleton, clip, times[i]);
+	};
+
+	if (parallel)
+		JobSystem::GetInstance().ParallelFor(count, SKINNING_JOB_POSES, evaluate);
+	else
+		evaluate(0, count);
+}
+
+void Skinning::SkinVertices(const SkinnedVertex* vertices, size_t count,
+	const XMFLOAT4X4* palette, Vertex* skinned, bool parallel)
+{
+	auto skin = [=](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			const SkinnedVertex& vertex = vertices[i];
+
+			// The weighted sum of the bones' matrices, a row at a time
+			XMVECTOR weights = XMLoadFloat4(&vertex.BoneWeights);
+			XMVECTOR boneWeights[SKINNED_VERTEX_INFLUENCES] =
+			{
+				XMVectorSplatX(weights), XMVectorSplatY(weights), XMVectorSplatZ(weights), XMVectorSplatW(weights)
+			};
+			XMMATRIX blended;
+			for (int row = 0; row < 4; row++)
+			{
+				XMVECTOR sum = XMVectorZero();
+				for (int influence = 0; influence < SKINNED_VERTEX_INFLUENCES; influence++)
+				{
+					const XMFLOAT4X4& bone = palette[vertex.BoneIndices[influence]];
+					sum = XMVectorMultiplyAdd(XMLoadFloat4((const XMFLOAT4*)&bone.m[row][0]), boneWeights[influence], sum);
+				}
+				blended.r[row] = sum;
+			}
+
+			Vertex& out = skinned[i];
+			XMStoreFloat3(&out.Position, XMVector3Transform(XMLoadFloat3(&vertex.Position), blended));
+			XMStoreFloat3(&out.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&vertex.Normal), blended)));
+			XMStoreFloat4(&out.Tangent, XMVectorSetW(XMVector3Normalize(
+				XMVector3TransformNormal(XMLoadFloat4(&vertex.Tangent), blended)), vertex.Tangent.w));
+			out.UV = vertex.UV;
+		}
+	};
+
+	if (parallel)
+		JobSystem::GetInstance().ParallelFor(count, SKINNING_JOB_VERTICES, skin);
+	else
+		skin(0, count);
+}
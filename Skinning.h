@@ -0,0 +1,66 @@
+#pragma once
+#include "Skeleton.h"
+#include "SkeletalClip.h"
+#include "Vertex.h"
+
+#include <DirectXMath.h>
+#include <vector>
+
+// Work per job when skinning or posing is spread over the JobSystem
+#define SKINNING_JOB_VERTICES 4096
+#define SKINNING_JOB_POSES 8
+
+// --------------------------------------------------------
+// One skeleton's pose at one moment, and the palette of
+// skinning matrices it gives: one per bone, taking a bind
+// pose vertex to where that bone now puts it. The palette
+// is laid out like the world matrices the shaders get, so
+// it can go straight into a constant buffer.
+// --------------------------------------------------------
+class SkinnedPose
+{
+private:
+	// Each bone relative to its parent, then relative to the model
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<DirectX::XMFLOAT4> rotations;
+	std::vector<DirectX::XMFLOAT3> scales;
+	std::vector<DirectX::XMFLOAT4X4> modelMatrices;
+	std::vector<DirectX::XMFLOAT4X4> palette;
+
+	// Builds the model matrices and palette from the local pose, parents first
+	void BuildPalette(Skeleton& skeleton);
+
+public:
+	SkinnedPose();
+
+	// Poses the skeleton with a clip made for it, at a time in seconds
+	// (a clip with a different number of bones gives the bind pose)
+	void Evaluate(Skeleton& skeleton, const SkeletalClip& clip, float time);
+
+	// Poses the skeleton as it was modelled (every skinning matrix is identity)
+	void SetBindPose(Skeleton& skeleton);
+
+	const std::vector<DirectX::XMFLOAT4X4>& GetPalette();
+	const DirectX::XMFLOAT4X4& GetModelMatrix(int bone);
+};
+
+// --------------------------------------------------------
+// CPU skinning: poses for many skeletons at once, and
+// vertices blended between the matrices of their bones.
+// Nothing here touches the GPU, so it runs (and can be
+// timed) anywhere. Both can be spread over the JobSystem;
+// every job writes only its own poses or vertices.
+// --------------------------------------------------------
+class Skinning
+{
+public:
+	// Evaluates poses[i] at times[i], all with the same skeleton and clip
+	static void EvaluatePoses(Skeleton& skeleton, const SkeletalClip& clip,
+		const float* times, SkinnedPose* poses, size_t count, bool parallel = true);
+
+	// Moves each vertex by its bones' weighted palette matrices. Normals and
+	// tangents are renormalized, which is exact while bones scale uniformly.
+	static void SkinVertices(const SkinnedVertex* vertices, size_t count,
+		const DirectX::XMFLOAT4X4* palette, Vertex* skinned, bool parallel = true);
+};
+
@@ -33,8 +33,10 @@ Sky::Sky(std::shared_ptr<Mesh> mesh,
 	device->CreateDepthStencilState(&depthStencilDesc, &depthStencilState);
 }
 
-void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera)
+void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const RenderSnapshot& snapshot)
 {
+	const RenderView& view = snapshot.GetView();
+
 	// Sets render states
 	context->RSSetState(rasterizerState.Get());
 	context->OMSetDepthStencilState(depthStencilState.Get(), 0);
@@ -44,8 +46,8 @@ void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_
 	pixelShader->SetShader();
 
 	// Creates a struct to represent the data to put in the vertex constant buffer
-	vertexShader->SetMatrix4x4("viewMatrix", camera->GetViewMatrix());
-	vertexShader->SetMatrix4x4("projectionMatrix", camera->GetProjectionMatrix());
+	vertexShader->SetMatrix4x4("viewMatrix", view.viewMatrix);
+	vertexShader->SetMatrix4x4("projectionMatrix", view.projectionMatrix);
 
 	// Creates a struct to represent the data to put in the pixel constant buffer
 	pixelShader->SetShaderResourceView("CubeMap", cubeMapSRV);
@@ -55,10 +57,12 @@ void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_
 	vertexShader->CopyAllBufferData();
 	pixelShader->CopyAllBufferData();
 
-	// Draws mesh
-	mesh->Draw(context);
+	// Draws mesh (as it was when the snapshot was written)
+	snapshot.DrawSkyMesh(context.Get());
 	
 	// Resets render state
 	context->RSSetState(nullptr);
 	context->OMSetDepthStencilState(nullptr, 0);
-}
\ No newline at end of file
+}
+
+std::shared_ptr<Mesh> Sky::GetMesh() { return mesh; }
@@ -1,7 +1,7 @@
 #pragma once
 #include "SimpleShader.h"
 #include "Mesh.h"
-#include "Camera.h"
+#include "RenderSnapshot.h"
 
 #include <memory>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
@@ -25,8 +25,11 @@ public:
 		std::shared_ptr<SimpleVertexShader> vertexShader,
 		std::shared_ptr<SimplePixelShader> pixelShader);
 
-	// Draws skybox
+	// Draws skybox with the mesh and camera of a render snapshot
 	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
-		std::shared_ptr<Camera> camera);
+		const RenderSnapshot& snapshot);
+
+	// Getters
+	std::shared_ptr<Mesh> GetMesh();
 };
 
@@ -0,0 +1,218 @@
+#include "SpatialHashGrid.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+SpatialHashGrid::SpatialHashGrid(float cellSize)
+	: cellSize(cellSize), inverseCellSize(1.0f / cellSize), bucketMask(0)
+{
+}
+
+void SpatialHashGrid::GetCell(const XMFLOAT3& position, int cell[3]) const
+{
+	cell[0] = (int)floorf(position.x * inverseCellSize);
+	cell[1] = (int)floorf(position.y * inverseCellSize);
+	cell[2] = (int)floorf(position.z * inverseCellSize);
+}
+
+unsigned int SpatialHashGrid::GetBucket(int x, int y, int z) const
+{
+	// Large primes mixed with xor, as in Teschner et al.'s hashing for collision detection
+	return (((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u) ^ ((unsigned int)z * 83492791u)) & bucketMask;
+}
+
+void SpatialHashGrid::Build(const XMFLOAT3* positions, size_t count, bool parallel)
+{
+	// About one bucket per point, so most cells get a bucket to themselves
+	size_t bucketCount = SPATIAL_HASH_MIN_BUCKETS;
+	while (bucketCount < count)
+		bucketCount *= 2;
+
+	if (bucketCounters.size() != bucketCount)
+		bucketCounters = std::vector<std::atomic<unsigned int>>(bucketCount);
+	bucketMask = (unsigned int)bucketCount - 1;
+	cellStarts.resize(bucketCount + 1);
+	pointBuckets.resize(count);
+	sortedIndices.resize(count);
+	sortedPositions.resize(count);
+
+	auto run = [parallel](size_t count, size_t pieceSize, const std::function<void(size_t, size_t)>& func)
+	{
+		if (parallel)
+			JobSystem::GetInstance().ParallelFor(count, pieceSize, func);
+		else
+			func(0, count);
+	};
+
+	// Count the points in each bucket
+	run(bucketCount, SPATIAL_HASH_JOB_BUCKETS, [&](size_t first, size_t last)
+	{
+		for (size_t b = first; b < last; b++)
+			bucketCounters[b].store(0, std::memory_order_relaxed);
+	});
+	run(count, SPATIAL_HASH_JOB_POINTS, [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			int cell[3];
+			GetCell(positions[i], cell);
+			unsigned int bucket = GetBucket(cell[0], cell[1], cell[2]);
+			pointBuckets[i] = bucket;
+			bucketCounters[bucket].fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+
+	// Prefix sum the counts into each bucket's start: per block totals, then
+	// the blocks' starts, then each block's buckets. The counters are left
+	// at the starts, to be used as write cursors.
+	size_t blockCount = (bucketCount + SPATIAL_HASH_JOB_BUCKETS - 1) / SPATIAL_HASH_JOB_BUCKETS;
+	blockSums.resize(blockCount);
+	run(blockCount, 1, [&](size_t first, size_t last)
+	{
+		for (size_t block = first; block < last; block++)
+		{
+			size_t end = (block + 1) * SPATIAL_HASH_JOB_BUCKETS;
+			if (end > bucketCount)
+				end = bucketCount;
+			unsigned int sum = 0;
+			for (size_t b = block * SPATIAL_HASH_JOB_BUCKETS; b < end; b++)
+				sum += bucketCounters[b].load(std::memory_order_relaxed);
+			blockSums[block] = sum;
+		}
+	});
+
+	unsigned int blockStart = 0;
+	for (size_t block = 0; block < blockCount; block++)
+	{
+		unsigned int sum = blockSums[block];
+		blockSums[block] = blockStart;
+		blockStart += sum;
+	}
+
+	run(blockCount, 1, [&](size_t first, size_t last)
+	{
+		for (size_t block = first; block < last; block++)
+		{
+			size_t end = (block + 1) * SPATIAL_HASH_JOB_BUCKETS;
+			if (end > bucketCount)
+				end = bucketCount;
+			unsigned int start = blockSums[block];
+			for (size_t b = block * SPATIAL_HASH_JOB_BUCKETS; b < end; b++)
+			{
+				unsigned int bucketSize = bucketCounters[b].load(std::memory_order_relaxed);
+				cellStarts[b] = start;
+				bucketCounters[b].store(start, std::memory_order_relaxed);
+				start += bucketSize;
+			}
+		}
+	});
+	cellStarts[bucketCount] = (unsigned int)count;
+
+	// Scatter each point into its bucket's range
+	run(count, SPATIAL_HASH_JOB_POINTS, [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			unsigned int slot = bucketCounters[pointBuckets[i]].fetch_add(1, std::memory_order_relaxed);
+			sortedIndices[slot] = (unsigned int)i;
+		}
+	});
+
+	// Threads scatter in whatever order they get to, so put each bucket back in
+	// index order (buckets are small, and already sorted when built serially),
+	// then copy the positions alongside
+	run(bucketCount, SPATIAL_HASH_JOB_BUCKETS, [&](size_t first, size_t last)
+	{
+		for (size_t b = first; b < last; b++)
+		{
+			unsigned int* begin = sortedIndices.data() + cellStarts[b];
+			unsigned int* end = sortedIndices.data() + cellStarts[b + 1];
+			if (end - begin > 16)
+				std::sort(begin, end);
+			else
+			{
+				for (unsigned int* i = begin + 1; i < end; i++)
+				{
+					unsigned int index = *i;
+					unsigned int* j = i;
+					for (; j > begin && *(j - 1) > index; j--)
+						*j = *(j - 1);
+					*j = index;
+				}
+			}
+
+			for (unsigned int s = cellStarts[b]; s < cellStarts[b + 1]; s++)
+				sortedPositions[s] = positions[sortedIndices[s]];
+		}
+	});
+}
+
+template<typename Visit>
+void SpatialHashGrid::VisitCells(const int cellMin[3], const int cellMax[3], Visit visit) const
+{
+	if (sortedIndices.empty())
+		return;
+
+	for (int z = cellMin[2]; z <= cellMax[2]; z++)
+	{
+		for (int y = cellMin[1]; y <= cellMax[1]; y++)
+		{
+			for (int x = cellMin[0]; x <= cellMax[0]; x++)
+			{
+				unsigned int bucket = GetBucket(x, y, z);
+				for (unsigned int s = cellStarts[bucket]; s < cellStarts[bucket + 1]; s++)
+				{
+					// Other cells can hash to the same bucket, so skip their points
+					// (which also stops a point being found twice)
+					int cell[3];
+					GetCell(sortedPositions[s], cell);
+					if (cell[0] == x && cell[1] == y && cell[2] == z)
+						visit(s);
+				}
+			}
+		}
+	}
+}
+
+void SpatialHashGrid::QueryNeighborhood(const XMFLOAT3& position, std::vector<unsigned int>& results) const
+{
+	int cell[3];
+	GetCell(position, cell);
+	int cellMin[3] = { cell[0] - 1, cell[1] - 1, cell[2] - 1 };
+	int cellMax[3] = { cell[0] + 1, cell[1] + 1, cell[2] + 1 };
+
+	VisitCells(cellMin, cellMax, [&](unsigned int s)
+	{
+		results.push_back(sortedIndices[s]);
+	});
+}
+
+void SpatialHashGrid::QueryRadius(const XMFLOAT3& center, float radius, std::vector<unsigned int>& results) const
+{
+	int cellMin[3], cellMax[3];
+	GetCell(XMFLOAT3(center.x - radius, center.y - radius, center.z - radius), cellMin);
+	GetCell(XMFLOAT3(center.x + radius, center.y + radius, center.z + radius), cellMax);
+
+	float radiusSquared = radius * radius;
+	VisitCells(cellMin, cellMax, [&](unsigned int s)
+	{
+		const XMFLOAT3& position = sortedPositions[s];
+		float x = position.x - center.x;
+		float y = position.y - center.y;
+		float z = position.z - center.z;
+		if (x * x + y * y + z * z <= radiusSquared)
+			results.push_back(sortedIndices[s]);
+	});
+}
+
+float SpatialHashGrid::GetCellSize() const { return cellSize; }
+
+size_t SpatialHashGrid::GetCount() const { return sortedIndices.size(); }
+
+size_t SpatialHashGrid::GetBucketCount() const { return cellStarts.empty() ? 0 : cellStarts.size() - 1; }
+
+const std::vector<unsigned int>& SpatialHashGrid::GetSortedIndices() const { return sortedIndices; }
+
+const std::vector<XMFLOAT3>& SpatialHashGrid::GetSortedPositions() const { return sortedPositions; }
@@ -0,0 +1,76 @@
+#pragma once
+#include <DirectXMath.h>
+#include <atomic>
+#include <vector>
+
+// Work per job when building is spread over the JobSystem
+#define SPATIAL_HASH_JOB_POINTS 8192
+#define SPATIAL_HASH_JOB_BUCKETS 16384
+
+// The table never gets smaller than this many buckets
+#define SPATIAL_HASH_MIN_BUCKETS 64
+
+// --------------------------------------------------------
+// A uniform grid over points that all move every frame
+// (balls, particles, crowds), hashed so it covers an
+// unbounded world with a table sized by the point count.
+//
+// Rather than updating anything as points move, the whole
+// grid is rebuilt each frame by a counting sort: count the
+// points per bucket, prefix sum the counts, then scatter
+// each point into its bucket's range. Every step is spread
+// over the JobSystem, and each bucket's points end up in
+// index order, so the result never depends on the threads.
+// The sorted copy of the positions keeps a cell's points
+// next to each other in memory for the queries.
+//
+// Queries report the indices the points were built with.
+// They're meant for radii of a cell or two; make the cell
+// size about the largest query radius. Nothing changes the
+// grid but Build, so any number of threads can query it.
+// --------------------------------------------------------
+class SpatialHashGrid
+{
+private:
+	float cellSize;
+	float inverseCellSize;
+	unsigned int bucketMask;
+
+	// Each bucket's range of the sorted arrays is [cellStarts[b], cellStarts[b + 1])
+	std::vector<unsigned int> cellStarts;
+	std::vector<unsigned int> sortedIndices;
+	std::vector<DirectX::XMFLOAT3> sortedPositions;
+
+	// Scratch for building: per bucket counts (then write cursors),
+	// each point's bucket, and per block sums for the prefix sum
+	std::vector<std::atomic<unsigned int>> bucketCounters;
+	std::vector<unsigned int> pointBuckets;
+	std::vector<unsigned int> blockSums;
+
+	// The integer coordinates of the cell a point is in, and the bucket a cell hashes to
+	void GetCell(const DirectX::XMFLOAT3& position, int cell[3]) const;
+	unsigned int GetBucket(int x, int y, int z) const;
+
+	// Calls visit(sorted slot) for every point in the cells from cellMin to cellMax
+	template<typename Visit> void VisitCells(const int cellMin[3], const int cellMax[3], Visit visit) const;
+
+public:
+	SpatialHashGrid(float cellSize = 1.0f);
+
+	// Sorts the points into the grid, replacing whatever was there
+	void Build(const DirectX::XMFLOAT3* positions, size_t count, bool parallel = true);
+
+	// Appends the index of every point in the 3x3x3 cells around a position
+	// (everything within one cell size, and some a little further)
+	void QueryNeighborhood(const DirectX::XMFLOAT3& position, std::vector<unsigned int>& results) const;
+
+	// Appends the index of every point within a radius of the center
+	void QueryRadius(const DirectX::XMFLOAT3& center, float radius, std::vector<unsigned int>& results) const;
+
+	// Getters
+	float GetCellSize() const;
+	size_t GetCount() const;
+	size_t GetBucketCount() const;
+	const std::vector<unsigned int>& GetSortedIndices() const;
+	const std::vector<DirectX::XMFLOAT3>& GetSortedPositions() const;
+};
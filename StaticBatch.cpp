@@ -0,0 +1,159 @@
+#include "StaticBatch.h"
+#include <cfloat>
+#include <climits>
+
+using namespace DirectX;
+
+// Geometry being gathered for one material's batch
+struct StaticBatchBuilder
+{
+	MaterialHandle material;
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<StaticBatchRange> ranges;
+};
+
+// Ctor
+StaticBatch::StaticBatch(MeshHandle mesh, MaterialHandle material, std::vector<StaticBatchRange> ranges)
+{
+	this->mesh = mesh;
+	this->material = material;
+	this->ranges = ranges;
+}
+
+StaticBatch::~StaticBatch()
+{
+	// Nothing else uses the merged mesh, so it goes with the batch
+	Resources::GetInstance().GetMeshes().Remove(mesh);
+}
+
+std::vector<std::shared_ptr<StaticBatch>> StaticBatch::Build(
+	EntityStore& store,
+	const std::vector<MaterialHandle>& materialSlots,
+	Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	std::vector<StaticBatchBuilder> builders;
+	Resources& resources = Resources::GetInstance();
+
+	store.ForEach<TransformComponent, RenderComponent, StaticComponent>([&](EntityId id,
+		TransformComponent& transform, RenderComponent& render, StaticComponent&)
+	{
+		Mesh* mesh = resources.GetMeshes().Get(render.mesh);
+		if (!mesh)
+			return;
+
+		// World matrix for positions, inverse transpose for normals and tangents
+		XMMATRIX worldMat = XMLoadFloat4x4(&transform.worldMatrix);
+		XMMATRIX normalMat = XMLoadFloat4x4(&transform.worldInverseTransposeMatrix);
+
+		const std::vector<Vertex>& sourceVerts = mesh->GetVertices();
+		const std::vector<unsigned int>& sourceIndices = mesh->GetIndices();
+
+		for (int s = 0; s < mesh->GetSubmeshCount(); s++)
+		{
+			const Submesh& submesh = mesh->GetSubmesh(s);
+			unsigned int slot = submesh.materialSlot < render.materialCount ? submesh.materialSlot : 0;
+			MaterialHandle material = materialSlots[render.firstMaterial + slot];
+
+			// Finds (or starts) the batch for this material
+			StaticBatchBuilder* builder = 0;
+			for (StaticBatchBuilder& b : builders)
+			{
+				if (b.material == material)
+				{
+					builder = &b;
+					break;
+				}
+			}
+			if (!builder)
+			{
+				builders.push_back({});
+				builder = &builders.back();
+				builder->material = material;
+			}
+
+			// Copies only the vertices this submesh uses, remapping its indices
+			std::vector<unsigned int> remap(sourceVerts.size(), UINT_MAX);
+			StaticBatchRange range = {};
+			range.entity = id;
+			range.startIndex = (unsigned int)builder->indices.size();
+			range.indexCount = submesh.indexCount;
+			range.transformVersion = transform.version;
+			XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+			XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+
+			for (unsigned int i = 0; i < submesh.indexCount; i++)
+			{
+				unsigned int sourceIndex = sourceIndices[submesh.startIndex + i];
+				if (remap[sourceIndex] == UINT_MAX)
+				{
+					// Pre-transforms the vertex into world space
+					Vertex v = sourceVerts[sourceIndex];
+					XMVECTOR pos = XMVector3Transform(XMLoadFloat3(&v.Position), worldMat);
+					XMStoreFloat3(&v.Position, pos);
+					XMStoreFloat3(&v.Normal, XMVector3Normalize(
+						XMVector3TransformNormal(XMLoadFloat3(&v.Normal), normalMat)));
+					XMStoreFloat4(&v.Tangent, XMVectorSetW(XMVector3Normalize(
+						XMVector3TransformNormal(XMLoadFloat4(&v.Tangent), normalMat)), v.Tangent.w));
+
+					boundsMin = XMVectorMin(boundsMin, pos);
+					boundsMax = XMVectorMax(boundsMax, pos);
+
+					remap[sourceIndex] = (unsigned int)builder->vertices.size();
+					builder->vertices.push_back(v);
+				}
+				builder->indices.push_back(remap[sourceIndex]);
+			}
+
+			XMStoreFloat3(&range.boundsMin, boundsMin);
+			XMStoreFloat3(&range.boundsMax, boundsMax);
+
+			// Submeshes of the same entity that land next to each other share a range
+			if (!builder->ranges.empty() && builder->ranges.back().entity == id)
+			{
+				StaticBatchRange& last = builder->ranges.back();
+				last.indexCount += range.indexCount;
+				XMStoreFloat3(&last.boundsMin, XMVectorMin(XMLoadFloat3(&last.boundsMin), boundsMin));
+				XMStoreFloat3(&last.boundsMax, XMVectorMax(XMLoadFloat3(&last.boundsMax), boundsMax));
+			}
+			else
+			{
+				builder->ranges.push_back(range);
+			}
+		}
+	});
+
+	// Uploads each material's merged geometry as one mesh
+	std::vector<std::shared_ptr<StaticBatch>> batches;
+	for (StaticBatchBuilder& b : builders)
+	{
+		if (b.indices.empty())
+			continue;
+
+		std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(
+			&b.vertices[0], (int)b.vertices.size(),
+			&b.indices[0], (int)b.indices.size(), device);
+
+		batches.push_back(std::make_shared<StaticBatch>(resources.GetMeshes().Add(mesh), b.material, b.ranges));
+	}
+
+	return batches;
+}
+
+bool StaticBatch::IsStale(EntityStore& store)
+{
+	for (const StaticBatchRange& range : ranges)
+	{
+		// A destroyed entity's geometry shouldn't be drawn any more either
+		TransformComponent* transform = store.Get<TransformComponent>(range.entity);
+		if (!transform || transform->version != range.transformVersion)
+			return true;
+	}
+	return false;
+}
+
+MeshHandle StaticBatch::GetMesh() { return mesh; }
+
+MaterialHandle StaticBatch::GetMaterial() { return material; }
+
+const std::vector<StaticBatchRange>& StaticBatch::GetRanges() { return ranges; }
@@ -0,0 +1,63 @@
+#pragma once
+#include "EntityStore.h"
+#include "Components.h"
+#include "Mesh.h"
+#include "Material.h"
+
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+
+// --------------------------------------------------------
+// The part of a batch's index buffer that came from one
+// source entity, kept so the batch can still be culled
+// per entity
+// --------------------------------------------------------
+struct StaticBatchRange
+{
+	EntityId entity;				// Store entity the range came from
+	unsigned int startIndex;		// First index of the range
+	unsigned int indexCount;		// Number of indices in the range
+	DirectX::XMFLOAT3 boundsMin;	// World space bounding box
+	DirectX::XMFLOAT3 boundsMax;
+	unsigned int transformVersion;	// Of the entity's transform when it was baked
+};
+
+// --------------------------------------------------------
+// All static geometry that shares one material, pre-transformed
+// into world space and merged into a single vertex/index buffer
+// --------------------------------------------------------
+class StaticBatch
+{
+private:
+	// The merged mesh, already in world space (so drawn with an identity
+	// transform), and the material all of it shares
+	MeshHandle mesh;
+	MaterialHandle material;
+	std::vector<StaticBatchRange> ranges;
+
+public:
+	// Ctor
+	StaticBatch(MeshHandle mesh, MaterialHandle material, std::vector<StaticBatchRange> ranges);
+
+	// Removes the merged mesh from the Resources pool
+	~StaticBatch();
+
+	// Merges every static entity in the store into one batch per material
+	// (materialSlots is the list the render components' slots index)
+	static std::vector<std::shared_ptr<StaticBatch>> Build(
+		EntityStore& store,
+		const std::vector<MaterialHandle>& materialSlots,
+		Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Whether any entity baked into the batch has moved since (as of the
+	// world matrices last copied into its transform component)
+	bool IsStale(EntityStore& store);
+
+	// Getters
+	MeshHandle GetMesh();
+	MaterialHandle GetMaterial();
+	const std::vector<StaticBatchRange>& GetRanges();
+};
+
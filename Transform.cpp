@@ -1,18 +1,51 @@
 #include "Transform.h"
 
+#include <cmath>
+
 using namespace DirectX;
 
+unsigned int Transform::hierarchyVersion = 0;
+unsigned int Transform::staticVersion = 1;
+
 Transform::Transform()
+    : parent(0), isStatic(false), matrixDirty(true), worldDirty(false), version(0), uniformScale(true)
 {
     // Set up our initial transform values
     SetPosition(0, 0, 0);
-    SetRotation(0, 0, 0);
+    SetRotation(XMFLOAT4(0, 0, 0, 1));
     SetScale(1, 1, 1);
 
     // Create our initial matrix
+    XMStoreFloat4x4(&localMatrix, XMMatrixIdentity());
     XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
     XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixIdentity());
     matrixDirty = false;
+    worldDirty = false;
+}
+
+Transform::~Transform()
+{
+    // Children become roots rather than pointing at a dead parent
+    SetParent(0);
+    while (!children.empty())
+        children.back()->SetParent(0);
+}
+
+Transform::Transform(const Transform& other)
+    : parent(0), isStatic(false), matrixDirty(true), worldDirty(false), version(0), uniformScale(true)
+{
+    *this = other;
+}
+
+Transform& Transform::operator=(const Transform& other)
+{
+    // Links stay as they are, since a parent can only list each child once
+    position = other.position;
+    rotation = other.rotation;
+    scale = other.scale;
+    basisDirty = true;
+    MarkDirty();
+    return *this;
 }
 
 void Transform::MoveAbsolute(float x, float y, float z)
@@ -27,7 +60,7 @@ void Transform::MoveAbsolute(float x, float y, float z)
     //XMVECTOR offset = XMVectorSet(x, y, z, 0);
     //XMStoreFloat3(&position, pos + offset);
 
-    matrixDirty = true;
+    MarkDirty();
 }
 
 void Transform::MoveRelative(float x, float y, float z)
@@ -36,9 +69,7 @@ void Transform::MoveRelative(float x, float y, float z)
     XMVECTOR moveVec = XMVectorSet(x, y, z, 0);
 
     // Rotate the movement vector by this transform's orientation
-    XMVECTOR rotatedVec = XMVector3Rotate(
-        moveVec,
-        XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z));
+    XMVECTOR rotatedVec = XMVector3Rotate(moveVec, XMLoadFloat4(&rotation));
 
     // Add the rotated movement vector to my
     // position and overwrite the old position
@@ -46,15 +77,21 @@ void Transform::MoveRelative(float x, float y, float z)
     XMStoreFloat3(&position, newPos);
 
     // Remember that the matrices are out of date
-    matrixDirty = true;
+    MarkDirty();
 }
 
 void Transform::Rotate(float p, float y, float r)
 {
-    pitchYawRoll.x += p;
-    pitchYawRoll.y += y;
-    pitchYawRoll.z += r;
-    matrixDirty = true;
+    // Pitch and roll turn about the local axes, yaw about the world's up axis,
+    // which is the same as adding to the angles while there's no roll
+    XMVECTOR local = XMQuaternionRotationRollPitchYaw(p, 0, r);
+    XMVECTOR world = XMQuaternionRotationRollPitchYaw(0, y, 0);
+    XMVECTOR q = XMQuaternionMultiply(XMQuaternionMultiply(local, XMLoadFloat4(&rotation)), world);
+
+    // Renormalized so rounding doesn't build up over many small turns
+    XMStoreFloat4(&rotation, XMQuaternionNormalize(q));
+    basisDirty = true;
+    MarkDirty();
 }
 
 void Transform::Scale(float x, float y, float z)
@@ -62,7 +99,7 @@ void Transform::Scale(float x, float y, float z)
     scale.x *= x;
     scale.y *= y;
     scale.z *= z;
-    matrixDirty = true;
+    MarkDirty();
 }
 
 void Transform::SetPosition(float x, float y, float z)
@@ -70,30 +107,21 @@ void Transform::SetPosition(float x, float y, float z)
     position.x = x;
     position.y = y;
     position.z = z;
-    matrixDirty = true;
+    MarkDirty();
 }
 
 void Transform::SetRotation(float p, float y, float r)
 {
-    pitchYawRoll.x = p;
-    pitchYawRoll.y = y;
-    pitchYawRoll.z = r;
-    matrixDirty = true;
-
-    // Updates the forward, up, and right vectors
-    // Overrites the forward vector
-    XMStoreFloat3(&forward, XMVector3Rotate(
-        XMVectorSet(0, 0, 1, 0),
-        XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z)));
-
-    // Overrites the up vector
-    XMStoreFloat3(&up, XMVector3Rotate(
-        XMVectorSet(0, 1, 0, 0),
-        XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z)));
+    XMStoreFloat4(&rotation, XMQuaternionRotationRollPitchYaw(p, y, r));
+    basisDirty = true;
+    MarkDirty();
+}
 
-    // Crosses the forward and up vectors to get the right vector
-    XMStoreFloat3(&right, XMVector3Cross(XMLoadFloat3(&forward),
-        XMLoadFloat3(&up)));
+void Transform::SetRotation(XMFLOAT4 quaternion)
+{
+    XMStoreFloat4(&rotation, XMQuaternionNormalize(XMLoadFloat4(&quaternion)));
+    basisDirty = true;
+    MarkDirty();
 }
 
 void Transform::SetScale(float x, float y, float z)
@@ -101,20 +129,82 @@ void Transform::SetScale(float x, float y, float z)
     scale.x = x;
     scale.y = y;
     scale.z = z;
-    matrixDirty = true;
+    MarkDirty();
 }
 
 XMFLOAT3 Transform::GetPosition(){ return position; }
 
-XMFLOAT3 Transform::GetPitchYawRoll(){ return pitchYawRoll; }
+XMFLOAT3 Transform::GetPitchYawRoll()
+{
+    // Reads the angles back out of the rotation matrix's elements, which for
+    // roll, then pitch, then yaw are m21 = -sin(pitch), m20 / m22 = tan(yaw)
+    // and m01 / m11 = tan(roll)
+    float x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+    float m21 = 2 * (y * z - x * w);
+    float sinPitch = -m21 > 1 ? 1 : (-m21 < -1 ? -1 : -m21);
+
+    // Looking straight up or down, yaw and roll turn about the same axis,
+    // so it's all put into yaw
+    if (fabsf(sinPitch) > 0.99999f)
+    {
+        float m00 = 1 - 2 * (y * y + z * z);
+        float m02 = 2 * (x * z - y * w);
+        return XMFLOAT3(asinf(sinPitch), atan2f(-m02, m00), 0);
+    }
+
+    float m01 = 2 * (x * y + z * w);
+    float m11 = 1 - 2 * (x * x + z * z);
+    float m20 = 2 * (x * z + y * w);
+    float m22 = 1 - 2 * (x * x + y * y);
+    return XMFLOAT3(asinf(sinPitch), atan2f(m20, m22), atan2f(m01, m11));
+}
+
+XMFLOAT4 Transform::GetRotation(){ return rotation; }
 
 XMFLOAT3 Transform::GetScale(){ return scale; }
 
-XMFLOAT3 Transform::GetForward(){ return forward; }
+XMFLOAT3 Transform::GetForward()
+{
+    UpdateBasis();
+    return forward;
+}
+
+XMFLOAT3 Transform::GetUp()
+{
+    UpdateBasis();
+    return up;
+}
+
+XMFLOAT3 Transform::GetRight()
+{
+    UpdateBasis();
+    return right;
+}
+
+void Transform::UpdateBasis()
+{
+    if (!basisDirty)
+        return;
+
+    // The rotated axes are just the rows of the rotation matrix
+    XMMATRIX rotMat = XMMatrixRotationQuaternion(XMLoadFloat4(&rotation));
+    XMStoreFloat3(&right, rotMat.r[0]);
+    XMStoreFloat3(&up, rotMat.r[1]);
+    XMStoreFloat3(&forward, rotMat.r[2]);
+    basisDirty = false;
+}
 
-XMFLOAT3 Transform::GetUp(){ return up; }
+XMFLOAT3 Transform::GetWorldPosition()
+{
+    UpdateMatrices();
+    return XMFLOAT3(worldMatrix._41, worldMatrix._42, worldMatrix._43);
+}
 
-XMFLOAT3 Transform::GetRight(){ return right; }
+XMFLOAT4X4 Transform::GetLocalMatrix()
+{
+    UpdateMatrices();
+    return localMatrix;
+}
 
 XMFLOAT4X4 Transform::GetWorldMatrix()
 {
@@ -129,22 +219,160 @@ XMFLOAT4X4 Transform::GetworldInverseTransposeMatrix()
 }
 
 void Transform::UpdateMatrices() {
+    UpdateLocalMatrix();
+
+    // The world matrix needs the parent's to be current first
+    if (worldDirty)
+    {
+        if (parent)
+        {
+            parent->UpdateMatrices();
+            UpdateWorldMatrix(&parent->worldMatrix);
+        }
+        else
+            UpdateWorldMatrix(0);
+    }
+}
+
+void Transform::UpdateLocalMatrix()
+{
     // Only do the heavy lifting if the matrix is out of date
     if (matrixDirty)
     {
-        // Create the individual transformation matrices
-        // for each type of transform
-        XMMATRIX transMat = XMMatrixTranslation(position.x, position.y, position.z);
-        XMMATRIX rotMat = XMMatrixRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
-        XMMATRIX scaleMat = XMMatrixScaling(scale.x, scale.y, scale.z);
-
-        // Combine them and store the result
-        XMMATRIX worldMat = scaleMat * rotMat * transMat;
-        XMStoreFloat4x4(&worldMatrix, worldMat);
-        XMStoreFloat4x4(&worldInverseTransposeMatrix,
-            XMMatrixInverse(0, XMMatrixTranspose(worldMat)));
+        // Scale * rotation * translation, written out directly: the
+        // rotation's rows scaled, with the position as the last row
+        XMMATRIX localMat = XMMatrixRotationQuaternion(XMLoadFloat4(&rotation));
+        localMat.r[0] = XMVectorScale(localMat.r[0], scale.x);
+        localMat.r[1] = XMVectorScale(localMat.r[1], scale.y);
+        localMat.r[2] = XMVectorScale(localMat.r[2], scale.z);
+        localMat.r[3] = XMVectorSet(position.x, position.y, position.z, 1);
+        XMStoreFloat4x4(&localMatrix, localMat);
 
         // Remember that we're clean
         matrixDirty = false;
     }
-}
\ No newline at end of file
+}
+
+void Transform::UpdateWorldMatrix(const XMFLOAT4X4* parentWorld)
+{
+    UpdateLocalMatrix();
+
+    // Children are transformed by their own matrix first, then the parent's
+    XMMATRIX worldMat = XMLoadFloat4x4(&localMatrix);
+    if (parentWorld)
+        worldMat = worldMat * XMLoadFloat4x4(parentWorld);
+    XMStoreFloat4x4(&worldMatrix, worldMat);
+
+    // The inverse transpose in closed form instead of a general 4x4 inverse.
+    // With only uniform scales up the chain, the upper 3x3 is a rotation
+    // times s, so its inverse transpose is just itself divided by s squared.
+    uniformScale = scale.x == scale.y && scale.y == scale.z && (!parent || parent->uniformScale);
+    XMVECTOR r0 = worldMat.r[0];
+    XMVECTOR r1 = worldMat.r[1];
+    XMVECTOR r2 = worldMat.r[2];
+    XMMATRIX invTranspose;
+    if (uniformScale)
+    {
+        XMVECTOR inverseScaleSq = XMVectorReciprocal(XMVector3LengthSq(r0));
+        invTranspose.r[0] = r0 * inverseScaleSq;
+        invTranspose.r[1] = r1 * inverseScaleSq;
+        invTranspose.r[2] = r2 * inverseScaleSq;
+    }
+    else
+    {
+        // Otherwise (scale under rotation shears) it's the cofactors over the determinant
+        XMVECTOR c0 = XMVector3Cross(r1, r2);
+        XMVECTOR inverseDet = XMVectorReciprocal(XMVector3Dot(r0, c0));
+        invTranspose.r[0] = c0 * inverseDet;
+        invTranspose.r[1] = XMVector3Cross(r2, r0) * inverseDet;
+        invTranspose.r[2] = XMVector3Cross(r0, r1) * inverseDet;
+    }
+
+    // The inverse translation ends up in the last column
+    XMVECTOR translation = worldMat.r[3];
+    invTranspose.r[0] = XMVectorSetW(invTranspose.r[0], -XMVectorGetX(XMVector3Dot(translation, invTranspose.r[0])));
+    invTranspose.r[1] = XMVectorSetW(invTranspose.r[1], -XMVectorGetX(XMVector3Dot(translation, invTranspose.r[1])));
+    invTranspose.r[2] = XMVectorSetW(invTranspose.r[2], -XMVectorGetX(XMVector3Dot(translation, invTranspose.r[2])));
+    invTranspose.r[3] = XMVectorSet(0, 0, 0, 1);
+    XMStoreFloat4x4(&worldInverseTransposeMatrix, invTranspose);
+    worldDirty = false;
+    version++;
+}
+
+void Transform::MarkDirty()
+{
+    matrixDirty = true;
+    MarkWorldDirty();
+}
+
+void Transform::MarkWorldDirty()
+{
+    // Anything already dirty has a dirty subtree, so only
+    // subtrees that were clean get walked
+    if (worldDirty)
+        return;
+
+    if (isStatic)
+        staticVersion++;
+
+    worldDirty = true;
+    for (size_t i = 0; i < children.size(); i++)
+        children[i]->MarkWorldDirty();
+}
+
+void Transform::SetParent(Transform* newParent)
+{
+    if (newParent == parent || newParent == this)
+        return;
+
+    // Refuses links that would make a loop
+    for (Transform* ancestor = newParent; ancestor; ancestor = ancestor->parent)
+    {
+        if (ancestor == this)
+            return;
+    }
+
+    if (parent)
+    {
+        std::vector<Transform*>& siblings = parent->children;
+        for (size_t i = 0; i < siblings.size(); i++)
+        {
+            if (siblings[i] == this)
+            {
+                siblings.erase(siblings.begin() + i);
+                break;
+            }
+        }
+    }
+
+    parent = newParent;
+    if (parent)
+        parent->children.push_back(this);
+
+    hierarchyVersion++;
+    MarkWorldDirty();
+}
+
+Transform* Transform::GetParent() { return parent; }
+
+int Transform::GetChildCount() { return (int)children.size(); }
+
+Transform* Transform::GetChild(int index) { return children[index]; }
+
+unsigned int Transform::GetHierarchyVersion() { return hierarchyVersion; }
+
+bool Transform::IsStatic() { return isStatic; }
+
+void Transform::SetStatic(bool isStatic)
+{
+    if (isStatic == this->isStatic)
+        return;
+
+    // Counts as a change to the static set either way
+    this->isStatic = isStatic;
+    staticVersion++;
+}
+
+unsigned int Transform::GetStaticVersion() { return staticVersion; }
+
+unsigned int Transform::GetVersion() { return version; }
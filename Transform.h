@@ -1,53 +1,132 @@
 #pragma once
 #include <DirectXMath.h>
+#include <vector>
 
+class TransformHierarchy;
+
+// --------------------------------------------------------
+// Position, rotation and scale relative to an optional
+// parent, so parts of a machine move along with it.
+//
+// Changing a transform marks its world matrix and those of
+// its whole subtree dirty; they're rebuilt on demand, or in
+// one pass by a TransformHierarchy.
+// --------------------------------------------------------
 class Transform
 {
+	friend class TransformHierarchy;
+
 public:
 	Transform();
+	~Transform();
+
+	// Copies only the local position, rotation and scale; the copy starts
+	// out with no parent or children of its own
+	Transform(const Transform& other);
+	Transform& operator=(const Transform& other);
 
 	void MoveAbsolute(float x, float y, float z);
 	void MoveRelative(float x, float y, float z);
+	// Pitch and roll turn about the local axes, yaw about the world's up axis
 	void Rotate(float p, float y, float r);
 	void Scale(float x, float y, float z);
 
 	void SetPosition(float x, float y, float z);
-	void SetRotation(float p, float y, float r);
+	void SetRotation(DirectX::XMFLOAT4 quaternion);
 	void SetScale(float x, float y, float z);
 
+	// Pitch/yaw/roll versions, kept for code written against angles
+	void SetRotation(float p, float y, float r);
+
+	// Local values (relative to the parent)
 	DirectX::XMFLOAT3 GetPosition();
+	DirectX::XMFLOAT4 GetRotation();
 	DirectX::XMFLOAT3 GetPitchYawRoll();
 	DirectX::XMFLOAT3 GetScale();
 
+	DirectX::XMFLOAT3 GetWorldPosition();
+
 	DirectX::XMFLOAT3 GetForward();
 	DirectX::XMFLOAT3 GetUp();
 	DirectX::XMFLOAT3 GetRight();
 
+	DirectX::XMFLOAT4X4 GetLocalMatrix();
 	DirectX::XMFLOAT4X4 GetWorldMatrix();
 	DirectX::XMFLOAT4X4 GetworldInverseTransposeMatrix();
 
 	void UpdateMatrices();
 
+	// Parent/child links; a null parent makes this a root.
+	// Local values are kept, so the child snaps to its new parent.
+	void SetParent(Transform* newParent);
+	Transform* GetParent();
+	int GetChildCount();
+	Transform* GetChild(int index);
+
+	// Bumped whenever any parent/child link anywhere changes
+	static unsigned int GetHierarchyVersion();
+
+	// Static transforms aren't expected to move, so they can be updated
+	// once and left out of per-frame work
+	bool IsStatic();
+	void SetStatic(bool isStatic);
+
+	// Bumped whenever a static transform's world matrix goes out of date (or
+	// one is made static or dynamic), so static work can wait until it differs
+	static unsigned int GetStaticVersion();
+
+	// Bumped every time the world matrix is rebuilt, so caches of anything
+	// derived from it only need redoing when it differs from what they saw
+	unsigned int GetVersion();
+
 private:
 
 	// Raw transformation data
 	// Postion
-	// Rotation
+	// Rotation (unit quaternion)
 	// Scale
 	DirectX::XMFLOAT3 position;
-	DirectX::XMFLOAT3 pitchYawRoll;
+	DirectX::XMFLOAT4 rotation;
 	DirectX::XMFLOAT3 scale;
 
-	// Forward, up, and right vectors
+	// Forward, up, and right vectors, derived from the rotation when asked for
 	DirectX::XMFLOAT3 forward;
 	DirectX::XMFLOAT3 up;
 	DirectX::XMFLOAT3 right;
+	bool basisDirty;
+	void UpdateBasis();
 
-	// Finalized matrix
+	// Finalized matrices
+	DirectX::XMFLOAT4X4 localMatrix;
 	DirectX::XMFLOAT4X4 worldMatrix;
 	DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
 
-	// Does our matrix need an update?
+	// Hierarchy links
+	Transform* parent;
+	std::vector<Transform*> children;
+	static unsigned int hierarchyVersion;
+
+	bool isStatic;
+	static unsigned int staticVersion;
+
+	// Do our matrices need an update? A dirty world matrix
+	// always means the whole subtree's are dirty too.
 	bool matrixDirty;
+	bool worldDirty;
+	unsigned int version;
+
+	// Whether every scale from here up to the root is uniform, as of the
+	// last world matrix update (normals then only need rotating)
+	bool uniformScale;
+
+	// Marks the local matrix dirty, and the world matrices below it
+	void MarkDirty();
+	void MarkWorldDirty();
+
+	// Rebuilds the local matrix if it's out of date
+	void UpdateLocalMatrix();
+
+	// Rebuilds the world matrices from an up to date parent world matrix
+	void UpdateWorldMatrix(const DirectX::XMFLOAT4X4* parentWorld);
 };
 
@@ -0,0 +1,132 @@
+#include "TransformHierarchy.h"
+#include "JobSystem.h"
+
+#include <unordered_set>
+
+TransformHierarchy::TransformHierarchy()
+	: builtVersion(0), orderDirty(true)
+{
+}
+
+void TransformHierarchy::Add(Transform* transform)
+{
+	transforms.push_back(transform);
+	orderDirty = true;
+}
+
+void TransformHierarchy::Remove(Transform* transform)
+{
+	for (size_t i = 0; i < transforms.size(); i++)
+	{
+		if (transforms[i] == transform)
+		{
+			transforms.erase(transforms.begin() + i);
+			orderDirty = true;
+			return;
+		}
+	}
+}
+
+void TransformHierarchy::BuildOrder()
+{
+	order.clear();
+	parentIndices.clear();
+	depthStarts.clear();
+
+	// Seeds with every added transform whose parent wasn't added, so a
+	// transform in another hierarchy (or none) is never walked into
+	std::unordered_set<Transform*> members(transforms.begin(), transforms.end());
+	std::unordered_set<Transform*> seeds;
+	for (size_t i = 0; i < transforms.size(); i++)
+	{
+		Transform* transform = transforms[i];
+		if (members.count(transform->GetParent()) == 0 && seeds.insert(transform).second)
+		{
+			order.push_back(transform);
+			parentIndices.push_back(-1);
+		}
+	}
+
+	// Then appends each depth's children, one depth after another
+	size_t depthStart = 0;
+	while (depthStart < order.size())
+	{
+		size_t depthEnd = order.size();
+		depthStarts.push_back(depthStart);
+		for (size_t i = depthStart; i < depthEnd; i++)
+		{
+			for (size_t c = 0; c < order[i]->children.size(); c++)
+			{
+				if (members.count(order[i]->children[c]) == 0)
+					continue;
+
+				order.push_back(order[i]->children[c]);
+				parentIndices.push_back((int)i);
+			}
+		}
+		depthStart = depthEnd;
+	}
+	depthStarts.push_back(order.size());
+
+	// Nothing is known about the new order yet, so all of it counts as changed
+	seenVersions.resize(order.size());
+	changedFlags.resize(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+		seenVersions[i] = order[i]->GetVersion() - 1;
+
+	builtVersion = Transform::GetHierarchyVersion();
+	orderDirty = false;
+}
+
+void TransformHierarchy::Update()
+{
+	if (orderDirty || builtVersion != Transform::GetHierarchyVersion())
+		BuildOrder();
+
+	// Parents outside the hierarchy are brought up to date first (on this
+	// thread, since that can walk up their own parents)
+	size_t seedCount = depthStarts.size() > 1 ? depthStarts[1] : 0;
+	for (size_t i = 0; i < seedCount; i++)
+	{
+		if (order[i]->worldDirty && order[i]->parent)
+			order[i]->parent->UpdateMatrices();
+	}
+
+	// A depth's parents are all in the depth before it, so their world matrices
+	// are already current. Versions are compared rather than dirty flags, so
+	// matrices something rebuilt on demand since the last update count too.
+	for (size_t depth = 0; depth + 1 < depthStarts.size(); depth++)
+	{
+		size_t depthStart = depthStarts[depth];
+		JobSystem::GetInstance().ParallelFor(depthStarts[depth + 1] - depthStart, TRANSFORM_HIERARCHY_JOB_SIZE,
+			[this, depthStart](size_t first, size_t last)
+		{
+			for (size_t i = depthStart + first; i < depthStart + last; i++)
+			{
+				Transform* transform = order[i];
+				if (transform->worldDirty)
+				{
+					int parentIndex = parentIndices[i];
+					transform->UpdateWorldMatrix(
+						parentIndex >= 0 ? &order[parentIndex]->worldMatrix :
+						transform->parent ? &transform->parent->worldMatrix : 0);
+				}
+
+				changedFlags[i] = transform->version != seenVersions[i];
+				seenVersions[i] = transform->version;
+			}
+		});
+	}
+
+	// Gathered afterwards, so the list is in the same order however the work was split
+	changed.clear();
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		if (changedFlags[i])
+			changed.push_back(order[i]);
+	}
+}
+
+int TransformHierarchy::GetCount() { return (int)order.size(); }
+
+const std::vector<Transform*>& TransformHierarchy::GetChanged() { return changed; }
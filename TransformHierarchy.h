@@ -0,0 +1,59 @@
+#pragma once
+#include "Transform.h"
+
+#include <vector>
+
+// Transforms per job when a level of the trees is updated in parallel
+#define TRANSFORM_HIERARCHY_JOB_SIZE 256
+
+// --------------------------------------------------------
+// Updates the world matrices of a set of transform trees
+// in one pass. The trees are flattened breadth first, so
+// every parent comes before its children and the pass is
+// a single walk over an array, rebuilding only the nodes
+// whose subtree was marked dirty. Each depth only depends
+// on the one above it, so the nodes of a depth are spread
+// over the JobSystem's threads.
+//
+// Only the transforms added are updated, so one tree can
+// be split between hierarchies (static and dynamic parts,
+// say) without any transform being updated twice. One
+// whose parent wasn't added starts a tree of its own, with
+// that parent brought up to date before the pass.
+//
+// The order is rebuilt lazily whenever any parent/child
+// link changes.
+// --------------------------------------------------------
+class TransformHierarchy
+{
+private:
+	std::vector<Transform*> transforms;	// Everything added, roots or not
+	std::vector<Transform*> order;		// Breadth first over the added trees
+	std::vector<int> parentIndices;		// Parent's position in the order, -1 if it wasn't added
+	std::vector<size_t> depthStarts;	// Where each depth begins in the order, plus the end
+	std::vector<unsigned int> seenVersions;	// Each one's version as of the last update
+	std::vector<unsigned char> changedFlags;	// Per position in the order, set by the jobs
+	std::vector<Transform*> changed;	// Whose world matrix changed in the last update
+	unsigned int builtVersion;
+	bool orderDirty;
+
+	void BuildOrder();
+
+public:
+	TransformHierarchy();
+
+	// Adds a transform to update (its children only if they're added too).
+	// Transforms must be removed before they're destroyed.
+	void Add(Transform* transform);
+	void Remove(Transform* transform);
+
+	// Brings every world matrix up to date
+	void Update();
+
+	// Number of transforms in the last update's order
+	int GetCount();
+
+	// Transforms the last update found with a new world matrix, however it
+	// was rebuilt (all of them, after a parent/child link changed)
+	const std::vector<Transform*>& GetChanged();
+};
@@ -12,5 +12,22 @@ struct Vertex
 	DirectX::XMFLOAT3 Position;	    // The local position of the vertex
 	DirectX::XMFLOAT3 Normal;        // The normal of the vertex
 	DirectX::XMFLOAT2 UV;        // The UV of the vertex
-	DirectX::XMFLOAT3 Tangent;        // The tangent of the vertex
-};
\ No newline at end of file
+	DirectX::XMFLOAT4 Tangent;        // The tangent of the vertex, w is +1 or -1 for the bitangent's direction
+};
+
+// Most bones that can move one skinned vertex
+#define SKINNED_VERTEX_INFLUENCES 4
+
+// --------------------------------------------------------
+// A vertex that follows a skeleton: the same data as a
+// Vertex, plus the bones that move it and how much
+// --------------------------------------------------------
+struct SkinnedVertex
+{
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 UV;
+	DirectX::XMFLOAT4 Tangent;
+	unsigned char BoneIndices[SKINNED_VERTEX_INFLUENCES];	// Into the skeleton
+	DirectX::XMFLOAT4 BoneWeights;	// Adding up to 1, unused influences weighted 0
+};
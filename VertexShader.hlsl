@@ -2,7 +2,7 @@
 cbuffer ExternalData : register(b0) 
 { 
 	matrix worldMatrix; 
-	matrix worldInvMatrix; 
+	float3x3 worldInvMatrix;	// Upper 3x3 of the inverse transpose, for normals
 	matrix viewMatrix;
 	matrix projectionMatrix;
 }
@@ -27,10 +27,10 @@ VertexToPixel main( VertexShaderInput input )
 	output.uv = input.uv;
 	
 	// Sets the tangents
-    output.tangent = mul((float3x3) worldInvMatrix, input.tangent);;
+    output.tangent = float4(mul(worldInvMatrix, input.tangent.xyz), input.tangent.w);
 
 	// Sets the normals
-	output.normal = mul((float3x3)worldInvMatrix, input.normal);
+	output.normal = mul(worldInvMatrix, input.normal);
 
 	// Sets the world position
 	output.worldPosition = mul(worldMatrix, float4(input.localPosition, 1)).xyz;